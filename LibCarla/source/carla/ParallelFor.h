@@ -0,0 +1,85 @@
+// Copyright (c) 2019 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#pragma once
+
+#include "carla/ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+
+namespace carla {
+
+  /// Number of threads to launch in a ThreadPool used with ParallelFor, one
+  /// for each hardware thread.
+  inline size_t GetParallelThreads() {
+    return std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  /// Calls @a functor for every index in [0, count), handing out the indices
+  /// in chunks of @a grain to the @a threads threads running in @a pool.
+  /// Blocks until all the indices are done, and rethrows the first exception
+  /// thrown by @a functor once every thread finished its chunk.
+  ///
+  /// @warning @a functor must not call ParallelFor on the same @a pool.
+  template <typename FunctorT>
+  void ParallelFor(
+      ThreadPool &pool,
+      const size_t threads,
+      const size_t count,
+      const size_t grain,
+      FunctorT &&functor) {
+    const size_t chunks = (count + grain - 1u) / grain;
+    const size_t workers = std::min(threads, chunks);
+    if (workers <= 1u) {
+      for (size_t i = 0u; i < count; ++i) {
+        functor(i);
+      }
+      return;
+    }
+    std::atomic<size_t> next_chunk{0u};
+    std::vector<std::future<void>> futures;
+    futures.reserve(workers);
+    for (size_t i = 0u; i < workers; ++i) {
+      futures.emplace_back(pool.Post([&]() {
+        for (size_t chunk = next_chunk++; chunk < chunks; chunk = next_chunk++) {
+          const size_t end = std::min(count, (chunk + 1u) * grain);
+          for (size_t item = chunk * grain; item < end; ++item) {
+            functor(item);
+          }
+        }
+      }));
+    }
+    // Wait for all the workers before rethrowing, they reference this frame.
+    for (auto &future : futures) {
+      future.wait();
+    }
+    for (auto &future : futures) {
+      future.get();
+    }
+  }
+
+  /// Calls @a functor for each element of @a items as ParallelFor does, and
+  /// returns the results in the same order as @a items so the output does not
+  /// depend on the scheduling.
+  template <typename T, typename FunctorT>
+  auto ParallelTransform(
+      ThreadPool &pool,
+      const size_t threads,
+      const std::vector<T> &items,
+      FunctorT &&functor)
+      -> std::vector<decltype(functor(items.front()))> {
+    std::vector<decltype(functor(items.front()))> results(items.size());
+    ParallelFor(pool, threads, items.size(), 1u, [&](const size_t i) {
+      results[i] = functor(items[i]);
+    });
+    return results;
+  }
+
+} // namespace carla
@@ -26,6 +26,9 @@ namespace client {
 
     static const std::string& GetFilesBaseFolder();
 
+    /// Path of @a file in the cache folder of this version.
+    static std::string GetFilePath(std::string file);
+
     static bool FileExists(std::string file);
 
     static bool WriteFile(std::string path, std::vector<uint8_t> content);
@@ -5,6 +5,7 @@
 // For a copy, see <https://opensource.org/licenses/MIT>.
 
 #include "carla/client/Junction.h"
+#include "carla/Debug.h"
 #include "carla/client/Map.h"
 #include "carla/road/element/Waypoint.h"
 
@@ -25,5 +26,9 @@ namespace client {
     return _bounding_box;
   }
 
+  const std::vector<road::Junction::LaneConflict> &Junction::GetLaneConflicts() const {
+    return _parent->GetMap().GetJunctionLaneConflicts(_id);
+  }
+
 } // namespace client
 } // namespace carla
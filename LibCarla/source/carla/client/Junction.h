@@ -35,6 +35,10 @@ namespace client {
 
     geom::BoundingBox GetBoundingBox() const;
 
+    /// Returns the zones where lanes of different connecting roads of the
+    /// junction overlap, computed the first time they are requested.
+    const std::vector<road::Junction::LaneConflict> &GetLaneConflicts() const;
+
   private:
 
     friend class Map;
@@ -6,30 +6,33 @@
 
 #include "carla/client/Map.h"
 
+#include "carla/ParallelFor.h"
 #include "carla/client/Junction.h"
 #include "carla/client/Waypoint.h"
 #include "carla/opendrive/OpenDriveParser.h"
+#include "carla/opendrive/TiledMap.h"
 #include "carla/road/Map.h"
 #include "carla/road/RoadTypes.h"
 #include "carla/trafficmanager/InMemoryMap.h"
 
+#include <algorithm>
 #include <sstream>
+#include <stdexcept>
 
 namespace carla {
 namespace client {
 
-  static auto MakeMap(const std::string &opendrive_contents) {
+  static SharedPtr<const road::Map> MakeMap(const std::string &opendrive_contents) {
     auto stream = std::istringstream(opendrive_contents);
     auto map = opendrive::OpenDriveParser::Load(stream.str());
     if (!map.has_value()) {
       throw_exception(std::runtime_error("failed to generate map"));
     }
-    return std::move(*map);
+    return MakeShared<road::Map>(std::move(*map));
   }
 
   Map::Map(rpc::MapInfo description, std::string xodr_content)
-    : _description(std::move(description)),
-      _map(MakeMap(xodr_content)){
+    : _description(std::move(description)) {
     open_drive_file = xodr_content;
   }
   Map::Map(std::string name, std::string xodr_content)
@@ -39,17 +42,41 @@ namespace client {
     open_drive_file = xodr_content;
   }
 
+  Map::Map(
+      rpc::MapInfo description,
+      std::string xodr_content,
+      SharedPtr<const road::Map> map,
+      std::shared_ptr<opendrive::TiledMap> tiled_map)
+    : open_drive_file(std::move(xodr_content)),
+      _description(std::move(description)),
+      _map(std::move(map)),
+      _tiled_map(std::move(tiled_map)) {
+    DEBUG_ASSERT(_map != nullptr);
+    DEBUG_ASSERT(_tiled_map != nullptr);
+  }
+
   Map::~Map() = default;
 
+  const road::Map &Map::GetMap() const {
+    // Regions are given their map at construction. If parsing throws, the
+    // next call tries again.
+    std::call_once(_map_built, [this]() {
+      if (_map == nullptr) {
+        _map = MakeMap(open_drive_file);
+      }
+    });
+    return *_map;
+  }
+
   SharedPtr<Waypoint> Map::GetWaypoint(
   const geom::Location &location,
   bool project_to_road,
   int32_t lane_type) const {
     boost::optional<road::element::Waypoint> waypoint;
     if (project_to_road) {
-      waypoint = _map.GetClosestWaypointOnRoad(location, lane_type);
+      waypoint = GetMap().GetClosestWaypointOnRoad(location, lane_type);
     } else {
-      waypoint = _map.GetWaypoint(location, lane_type);
+      waypoint = GetMap().GetWaypoint(location, lane_type);
     }
     return waypoint.has_value() ?
     SharedPtr<Waypoint>(new Waypoint{shared_from_this(), *waypoint}) :
@@ -61,7 +88,7 @@ namespace client {
       carla::road::LaneId lane_id,
       float s) const {
     boost::optional<road::element::Waypoint> waypoint;
-    waypoint = _map.GetWaypoint(road_id, lane_id, s);
+    waypoint = GetMap().GetWaypoint(road_id, lane_id, s);
     return waypoint.has_value() ?
         SharedPtr<Waypoint>(new Waypoint{shared_from_this(), *waypoint}) :
         nullptr;
@@ -82,7 +109,7 @@ namespace client {
     };
 
     TopologyList result;
-    auto topology = _map.GenerateTopology();
+    auto topology = GetMap().GenerateTopology();
     result.reserve(topology.size());
     for (const auto &pair : topology) {
       result.emplace_back(
@@ -94,7 +121,7 @@ namespace client {
 
   std::vector<SharedPtr<Waypoint>> Map::GenerateWaypoints(double distance) const {
     std::vector<SharedPtr<Waypoint>> result;
-    const auto waypoints = _map.GenerateWaypoints(distance);
+    const auto waypoints = GetMap().GenerateWaypoints(distance);
     result.reserve(waypoints.size());
     for (const auto &waypoint : waypoints) {
       result.emplace_back(SharedPtr<Waypoint>(new Waypoint{shared_from_this(), waypoint}));
@@ -105,15 +132,15 @@ namespace client {
   std::vector<road::element::LaneMarking> Map::CalculateCrossedLanes(
   const geom::Location &origin,
   const geom::Location &destination) const {
-    return _map.CalculateCrossedLanes(origin, destination);
+    return GetMap().CalculateCrossedLanes(origin, destination);
   }
 
   const geom::GeoLocation &Map::GetGeoReference() const {
-    return _map.GetGeoReference();
+    return GetMap().GetGeoReference();
   }
 
   std::vector<geom::Location> Map::GetAllCrosswalkZones() const {
-    return _map.GetAllCrosswalkZones();
+    return GetMap().GetAllCrosswalkZones();
   }
 
   SharedPtr<Junction> Map::GetJunction(const Waypoint &waypoint) const {
@@ -137,7 +164,7 @@ namespace client {
 
   std::vector<SharedPtr<Landmark>> Map::GetAllLandmarks() const {
     std::vector<SharedPtr<Landmark>> result;
-    auto signal_references = _map.GetAllSignalReferences();
+    auto signal_references = GetMap().GetAllSignalReferences();
     for(auto* signal_reference : signal_references) {
       result.emplace_back(
           new Landmark(nullptr, shared_from_this(), signal_reference, 0));
@@ -147,7 +174,7 @@ namespace client {
 
   std::vector<SharedPtr<Landmark>> Map::GetLandmarksFromId(std::string id) const {
     std::vector<SharedPtr<Landmark>> result;
-    auto signal_references = _map.GetAllSignalReferences();
+    auto signal_references = GetMap().GetAllSignalReferences();
     for(auto* signal_reference : signal_references) {
       if(signal_reference->GetSignalId() == id) {
         result.emplace_back(
@@ -159,7 +186,7 @@ namespace client {
 
   std::vector<SharedPtr<Landmark>> Map::GetAllLandmarksOfType(std::string type) const {
     std::vector<SharedPtr<Landmark>> result;
-    auto signal_references = _map.GetAllSignalReferences();
+    auto signal_references = GetMap().GetAllSignalReferences();
     for(auto* signal_reference : signal_references) {
       if(signal_reference->GetSignal()->GetType() == type) {
         result.emplace_back(
@@ -174,9 +201,9 @@ namespace client {
     std::vector<SharedPtr<Landmark>> result;
     auto &controllers = landmark._signal->GetSignal()->GetControllers();
     for (auto& controller_id : controllers) {
-      const auto &controller = _map.GetControllers().at(controller_id);
+      const auto &controller = GetMap().GetControllers().at(controller_id);
       for(auto& signal_id : controller->GetSignals()) {
-        auto& signal = _map.GetSignals().at(signal_id);
+        auto& signal = GetMap().GetSignals().at(signal_id);
         auto new_landmarks = GetLandmarksFromId(signal->GetSignalId());
         result.insert(result.end(), new_landmarks.begin(), new_landmarks.end());
       }
@@ -188,5 +215,119 @@ namespace client {
     traffic_manager::InMemoryMap::Cook(shared_from_this(), path);
   }
 
+  void Map::PrepareRoutePlanner(
+      const double lane_change_cost,
+      const bool contraction_hierarchy) const {
+    auto planner = std::make_shared<road::RoutePlanner>(GetMap(), lane_change_cost);
+    if (contraction_hierarchy) {
+      planner->BuildContractionHierarchy();
+    }
+    std::lock_guard<std::mutex> lock(_route_planner_mutex);
+    _route_planner = std::move(planner);
+  }
+
+  std::shared_ptr<const road::RoutePlanner> Map::GetRoutePlanner() const {
+    std::lock_guard<std::mutex> lock(_route_planner_mutex);
+    if (_route_planner == nullptr) {
+      _route_planner = std::make_shared<road::RoutePlanner>(GetMap());
+    }
+    return _route_planner;
+  }
+
+  std::vector<std::vector<SharedPtr<Waypoint>>> Map::ComputeRoutes(
+      const std::vector<std::pair<geom::Location, geom::Location>> &queries,
+      const double resolution,
+      const road::RoutePlanner::Algorithm algorithm) const {
+    std::vector<std::vector<SharedPtr<Waypoint>>> result(queries.size());
+    std::vector<std::pair<road::element::Waypoint, road::element::Waypoint>> waypoints;
+    std::vector<size_t> indices;
+    waypoints.reserve(queries.size());
+    indices.reserve(queries.size());
+    for (size_t i = 0u; i < queries.size(); ++i) {
+      const auto origin_waypoint = GetMap().GetClosestWaypointOnRoad(queries[i].first);
+      const auto destination_waypoint = GetMap().GetClosestWaypointOnRoad(queries[i].second);
+      if (origin_waypoint.has_value() && destination_waypoint.has_value()) {
+        waypoints.emplace_back(*origin_waypoint, *destination_waypoint);
+        indices.emplace_back(i);
+      }
+    }
+    const auto planner = GetRoutePlanner();
+    std::vector<std::vector<road::element::Waypoint>> routes;
+    {
+      // The threads are shared by the calls, which take turns.
+      std::lock_guard<std::mutex> lock(_route_threads_mutex);
+      if (_route_threads == nullptr) {
+        _route_thread_count = GetParallelThreads();
+        _route_threads = std::make_unique<ThreadPool>();
+        _route_threads->AsyncRun(_route_thread_count);
+      }
+      routes = planner->TraceRoutes(
+          waypoints, resolution, algorithm, *_route_threads, _route_thread_count);
+    }
+    for (size_t i = 0u; i < routes.size(); ++i) {
+      auto &route = result[indices[i]];
+      route.reserve(routes[i].size());
+      for (const auto &waypoint : routes[i]) {
+        route.emplace_back(SharedPtr<Waypoint>(new Waypoint{shared_from_this(), waypoint}));
+      }
+    }
+    return result;
+  }
+
+  SharedPtr<Map> Map::GetRegion(
+      const geom::Location &location,
+      const double radius,
+      const double tile_size,
+      const size_t max_loaded_tiles) const {
+    if (tile_size <= 0.0) {
+      throw_exception(std::invalid_argument("the tile size must be positive"));
+    }
+    std::shared_ptr<opendrive::TiledMap> tiled_map;
+    {
+      std::lock_guard<std::mutex> lock(_tiled_map_mutex);
+      if (_tiled_map == nullptr ||
+          _tiled_map->GetTileSize() != tile_size ||
+          _tiled_map->GetMaxLoadedTiles() != std::max<size_t>(1u, max_loaded_tiles)) {
+        _tiled_map = opendrive::TiledMap::Load(open_drive_file, tile_size, max_loaded_tiles);
+        if (_tiled_map == nullptr) {
+          throw_exception(std::runtime_error("failed to split the map in tiles"));
+        }
+      }
+      tiled_map = _tiled_map;
+    }
+    auto region = tiled_map->GetRegion(location, radius);
+    if (region.map == nullptr) {
+      return nullptr;
+    }
+    return SharedPtr<Map>(new Map(
+        _description,
+        std::move(region.opendrive),
+        std::move(region.map),
+        std::move(tiled_map)));
+  }
+
+  std::vector<SharedPtr<Waypoint>> Map::ComputeRoute(
+      const geom::Location &origin,
+      const geom::Location &destination,
+      const double resolution,
+      const road::RoutePlanner::Algorithm algorithm) const {
+    std::vector<SharedPtr<Waypoint>> result;
+    const auto origin_waypoint = GetMap().GetClosestWaypointOnRoad(origin);
+    const auto destination_waypoint = GetMap().GetClosestWaypointOnRoad(destination);
+    if (!origin_waypoint.has_value() || !destination_waypoint.has_value()) {
+      return result;
+    }
+    const auto route = GetRoutePlanner()->TraceRoute(
+        *origin_waypoint,
+        *destination_waypoint,
+        resolution,
+        algorithm);
+    result.reserve(route.size());
+    for (const auto &waypoint : route) {
+      result.emplace_back(SharedPtr<Waypoint>(new Waypoint{shared_from_this(), waypoint}));
+    }
+    return result;
+  }
+
 } // namespace client
 } // namespace carla
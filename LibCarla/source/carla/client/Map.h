@@ -12,13 +12,18 @@
 #include "carla/road/Lane.h"
 #include "carla/road/Map.h"
 #include "carla/road/RoadTypes.h"
+#include "carla/road/RoutePlanner.h"
 #include "carla/rpc/MapInfo.h"
 #include "Landmark.h"
 
+#include <memory>
+#include <mutex>
 #include <string>
 
 namespace carla {
+class ThreadPool;
 namespace geom { class GeoLocation; }
+namespace opendrive { class TiledMap; }
 namespace client {
 
   class Waypoint;
@@ -39,9 +44,9 @@ namespace client {
       return _description.name;
     }
 
-    const road::Map &GetMap() const {
-      return _map;
-    }
+    /// The whole road map. The OpenDRIVE is parsed on the first call, so
+    /// clients only querying regions never build it.
+    const road::Map &GetMap() const;
 
     const std::string &GetOpenDrive() const {
       return open_drive_file;
@@ -97,13 +102,77 @@ namespace client {
     /// Cooks InMemoryMap used by the traffic manager
     void CookInMemoryMap(const std::string& path) const;
 
+    /// Build the lane graph used by ComputeRoute, optionally preprocessed
+    /// into a contraction hierarchy. Otherwise it is built with default
+    /// settings on the first route requested.
+    void PrepareRoutePlanner(double lane_change_cost, bool contraction_hierarchy) const;
+
+    /// Returns the waypoints, every @a resolution meters, of the shortest
+    /// route driving from @a origin to @a destination. Empty if there is none.
+    std::vector<SharedPtr<Waypoint>> ComputeRoute(
+        const geom::Location &origin,
+        const geom::Location &destination,
+        double resolution,
+        road::RoutePlanner::Algorithm algorithm = road::RoutePlanner::Algorithm::AStar) const;
+
+    /// Returns the route of each pair of origin and destination in
+    /// @a queries, as ComputeRoute. The routes are found in parallel.
+    std::vector<std::vector<SharedPtr<Waypoint>>> ComputeRoutes(
+        const std::vector<std::pair<geom::Location, geom::Location>> &queries,
+        double resolution,
+        road::RoutePlanner::Algorithm algorithm = road::RoutePlanner::Algorithm::AStar) const;
+
+    /// Returns a map with only the roads within @a radius meters of
+    /// @a location, and the whole junctions they belong to, or nullptr if
+    /// there are no roads there. The OpenDRIVE is split in tiles of
+    /// @a tile_size meters the first time this is called, and again if the
+    /// tile parameters change. The map of each tile is built once and up to
+    /// @a max_loaded_tiles of them are kept, so regions of nearby locations
+    /// reuse them. Road, section and lane ids are the ones of this map. The
+    /// region has the OpenDRIVE of its roads and shares the tiles of this map,
+    /// so regions of a region can be requested as well.
+    SharedPtr<Map> GetRegion(
+        const geom::Location &location,
+        double radius,
+        double tile_size = 500.0,
+        size_t max_loaded_tiles = 36u) const;
+
   private:
 
+    Map(
+        rpc::MapInfo description,
+        std::string xodr_content,
+        SharedPtr<const road::Map> map,
+        std::shared_ptr<opendrive::TiledMap> tiled_map);
+
+    std::shared_ptr<const road::RoutePlanner> GetRoutePlanner() const;
+
     std::string open_drive_file;
 
     const rpc::MapInfo _description;
 
-    const road::Map _map;
+    mutable std::once_flag _map_built;
+
+    /// Built from @a open_drive_file on the first call to GetMap, unless this
+    /// is a region.
+    mutable SharedPtr<const road::Map> _map;
+
+    mutable std::mutex _route_planner_mutex;
+
+    mutable std::shared_ptr<const road::RoutePlanner> _route_planner;
+
+    mutable std::mutex _route_threads_mutex;
+
+    /// Threads finding the routes of ComputeRoutes, started on its first call.
+    mutable std::unique_ptr<ThreadPool> _route_threads;
+
+    mutable size_t _route_thread_count = 1u;
+
+    mutable std::mutex _tiled_map_mutex;
+
+    /// Tiles of the OpenDRIVE, split on the first call to GetRegion and shared
+    /// with the regions.
+    mutable std::shared_ptr<opendrive::TiledMap> _tiled_map;
   };
 
 } // namespace client
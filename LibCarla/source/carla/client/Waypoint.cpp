@@ -159,60 +159,8 @@ namespace client {
     return boost::optional<road::element::LaneMarking>{};
   }
 
-  template <typename EnumT>
-  static EnumT operator&(EnumT lhs, EnumT rhs) {
-    return static_cast<EnumT>(
-        static_cast<typename std::underlying_type<EnumT>::type>(lhs) &
-        static_cast<typename std::underlying_type<EnumT>::type>(rhs));
-  }
-
-  template <typename EnumT>
-  static EnumT operator|(EnumT lhs, EnumT rhs) {
-    return static_cast<EnumT>(
-        static_cast<typename std::underlying_type<EnumT>::type>(lhs) |
-        static_cast<typename std::underlying_type<EnumT>::type>(rhs));
-  }
-
   road::element::LaneMarking::LaneChange Waypoint::GetLaneChange() const {
-    using lane_change_type = road::element::LaneMarking::LaneChange;
-
-    const auto lane_change_right_info = _mark_record.first;
-    lane_change_type c_right;
-    if (lane_change_right_info != nullptr) {
-      const auto lane_change_right = lane_change_right_info->GetLaneChange();
-      c_right = static_cast<lane_change_type>(lane_change_right);
-    } else {
-      c_right = lane_change_type::Both;
-    }
-
-    const auto lane_change_left_info = _mark_record.second;
-    lane_change_type c_left;
-    if (lane_change_left_info != nullptr) {
-      const auto lane_change_left = lane_change_left_info->GetLaneChange();
-      c_left = static_cast<lane_change_type>(lane_change_left);
-    } else {
-      c_left = lane_change_type::Both;
-    }
-
-    if (_waypoint.lane_id > 0) {
-      // if road goes backward
-      if (c_right == lane_change_type::Right) {
-        c_right = lane_change_type::Left;
-      } else if (c_right == lane_change_type::Left) {
-        c_right = lane_change_type::Right;
-      }
-    }
-
-    if (((_waypoint.lane_id > 0) ? _waypoint.lane_id - 1 : _waypoint.lane_id + 1) > 0) {
-      // if road goes backward
-      if (c_left == lane_change_type::Right) {
-        c_left = lane_change_type::Left;
-      } else if (c_left == lane_change_type::Left) {
-        c_left = lane_change_type::Right;
-      }
-    }
-
-    return (c_right & lane_change_type::Right) | (c_left & lane_change_type::Left);
+    return road::Map::GetLaneChange(_waypoint, _mark_record);
   }
 
   std::vector<SharedPtr<Landmark>> Waypoint::GetAllLandmarksInDistance(
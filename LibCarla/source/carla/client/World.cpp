@@ -164,6 +164,14 @@ namespace client {
     _episode.Lock()->SetPedestriansSeed(seed);
   }
 
+  void World::SetPedestriansPartitions(unsigned int partitions) {
+    _episode.Lock()->SetPedestriansPartitions(partitions);
+  }
+
+  void World::SetPedestriansVehicleRadius(float radius) {
+    _episode.Lock()->SetPedestriansVehicleRadius(radius);
+  }
+
   SharedPtr<Actor> World::GetTrafficSign(const Landmark& landmark) const {
     SharedPtr<ActorList> actors = GetActors();
     SharedPtr<TrafficSign> result;
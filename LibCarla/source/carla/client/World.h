@@ -148,6 +148,14 @@ namespace client {
     /// set the seed to use with random numbers in the pedestrians module
     void SetPedestriansSeed(unsigned int seed);
 
+    /// split the pedestrians in up to this number of regions of the map, each
+    /// one simulated in parallel; should be set before spawning pedestrians
+    void SetPedestriansPartitions(unsigned int partitions);
+
+    /// set the radius around the pedestrians where the vehicles are added to
+    /// their crowd to be avoided
+    void SetPedestriansVehicleRadius(float radius);
+
     SharedPtr<Actor> GetTrafficSign(const Landmark& landmark) const;
 
     SharedPtr<Actor> GetTrafficLight(const Landmark& landmark) const;
@@ -326,6 +326,20 @@ namespace detail {
     navigation->SetPedestriansSeed(seed);
   }
 
+  void Simulator::SetPedestriansPartitions(unsigned int partitions) {
+    DEBUG_ASSERT(_episode != nullptr);
+    auto navigation = _episode->CreateNavigationIfMissing();
+    DEBUG_ASSERT(navigation != nullptr);
+    navigation->SetPedestriansPartitions(partitions);
+  }
+
+  void Simulator::SetPedestriansVehicleRadius(float radius) {
+    DEBUG_ASSERT(_episode != nullptr);
+    auto navigation = _episode->CreateNavigationIfMissing();
+    DEBUG_ASSERT(navigation != nullptr);
+    navigation->SetPedestriansVehicleRadius(radius);
+  }
+
   // ===========================================================================
   // -- General operations with actors -----------------------------------------
   // ===========================================================================
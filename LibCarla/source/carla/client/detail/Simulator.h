@@ -298,6 +298,10 @@ namespace detail {
 
     void SetPedestriansSeed(unsigned int seed);
 
+    void SetPedestriansPartitions(unsigned int partitions);
+
+    void SetPedestriansVehicleRadius(float radius);
+
     /// @}
     // =========================================================================
     /// @name General operations with actors
@@ -14,12 +14,22 @@
 #include "carla/rpc/DebugShape.h"
 #include "carla/rpc/WalkerControl.h"
 
+#include <cmath>
 #include <sstream>
+#include <unordered_set>
 
 namespace carla {
 namespace client {
 namespace detail {
 
+  // the state of a walker is sent again to the simulator only when it drifted
+  // from the one the simulator keeps moving with since the last time
+  static const float WALKER_STATE_LOCATION_THRESHOLD = 0.1f;
+  static const float WALKER_STATE_YAW_THRESHOLD = 2.0f;
+  static const float WALKER_STATE_SPEED_THRESHOLD = 0.05f;
+  // and at least once in this time, to fix any drift of the simulator
+  static const double WALKER_STATE_REFRESH_TIME = 1.0;
+
   WalkerNavigation::WalkerNavigation(Client &client) : _client(client), _next_check_index(0) {
     // Here call the server to retrieve the navmesh data.
     auto files = _client.GetRequiredFiles("Nav");
@@ -46,22 +56,76 @@ namespace detail {
     // update crowd in navigation module
     _nav.UpdateCrowd(*state);
 
+    // forget the walkers no longer registered
+    if (_sent_states.size() > walkers->size()) {
+      std::unordered_set<ActorId> registered;
+      for (const auto &handle : *walkers) {
+        registered.insert(handle.walker);
+      }
+      for (auto it = _sent_states.begin(); it != _sent_states.end();) {
+        if (registered.find(it->first) == registered.end()) {
+          it = _sent_states.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+
+    // send only the walkers that changed, in a single command
+    const double delta_seconds = state->GetTimestamp().delta_seconds;
     carla::geom::Transform trans;
     using Cmd = rpc::Command;
-    std::vector<Cmd> commands;
-    commands.reserve(walkers->size());
-    for (auto handle : *walkers) {
+    Cmd::ApplyWalkerStates changed;
+    for (const auto &handle : *walkers) {
       // get the transform of the walker
       if (_nav.GetWalkerTransform(handle.walker, trans)) {
         float speed = _nav.GetWalkerSpeed(handle.walker);
-        commands.emplace_back(Cmd::ApplyWalkerState{ handle.walker, trans, speed });
+        if (UpdateSentState(handle.walker, trans, speed, delta_seconds)) {
+          changed.actors.push_back(handle.walker);
+          changed.transforms.push_back(trans);
+          changed.speeds.push_back(speed);
+        }
       }
     }
 
-    _client.ApplyBatchSync(std::move(commands), false);
+    if (!changed.actors.empty()) {
+      std::vector<Cmd> commands;
+      commands.emplace_back(std::move(changed));
+      _client.ApplyBatchSync(std::move(commands), false);
+    }
+  }
+
+  bool WalkerNavigation::UpdateSentState(
+      ActorId walker_id,
+      const geom::Transform &transform,
+      float speed,
+      double delta_seconds) {
+    auto it = _sent_states.find(walker_id);
+    if (it == _sent_states.end()) {
+      _sent_states.emplace(walker_id, WalkerState{ transform, speed, 0.0 });
+      return true;
+    }
+    WalkerState &sent = it->second;
+    sent.elapsed += delta_seconds;
+
+    // the simulator keeps the walker moving forward at the speed sent
+    const geom::Vector3D forward = sent.transform.GetForwardVector();
+    const float distance = sent.speed * static_cast<float>(sent.elapsed);
+    const float dx = sent.transform.location.x + forward.x * distance - transform.location.x;
+    const float dy = sent.transform.location.y + forward.y * distance - transform.location.y;
+    const float yaw = std::fabs(std::remainder(transform.rotation.yaw - sent.transform.rotation.yaw, 360.0f));
+
+    if (dx * dx + dy * dy < WALKER_STATE_LOCATION_THRESHOLD * WALKER_STATE_LOCATION_THRESHOLD &&
+        yaw < WALKER_STATE_YAW_THRESHOLD &&
+        std::fabs(speed - sent.speed) < WALKER_STATE_SPEED_THRESHOLD &&
+        sent.elapsed < WALKER_STATE_REFRESH_TIME) {
+      return false;
+    }
+    sent = WalkerState{ transform, speed, 0.0 };
+    return true;
   }
 
-  void WalkerNavigation::CheckIfWalkerExist(std::vector<WalkerHandle> walkers, const EpisodeState &state) {
+  void WalkerNavigation::CheckIfWalkerExist(const std::vector<WalkerHandle> &walkers, const EpisodeState &state) {
 
     // check with total
     if (_next_check_index >= walkers.size())
@@ -88,14 +152,36 @@ namespace detail {
     // get current state
     std::shared_ptr<const EpisodeState> state = episode->GetState();
 
-    // get all vehicles from episode
-    for (auto &&actor : episode->GetActors()) {
+    // forget the actors no longer in the episode
+    if (_actor_bounds.size() > state->size()) {
+      for (auto it = _actor_bounds.begin(); it != _actor_bounds.end();) {
+        if (!state->ContainsActorSnapshot(it->first)) {
+          it = _actor_bounds.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+
+    // get the vehicles near some walker, the description of each actor is
+    // only requested the first time it gets near
+    for (const auto &snapshot : *state) {
+      if (!_nav.IsNearWalkers(snapshot.transform.location)) {
+        continue;
+      }
+      auto it = _actor_bounds.find(snapshot.id);
+      if (it == _actor_bounds.end()) {
+        ActorBounds bounds { false, geom::BoundingBox() };
+        auto actor = episode->GetActorById(snapshot.id);
+        if (actor.has_value() && actor->description.id.rfind("vehicle.", 0) == 0) {
+          bounds = ActorBounds { true, actor->bounding_box };
+        }
+        it = _actor_bounds.emplace(snapshot.id, bounds).first;
+      }
       // only vehicles
-      if (actor.description.id.rfind("vehicle.", 0) == 0) {
-        // get the snapshot
-        ActorSnapshot snapshot = state->GetActorSnapshot(actor.id);
+      if (it->second.is_vehicle) {
         // add to the vector
-        vehicles.emplace_back(carla::nav::VehicleCollisionInfo{actor.id, snapshot.transform, actor.bounding_box});
+        vehicles.emplace_back(carla::nav::VehicleCollisionInfo{snapshot.id, snapshot.transform, it->second.bounding});
       }
     }
 
@@ -107,62 +193,66 @@ namespace detail {
       if (_nav.GetCrowd() == nullptr) return;
 
       // draw bounding boxes for debug
-      for (int i = 0; i < _nav.GetCrowd()->getAgentCount(); ++i) {
-        // get the agent
-        const dtCrowdAgent *agent = _nav.GetCrowd()->getAgent(i);
-        if (agent && agent->params.useObb) {
-          // draw for debug
-          carla::geom::Location p1, p2, p3, p4;
-          p1.x = agent->params.obb[0];
-          p1.z = agent->params.obb[1];
-          p1.y = agent->params.obb[2];
-          p2.x = agent->params.obb[3];
-          p2.z = agent->params.obb[4];
-          p2.y = agent->params.obb[5];
-          p3.x = agent->params.obb[6];
-          p3.z = agent->params.obb[7];
-          p3.y = agent->params.obb[8];
-          p4.x = agent->params.obb[9];
-          p4.z = agent->params.obb[10];
-          p4.y = agent->params.obb[11];
-          carla::rpc::DebugShape line1;
-          line1.life_time = 0.01f;
-          line1.persistent_lines = false;
-          // line 1
-          line1.primitive = carla::rpc::DebugShape::Line {p1, p2, 0.2f};
-          line1.color = { 0, 255, 0 };
-          _client.DrawDebugShape(line1);
-          // line 2
-          line1.primitive = carla::rpc::DebugShape::Line {p2, p3, 0.2f};
-          line1.color = { 255, 0, 0 };
-          _client.DrawDebugShape(line1);
-          // line 3
-          line1.primitive = carla::rpc::DebugShape::Line {p3, p4, 0.2f};
-          line1.color = { 0, 0, 255 };
-          _client.DrawDebugShape(line1);
-          // line 4
-          line1.primitive = carla::rpc::DebugShape::Line {p4, p1, 0.2f};
-          line1.color = { 255, 255, 0 };
-          _client.DrawDebugShape(line1);
+      for (dtCrowd *crowd : _nav.GetCrowds()) {
+        for (int i = 0; i < crowd->getAgentCount(); ++i) {
+          // get the agent
+          const dtCrowdAgent *agent = crowd->getAgent(i);
+          if (agent && agent->params.useObb) {
+            // draw for debug
+            carla::geom::Location p1, p2, p3, p4;
+            p1.x = agent->params.obb[0];
+            p1.z = agent->params.obb[1];
+            p1.y = agent->params.obb[2];
+            p2.x = agent->params.obb[3];
+            p2.z = agent->params.obb[4];
+            p2.y = agent->params.obb[5];
+            p3.x = agent->params.obb[6];
+            p3.z = agent->params.obb[7];
+            p3.y = agent->params.obb[8];
+            p4.x = agent->params.obb[9];
+            p4.z = agent->params.obb[10];
+            p4.y = agent->params.obb[11];
+            carla::rpc::DebugShape line1;
+            line1.life_time = 0.01f;
+            line1.persistent_lines = false;
+            // line 1
+            line1.primitive = carla::rpc::DebugShape::Line {p1, p2, 0.2f};
+            line1.color = { 0, 255, 0 };
+            _client.DrawDebugShape(line1);
+            // line 2
+            line1.primitive = carla::rpc::DebugShape::Line {p2, p3, 0.2f};
+            line1.color = { 255, 0, 0 };
+            _client.DrawDebugShape(line1);
+            // line 3
+            line1.primitive = carla::rpc::DebugShape::Line {p3, p4, 0.2f};
+            line1.color = { 0, 0, 255 };
+            _client.DrawDebugShape(line1);
+            // line 4
+            line1.primitive = carla::rpc::DebugShape::Line {p4, p1, 0.2f};
+            line1.color = { 255, 255, 0 };
+            _client.DrawDebugShape(line1);
+          }
         }
       }
 
       // draw some text for debug
-      for (int i = 0; i < _nav.GetCrowd()->getAgentCount(); ++i) {
-        // get the agent
-        const dtCrowdAgent *agent = _nav.GetCrowd()->getAgent(i);
-        if (agent) {
-          // draw for debug
-          carla::geom::Location p1(agent->npos[0], agent->npos[2], agent->npos[1] + 1);
-          if (agent->params.userData) {
-            std::ostringstream out;
-            out << *(reinterpret_cast<const float *>(agent->params.userData));
-            carla::rpc::DebugShape text;
-            text.life_time = 0.01f;
-            text.persistent_lines = false;
-            text.primitive = carla::rpc::DebugShape::String {p1, out.str(), false};
-            text.color = { 0, 255, 0 };
-            _client.DrawDebugShape(text);
+      for (dtCrowd *crowd : _nav.GetCrowds()) {
+        for (int i = 0; i < crowd->getAgentCount(); ++i) {
+          // get the agent
+          const dtCrowdAgent *agent = crowd->getAgent(i);
+          if (agent) {
+            // draw for debug
+            carla::geom::Location p1(agent->npos[0], agent->npos[2], agent->npos[1] + 1);
+            if (agent->params.userData) {
+              std::ostringstream out;
+              out << *(reinterpret_cast<const float *>(agent->params.userData));
+              carla::rpc::DebugShape text;
+              text.life_time = 0.01f;
+              text.persistent_lines = false;
+              text.primitive = carla::rpc::DebugShape::String {p1, out.str(), false};
+              text.color = { 0, 255, 0 };
+              _client.DrawDebugShape(text);
+            }
           }
         }
       }
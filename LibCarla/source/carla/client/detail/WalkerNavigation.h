@@ -14,6 +14,7 @@
 #include "carla/rpc/ActorId.h"
 
 #include <memory>
+#include <unordered_map>
 
 namespace carla {
 namespace client {
@@ -89,6 +90,16 @@ namespace detail {
       _nav.SetSeed(seed);
     }
 
+    // split the crowd in regions updated in parallel
+    void SetPedestriansPartitions(unsigned int partitions) {
+      _nav.SetCrowdPartitions(partitions);
+    }
+
+    // set the radius around the pedestrians where they avoid the vehicles
+    void SetPedestriansVehicleRadius(float radius) {
+      _nav.SetVehicleRadius(radius);
+    }
+
   private:
 
     Client &_client;
@@ -104,8 +115,28 @@ namespace detail {
 
     AtomicList<WalkerHandle> _walkers;
 
+    /// last state sent to the simulator for each walker
+    struct WalkerState {
+      geom::Transform transform;
+      float speed;
+      double elapsed;
+    };
+
+    std::unordered_map<ActorId, WalkerState> _sent_states;
+
+    /// bounding box of the actors found near the walkers, only for vehicles
+    struct ActorBounds {
+      bool is_vehicle;
+      geom::BoundingBox bounding;
+    };
+
+    std::unordered_map<ActorId, ActorBounds> _actor_bounds;
+
     /// check a few walkers and if they don't exist then remove from the crowd
-    void CheckIfWalkerExist(std::vector<WalkerHandle> walkers, const EpisodeState &state);
+    void CheckIfWalkerExist(const std::vector<WalkerHandle> &walkers, const EpisodeState &state);
+    /// return if the state of a walker drifted enough from the last one sent
+    /// to send it again, and update it
+    bool UpdateSentState(ActorId walker_id, const geom::Transform &transform, float speed, double delta_seconds);
     /// add/update/delete all vehicles in crowd
     void UpdateVehiclesInCrowd(std::shared_ptr<Episode> episode, bool show_debug = false);
   };
@@ -6,9 +6,13 @@
 
 #include <carla/geom/Mesh.h>
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <string>
 #include <sstream>
 #include <ios>
+#include <unordered_map>
 
 #include <carla/geom/Math.h>
 
@@ -137,6 +141,134 @@ namespace geom {
     _materials.back().index_end = close_index;
   }
 
+  void Mesh::Reserve(size_t vertices, size_t normals, size_t indexes, size_t uvs, size_t materials) {
+    _vertices.reserve(vertices);
+    _normals.reserve(normals);
+    _indexes.reserve(indexes);
+    _uvs.reserve(uvs);
+    _materials.reserve(materials);
+  }
+
+  size_t Mesh::WeldVertices(float tolerance) {
+    DEBUG_ASSERT(tolerance > 0.0f);
+    const size_t vertex_num = _vertices.size();
+    if (vertex_num == 0u) {
+      return 0u;
+    }
+    // Normals and uvs are only kept in sync when there is one per vertex.
+    const bool has_uvs = _uvs.size() == vertex_num;
+    const bool has_normals = _normals.size() == vertex_num;
+
+    // Spatial hash with cells of the size of the tolerance, so a vertex can
+    // only be merged with vertices in its cell or in the neighbour ones.
+    using CellKey = std::array<int64_t, 3>;
+    struct CellKeyHash {
+      size_t operator()(const CellKey &key) const {
+        return static_cast<size_t>(
+            (key[0] * 73856093) ^ (key[1] * 19349663) ^ (key[2] * 83492791));
+      }
+    };
+    const auto to_cell = [tolerance](const vertex_type &v) -> CellKey {
+      return {
+          static_cast<int64_t>(std::floor(v.x / tolerance)),
+          static_cast<int64_t>(std::floor(v.y / tolerance)),
+          static_cast<int64_t>(std::floor(v.z / tolerance))};
+    };
+    std::unordered_map<CellKey, std::vector<size_t>, CellKeyHash> grid;
+    grid.reserve(vertex_num);
+
+    const float sq_tolerance = tolerance * tolerance;
+    // Uvs are in texture space, the position tolerance does not apply there.
+    constexpr float sq_uv_tolerance = 1e-12f;
+    std::vector<size_t> remap(vertex_num);
+    std::vector<vertex_type> vertices;
+    std::vector<normal_type> normals;
+    std::vector<uv_type> uvs;
+    vertices.reserve(vertex_num);
+
+    for (size_t i = 0u; i < vertex_num; ++i) {
+      const vertex_type &vertex = _vertices[i];
+      const CellKey cell = to_cell(vertex);
+      size_t found = vertex_num;
+      for (int64_t dx = -1; dx <= 1 && found == vertex_num; ++dx) {
+        for (int64_t dy = -1; dy <= 1 && found == vertex_num; ++dy) {
+          for (int64_t dz = -1; dz <= 1 && found == vertex_num; ++dz) {
+            const auto it = grid.find({cell[0] + dx, cell[1] + dy, cell[2] + dz});
+            if (it == grid.end()) {
+              continue;
+            }
+            for (size_t candidate : it->second) {
+              if ((vertices[candidate] - vertex).SquaredLength() > sq_tolerance) {
+                continue;
+              }
+              if (has_uvs &&
+                  (uvs[candidate] - _uvs[i]).SquaredLength() > sq_uv_tolerance) {
+                continue;
+              }
+              found = candidate;
+              break;
+            }
+          }
+        }
+      }
+      if (found == vertex_num) {
+        found = vertices.size();
+        vertices.push_back(vertex);
+        if (has_uvs) {
+          uvs.push_back(_uvs[i]);
+        }
+        if (has_normals) {
+          normals.push_back(_normals[i]);
+        }
+        grid[cell].push_back(found);
+      }
+      remap[i] = found;
+    }
+
+    // Indexes are 1-based.
+    for (auto &index : _indexes) {
+      DEBUG_ASSERT(index > 0u && index <= vertex_num);
+      index = remap[index - 1u] + 1u;
+    }
+
+    // Drop the triangles that collapsed into a line or a point, moving the
+    // material ranges along with the indexes that remain.
+    if (_indexes.size() % 3u == 0u) {
+      std::vector<size_t> kept_before(_indexes.size() + 1u, 0u);
+      size_t kept = 0u;
+      for (size_t i = 0u; i < _indexes.size(); i += 3u) {
+        const index_type a = _indexes[i];
+        const index_type b = _indexes[i + 1u];
+        const index_type c = _indexes[i + 2u];
+        const bool degenerate = a == b || b == c || a == c;
+        for (size_t j = 0u; j < 3u; ++j) {
+          kept_before[i + j] = kept;
+          if (!degenerate) {
+            _indexes[kept++] = _indexes[i + j];
+          }
+        }
+      }
+      kept_before[_indexes.size()] = kept;
+      if (kept != _indexes.size()) {
+        for (auto &material : _materials) {
+          material.index_start = kept_before[material.index_start];
+          material.index_end = kept_before[material.index_end];
+        }
+        _indexes.resize(kept);
+      }
+    }
+
+    const size_t removed = vertex_num - vertices.size();
+    _vertices = std::move(vertices);
+    if (has_uvs) {
+      _uvs = std::move(uvs);
+    }
+    if (has_normals) {
+      _normals = std::move(normals);
+    }
+    return removed;
+  }
+
   std::string Mesh::GenerateOBJ() const {
     if (!IsValid()) {
       return "";
@@ -320,6 +452,41 @@ namespace geom {
     return *this;
   }
 
+  Mesh &Mesh::operator+=(Mesh &&rhs) {
+    // The buffers of rhs are taken only if they would not replace room
+    // already reserved in this mesh.
+    if (_vertices.empty() && _indexes.empty() && _materials.empty() &&
+        _uvs.empty() && _normals.empty() &&
+        _vertices.capacity() < rhs._vertices.size() &&
+        _indexes.capacity() < rhs._indexes.size()) {
+      _vertices = std::move(rhs._vertices);
+      _normals = std::move(rhs._normals);
+      _indexes = std::move(rhs._indexes);
+      _uvs = std::move(rhs._uvs);
+      _materials = std::move(rhs._materials);
+      return *this;
+    }
+
+    const size_t v_num = GetVerticesNum();
+    const size_t i_num = GetIndexesNum();
+
+    _vertices.insert(_vertices.end(), rhs._vertices.begin(), rhs._vertices.end());
+    _normals.insert(_normals.end(), rhs._normals.begin(), rhs._normals.end());
+    _uvs.insert(_uvs.end(), rhs._uvs.begin(), rhs._uvs.end());
+
+    _indexes.reserve(i_num + rhs._indexes.size());
+    for (const auto index : rhs._indexes) {
+      _indexes.push_back(index + v_num);
+    }
+
+    _materials.reserve(_materials.size() + rhs._materials.size());
+    for (const auto &mat : rhs._materials) {
+      _materials.emplace_back(mat.name, mat.index_start + i_num, mat.index_end + i_num);
+    }
+
+    return *this;
+  }
+
   Mesh operator+(const Mesh &lhs, const Mesh &rhs) {
     Mesh m = lhs;
     return m += rhs;
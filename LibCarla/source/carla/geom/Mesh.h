@@ -101,6 +101,16 @@ namespace geom {
     /// Stops applying the material to the new added triangles.
     void EndMaterial();
 
+    /// Reserves space for the given amount of elements so consecutive merges
+    /// do not reallocate the buffers.
+    void Reserve(size_t vertices, size_t normals, size_t indexes, size_t uvs, size_t materials);
+
+    /// Merges the vertices closer than @a tolerance (that also share the same
+    /// uv coordinates) and compacts the vertex list, remapping the indexes.
+    /// Triangles left with repeated indexes are removed. Returns the number of
+    /// vertices removed.
+    size_t WeldVertices(float tolerance = 1e-3f);
+
     // =========================================================================
     // -- Export methods -------------------------------------------------------
     // =========================================================================
@@ -145,6 +155,10 @@ namespace geom {
     /// Merges two meshes into a single mesh
     Mesh &operator+=(const Mesh &rhs);
 
+    /// Merges two meshes into a single mesh, reusing the buffers of @a rhs
+    /// when possible.
+    Mesh &operator+=(Mesh &&rhs);
+
     friend Mesh operator+(const Mesh &lhs, const Mesh &rhs);
 
     // =========================================================================
@@ -9,10 +9,12 @@
 #include <cmath>
 
 #include "carla/Logging.h"
+#include "carla/ParallelFor.h"
 #include "carla/nav/Navigation.h"
 #include "carla/nav/WalkerManager.h"
 #include "carla/geom/Math.h"
 
+#include <algorithm>
 #include <iterator>
 #include <fstream>
 #include <mutex>
@@ -31,7 +33,7 @@ namespace nav {
   // these settings are the same than in RecastBuilder, so if you change the height of the agent, 
   // you should do the same in RecastBuilder
   static const int   MAX_POLYS = 256;
-  static const int   MAX_AGENTS = 500;
+  static const int   MIN_AGENTS = 500;
   static const int   MAX_QUERY_SEARCH_NODES = 2048;
   static const float AGENT_HEIGHT = 1.8f;
   static const float AGENT_RADIUS = 0.3f;
@@ -43,11 +45,96 @@ namespace nav {
   static const float AREA_GRASS_COST =  1.0f;
   static const float AREA_ROAD_COST  = 10.0f;
 
+  // below this number of paths per thread a batch is not worth splitting
+  static const size_t MIN_PATHS_PER_THREAD = 8u;
+
+  // a walker is moved to the crowd of the next region once it is this far
+  // past the border, so walkers walking along a border do not jump back and
+  // forth every tick
+  static const float REGION_HANDOVER_MARGIN = 2.0f;
+  // vehicles are added also to the crowds of the regions this close, so the
+  // walkers near a border can avoid them
+  static const float REGION_VEHICLE_MARGIN = 15.0f;
+  // walkers are mirrored in the crowds of the regions this close, the range
+  // where the walkers look for others to avoid
+  static const float REGION_WALKER_MARGIN = 10.0f;
+
+  // room kept in each crowd for the vehicles, besides the walkers
+  static const int   CROWD_VEHICLE_AGENTS = 100;
+
+  // a vehicle in the crowd is updated only when it moved or turned more than
+  // this since the last update
+  static const float VEHICLE_MOVED_DISTANCE = 0.01f;
+  static const float VEHICLE_MOVED_YAW = 0.5f;
+
   // return a random float
   static float frand() {
     return static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
   }
 
+  // init a crowd with the filters and the avoidance settings of the walkers
+  static bool InitCrowd(dtCrowd *crowd, int max_agents, dtNavMesh *nav_mesh) {
+    // these radius should be the maximum size of the vehicles (CarlaCola for Carla)
+    const float max_agent_radius = AGENT_RADIUS * 20;
+    if (!crowd->init(max_agents, max_agent_radius, nav_mesh)) {
+      return false;
+    }
+
+    // set different filters
+    // filter 0 can not walk on roads
+    crowd->getEditableFilter(0)->setIncludeFlags(CARLA_TYPE_WALKABLE);
+    crowd->getEditableFilter(0)->setExcludeFlags(CARLA_TYPE_ROAD);
+    crowd->getEditableFilter(0)->setAreaCost(CARLA_AREA_ROAD, AREA_ROAD_COST);
+    crowd->getEditableFilter(0)->setAreaCost(CARLA_AREA_GRASS, AREA_GRASS_COST);
+    // filter 1 can walk on roads
+    crowd->getEditableFilter(1)->setIncludeFlags(CARLA_TYPE_WALKABLE);
+    crowd->getEditableFilter(1)->setExcludeFlags(CARLA_TYPE_NONE);
+    crowd->getEditableFilter(1)->setAreaCost(CARLA_AREA_ROAD, AREA_ROAD_COST);
+    crowd->getEditableFilter(1)->setAreaCost(CARLA_AREA_GRASS, AREA_GRASS_COST);
+
+    // Setup local avoidance params to different qualities.
+    dtObstacleAvoidanceParams params;
+    // Use mostly default settings, copy from dtCrowd.
+    memcpy(&params, crowd->getObstacleAvoidanceParams(0), sizeof(dtObstacleAvoidanceParams));
+
+    // Low (11)
+    params.velBias = 0.5f;
+    params.adaptiveDivs = 5;
+    params.adaptiveRings = 2;
+    params.adaptiveDepth = 1;
+    crowd->setObstacleAvoidanceParams(0, &params);
+
+    // Medium (22)
+    params.velBias = 0.5f;
+    params.adaptiveDivs = 5;
+    params.adaptiveRings = 2;
+    params.adaptiveDepth = 2;
+    crowd->setObstacleAvoidanceParams(1, &params);
+
+    // Good (45)
+    params.velBias = 0.5f;
+    params.adaptiveDivs = 7;
+    params.adaptiveRings = 2;
+    params.adaptiveDepth = 3;
+    crowd->setObstacleAvoidanceParams(2, &params);
+
+    // High (66)
+    params.velBias = 0.5f;
+    params.adaptiveDivs = 7;
+    params.adaptiveRings = 3;
+    params.adaptiveDepth = 3;
+
+    crowd->setObstacleAvoidanceParams(3, &params);
+
+    return true;
+  }
+
+  // return if an agent is the mirror of a walker of another crowd, the only
+  // agents without vehicle box nor update flags
+  static bool IsWalkerMirror(const dtCrowdAgent *agent) {
+    return !agent->params.useObb && agent->params.updateFlags == 0;
+  }
+
   Navigation::Navigation() {
     // assign walker manager
     _walker_manager.SetNav(this);
@@ -55,6 +142,7 @@ namespace nav {
 
   Navigation::~Navigation() {
     _ready = false;
+    _threads.reset();
     _time_to_unblock = 0.0f;
     _mapped_walkers_id.clear();
     _mapped_vehicles_id.clear();
@@ -62,9 +150,8 @@ namespace nav {
     _walkers_blocked_position.clear();
     _yaw_walkers.clear();
     _binary_mesh.clear();
-    dtFreeCrowd(_crowd);
-    dtFreeNavMeshQuery(_nav_query);
-    dtFreeNavMesh(_nav_mesh);
+    FreeCrowds();
+    ReplaceNavMesh(nullptr);
   }
 
   // set the seed to use with random numbers
@@ -172,14 +259,16 @@ namespace nav {
       tile_header.tile_ref, 0);
     }
 
-    // exchange
-    dtFreeNavMesh(_nav_mesh);
-    _nav_mesh = mesh;
+    // exchange, the queries and the corridors of the previous mesh are created
+    // again on demand
+    ReplaceNavMesh(mesh);
 
-    // prepare the query object
-    dtFreeNavMeshQuery(_nav_query);
-    _nav_query = dtAllocNavMeshQuery();
-    _nav_query->init(_nav_mesh, MAX_QUERY_SEARCH_NODES);
+    // threads for the crowds and the batches of paths, kept between loads
+    if (_threads == nullptr) {
+      _thread_count = GetParallelThreads();
+      _threads = std::make_unique<ThreadPool>();
+      _threads->AsyncRun(_thread_count);
+    }
 
     // copy
     _binary_mesh = std::move(content);
@@ -198,128 +287,458 @@ namespace nav {
       return;
     }
 
-    DEBUG_ASSERT(_crowd == nullptr);
+    DEBUG_ASSERT(_crowds.empty());
 
-    // create and init
-    _crowd = dtAllocCrowd();
-    // these radius should be the maximum size of the vehicles (CarlaCola for Carla)
-    const float max_agent_radius = AGENT_RADIUS * 20;
-    if (!_crowd->init(MAX_AGENTS, max_agent_radius, _nav_mesh)) {
-      logging::log("Nav: failed to create crowd");
+    // horizontal bounds of the navmesh (x and z in Recast coordinates)
+    float bmin[2] = { 0.0f, 0.0f };
+    float bmax[2] = { 0.0f, 0.0f };
+    bool first = true;
+    const dtNavMesh *nav_mesh = _nav_mesh;
+    for (int i = 0; i < nav_mesh->getMaxTiles(); ++i) {
+      const dtMeshTile *tile = nav_mesh->getTile(i);
+      if (!tile || !tile->header) {
+        continue;
+      }
+      if (first) {
+        bmin[0] = tile->header->bmin[0];
+        bmin[1] = tile->header->bmin[2];
+        bmax[0] = tile->header->bmax[0];
+        bmax[1] = tile->header->bmax[2];
+        first = false;
+      } else {
+        bmin[0] = std::min(bmin[0], tile->header->bmin[0]);
+        bmin[1] = std::min(bmin[1], tile->header->bmin[2]);
+        bmax[0] = std::max(bmax[0], tile->header->bmax[0]);
+        bmax[1] = std::max(bmax[1], tile->header->bmax[2]);
+      }
+    }
+
+    // split the bounds in a grid of regions as square as possible
+    const float width = std::max(bmax[0] - bmin[0], 1.0f);
+    const float depth = std::max(bmax[1] - bmin[1], 1.0f);
+    const int partitions = static_cast<int>(_partitions);
+    _region_columns = static_cast<int>(std::lround(std::sqrt(static_cast<float>(partitions) * width / depth)));
+    _region_columns = std::max(1, std::min(partitions, _region_columns));
+    _region_rows = std::max(1, partitions / _region_columns);
+    _region_origin[0] = bmin[0];
+    _region_origin[1] = bmin[1];
+    _region_size[0] = width / static_cast<float>(_region_columns);
+    _region_size[1] = depth / static_cast<float>(_region_rows);
+
+    // create and init a crowd for each region, each one with room for all the
+    // walkers, as all of them can end in the same region
+    const int regions = _region_columns * _region_rows;
+    _agents_per_crowd = std::max(MIN_AGENTS, static_cast<int>(_mapped_walkers_id.size()) + CROWD_VEHICLE_AGENTS);
+    _crowds.reserve(static_cast<size_t>(regions));
+    for (int i = 0; i < regions; ++i) {
+      dtCrowd *crowd = dtAllocCrowd();
+      if (crowd == nullptr || !InitCrowd(crowd, _agents_per_crowd, _nav_mesh)) {
+        dtFreeCrowd(crowd);
+        FreeCrowds();
+        logging::log("Nav: failed to create crowd");
+        return;
+      }
+      _crowds.push_back(crowd);
+    }
+  }
+
+  // free the crowds and forget the agents in them
+  void Navigation::FreeCrowds() {
+    for (dtCrowd *crowd : _crowds) {
+      dtFreeCrowd(crowd);
+    }
+    _crowds.clear();
+    _mapped_vehicles_id.clear();
+    _mapped_vehicle_agents.clear();
+    _mapped_walker_mirrors.clear();
+    _tracked_vehicles.clear();
+    _mapped_by_index.clear();
+    _walkers_blocked_position.clear();
+  }
+
+  // split the navmesh in regions, each one with its own crowd, only before
+  // adding walkers
+  void Navigation::SetCrowdPartitions(unsigned int partitions) {
+    partitions = std::max(1u, partitions);
+    if (partitions == _partitions) {
       return;
     }
 
-    // set different filters
-    // filter 0 can not walk on roads
-    _crowd->getEditableFilter(0)->setIncludeFlags(CARLA_TYPE_WALKABLE);
-    _crowd->getEditableFilter(0)->setExcludeFlags(CARLA_TYPE_ROAD);
-    _crowd->getEditableFilter(0)->setAreaCost(CARLA_AREA_ROAD, AREA_ROAD_COST);
-    _crowd->getEditableFilter(0)->setAreaCost(CARLA_AREA_GRASS, AREA_GRASS_COST);
-    // filter 1 can walk on roads
-    _crowd->getEditableFilter(1)->setIncludeFlags(CARLA_TYPE_WALKABLE);
-    _crowd->getEditableFilter(1)->setExcludeFlags(CARLA_TYPE_NONE);
-    _crowd->getEditableFilter(1)->setAreaCost(CARLA_AREA_ROAD, AREA_ROAD_COST);
-    _crowd->getEditableFilter(1)->setAreaCost(CARLA_AREA_GRASS, AREA_GRASS_COST);
+    // critical section, force single thread running this
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_mapped_walkers_id.empty()) {
+      logging::log("Nav: the crowd partitions can not change once walkers are added");
+      return;
+    }
+    _partitions = partitions;
+    if (_ready) {
+      FreeCrowds();
+      CreateCrowd();
+    }
+  }
 
-    // Setup local avoidance params to different qualities.
-    dtObstacleAvoidanceParams params;
-    // Use mostly default settings, copy from dtCrowd.
-    memcpy(&params, _crowd->getObstacleAvoidanceParams(0), sizeof(dtObstacleAvoidanceParams));
+  // return the crowd holding an agent
+  dtCrowd *Navigation::GetAgentCrowd(int index) const {
+    if (index < 0 || static_cast<size_t>(index / _agents_per_crowd) >= _crowds.size()) {
+      return nullptr;
+    }
+    return _crowds[static_cast<size_t>(index / _agents_per_crowd)];
+  }
 
-    // Low (11)
-    params.velBias = 0.5f;
-    params.adaptiveDivs = 5;
-    params.adaptiveRings = 2;
-    params.adaptiveDepth = 1;
-    _crowd->setObstacleAvoidanceParams(0, &params);
+  // return an agent
+  const dtCrowdAgent *Navigation::GetAgent(int index) const {
+    dtCrowd *crowd = GetAgentCrowd(index);
+    return crowd ? crowd->getAgent(index % _agents_per_crowd) : nullptr;
+  }
 
-    // Medium (22)
-    params.velBias = 0.5f;
-    params.adaptiveDivs = 5;
-    params.adaptiveRings = 2;
-    params.adaptiveDepth = 2;
-    _crowd->setObstacleAvoidanceParams(1, &params);
+  dtCrowdAgent *Navigation::GetEditableAgent(int index) const {
+    dtCrowd *crowd = GetAgentCrowd(index);
+    return crowd ? crowd->getEditableAgent(index % _agents_per_crowd) : nullptr;
+  }
 
-    // Good (45)
-    params.velBias = 0.5f;
-    params.adaptiveDivs = 7;
-    params.adaptiveRings = 2;
-    params.adaptiveDepth = 3;
-    _crowd->setObstacleAvoidanceParams(2, &params);
+  // add an agent to the crowd of a region, return its index or -1
+  int Navigation::AddCrowdAgent(int region, const float *pos, const dtCrowdAgentParams *params) {
+    if (region < 0 || static_cast<size_t>(region) >= _crowds.size()) {
+      return -1;
+    }
+    int index = _crowds[static_cast<size_t>(region)]->addAgent(pos, params);
+    return (index == -1) ? -1 : region * _agents_per_crowd + index;
+  }
 
-    // High (66)
-    params.velBias = 0.5f;
-    params.adaptiveDivs = 7;
-    params.adaptiveRings = 3;
-    params.adaptiveDepth = 3;
+  // remove an agent from its crowd
+  void Navigation::RemoveCrowdAgent(int index) {
+    dtCrowd *crowd = GetAgentCrowd(index);
+    if (crowd) {
+      crowd->removeAgent(index % _agents_per_crowd);
+    }
+  }
 
-    _crowd->setObstacleAvoidanceParams(3, &params);
+  // return the region holding a position, the regions in the border of the
+  // grid hold also the positions outside it
+  int Navigation::GetRegion(const float *pos) const {
+    int column = static_cast<int>(std::floor((pos[0] - _region_origin[0]) / _region_size[0]));
+    int row = static_cast<int>(std::floor((pos[2] - _region_origin[1]) / _region_size[1]));
+    column = std::max(0, std::min(_region_columns - 1, column));
+    row = std::max(0, std::min(_region_rows - 1, row));
+    return row * _region_columns + column;
   }
 
-  // return the path points to go from one position to another
-  bool Navigation::GetPath(carla::geom::Location from,
-                           carla::geom::Location to,
-                           dtQueryFilter * filter,
-                           std::vector<carla::geom::Location> &path,
-                           std::vector<unsigned char> &area) {
+  // return the regions touching a square of half side margin around a position
+  void Navigation::GetRegions(const float *pos, float margin, std::vector<int> &regions) const {
+    const float from[3] = { pos[0] - margin, pos[1], pos[2] - margin };
+    const float to[3] = { pos[0] + margin, pos[1], pos[2] + margin };
+    const int first = GetRegion(from);
+    const int last = GetRegion(to);
+    regions.clear();
+    for (int row = first / _region_columns; row <= last / _region_columns; ++row) {
+      for (int column = first % _region_columns; column <= last % _region_columns; ++column) {
+        regions.push_back(row * _region_columns + column);
+      }
+    }
+  }
+
+  // return if a position is inside a region, enlarged by a margin
+  bool Navigation::IsInRegion(const float *pos, int region, float margin) const {
+    const int column = region % _region_columns;
+    const int row = region / _region_columns;
+    const float min_x = _region_origin[0] + static_cast<float>(column) * _region_size[0];
+    const float min_z = _region_origin[1] + static_cast<float>(row) * _region_size[1];
+    return (column == 0 || pos[0] >= min_x - margin) &&
+           (column == _region_columns - 1 || pos[0] <= min_x + _region_size[0] + margin) &&
+           (row == 0 || pos[2] >= min_z - margin) &&
+           (row == _region_rows - 1 || pos[2] <= min_z + _region_size[1] + margin);
+  }
+
+  // add a copy of an agent to the crowd of a region, keeping its movement and
+  // target, return its index or -1
+  int Navigation::CopyCrowdAgent(int region, const dtCrowdAgent *agent) {
+    const int index = AddCrowdAgent(region, agent->npos, &agent->params);
+    if (index == -1) {
+      return -1;
+    }
+    dtCrowdAgent *copy = GetEditableAgent(index);
+    dtVcopy(copy->vel, agent->vel);
+    dtVcopy(copy->nvel, agent->nvel);
+    dtVcopy(copy->dvel, agent->dvel);
+    copy->paused = agent->paused;
+    // vehicles are valid also out of the navmesh
+    if (agent->params.useObb) {
+      copy->state = DT_CROWDAGENT_STATE_WALKING;
+    }
+    if (agent->targetRef) {
+      GetAgentCrowd(index)->requestMoveTarget(index % _agents_per_crowd, agent->targetRef, agent->targetPos);
+    }
+    return index;
+  }
+
+  // move the walkers that went past the border of their region to the crowd
+  // of the region they are in, keeping their movement and target
+  void Navigation::HandOverWalkers() {
+    for (size_t region = 0u; region < _crowds.size(); ++region) {
+      dtCrowd *crowd = _crowds[region];
+      for (int i = 0; i < crowd->getAgentCount(); ++i) {
+        const dtCrowdAgent *agent = crowd->getAgent(i);
+        if (!agent->active || agent->params.useObb || IsWalkerMirror(agent) ||
+            IsInRegion(agent->npos, static_cast<int>(region), REGION_HANDOVER_MARGIN)) {
+          continue;
+        }
+
+        // add it to the new crowd, if it is full try again next tick
+        const int from = static_cast<int>(region) * _agents_per_crowd + i;
+        const int to = CopyCrowdAgent(GetRegion(agent->npos), agent);
+        if (to == -1) {
+          continue;
+        }
+        crowd->removeAgent(i);
+
+        // update the mapping
+        auto it = _mapped_by_index.find(from);
+        if (it != _mapped_by_index.end()) {
+          _mapped_walkers_id[it->second] = to;
+          _mapped_by_index[to] = it->second;
+          _mapped_by_index.erase(it);
+        }
+        auto blocked = _walkers_blocked_position.find(from);
+        if (blocked != _walkers_blocked_position.end()) {
+          _walkers_blocked_position[to] = blocked->second;
+          _walkers_blocked_position.erase(blocked);
+        }
+      }
+    }
+  }
+
+  // mirror each walker in the crowds of the regions near enough for their
+  // walkers to avoid it, the mirrors only move with the walker
+  void Navigation::UpdateWalkerMirrors() {
+    std::vector<int> regions;
+    for (auto &&entry : _mapped_walkers_id) {
+      const dtCrowdAgent *walker = GetAgent(entry.second);
+      if (!walker || !walker->active) {
+        continue;
+      }
+
+      // the regions near the walker, except the one of its own crowd
+      const int own_region = entry.second / _agents_per_crowd;
+      GetRegions(walker->npos, REGION_WALKER_MARGIN, regions);
+      regions.erase(std::remove(regions.begin(), regions.end(), own_region), regions.end());
+      if (regions.empty() && _mapped_walker_mirrors.find(entry.first) == _mapped_walker_mirrors.end()) {
+        continue;
+      }
+
+      // remove the mirrors of the regions left behind
+      std::vector<int> &mirrors = _mapped_walker_mirrors[entry.first];
+      for (auto it = mirrors.begin(); it != mirrors.end();) {
+        if (std::find(regions.begin(), regions.end(), *it / _agents_per_crowd) == regions.end()) {
+          RemoveCrowdAgent(*it);
+          it = mirrors.erase(it);
+        } else {
+          ++it;
+        }
+      }
+
+      // update the mirrors found and add the missing ones
+      for (int region : regions) {
+        auto found = std::find_if(mirrors.begin(), mirrors.end(), [this, region](int index) {
+          return index / _agents_per_crowd == region;
+        });
+        int index;
+        if (found != mirrors.end()) {
+          index = *found;
+        } else {
+          // same size than the walker, but without steering nor avoidance
+          dtCrowdAgentParams params = walker->params;
+          params.maxAcceleration = 0.0f;
+          params.collisionQueryRange = 0;
+          params.obstacleAvoidanceType = 0;
+          params.updateFlags = 0;
+          index = AddCrowdAgent(region, walker->npos, &params);
+          if (index == -1) {
+            continue;
+          }
+          mirrors.push_back(index);
+        }
+        // copy its position and movement, for the others to see where it goes
+        dtCrowdAgent *mirror = GetEditableAgent(index);
+        dtVcopy(mirror->npos, walker->npos);
+        dtVcopy(mirror->vel, walker->vel);
+        dtVcopy(mirror->nvel, walker->nvel);
+        dtVcopy(mirror->dvel, walker->dvel);
+      }
+
+      if (mirrors.empty()) {
+        _mapped_walker_mirrors.erase(entry.first);
+      }
+    }
+  }
+
+  // create again the crowds with room for this number of agents in each one,
+  // the agents are copied to them and their indices updated
+  bool Navigation::ResizeCrowds(int max_agents) {
+    std::vector<dtCrowd *> crowds;
+    crowds.reserve(_crowds.size());
+    for (size_t i = 0u; i < _crowds.size(); ++i) {
+      dtCrowd *crowd = dtAllocCrowd();
+      if (crowd == nullptr || !InitCrowd(crowd, max_agents, _nav_mesh)) {
+        dtFreeCrowd(crowd);
+        for (dtCrowd *created : crowds) {
+          dtFreeCrowd(created);
+        }
+        return false;
+      }
+      crowds.push_back(crowd);
+    }
+
+    // copy the agents to the crowd of the same region, the new ones are larger
+    // so all of them fit
+    const std::vector<dtCrowd *> previous = _crowds;
+    const int previous_agents = _agents_per_crowd;
+    _crowds = std::move(crowds);
+    _agents_per_crowd = max_agents;
+    std::vector<int> moved(previous.size() * static_cast<size_t>(previous_agents), -1);
+    for (size_t region = 0u; region < previous.size(); ++region) {
+      for (int i = 0; i < previous[region]->getAgentCount(); ++i) {
+        const dtCrowdAgent *agent = previous[region]->getAgent(i);
+        if (agent->active) {
+          const int to = CopyCrowdAgent(static_cast<int>(region), agent);
+          DEBUG_ASSERT(to != -1);
+          moved[region * static_cast<size_t>(previous_agents) + static_cast<size_t>(i)] = to;
+        }
+      }
+      dtFreeCrowd(previous[region]);
+    }
+
+    // update the mapping
+    auto remap = [&moved](int index) {
+      return (index < 0) ? -1 : moved[static_cast<size_t>(index)];
+    };
+    for (auto &&entry : _mapped_walkers_id) {
+      entry.second = remap(entry.second);
+    }
+    for (auto &&entry : _mapped_vehicles_id) {
+      entry.second = remap(entry.second);
+    }
+    for (auto &&entry : _mapped_vehicle_agents) {
+      for (int &index : entry.second) {
+        index = remap(index);
+      }
+    }
+    for (auto &&entry : _mapped_walker_mirrors) {
+      for (int &index : entry.second) {
+        index = remap(index);
+      }
+    }
+    std::unordered_map<int, ActorId> mapped_by_index;
+    for (auto &&entry : _mapped_by_index) {
+      const int index = remap(entry.first);
+      if (index != -1) {
+        mapped_by_index[index] = entry.second;
+      }
+    }
+    _mapped_by_index.swap(mapped_by_index);
+    std::unordered_map<int, carla::geom::Vector3D> blocked_position;
+    for (auto &&entry : _walkers_blocked_position) {
+      const int index = remap(entry.first);
+      if (index != -1) {
+        blocked_position[index] = entry.second;
+      }
+    }
+    _walkers_blocked_position.swap(blocked_position);
+
+    return true;
+  }
+
+  // take a query from the pool, or create a new one if all are in use
+  dtNavMeshQuery *Navigation::AcquireQuery() const {
+    dtNavMesh *mesh = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(_query_mutex);
+      ++_queries_in_use;
+      if (!_free_queries.empty()) {
+        dtNavMeshQuery *query = _free_queries.back();
+        _free_queries.pop_back();
+        return query;
+      }
+      mesh = _nav_mesh;
+    }
+    // the navmesh is not replaced while this query is counted as in use
+    dtNavMeshQuery *query = dtAllocNavMeshQuery();
+    if (query == nullptr || dtStatusFailed(query->init(mesh, MAX_QUERY_SEARCH_NODES))) {
+      dtFreeNavMeshQuery(query);
+      std::lock_guard<std::mutex> lock(_query_mutex);
+      --_queries_in_use;
+      _query_released.notify_all();
+      return nullptr;
+    }
+    return query;
+  }
+
+  // return a query to the pool
+  void Navigation::ReleaseQuery(dtNavMeshQuery *query) const {
+    if (query != nullptr) {
+      std::lock_guard<std::mutex> lock(_query_mutex);
+      _free_queries.push_back(query);
+      --_queries_in_use;
+      _query_released.notify_all();
+    }
+  }
+
+  // wait until every query is back in the pool, as a query in use reads the
+  // navmesh it was created for, then free them and replace the navmesh; no
+  // query is taken meanwhile
+  void Navigation::ReplaceNavMesh(dtNavMesh *mesh) {
+    std::unique_lock<std::mutex> lock(_query_mutex);
+    _query_released.wait(lock, [this]() { return _queries_in_use == 0u; });
+    for (dtNavMeshQuery *query : _free_queries) {
+      dtFreeNavMeshQuery(query);
+    }
+    _free_queries.clear();
+    _path_cache.Reset(mesh);
+    dtFreeNavMesh(_nav_mesh);
+    _nav_mesh = mesh;
+  }
+
+  // find the path between two points using the given query, the navmesh is
+  // only read so any number of threads can do this with their own query
+  bool Navigation::FindPath(dtNavMeshQuery *query,
+                            carla::geom::Location from,
+                            carla::geom::Location to,
+                            const dtQueryFilter *filter,
+                            std::vector<carla::geom::Location> &path,
+                            std::vector<unsigned char> &area) const {
     // path found
     float straight_path[MAX_POLYS * 3];
     unsigned char straight_path_flags[MAX_POLYS];
     dtPolyRef straight_path_polys[MAX_POLYS];
-    int num_straight_path;
+    int num_straight_path = 0;
     int straight_path_options = DT_STRAIGHTPATH_AREA_CROSSINGS;
 
     // polys in path
     dtPolyRef polys[MAX_POLYS];
-    int num_polys;
+    int num_polys = 0;
 
-    // check if all is ready
-    if (!_ready) {
+    if (query == nullptr || filter == nullptr) {
       return false;
     }
 
-    DEBUG_ASSERT(_nav_query != nullptr);
-
     // point extension
-    float poly_pick_ext[3];
-    poly_pick_ext[0] = 2;
-    poly_pick_ext[1] = 4;
-    poly_pick_ext[2] = 2;
-
-    // filter
-    dtQueryFilter filter2;
-    if (filter == nullptr) {
-      filter2.setAreaCost(CARLA_AREA_ROAD, AREA_ROAD_COST);
-      filter2.setAreaCost(CARLA_AREA_GRASS, AREA_GRASS_COST);
-      filter2.setIncludeFlags(CARLA_TYPE_WALKABLE);
-      filter2.setExcludeFlags(CARLA_TYPE_NONE);
-      filter = &filter2;
-    }
+    float poly_pick_ext[3] = {2,4,2};
 
     // set the points
     dtPolyRef start_ref = 0;
     dtPolyRef end_ref = 0;
     float start_pos[3] = { from.x, from.z, from.y };
     float end_pos[3] = { to.x, to.z, to.y };
-    {
-      // critical section, force single thread running this
-      std::lock_guard<std::mutex> lock(_mutex);
-      _nav_query->findNearestPoly(start_pos, poly_pick_ext, filter, &start_ref, 0);
-      _nav_query->findNearestPoly(end_pos, poly_pick_ext, filter, &end_ref, 0);
-    }
+    query->findNearestPoly(start_pos, poly_pick_ext, filter, &start_ref, 0);
+    query->findNearestPoly(end_pos, poly_pick_ext, filter, &end_ref, 0);
     if (!start_ref || !end_ref) {
       return false;
     }
 
-    {
-      // critical section, force single thread running this
-      std::lock_guard<std::mutex> lock(_mutex);
-      // get the path of nodes
-      _nav_query->findPath(start_ref, end_ref, start_pos, end_pos, filter, polys, &num_polys, MAX_POLYS);
-    }
+    // get the path of nodes, reusing the corridor when these polygons were
+    // connected before
+    _path_cache.FindCorridor(query, start_ref, end_ref, start_pos, end_pos, filter, polys, &num_polys, MAX_POLYS);
 
     // get the path of points
-    num_straight_path = 0;
     if (num_polys == 0) {
       return false;
     }
@@ -329,19 +748,13 @@ namespace nav {
     float end_pos2[3];
     dtVcopy(end_pos2, end_pos);
     if (polys[num_polys - 1] != end_ref) {
-      // critical section, force single thread running this
-      std::lock_guard<std::mutex> lock(_mutex);
-      _nav_query->closestPointOnPoly(polys[num_polys - 1], end_pos, end_pos2, 0);
+      query->closestPointOnPoly(polys[num_polys - 1], end_pos, end_pos2, 0);
     }
 
     // get the points
-    {
-      // critical section, force single thread running this
-      std::lock_guard<std::mutex> lock(_mutex);
-      _nav_query->findStraightPath(start_pos, end_pos2, polys, num_polys,
-      straight_path, straight_path_flags,
-      straight_path_polys, &num_straight_path, MAX_POLYS, straight_path_options);
-    }
+    query->findStraightPath(start_pos, end_pos2, polys, num_polys,
+    straight_path, straight_path_flags,
+    straight_path_polys, &num_straight_path, MAX_POLYS, straight_path_options);
 
     // copy the path to the output buffer
     path.clear();
@@ -351,115 +764,144 @@ namespace nav {
       // save coordinate for Unreal axis (x, z, y)
       path.emplace_back(straight_path[i], straight_path[i + 2], straight_path[i + 1]);
       // save area type
-      {
-        // critical section, force single thread running this
-        std::lock_guard<std::mutex> lock(_mutex);
-        _nav_mesh->getPolyArea(straight_path_polys[j], &area_type);
-      }
+      _nav_mesh->getPolyArea(straight_path_polys[j], &area_type);
       area.emplace_back(area_type);
     }
 
     return true;
   }
 
-  bool Navigation::GetAgentRoute(ActorId id, carla::geom::Location from, carla::geom::Location to,
-  std::vector<carla::geom::Location> &path, std::vector<unsigned char> &area) {
-    // path found
-    float straight_path[MAX_POLYS * 3];
-    unsigned char straight_path_flags[MAX_POLYS];
-    dtPolyRef straight_path_polys[MAX_POLYS];
-    int num_straight_path = 0;
-    int straight_path_options = DT_STRAIGHTPATH_AREA_CROSSINGS;
-
-    // polys in path
-    dtPolyRef polys[MAX_POLYS];
-    int num_polys;
+  // find the paths of many requests across several threads, each thread with
+  // its own query; the results keep the order of the requests
+  void Navigation::FindPaths(const std::vector<PathRequest> &requests,
+                             const std::vector<const dtQueryFilter *> &filters,
+                             std::vector<PathResult> &results) const {
+    results.clear();
+    results.resize(requests.size());
+
+    // each chunk of requests uses its own query
+    const size_t chunks = (requests.size() + MIN_PATHS_PER_THREAD - 1u) / MIN_PATHS_PER_THREAD;
+    ParallelFor(*_threads, _thread_count, chunks, 1u, [&](const size_t chunk) {
+      dtNavMeshQuery *query = AcquireQuery();
+      const size_t end = std::min(requests.size(), (chunk + 1u) * MIN_PATHS_PER_THREAD);
+      for (size_t i = chunk * MIN_PATHS_PER_THREAD; i < end; ++i) {
+        PathResult &result = results[i];
+        result.found = FindPath(query, requests[i].from, requests[i].to, filters[i], result.path, result.area);
+      }
+      ReleaseQuery(query);
+    });
+  }
 
+  // return the path points to go from one position to another
+  bool Navigation::GetPath(carla::geom::Location from,
+                           carla::geom::Location to,
+                           dtQueryFilter * filter,
+                           std::vector<carla::geom::Location> &path,
+                           std::vector<unsigned char> &area) {
     // check if all is ready
     if (!_ready) {
       return false;
     }
 
-    DEBUG_ASSERT(_nav_query != nullptr);
+    // filter
+    dtQueryFilter filter2;
+    if (filter == nullptr) {
+      filter2.setAreaCost(CARLA_AREA_ROAD, AREA_ROAD_COST);
+      filter2.setAreaCost(CARLA_AREA_GRASS, AREA_GRASS_COST);
+      filter2.setIncludeFlags(CARLA_TYPE_WALKABLE);
+      filter2.setExcludeFlags(CARLA_TYPE_NONE);
+      filter = &filter2;
+    }
 
-    // point extension
-    float poly_pick_ext[3] = {2,4,2};
+    dtNavMeshQuery *query = AcquireQuery();
+    bool result = FindPath(query, from, to, filter, path, area);
+    ReleaseQuery(query);
+    return result;
+  }
 
-    // get current filter from agent
-    auto it = _mapped_walkers_id.find(id);
-    if (it == _mapped_walkers_id.end())
+  bool Navigation::GetAgentRoute(ActorId id, carla::geom::Location from, carla::geom::Location to,
+  std::vector<carla::geom::Location> &path, std::vector<unsigned char> &area) {
+    // check if all is ready
+    if (!_ready) {
       return false;
-
-    const dtQueryFilter *filter;
-    {
-      // critical section, force single thread running this
-      std::lock_guard<std::mutex> lock(_mutex);
-      filter = _crowd->getFilter(_crowd->getAgent(it->second)->params.queryFilterType);
     }
 
-    // set the points
-    dtPolyRef start_ref = 0;
-    dtPolyRef end_ref = 0;
-    float start_pos[3] = { from.x, from.z, from.y };
-    float end_pos[3] = { to.x, to.z, to.y };
+    // get current filter from agent, the path is found outside the lock
+    dtQueryFilter filter;
     {
-      // critical section, force single thread running this
       std::lock_guard<std::mutex> lock(_mutex);
-      _nav_query->findNearestPoly(start_pos, poly_pick_ext, filter, &start_ref, 0);
-      _nav_query->findNearestPoly(end_pos, poly_pick_ext, filter, &end_ref, 0);
+      if (!CopyWalkerFilter(id, filter)) {
+        return false;
+      }
     }
-    if (!start_ref || !end_ref) {
+
+    dtNavMeshQuery *query = AcquireQuery();
+    bool result = FindPath(query, from, to, &filter, path, area);
+    ReleaseQuery(query);
+    return result;
+  }
+
+  // copy the filter of a walker, the walkers can change crowd while the
+  // crowds are updated so this must be called holding _mutex
+  bool Navigation::CopyWalkerFilter(ActorId id, dtQueryFilter &filter) const {
+    auto it = _mapped_walkers_id.find(id);
+    if (it == _mapped_walkers_id.end()) {
       return false;
     }
+    const dtCrowdAgent *agent = GetAgent(it->second);
+    filter = *GetAgentCrowd(it->second)->getFilter(agent->params.queryFilterType);
+    return true;
+  }
 
-    // get the path of nodes
-    {
-      // critical section, force single thread running this
-      std::lock_guard<std::mutex> lock(_mutex);
-      _nav_query->findPath(start_ref, end_ref, start_pos, end_pos, filter, polys, &num_polys, MAX_POLYS);
+  // return the paths for many start and end points at once
+  void Navigation::GetPaths(const std::vector<PathRequest> &requests,
+                            dtQueryFilter * filter,
+                            std::vector<PathResult> &results) {
+    // check if all is ready
+    if (!_ready) {
+      results.assign(requests.size(), PathResult());
+      return;
     }
 
-    // get the path of points
-    if (num_polys == 0) {
-      return false;
+    // filter
+    dtQueryFilter filter2;
+    if (filter == nullptr) {
+      filter2.setAreaCost(CARLA_AREA_ROAD, AREA_ROAD_COST);
+      filter2.setAreaCost(CARLA_AREA_GRASS, AREA_GRASS_COST);
+      filter2.setIncludeFlags(CARLA_TYPE_WALKABLE);
+      filter2.setExcludeFlags(CARLA_TYPE_NONE);
+      filter = &filter2;
     }
 
-    // in case of partial path, make sure the end point is clamped to the last
-    // polygon
-    float end_pos2[3];
-    dtVcopy(end_pos2, end_pos);
-    if (polys[num_polys - 1] != end_ref) {
-      // critical section, force single thread running this
-      std::lock_guard<std::mutex> lock(_mutex);
-      _nav_query->closestPointOnPoly(polys[num_polys - 1], end_pos, end_pos2, 0);
+    FindPaths(requests, std::vector<const dtQueryFilter *>(requests.size(), filter), results);
+  }
+
+  // return the routes of many agents at once
+  void Navigation::GetAgentRoutes(const std::vector<ActorId> &ids,
+                                  const std::vector<PathRequest> &requests,
+                                  std::vector<PathResult> &results) {
+    DEBUG_ASSERT(ids.size() == requests.size());
+
+    // check if all is ready
+    if (!_ready) {
+      results.assign(requests.size(), PathResult());
+      return;
     }
 
-    // get the points
+    // get current filter from each agent, agents not found get no path; the
+    // paths are found outside the lock
+    std::vector<dtQueryFilter> agent_filters(ids.size());
+    std::vector<const dtQueryFilter *> filters(ids.size(), nullptr);
     {
-      // critical section, force single thread running this
       std::lock_guard<std::mutex> lock(_mutex);
-      _nav_query->findStraightPath(start_pos, end_pos2, polys, num_polys,
-      straight_path, straight_path_flags,
-      straight_path_polys, &num_straight_path, MAX_POLYS, straight_path_options);
-    }
-
-    // copy the path to the output buffer
-    path.clear();
-    path.reserve(static_cast<unsigned long>(num_straight_path));
-    unsigned char area_type;
-    for (int i = 0, j = 0; j < num_straight_path; i += 3, ++j) {
-      // save coordinate for Unreal axis (x, z, y)
-      path.emplace_back(straight_path[i], straight_path[i + 2], straight_path[i + 1]);
-      // save area type
-      {
-        // critical section, force single thread running this
-        std::lock_guard<std::mutex> lock(_mutex);
-        _nav_mesh->getPolyArea(straight_path_polys[j], &area_type);
+      for (size_t i = 0u; i < ids.size(); ++i) {
+        if (CopyWalkerFilter(ids[i], agent_filters[i])) {
+          filters[i] = &agent_filters[i];
+        }
       }
-      area.emplace_back(area_type);
     }
 
-    return true;
+    FindPaths(requests, filters, results);
   }
 
   // create a new walker in crowd
@@ -471,7 +913,7 @@ namespace nav {
       return false;
     }
 
-    DEBUG_ASSERT(_crowd != nullptr);
+    DEBUG_ASSERT(!_crowds.empty());
 
     // set parameters
     memset(&params, 0, sizeof(params));
@@ -504,18 +946,29 @@ namespace nav {
     {
       // critical section, force single thread running this
       std::lock_guard<std::mutex> lock(_mutex);
-      index = _crowd->addAgent(point_from, &params);
+
+      // make room in the crowds for one walker more
+      const int agents = static_cast<int>(_mapped_walkers_id.size()) + 1 + CROWD_VEHICLE_AGENTS;
+      if (agents > _agents_per_crowd && !ResizeCrowds(std::max(agents, 2 * _agents_per_crowd))) {
+        logging::log("Nav: failed to resize the crowds");
+        return false;
+      }
+
+      index = AddCrowdAgent(GetRegion(point_from), point_from, &params);
       if (index == -1) {
         return false;
       }
-    }
 
-    // save the id
-    _mapped_walkers_id[id] = index;
-    _mapped_by_index[index] = id;
+      // save the id
+      _mapped_walkers_id[id] = index;
+      _mapped_by_index[index] = id;
+
+      // init yaw
+      _yaw_walkers[id] = 0.0f;
 
-    // init yaw
-    _yaw_walkers[id] = 0.0f;
+      // vehicles around it are added from now on
+      _walker_cells.insert(GetWalkerCell(from.x, from.y));
+    }
 
     // add walker for the route planning
     _walker_manager.AddWalker(id);
@@ -533,7 +986,7 @@ namespace nav {
       return false;
     }
 
-    DEBUG_ASSERT(_crowd != nullptr);
+    DEBUG_ASSERT(!_crowds.empty());
 
     // get the bounding box extension plus some space around
     float marge = 0.8f;
@@ -556,41 +1009,17 @@ namespace nav {
     box_corner3 += vehicle.transform.location;
     box_corner4 += vehicle.transform.location;
 
-    // check if this actor exists
-    auto it = _mapped_vehicles_id.find(vehicle.id);
-    if (it != _mapped_vehicles_id.end()) {
-      // get the index found
-      int index = it->second;
-      if (index != -1) {
-        // get the agent
-        dtCrowdAgent *agent;
-        {
-          // critical section, force single thread running this
-          std::lock_guard<std::mutex> lock(_mutex);
-          agent = _crowd->getEditableAgent(index);
-        }
-        if (agent) {
-          // update its position
-          agent->npos[0] = vehicle.transform.location.x;
-          agent->npos[1] = vehicle.transform.location.z;
-          agent->npos[2] = vehicle.transform.location.y;
-          // update its oriented bounding box
-          agent->params.obb[0]  = box_corner1.x;
-          agent->params.obb[1]  = box_corner1.z;
-          agent->params.obb[2]  = box_corner1.y;
-          agent->params.obb[3]  = box_corner2.x;
-          agent->params.obb[4]  = box_corner2.z;
-          agent->params.obb[5]  = box_corner2.y;
-          agent->params.obb[6]  = box_corner3.x;
-          agent->params.obb[7]  = box_corner3.z;
-          agent->params.obb[8]  = box_corner3.y;
-          agent->params.obb[9]  = box_corner4.x;
-          agent->params.obb[10] = box_corner4.z;
-          agent->params.obb[11] = box_corner4.y;
-        }
-        return true;
-      }
-    }
+    // oriented bounding box
+    // data: [x][y][z] [x][y][z] [x][y][z] [x][y][z]
+    const float obb[12] = { box_corner1.x, box_corner1.z, box_corner1.y,
+                            box_corner2.x, box_corner2.z, box_corner2.y,
+                            box_corner3.x, box_corner3.z, box_corner3.y,
+                            box_corner4.x, box_corner4.z, box_corner4.y };
+
+    // from Unreal coordinates (vertical is Z) to Recast coordinates (vertical is Y)
+    float point_from[3] = { vehicle.transform.location.x,
+                            vehicle.transform.location.z,
+                            vehicle.transform.location.y };
 
     // set parameters
     memset(&params, 0, sizeof(params));
@@ -607,47 +1036,80 @@ namespace nav {
     params.updateFlags |= DT_CROWD_SEPARATION;
 
     // update its oriented bounding box
-    // data: [x][y][z] [x][y][z] [x][y][z] [x][y][z]
     params.useObb = true;
-    params.obb[0]  = box_corner1.x;
-    params.obb[1]  = box_corner1.z;
-    params.obb[2]  = box_corner1.y;
-    params.obb[3]  = box_corner2.x;
-    params.obb[4]  = box_corner2.z;
-    params.obb[5]  = box_corner2.y;
-    params.obb[6]  = box_corner3.x;
-    params.obb[7]  = box_corner3.z;
-    params.obb[8]  = box_corner3.y;
-    params.obb[9]  = box_corner4.x;
-    params.obb[10] = box_corner4.z;
-    params.obb[11] = box_corner4.y;
+    memcpy(params.obb, obb, sizeof(obb));
+
+    // the vehicle has an agent in its region and in the regions near enough
+    // for their walkers to meet it
+    const int own_region = GetRegion(point_from);
+    std::vector<int> regions;
+    GetRegions(point_from, REGION_VEHICLE_MARGIN, regions);
+
+    // critical section, force single thread running this
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // remove the agents of the regions left behind
+    std::vector<int> &agents = _mapped_vehicle_agents[vehicle.id];
+    for (auto it = agents.begin(); it != agents.end();) {
+      if (std::find(regions.begin(), regions.end(), *it / _agents_per_crowd) == regions.end()) {
+        RemoveCrowdAgent(*it);
+        _mapped_by_index.erase(*it);
+        it = agents.erase(it);
+      } else {
+        ++it;
+      }
+    }
 
-    // from Unreal coordinates (vertical is Z) to Recast coordinates (vertical is Y)
-    float point_from[3] = { vehicle.transform.location.x,
-                            vehicle.transform.location.z,
-                            vehicle.transform.location.y };
+    // update the agents found and add the missing ones
+    int own_index = -1;
+    for (int region : regions) {
+      auto found = std::find_if(agents.begin(), agents.end(), [this, region](int index) {
+        return index / _agents_per_crowd == region;
+      });
+      int index;
+      if (found != agents.end()) {
+        index = *found;
+        // get the agent
+        dtCrowdAgent *agent = GetEditableAgent(index);
+        if (agent) {
+          // update its position
+          dtVcopy(agent->npos, point_from);
+          // update its oriented bounding box
+          memcpy(agent->params.obb, obb, sizeof(obb));
+        }
+      } else {
+        // add vehicle
+        index = AddCrowdAgent(region, point_from, &params);
+        if (index == -1) {
+          if (region == own_region) {
+            logging::log("Vehicle agent not added to the crowd by some problem!");
+          }
+          continue;
+        }
 
-    // add walker
-    int index;
-    {
-      // critical section, force single thread running this
-      std::lock_guard<std::mutex> lock(_mutex);
-      index = _crowd->addAgent(point_from, &params);
-      if (index == -1) {
-        logging::log("Vehicle agent not added to the crowd by some problem!");
-        return false;
-      }
+        // mark as valid
+        dtCrowdAgent *agent = GetEditableAgent(index);
+        if (agent) {
+          agent->state = DT_CROWDAGENT_STATE_WALKING;
+        }
 
-      // mark as valid
-      dtCrowdAgent *agent = _crowd->getEditableAgent(index);
-      if (agent) {
-        agent->state = DT_CROWDAGENT_STATE_WALKING;
+        // save the index
+        agents.push_back(index);
+        _mapped_by_index[index] = vehicle.id;
+      }
+      if (region == own_region) {
+        own_index = index;
       }
     }
 
-    // save the id
-    _mapped_vehicles_id[vehicle.id] = index;
-    _mapped_by_index[index] = vehicle.id;
+    if (agents.empty()) {
+      _mapped_vehicle_agents.erase(vehicle.id);
+      _mapped_vehicles_id.erase(vehicle.id);
+      return false;
+    }
+
+    // save the id, the agent of its own region represents the vehicle
+    _mapped_vehicles_id[vehicle.id] = (own_index != -1) ? own_index : agents.front();
 
     return true;
   }
@@ -660,37 +1122,55 @@ namespace nav {
       return false;
     }
 
-    DEBUG_ASSERT(_crowd != nullptr);
+    DEBUG_ASSERT(!_crowds.empty());
 
-    // get the internal walker index
-    auto it = _mapped_walkers_id.find(id);
-    if (it != _mapped_walkers_id.end()) {
-      // remove from crowd
-      {
-        // critical section, force single thread running this
-        std::lock_guard<std::mutex> lock(_mutex);
-        _crowd->removeAgent(it->second);
+    // get the internal walker index, it changes when the walker moves to
+    // another crowd so it is read holding the lock
+    bool is_walker = false;
+    {
+      // critical section, force single thread running this
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto it = _mapped_walkers_id.find(id);
+      if (it != _mapped_walkers_id.end()) {
+        int index = it->second;
+        // remove from crowd, and its mirrors from the crowds near
+        RemoveCrowdAgent(index);
+        auto mirrors = _mapped_walker_mirrors.find(id);
+        if (mirrors != _mapped_walker_mirrors.end()) {
+          for (int mirror : mirrors->second) {
+            RemoveCrowdAgent(mirror);
+          }
+          _mapped_walker_mirrors.erase(mirrors);
+        }
+        // remove from mapping
+        _mapped_walkers_id.erase(it);
+        _mapped_by_index.erase(index);
+        _walkers_blocked_position.erase(index);
+        is_walker = true;
       }
+    }
+    if (is_walker) {
       _walker_manager.RemoveWalker(id);
-      // remove from mapping
-      _mapped_walkers_id.erase(it);
-      _mapped_by_index.erase(it->second);
-
       return true;
     }
 
     // get the internal vehicle index
-    it = _mapped_vehicles_id.find(id);
+    // critical section, force single thread running this
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _mapped_vehicles_id.find(id);
     if (it != _mapped_vehicles_id.end()) {
-      // remove from crowd
-      {
-        // critical section, force single thread running this
-        std::lock_guard<std::mutex> lock(_mutex);
-        _crowd->removeAgent(it->second);
+      // remove all its agents from the crowds
+      auto agents = _mapped_vehicle_agents.find(id);
+      if (agents != _mapped_vehicle_agents.end()) {
+        for (int index : agents->second) {
+          RemoveCrowdAgent(index);
+          _mapped_by_index.erase(index);
+        }
+        _mapped_vehicle_agents.erase(agents);
       }
       // remove from mapping
       _mapped_vehicles_id.erase(it);
-      _mapped_by_index.erase(it->second);
+      _tracked_vehicles.erase(id);
 
       return true;
     }
@@ -698,25 +1178,45 @@ namespace nav {
     return false;
   }
 
-  // add/update/delete vehicles in crowd
-  bool Navigation::UpdateVehicles(std::vector<VehicleCollisionInfo> vehicles) {
-    std::unordered_set<carla::rpc::ActorId> updated;
+  // add/update/delete vehicles in crowd, only the vehicles that were added,
+  // moved or are gone change the crowd
+  bool Navigation::UpdateVehicles(const std::vector<VehicleCollisionInfo> &vehicles) {
+    ++_vehicles_update;
 
-    // add all current mapped vehicles in the set
-    for (auto &&entry : _mapped_vehicles_id) {
-      updated.insert(entry.first);
-    }
-
-    // add all vehicles (if already exists, it gets updated only)
+    // add or update the vehicles
     for (auto &&entry : vehicles) {
+      auto it = _tracked_vehicles.find(entry.id);
+      if (it != _tracked_vehicles.end()) {
+        it->second.seen = _vehicles_update;
+        // skip the vehicles that did not move
+        const carla::geom::Transform &previous = it->second.transform;
+        const float distance = carla::geom::Math::DistanceSquared(previous.location, entry.transform.location);
+        const float yaw = std::fabs(std::remainder(previous.rotation.yaw - entry.transform.rotation.yaw, 360.0f));
+        if (distance < VEHICLE_MOVED_DISTANCE * VEHICLE_MOVED_DISTANCE && yaw < VEHICLE_MOVED_YAW) {
+          continue;
+        }
+      }
       // try to add or update the vehicle
-      AddOrUpdateVehicle(entry);
-      // mark as updated (to avoid removing it in this frame)
-      updated.erase(entry.id);
+      VehicleCollisionInfo vehicle = entry;
+      if (AddOrUpdateVehicle(vehicle)) {
+        _tracked_vehicles[entry.id] = TrackedVehicle{ entry.transform, _vehicles_update };
+      }
     }
 
-    // remove all vehicles not updated (they don't exist in this frame)
-    for (auto &&entry : updated) {
+    // remove all vehicles not updated (they don't exist or are far from the
+    // walkers in this frame)
+    std::vector<ActorId> removed;
+    {
+      // critical section, force single thread running this
+      std::lock_guard<std::mutex> lock(_mutex);
+      for (auto &&entry : _mapped_vehicles_id) {
+        auto it = _tracked_vehicles.find(entry.first);
+        if (it == _tracked_vehicles.end() || it->second.seen != _vehicles_update) {
+          removed.push_back(entry.first);
+        }
+      }
+    }
+    for (auto &&entry : removed) {
       // remove agent not updated
       RemoveAgent(entry);
     }
@@ -724,6 +1224,48 @@ namespace nav {
     return true;
   }
 
+  // return the key of the cell of the walkers grid holding a location
+  uint64_t Navigation::GetWalkerCell(float x, float y) const {
+    const int32_t cell_x = static_cast<int32_t>(std::floor(x / _vehicle_radius));
+    const int32_t cell_y = static_cast<int32_t>(std::floor(y / _vehicle_radius));
+    return (static_cast<uint64_t>(static_cast<uint32_t>(cell_x)) << 32u) | static_cast<uint32_t>(cell_y);
+  }
+
+  // fill the walkers grid with the current position of the walkers
+  void Navigation::UpdateWalkerCells() {
+    // critical section, force single thread running this
+    std::lock_guard<std::mutex> lock(_mutex);
+    _walker_cells.clear();
+    for (auto &&entry : _mapped_walkers_id) {
+      const dtCrowdAgent *agent = GetAgent(entry.second);
+      if (agent && agent->active) {
+        // from Recast coordinates to Unreal coordinates
+        _walker_cells.insert(GetWalkerCell(agent->npos[0], agent->npos[2]));
+      }
+    }
+  }
+
+  // return if a location is inside the radius around some walker, checking
+  // its cell and the neighbour ones
+  bool Navigation::IsNearWalkers(const carla::geom::Location &location) const {
+    for (int i = -1; i <= 1; ++i) {
+      for (int j = -1; j <= 1; ++j) {
+        const float x = location.x + static_cast<float>(i) * _vehicle_radius;
+        const float y = location.y + static_cast<float>(j) * _vehicle_radius;
+        if (_walker_cells.find(GetWalkerCell(x, y)) != _walker_cells.end()) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // set the radius around the walkers where the vehicles are added to the crowd
+  void Navigation::SetVehicleRadius(float radius) {
+    _vehicle_radius = std::max(radius, 1.0f);
+    UpdateWalkerCells();
+  }
+
   // set new max speed
   bool Navigation::SetWalkerMaxSpeed(ActorId id, float max_speed) {
 
@@ -732,7 +1274,10 @@ namespace nav {
       return false;
     }
 
-    DEBUG_ASSERT(_crowd != nullptr);
+    DEBUG_ASSERT(!_crowds.empty());
+
+    // critical section, force single thread running this
+    std::lock_guard<std::mutex> lock(_mutex);
 
     // get the internal index
     auto it = _mapped_walkers_id.find(id);
@@ -741,14 +1286,10 @@ namespace nav {
     }
 
     // get the agent
-    {
-      // critical section, force single thread running this
-      std::lock_guard<std::mutex> lock(_mutex);
-      dtCrowdAgent *agent = _crowd->getEditableAgent(it->second);
-      if (agent) {
-        agent->params.maxSpeed = max_speed;
-        return true;
-      }
+    dtCrowdAgent *agent = GetEditableAgent(it->second);
+    if (agent) {
+      agent->params.maxSpeed = max_speed;
+      return true;
     }
 
     return false;
@@ -762,10 +1303,12 @@ namespace nav {
       return false;
     }
 
-    // get the internal index
-    auto it = _mapped_walkers_id.find(id);
-    if (it == _mapped_walkers_id.end()) {
-      return false;
+    // check the walker exists, the route is found outside the lock
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (_mapped_walkers_id.find(id) == _mapped_walkers_id.end()) {
+        return false;
+      }
     }
 
     return _walker_manager.SetWalkerRoute(id, to);
@@ -779,13 +1322,23 @@ namespace nav {
       return false;
     }
 
-    // get the internal index
+    DEBUG_ASSERT(!_crowds.empty());
+
+    float point_to[3] = { to.x, to.z, to.y };
+    const dtPolyRef target_ref = GetTargetPoly(point_to);
+    if (!target_ref) {
+      return false;
+    }
+
+    // critical section, force single thread running this; the walker can
+    // move to another crowd, so its index is read in the same section
+    std::lock_guard<std::mutex> lock(_mutex);
     auto it = _mapped_walkers_id.find(id);
     if (it == _mapped_walkers_id.end()) {
       return false;
     }
-
-    return SetWalkerDirectTargetIndex(it->second, to);
+    dtCrowd *crowd = GetAgentCrowd(it->second);
+    return crowd && crowd->requestMoveTarget(it->second % _agents_per_crowd, target_ref, point_to);
   }
 
   // set a new target point to go directly without events
@@ -796,49 +1349,72 @@ namespace nav {
       return false;
     }
 
-    DEBUG_ASSERT(_crowd != nullptr);
-    DEBUG_ASSERT(_nav_query != nullptr);
+    DEBUG_ASSERT(!_crowds.empty());
 
     if (index == -1) {
       return false;
     }
 
-    // set target position
     float point_to[3] = { to.x, to.z, to.y };
-    float nearest[3];
+    const dtPolyRef target_ref = GetTargetPoly(point_to);
+    if (!target_ref) {
+      return false;
+    }
+
     bool res;
     {
       // critical section, force single thread running this
       std::lock_guard<std::mutex> lock(_mutex);
-      const dtQueryFilter *filter = _crowd->getFilter(0);
-      dtPolyRef target_ref;
-      _nav_query->findNearestPoly(point_to, _crowd->getQueryHalfExtents(), filter, &target_ref, nearest);
-      if (!target_ref) {
-        return false;
-      }
-
-      res = _crowd->requestMoveTarget(index, target_ref, point_to);
+      dtCrowd *crowd = GetAgentCrowd(index);
+      res = crowd && crowd->requestMoveTarget(index % _agents_per_crowd, target_ref, point_to);
     }
 
     return res;
   }
 
+  // find the polygon nearest to a target point, the filters and extents of
+  // the crowd do not change once created
+  dtPolyRef Navigation::GetTargetPoly(const float *point) const {
+    float nearest[3];
+    const dtQueryFilter *filter = _crowds.front()->getFilter(0);
+    dtPolyRef target_ref = 0;
+    dtNavMeshQuery *query = AcquireQuery();
+    if (query != nullptr) {
+      query->findNearestPoly(point, _crowds.front()->getQueryHalfExtents(), filter, &target_ref, nearest);
+    }
+    ReleaseQuery(query);
+    return target_ref;
+  }
+
   // update all walkers in crowd
   void Navigation::UpdateCrowd(const client::detail::EpisodeState &state) {
+    UpdateCrowd(state.GetTimestamp().delta_seconds);
+  }
+
+  // update all walkers in crowd for a step of this time
+  void Navigation::UpdateCrowd(double delta_seconds) {
 
     // check if all is ready
     if (!_ready) {
       return;
     }
 
-    DEBUG_ASSERT(_crowd != nullptr);
+    DEBUG_ASSERT(!_crowds.empty());
 
     // update crowd agents
-    _delta_seconds = state.GetTimestamp().delta_seconds;
+    _delta_seconds = delta_seconds;
     {
       // critical section, force single thread running this
       std::lock_guard<std::mutex> lock(_mutex);
-      _crowd->update(static_cast<float>(_delta_seconds), nullptr);
+      // each crowd only reads the navmesh and its own agents
+      const float crowd_delta_seconds = static_cast<float>(_delta_seconds);
+      ParallelFor(*_threads, _thread_count, _crowds.size(), 1u, [&](const size_t i) {
+        _crowds[i]->update(crowd_delta_seconds, nullptr);
+      });
+      if (_crowds.size() > 1u) {
+        HandOverWalkers();
+        UpdateWalkerMirrors();
+      }
     }
 
     // update the walkers route
@@ -847,22 +1423,18 @@ namespace nav {
     // update the time to check for blocked agents
     _time_to_unblock += _delta_seconds;
 
-    // check all active agents
+    // check all active agents, the routes of the blocked ones are found
+    // together at the end
     int total_unblocked = 0;
-    int total_agents;
-    {
-      // critical section, force single thread running this
-      std::lock_guard<std::mutex> lock(_mutex);
-      total_agents = _crowd->getAgentCount();
-    }
+    std::vector<ActorId> unblocked_ids;
+    std::vector<carla::geom::Location> unblocked_targets;
+    const int total_agents = static_cast<int>(_crowds.size()) * _agents_per_crowd;
     const dtCrowdAgent *ag;
+    // critical section, the agents and their mapping can change
+    std::unique_lock<std::mutex> lock(_mutex);
     for (int i = 0; i < total_agents; ++i) {
-      {
-        // critical section, force single thread running this
-        std::lock_guard<std::mutex> lock(_mutex);
-        ag = _crowd->getAgent(i);
-      }
-      if (!ag->active || ag->paused) {
+      ag = GetAgent(i);
+      if (!ag->active || ag->paused || IsWalkerMirror(ag)) {
         continue;
       }
 
@@ -899,16 +1471,24 @@ namespace nav {
             // set a new random target
             carla::geom::Location location;
             GetRandomLocation(location, nullptr);
-            _walker_manager.SetWalkerRoute(_mapped_by_index[i], location);
+            unblocked_ids.push_back(_mapped_by_index[i]);
+            unblocked_targets.push_back(location);
           }
         }
       }
     }
+    lock.unlock();
+    if (!unblocked_ids.empty()) {
+      _walker_manager.SetWalkerRoutes(unblocked_ids, unblocked_targets);
+    }
 
     // check for resetting time
     if (_time_to_unblock >= AGENT_UNBLOCK_TIME) {
       _time_to_unblock = 0.0f;
     }
+
+    // cells of the walkers, for the vehicles to add in the next update
+    UpdateWalkerCells();
   }
 
   // get the walker current transform
@@ -919,7 +1499,10 @@ namespace nav {
       return false;
     }
 
-    DEBUG_ASSERT(_crowd != nullptr);
+    DEBUG_ASSERT(!_crowds.empty());
+
+    // critical section, force single thread running this
+    std::lock_guard<std::mutex> lock(_mutex);
 
     // get the internal index
     auto it = _mapped_walkers_id.find(id);
@@ -934,12 +1517,7 @@ namespace nav {
     }
 
     // get the walker
-    const dtCrowdAgent *agent;
-    {
-      // critical section, force single thread running this
-      std::lock_guard<std::mutex> lock(_mutex);
-      agent = _crowd->getAgent(index);
-    }
+    const dtCrowdAgent *agent = GetAgent(index);
 
     if (!agent->active) {
       return false;
@@ -983,7 +1561,10 @@ namespace nav {
       return false;
     }
 
-    DEBUG_ASSERT(_crowd != nullptr);
+    DEBUG_ASSERT(!_crowds.empty());
+
+    // critical section, force single thread running this
+    std::lock_guard<std::mutex> lock(_mutex);
 
     // get the internal index
     auto it = _mapped_walkers_id.find(id);
@@ -998,12 +1579,7 @@ namespace nav {
     }
 
     // get the walker
-    const dtCrowdAgent *agent;
-    {
-      // critical section, force single thread running this
-      std::lock_guard<std::mutex> lock(_mutex);
-      agent = _crowd->getAgent(index);
-    }
+    const dtCrowdAgent *agent = GetAgent(index);
 
     if (!agent->active) {
       return false;
@@ -1024,7 +1600,10 @@ namespace nav {
       return 0.0f;
     }
 
-    DEBUG_ASSERT(_crowd != nullptr);
+    DEBUG_ASSERT(!_crowds.empty());
+
+    // critical section, force single thread running this
+    std::lock_guard<std::mutex> lock(_mutex);
 
     // get the internal index
     auto it = _mapped_walkers_id.find(id);
@@ -1039,12 +1618,7 @@ namespace nav {
     }
 
     // get the walker
-    const dtCrowdAgent *agent;
-    {
-      // critical section, force single thread running this
-      std::lock_guard<std::mutex> lock(_mutex);
-      agent = _crowd->getAgent(index);
-    }
+    const dtCrowdAgent *agent = GetAgent(index);
 
     return sqrt(agent->vel[0] * agent->vel[0] + agent->vel[1] * agent->vel[1] + agent->vel[2] *
     agent->vel[2]);
@@ -1058,8 +1632,6 @@ namespace nav {
       return false;
     }
 
-    DEBUG_ASSERT(_nav_query != nullptr);
-
     // filter
     dtQueryFilter filter2;
     if (filter == nullptr) {
@@ -1072,12 +1644,14 @@ namespace nav {
     dtPolyRef random_ref { 0 };
     float point[3] { 0.0f, 0.0f, 0.0f };
     int rounds = 10;
+    dtNavMeshQuery *query = AcquireQuery();
+    if (query == nullptr) {
+      return false;
+    }
     {
       dtStatus status;
-      // critical section, force single thread running this
-      std::lock_guard<std::mutex> lock(_mutex);
       do {
-        status = _nav_query->findRandomPoint(filter, frand, &random_ref, point);
+        status = query->findRandomPoint(filter, frand, &random_ref, point);
         // set the location in Unreal coords
         if (status == DT_SUCCESS) {
           location.x = point[0];
@@ -1087,6 +1661,7 @@ namespace nav {
         --rounds;
       } while (status != DT_SUCCESS && rounds > 0);
     }
+    ReleaseQuery(query);
 
     return (rounds > 0);
   }
@@ -1095,12 +1670,7 @@ namespace nav {
   void Navigation::SetAgentFilter(int agent_index, int filter_index)
   {
     // get the walker
-    dtCrowdAgent *agent;
-    {
-      // critical section, force single thread running this
-      std::lock_guard<std::mutex> lock(_mutex);
-      agent = _crowd->getEditableAgent(agent_index);
-    }
+    dtCrowdAgent *agent = GetEditableAgent(agent_index);
     agent->params.queryFilterType = static_cast<unsigned char>(filter_index);
   }
 
@@ -1120,7 +1690,10 @@ namespace nav {
       return;
     }
 
-    DEBUG_ASSERT(_crowd != nullptr);
+    DEBUG_ASSERT(!_crowds.empty());
+
+    // critical section, force single thread running this
+    std::lock_guard<std::mutex> lock(_mutex);
 
     // get the internal index
     auto it = _mapped_walkers_id.find(id);
@@ -1135,18 +1708,18 @@ namespace nav {
     }
 
     // get the walker
-    dtCrowdAgent *agent;
-    {
-      // critical section, force single thread running this
-      std::lock_guard<std::mutex> lock(_mutex);
-      agent = _crowd->getEditableAgent(index);
-    }
+    dtCrowdAgent *agent = GetEditableAgent(index);
 
     // mark
     agent->paused = pause;
   }
 
   bool Navigation::HasVehicleNear(ActorId id, float distance, carla::geom::Location direction) {
+    float dir[3] = { direction.x, direction.z, direction.y };
+
+    // critical section, force single thread running this
+    std::lock_guard<std::mutex> lock(_mutex);
+
     // get the internal index (walker or vehicle)
     auto it = _mapped_walkers_id.find(id);
     if (it == _mapped_walkers_id.end()) {
@@ -1156,18 +1729,15 @@ namespace nav {
       }
     }
 
-    float dir[3] = { direction.x, direction.z, direction.y };
-    bool result;
-    {
-      // critical section, force single thread running this
-      std::lock_guard<std::mutex> lock(_mutex);
-      result = _crowd->hasVehicleNear(it->second, distance * distance, dir, false);
-    }
-    return result;
+    dtCrowd *crowd = GetAgentCrowd(it->second);
+    return crowd && crowd->hasVehicleNear(it->second % _agents_per_crowd, distance * distance, dir, false);
   }
 
   /// make agent look at some location
   bool Navigation::SetWalkerLookAt(ActorId id, carla::geom::Location location) {
+    // critical section, force single thread running this
+    std::lock_guard<std::mutex> lock(_mutex);
+
     // get the internal index (walker or vehicle)
     auto it = _mapped_walkers_id.find(id);
     if (it == _mapped_walkers_id.end()) {
@@ -1177,12 +1747,7 @@ namespace nav {
       }
     }
 
-    dtCrowdAgent *agent;
-    {
-      // critical section, force single thread running this
-      std::lock_guard<std::mutex> lock(_mutex);
-      agent = _crowd->getEditableAgent(it->second);
-    }
+    dtCrowdAgent *agent = GetEditableAgent(it->second);
 
     // get the position
     float x = (location.x - agent->npos[0]) * 0.0001f;
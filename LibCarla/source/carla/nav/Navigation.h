@@ -11,6 +11,7 @@
 #include "carla/geom/BoundingBox.h"
 #include "carla/geom/Location.h"
 #include "carla/geom/Transform.h"
+#include "carla/nav/PathCache.h"
 #include "carla/nav/WalkerManager.h"
 #include "carla/rpc/ActorId.h"
 #include <recast/Recast.h>
@@ -20,7 +21,16 @@
 #include <recast/DetourNavMeshQuery.h>
 #include <recast/DetourCommon.h>
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
 namespace carla {
+
+  class ThreadPool;
+
 namespace nav {
 
   enum NavAreas {
@@ -50,6 +60,19 @@ namespace nav {
     carla::geom::BoundingBox bounding;
   };
 
+  /// start and end points of a path to find
+  struct PathRequest {
+    carla::geom::Location from;
+    carla::geom::Location to;
+  };
+
+  /// path found for a PathRequest
+  struct PathResult {
+    bool found { false };
+    std::vector<carla::geom::Location> path;
+    std::vector<unsigned char> area;
+  };
+
   /// Manage the pedestrians navigation, using the Recast & Detour library for low level calculations.
   ///
   /// This class gets the binary content of the map from the server, which is required for the path finding.
@@ -70,19 +93,35 @@ namespace nav {
     std::vector<carla::geom::Location> &path, std::vector<unsigned char> &area);
     bool GetAgentRoute(ActorId id, carla::geom::Location from, carla::geom::Location to,
     std::vector<carla::geom::Location> &path, std::vector<unsigned char> &area);
+    /// return the paths for many start and end points at once, found in parallel
+    void GetPaths(const std::vector<PathRequest> &requests, dtQueryFilter * filter,
+    std::vector<PathResult> &results);
+    /// return the routes of many agents at once, found in parallel
+    void GetAgentRoutes(const std::vector<ActorId> &ids, const std::vector<PathRequest> &requests,
+    std::vector<PathResult> &results);
 
     /// set the seed to use with random numbers
     void SetSeed(unsigned int seed);
-    /// create the crowd object
+    /// create the crowd object, one for each region of the navmesh
     void CreateCrowd(void);
+    /// split the navmesh in up to this number of regions, each one with its own
+    /// crowd updated in parallel (1 by default, a single crowd)
+    void SetCrowdPartitions(unsigned int partitions);
     /// create a new walker
     bool AddWalker(ActorId id, carla::geom::Location from);
     /// create a new vehicle in crowd to be avoided by walkers
     bool AddOrUpdateVehicle(VehicleCollisionInfo &vehicle);
     /// remove an agent
     bool RemoveAgent(ActorId id);
-    /// add/update/delete vehicles in crowd
-    bool UpdateVehicles(std::vector<VehicleCollisionInfo> vehicles);
+    /// add/update/delete vehicles in crowd, only the vehicles near walkers are
+    /// expected, the rest are removed
+    bool UpdateVehicles(const std::vector<VehicleCollisionInfo> &vehicles);
+    /// return if a location is inside the radius around some walker where the
+    /// vehicles are added to the crowd
+    bool IsNearWalkers(const carla::geom::Location &location) const;
+    /// set the radius around the walkers where the vehicles are added to the
+    /// crowd
+    void SetVehicleRadius(float radius);
     /// set new max speed
     bool SetWalkerMaxSpeed(ActorId id, float max_speed);
     /// set a new target point to go through a route with events
@@ -98,6 +137,8 @@ namespace nav {
     float GetWalkerSpeed(ActorId id);
     /// update all walkers in crowd
     void UpdateCrowd(const client::detail::EpisodeState &state);
+    /// update all walkers in crowd for a step of this time
+    void UpdateCrowd(double delta_seconds);
     /// get a random location for navigation
     bool GetRandomLocation(carla::geom::Location &location, dtQueryFilter * filter = nullptr) const;
     /// set the probability that an agent could cross the roads in its path following
@@ -109,7 +150,10 @@ namespace nav {
     /// make agent look at some location
     bool SetWalkerLookAt(ActorId id, carla::geom::Location location);
 
-    dtCrowd *GetCrowd() { return _crowd; };
+    /// return the crowd of the first region
+    dtCrowd *GetCrowd() { return _crowds.empty() ? nullptr : _crowds.front(); };
+    /// return the crowds of all the regions
+    const std::vector<dtCrowd *> &GetCrowds() const { return _crowds; };
 
     /// return the last delta seconds
     double GetDeltaSeconds() { return _delta_seconds; };
@@ -121,12 +165,48 @@ namespace nav {
     double _delta_seconds { 0.0 };
     /// meshes
     dtNavMesh *_nav_mesh { nullptr };
-    dtNavMeshQuery *_nav_query { nullptr };
-    /// crowd
-    dtCrowd *_crowd { nullptr };
+    /// queries over the navmesh not in use, a query can only be used by one
+    /// thread at a time
+    mutable std::vector<dtNavMeshQuery *> _free_queries;
+    mutable std::mutex _query_mutex;
+    /// queries taken from the pool and not returned yet; the navmesh is not
+    /// replaced until it is zero
+    mutable unsigned int _queries_in_use { 0u };
+    mutable std::condition_variable _query_released;
+    /// crowds, one for each region of the navmesh; the index of an agent
+    /// encodes its crowd and its index inside it
+    std::vector<dtCrowd *> _crowds;
+    /// agents each crowd has room for, grows with the number of walkers
+    int _agents_per_crowd { 1 };
+    unsigned int _partitions { 1u };
+    /// regions, as a grid over the horizontal bounds of the navmesh
+    int _region_columns { 1 };
+    int _region_rows { 1 };
+    float _region_origin[2] { 0.0f, 0.0f };
+    float _region_size[2] { 1.0f, 1.0f };
+    /// threads updating the crowds and finding the batches of paths
+    std::unique_ptr<ThreadPool> _threads;
+    size_t _thread_count { 1u };
     /// mapping Id
     std::unordered_map<ActorId, int> _mapped_walkers_id;
     std::unordered_map<ActorId, int> _mapped_vehicles_id;
+    /// all the agents of each vehicle, as vehicles near a border are also
+    /// added to the crowds of the neighbour regions
+    std::unordered_map<ActorId, std::vector<int>> _mapped_vehicle_agents;
+    /// the mirrors of each walker near a border in the crowds of the neighbour
+    /// regions, seen by their walkers but moved only with the walker
+    std::unordered_map<ActorId, std::vector<int>> _mapped_walker_mirrors;
+    /// transform of each vehicle in the crowd and the last update it was seen
+    struct TrackedVehicle {
+      carla::geom::Transform transform;
+      unsigned long seen;
+    };
+    std::unordered_map<ActorId, TrackedVehicle> _tracked_vehicles;
+    unsigned long _vehicles_update { 0u };
+    /// cells of side _vehicle_radius holding some walker, the vehicles in
+    /// these cells and their neighbours are added to the crowd
+    float _vehicle_radius { 30.0f };
+    std::unordered_set<uint64_t> _walker_cells;
     // mapping by index also
     std::unordered_map<int, ActorId> _mapped_by_index;
     /// store walkers yaw angle from previous tick
@@ -138,12 +218,67 @@ namespace nav {
     /// walker manager for the route planning with events
     WalkerManager _walker_manager;
 
+    /// guards the changes to the crowds
     mutable std::mutex _mutex;
 
+    /// corridors already found, forgotten when the navmesh changes
+    mutable PathCache _path_cache;
+
     float _probability_crossing { 0.0f };
 
     /// assign a filter index to an agent
     void SetAgentFilter(int agent_index, int filter_index);
+
+    /// free the crowds and forget the agents in them
+    void FreeCrowds();
+    /// return the crowd holding an agent
+    dtCrowd *GetAgentCrowd(int index) const;
+    /// return an agent
+    const dtCrowdAgent *GetAgent(int index) const;
+    dtCrowdAgent *GetEditableAgent(int index) const;
+    /// add an agent to the crowd of a region, return its index or -1
+    int AddCrowdAgent(int region, const float *pos, const dtCrowdAgentParams *params);
+    /// remove an agent from its crowd
+    void RemoveCrowdAgent(int index);
+    /// add a copy of an agent to the crowd of a region, return its index or -1
+    int CopyCrowdAgent(int region, const dtCrowdAgent *agent);
+    /// create again the crowds with room for this number of agents each one,
+    /// keeping the agents; must be called holding _mutex
+    bool ResizeCrowds(int max_agents);
+    /// return the region holding a position (Recast coordinates)
+    int GetRegion(const float *pos) const;
+    /// return the regions touching a square of half side margin around a position
+    void GetRegions(const float *pos, float margin, std::vector<int> &regions) const;
+    /// return if a position is inside a region, enlarged by a margin
+    bool IsInRegion(const float *pos, int region, float margin) const;
+    /// return the key of the cell of the walkers grid holding a location
+    uint64_t GetWalkerCell(float x, float y) const;
+    /// fill the walkers grid with the current position of the walkers
+    void UpdateWalkerCells();
+    /// move the walkers that went past the border of their region to the crowd
+    /// of the region they are in
+    void HandOverWalkers();
+    /// add, move or remove the mirrors of the walkers near a border
+    void UpdateWalkerMirrors();
+
+    /// take a query from the pool, or create a new one if all are in use
+    dtNavMeshQuery *AcquireQuery() const;
+    /// return a query to the pool
+    void ReleaseQuery(dtNavMeshQuery *query) const;
+    /// wait until no query is in use, free them all and replace the navmesh
+    void ReplaceNavMesh(dtNavMesh *mesh);
+    /// find the polygon nearest to a target point in Recast coordinates, 0 if
+    /// there is none
+    dtPolyRef GetTargetPoly(const float *point) const;
+    /// find the path between two points using the given query
+    bool FindPath(dtNavMeshQuery *query, carla::geom::Location from, carla::geom::Location to,
+    const dtQueryFilter *filter, std::vector<carla::geom::Location> &path, std::vector<unsigned char> &area) const;
+    /// copy the filter of a walker, return false if the walker is not found;
+    /// must be called holding _mutex
+    bool CopyWalkerFilter(ActorId id, dtQueryFilter &filter) const;
+    /// find the paths of many requests across several threads
+    void FindPaths(const std::vector<PathRequest> &requests, const std::vector<const dtQueryFilter *> &filters,
+    std::vector<PathResult> &results) const;
   };
 
 } // namespace nav
@@ -0,0 +1,396 @@
+// Copyright (c) 2019 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#include "carla/nav/PathCache.h"
+
+#include <recast/DetourCommon.h>
+
+#include <boost/container_hash/hash.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <queue>
+
+namespace carla {
+namespace nav {
+
+  // these settings are the same than in Navigation
+  static const int    MAX_SEGMENT_POLYS = 256;
+  static const size_t CORRIDOR_CACHE_SIZE = 4096u;
+  static const size_t TILE_ROUTE_CACHE_SIZE = 1024u;
+  // routes through less tiles than this are searched directly
+  static const size_t MIN_TILES_TO_SPLIT = 3u;
+
+  // return the center of a polygon
+  static void GetPolyCenter(const dtMeshTile *tile, const dtPoly *poly, float *center) {
+    center[0] = center[1] = center[2] = 0.0f;
+    for (int i = 0; i < poly->vertCount; ++i) {
+      const float *vertex = &tile->verts[poly->verts[i] * 3];
+      center[0] += vertex[0];
+      center[1] += vertex[1];
+      center[2] += vertex[2];
+    }
+    const float count = static_cast<float>(std::max(1, static_cast<int>(poly->vertCount)));
+    center[0] /= count;
+    center[1] /= count;
+    center[2] /= count;
+  }
+
+  // add a segment to a corridor, without repeating the polygon they share
+  static void Append(std::vector<dtPolyRef> &corridor, const std::vector<dtPolyRef> &segment) {
+    auto begin = segment.begin();
+    if (!corridor.empty() && begin != segment.end() && *begin == corridor.back()) {
+      ++begin;
+    }
+    corridor.insert(corridor.end(), begin, segment.end());
+  }
+
+  // cut the loops of a corridor back to the first visit of each polygon
+  static void RemoveLoops(std::vector<dtPolyRef> &corridor) {
+    std::unordered_map<dtPolyRef, size_t> position;
+    std::vector<dtPolyRef> result;
+    result.reserve(corridor.size());
+    for (dtPolyRef ref : corridor) {
+      auto it = position.find(ref);
+      if (it == position.end()) {
+        position.emplace(ref, result.size());
+        result.push_back(ref);
+        continue;
+      }
+      for (size_t i = it->second + 1u; i < result.size(); ++i) {
+        position.erase(result[i]);
+      }
+      result.resize(it->second + 1u);
+    }
+    corridor = std::move(result);
+  }
+
+  PathCache::FilterSettings::FilterSettings(const dtQueryFilter *filter)
+    : include_flags(filter->getIncludeFlags()),
+      exclude_flags(filter->getExcludeFlags()),
+      hash(0u) {
+    boost::hash_combine(hash, include_flags);
+    boost::hash_combine(hash, exclude_flags);
+    for (int i = 0; i < DT_MAX_AREAS; ++i) {
+      area_cost[i] = filter->getAreaCost(i);
+      boost::hash_combine(hash, area_cost[i]);
+    }
+  }
+
+  // the hash only discards most of the different filters, the settings are
+  // compared in full
+  bool PathCache::FilterSettings::operator==(const FilterSettings &rhs) const {
+    return hash == rhs.hash &&
+           include_flags == rhs.include_flags &&
+           exclude_flags == rhs.exclude_flags &&
+           std::equal(area_cost, area_cost + DT_MAX_AREAS, rhs.area_cost);
+  }
+
+  size_t PathCache::KeyHash::operator()(const Key &key) const {
+    size_t seed = key.filter.hash;
+    boost::hash_combine(seed, key.from);
+    boost::hash_combine(seed, key.to);
+    return seed;
+  }
+
+  PathCache::PathCache()
+    : _corridors(CORRIDOR_CACHE_SIZE),
+      _tile_routes(TILE_ROUTE_CACHE_SIZE) {}
+
+  // forget all the corridors and build the graph of the tiles of a navmesh
+  void PathCache::Reset(const dtNavMesh *nav_mesh) {
+    // critical section, force single thread running this
+    std::lock_guard<std::mutex> lock(_mutex);
+    _corridors.Clear();
+    _tile_routes.Clear();
+    _tiles.clear();
+    _nav_mesh = nav_mesh;
+    if (_nav_mesh == nullptr) {
+      return;
+    }
+
+    // the portals of each tile are the links of its polygons to the polygons
+    // of other tiles
+    _tiles.resize(static_cast<size_t>(std::max(0, _nav_mesh->getMaxTiles())));
+    for (int i = 0; i < _nav_mesh->getMaxTiles(); ++i) {
+      const dtMeshTile *tile = _nav_mesh->getTile(i);
+      if (!tile || !tile->header) {
+        continue;
+      }
+      Tile &entry = _tiles[static_cast<size_t>(i)];
+      entry.valid = true;
+      entry.center[0] = (tile->header->bmin[0] + tile->header->bmax[0]) * 0.5f;
+      entry.center[1] = (tile->header->bmin[1] + tile->header->bmax[1]) * 0.5f;
+      entry.center[2] = (tile->header->bmin[2] + tile->header->bmax[2]) * 0.5f;
+
+      const dtPolyRef base = _nav_mesh->getPolyRefBase(tile);
+      for (int j = 0; j < tile->header->polyCount; ++j) {
+        const dtPoly *poly = &tile->polys[j];
+        for (unsigned int k = poly->firstLink; k != DT_NULL_LINK; k = tile->links[k].next) {
+          const dtPolyRef ref = tile->links[k].ref;
+          const dtMeshTile *neighbour_tile = nullptr;
+          const dtPoly *neighbour_poly = nullptr;
+          if (dtStatusFailed(_nav_mesh->getTileAndPolyByRef(ref, &neighbour_tile, &neighbour_poly)) ||
+              neighbour_tile == tile) {
+            continue;
+          }
+          unsigned int salt, neighbour_index, poly_index;
+          _nav_mesh->decodePolyId(ref, salt, neighbour_index, poly_index);
+
+          Portal portal;
+          portal.to_tile = static_cast<int>(neighbour_index);
+          portal.from = base | static_cast<dtPolyRef>(j);
+          portal.to = ref;
+          portal.from_mesh_tile = tile;
+          portal.from_poly = poly;
+          portal.to_mesh_tile = neighbour_tile;
+          portal.to_poly = neighbour_poly;
+          GetPolyCenter(tile, poly, portal.from_pos);
+          GetPolyCenter(neighbour_tile, neighbour_poly, portal.to_pos);
+          entry.portals.push_back(portal);
+        }
+      }
+      std::sort(entry.portals.begin(), entry.portals.end(), [](const Portal &a, const Portal &b) {
+        return a.to_tile < b.to_tile;
+      });
+    }
+  }
+
+  // return the tile holding a polygon
+  int PathCache::GetTile(dtPolyRef ref) const {
+    unsigned int salt, tile_index, poly_index;
+    _nav_mesh->decodePolyId(ref, salt, tile_index, poly_index);
+    if (tile_index >= _tiles.size() || !_tiles[tile_index].valid) {
+      return -1;
+    }
+    return static_cast<int>(tile_index);
+  }
+
+  // find the corridor of polygons between two polygons, like findPath
+  dtStatus PathCache::FindCorridor(
+      const dtNavMeshQuery *query,
+      dtPolyRef start_ref,
+      dtPolyRef end_ref,
+      const float *start_pos,
+      const float *end_pos,
+      const dtQueryFilter *filter,
+      dtPolyRef *path,
+      int *path_count,
+      int max_path) {
+    *path_count = 0;
+    if (_nav_mesh == nullptr || query == nullptr || filter == nullptr ||
+        !start_ref || !end_ref || max_path <= 0) {
+      return DT_FAILURE;
+    }
+    const FilterSettings filter_key(filter);
+
+    // corridor found before
+    std::vector<dtPolyRef> corridor;
+    bool found;
+    {
+      // critical section, force single thread running this
+      std::lock_guard<std::mutex> lock(_mutex);
+      found = _corridors.Find(Key{ start_ref, end_ref, filter_key }, corridor);
+    }
+
+    if (!found) {
+      // long searches go through the portals of the tiles in between
+      const int start_tile = GetTile(start_ref);
+      const int end_tile = GetTile(end_ref);
+      std::vector<int> route;
+      if (start_tile != -1 && end_tile != -1 &&
+          FindTileRoute(start_tile, end_tile, filter, filter_key, route) &&
+          route.size() >= MIN_TILES_TO_SPLIT) {
+        found = FindCorridorThroughTiles(query, route, start_ref, end_ref, start_pos, end_pos,
+            filter, filter_key, static_cast<size_t>(max_path), corridor);
+      }
+      // otherwise, or if the portals do not connect, a single search
+      if (!found) {
+        FindSegment(query, start_ref, end_ref, start_pos, end_pos, filter, filter_key, corridor);
+      }
+    }
+
+    // copy the corridor, partial if it does not fit
+    const size_t count = std::min(corridor.size(), static_cast<size_t>(max_path));
+    std::copy(corridor.begin(), corridor.begin() + static_cast<std::ptrdiff_t>(count), path);
+    *path_count = static_cast<int>(count);
+    return (count > 0u) ? DT_SUCCESS : DT_FAILURE;
+  }
+
+  // find the corridor between two polygons with a single search, return if it
+  // reaches the end polygon
+  bool PathCache::FindSegment(
+      const dtNavMeshQuery *query,
+      dtPolyRef start_ref,
+      dtPolyRef end_ref,
+      const float *start_pos,
+      const float *end_pos,
+      const dtQueryFilter *filter,
+      const FilterSettings &filter_key,
+      std::vector<dtPolyRef> &corridor) {
+    const Key key { start_ref, end_ref, filter_key };
+    bool found;
+    {
+      // critical section, force single thread running this
+      std::lock_guard<std::mutex> lock(_mutex);
+      found = _corridors.Find(key, corridor);
+    }
+
+    // search and save it only if it reaches the end polygon, a partial
+    // corridor may be completed by a later search
+    if (!found) {
+      corridor.resize(MAX_SEGMENT_POLYS);
+      int count = 0;
+      query->findPath(start_ref, end_ref, start_pos, end_pos, filter, corridor.data(), &count, MAX_SEGMENT_POLYS);
+      corridor.resize(static_cast<size_t>(std::max(0, count)));
+      if (corridor.empty() || corridor.back() != end_ref) {
+        return false;
+      }
+      // critical section, force single thread running this
+      std::lock_guard<std::mutex> lock(_mutex);
+      _corridors.Insert(key, corridor);
+    }
+
+    return true;
+  }
+
+  // find the tiles to go through between two tiles, with A* over the tiles
+  // connected by portals the filter lets through
+  bool PathCache::FindTileRoute(
+      int start_tile,
+      int end_tile,
+      const dtQueryFilter *filter,
+      const FilterSettings &filter_key,
+      std::vector<int> &route) {
+    const Key key { static_cast<uint64_t>(start_tile), static_cast<uint64_t>(end_tile), filter_key };
+    {
+      // critical section, force single thread running this
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (_tile_routes.Find(key, route)) {
+        return !route.empty();
+      }
+    }
+
+    const size_t size = _tiles.size();
+    std::vector<float> cost(size, std::numeric_limits<float>::max());
+    std::vector<int> parent(size, -1);
+    std::vector<bool> closed(size, false);
+    using Node = std::pair<float, int>;
+    std::priority_queue<Node, std::vector<Node>, std::greater<Node>> open;
+    const float *goal = _tiles[static_cast<size_t>(end_tile)].center;
+    cost[static_cast<size_t>(start_tile)] = 0.0f;
+    open.emplace(dtVdist(_tiles[static_cast<size_t>(start_tile)].center, goal), start_tile);
+    while (!open.empty()) {
+      const int tile = open.top().second;
+      open.pop();
+      if (tile == end_tile) {
+        break;
+      }
+      if (closed[static_cast<size_t>(tile)]) {
+        continue;
+      }
+      closed[static_cast<size_t>(tile)] = true;
+
+      // the portals are sorted by neighbour, relax each neighbour once
+      const Tile &current = _tiles[static_cast<size_t>(tile)];
+      int last = -1;
+      for (const Portal &portal : current.portals) {
+        const size_t next = static_cast<size_t>(portal.to_tile);
+        if (portal.to_tile == last || next >= size || closed[next] ||
+            !filter->passFilter(portal.from, portal.from_mesh_tile, portal.from_poly) ||
+            !filter->passFilter(portal.to, portal.to_mesh_tile, portal.to_poly)) {
+          continue;
+        }
+        last = portal.to_tile;
+        const float next_cost = cost[static_cast<size_t>(tile)] + dtVdist(current.center, _tiles[next].center);
+        if (next_cost < cost[next]) {
+          cost[next] = next_cost;
+          parent[next] = tile;
+          open.emplace(next_cost + dtVdist(_tiles[next].center, goal), portal.to_tile);
+        }
+      }
+    }
+
+    // build the route from the end, empty if not connected
+    route.clear();
+    if (start_tile == end_tile || parent[static_cast<size_t>(end_tile)] != -1) {
+      for (int tile = end_tile; tile != -1; tile = parent[static_cast<size_t>(tile)]) {
+        route.push_back(tile);
+      }
+      std::reverse(route.begin(), route.end());
+    }
+
+    // critical section, force single thread running this
+    std::lock_guard<std::mutex> lock(_mutex);
+    _tile_routes.Insert(key, route);
+    return !route.empty();
+  }
+
+  // find the corridor between two polygons through the portals of the tiles
+  // of a route, each piece between portals is cached on its own
+  bool PathCache::FindCorridorThroughTiles(
+      const dtNavMeshQuery *query,
+      const std::vector<int> &route,
+      dtPolyRef start_ref,
+      dtPolyRef end_ref,
+      const float *start_pos,
+      const float *end_pos,
+      const dtQueryFilter *filter,
+      const FilterSettings &filter_key,
+      size_t max_path,
+      std::vector<dtPolyRef> &corridor) {
+    corridor.clear();
+    std::vector<dtPolyRef> segment;
+    dtPolyRef from_ref = start_ref;
+    const float *from_pos = start_pos;
+    for (size_t i = 0u; i + 1u < route.size() && corridor.size() < max_path; ++i) {
+      // the portal to the next tile closest to the way from here to the end
+      const Portal *best = nullptr;
+      float best_cost = std::numeric_limits<float>::max();
+      for (const Portal &portal : _tiles[static_cast<size_t>(route[i])].portals) {
+        if (portal.to_tile != route[i + 1u] ||
+            !filter->passFilter(portal.from, portal.from_mesh_tile, portal.from_poly) ||
+            !filter->passFilter(portal.to, portal.to_mesh_tile, portal.to_poly)) {
+          continue;
+        }
+        const float portal_cost = dtVdist(from_pos, portal.from_pos) + dtVdist(portal.to_pos, end_pos);
+        if (portal_cost < best_cost) {
+          best_cost = portal_cost;
+          best = &portal;
+        }
+      }
+      if (best == nullptr ||
+          !FindSegment(query, from_ref, best->from, from_pos, best->from_pos, filter, filter_key, segment)) {
+        return false;
+      }
+      Append(corridor, segment);
+      corridor.push_back(best->to);
+      from_ref = best->to;
+      from_pos = best->to_pos;
+    }
+    if (corridor.size() < max_path) {
+      if (!FindSegment(query, from_ref, end_ref, from_pos, end_pos, filter, filter_key, segment)) {
+        return false;
+      }
+      Append(corridor, segment);
+    }
+
+    RemoveLoops(corridor);
+
+    // save it only if it is complete, otherwise return it truncated
+    if (corridor.empty() || corridor.size() > max_path || corridor.back() != end_ref) {
+      corridor.resize(std::min(corridor.size(), max_path));
+      return true;
+    }
+    // critical section, force single thread running this
+    std::lock_guard<std::mutex> lock(_mutex);
+    _corridors.Insert(Key{ start_ref, end_ref, filter_key }, corridor);
+    return true;
+  }
+
+} // namespace nav
+} // namespace carla
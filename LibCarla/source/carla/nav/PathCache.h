@@ -0,0 +1,185 @@
+// Copyright (c) 2019 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#pragma once
+
+#include "carla/NonCopyable.h"
+#include <recast/DetourNavMesh.h>
+#include <recast/DetourNavMeshQuery.h>
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace carla {
+namespace nav {
+
+  /// cache of the corridors of polygons found between two polygons of the
+  /// navmesh, and a graph of the tiles of the navmesh connected by the
+  /// polygons in their borders (portals); long searches are split at the
+  /// portals in short ones, that are cached too and shared by all the walkers
+  /// going through the same tiles
+  class PathCache : private NonCopyable {
+
+  public:
+
+    PathCache();
+
+    /// forget all the corridors and build the graph of the tiles of a navmesh
+    void Reset(const dtNavMesh *nav_mesh);
+
+    /// find the corridor of polygons between two polygons, like findPath
+    dtStatus FindCorridor(
+        const dtNavMeshQuery *query,
+        dtPolyRef start_ref,
+        dtPolyRef end_ref,
+        const float *start_pos,
+        const float *end_pos,
+        const dtQueryFilter *filter,
+        dtPolyRef *path,
+        int *path_count,
+        int max_path);
+
+  private:
+
+    /// least recently used cache
+    template <typename Key, typename Value, typename Hash>
+    class LruCache {
+    public:
+
+      explicit LruCache(size_t capacity) : _capacity(capacity) {}
+
+      bool Find(const Key &key, Value &value) {
+        auto it = _map.find(key);
+        if (it == _map.end()) {
+          return false;
+        }
+        _list.splice(_list.begin(), _list, it->second);
+        value = it->second->second;
+        return true;
+      }
+
+      void Insert(const Key &key, Value value) {
+        auto it = _map.find(key);
+        if (it != _map.end()) {
+          it->second->second = std::move(value);
+          _list.splice(_list.begin(), _list, it->second);
+          return;
+        }
+        _list.emplace_front(key, std::move(value));
+        _map.emplace(key, _list.begin());
+        if (_list.size() > _capacity) {
+          _map.erase(_list.back().first);
+          _list.pop_back();
+        }
+      }
+
+      void Clear() {
+        _map.clear();
+        _list.clear();
+      }
+
+    private:
+
+      using Entry = std::pair<Key, Value>;
+
+      size_t _capacity;
+      std::list<Entry> _list;
+      std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> _map;
+    };
+
+    /// settings of a filter, two searches with the same settings find the
+    /// same corridor
+    struct FilterSettings {
+      explicit FilterSettings(const dtQueryFilter *filter);
+      bool operator==(const FilterSettings &rhs) const;
+      unsigned short include_flags;
+      unsigned short exclude_flags;
+      float area_cost[DT_MAX_AREAS];
+      size_t hash;
+    };
+
+    /// two polygons or two tiles, searched with the same filter
+    struct Key {
+      uint64_t from;
+      uint64_t to;
+      FilterSettings filter;
+      bool operator==(const Key &rhs) const {
+        return from == rhs.from && to == rhs.to && filter == rhs.filter;
+      }
+    };
+
+    struct KeyHash {
+      size_t operator()(const Key &key) const;
+    };
+
+    /// polygon in the border of a tile linked to a polygon of another tile
+    struct Portal {
+      int to_tile;
+      dtPolyRef from;
+      dtPolyRef to;
+      const dtMeshTile *from_mesh_tile;
+      const dtPoly *from_poly;
+      const dtMeshTile *to_mesh_tile;
+      const dtPoly *to_poly;
+      float from_pos[3];
+      float to_pos[3];
+    };
+
+    /// tile of the navmesh, with its portals sorted by neighbour tile
+    struct Tile {
+      bool valid { false };
+      float center[3] { 0.0f, 0.0f, 0.0f };
+      std::vector<Portal> portals;
+    };
+
+    /// return the tile holding a polygon
+    int GetTile(dtPolyRef ref) const;
+    /// find the corridor between two polygons with a single search
+    bool FindSegment(
+        const dtNavMeshQuery *query,
+        dtPolyRef start_ref,
+        dtPolyRef end_ref,
+        const float *start_pos,
+        const float *end_pos,
+        const dtQueryFilter *filter,
+        const FilterSettings &filter_key,
+        std::vector<dtPolyRef> &corridor);
+    /// find the tiles to go through between two tiles
+    bool FindTileRoute(
+        int start_tile,
+        int end_tile,
+        const dtQueryFilter *filter,
+        const FilterSettings &filter_key,
+        std::vector<int> &route);
+    /// find the corridor between two polygons through the portals of the tiles
+    /// of a route, searching only between consecutive portals
+    bool FindCorridorThroughTiles(
+        const dtNavMeshQuery *query,
+        const std::vector<int> &route,
+        dtPolyRef start_ref,
+        dtPolyRef end_ref,
+        const float *start_pos,
+        const float *end_pos,
+        const dtQueryFilter *filter,
+        const FilterSettings &filter_key,
+        size_t max_path,
+        std::vector<dtPolyRef> &corridor);
+
+    const dtNavMesh *_nav_mesh { nullptr };
+    std::vector<Tile> _tiles;
+
+    /// guards the caches, the graph of tiles only changes on reset
+    std::mutex _mutex;
+    LruCache<Key, std::vector<dtPolyRef>, KeyHash> _corridors;
+    LruCache<Key, std::vector<int>, KeyHash> _tile_routes;
+  };
+
+} // namespace nav
+} // namespace carla
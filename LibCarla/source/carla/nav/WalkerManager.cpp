@@ -43,6 +43,7 @@ namespace nav {
     bool WalkerManager::Update(double delta) {
 
         // check all walkers
+        _updating = true;
         for (auto &it : _walkers) {
 
             // get the elements
@@ -88,6 +89,14 @@ namespace nav {
                     break;
             }
         }
+        _updating = false;
+
+        // find the new routes of the walkers at once
+        if (!_pending_routes.empty()) {
+            std::vector<ActorId> ids;
+            ids.swap(_pending_routes);
+            SetWalkerRoutes(ids);
+        }
 
         return true;
     }
@@ -98,6 +107,12 @@ namespace nav {
         if (_nav == nullptr)
             return false;
 
+        // while updating, the route is found later along with the others
+        if (_updating) {
+            _pending_routes.push_back(id);
+            return true;
+        }
+
         // set a new random target
         carla::geom::Location location;
         _nav->GetRandomLocation(location, nullptr);
@@ -131,6 +146,67 @@ namespace nav {
         // get a route from navigation
         _nav->GetAgentRoute(id, info.from, to, path, area);
 
+        AssignRoute(id, info, path, area);
+        return true;
+    }
+
+	// set new random routes from their current positions
+    bool WalkerManager::SetWalkerRoutes(const std::vector<ActorId> &ids) {
+        // check
+        if (_nav == nullptr)
+            return false;
+
+        // set new random targets
+        std::vector<carla::geom::Location> locations(ids.size());
+        for (auto &location : locations) {
+            _nav->GetRandomLocation(location, nullptr);
+        }
+
+        // set the routes
+        return SetWalkerRoutes(ids, locations);
+    }
+
+	// set new routes from their current positions
+    bool WalkerManager::SetWalkerRoutes(const std::vector<ActorId> &ids, const std::vector<carla::geom::Location> &to) {
+        // check
+        if (_nav == nullptr)
+            return false;
+
+        // save both points for each route
+        std::vector<ActorId> found_ids;
+        std::vector<PathRequest> requests;
+        found_ids.reserve(ids.size());
+        requests.reserve(ids.size());
+        for (size_t i = 0; i < ids.size() && i < to.size(); ++i) {
+            auto it = _walkers.find(ids[i]);
+            if (it == _walkers.end())
+                continue;
+            WalkerInfo &info = it->second;
+            _nav->GetWalkerPosition(ids[i], info.from);
+            info.to = to[i];
+            info.currentIndex = 0;
+            info.state = WALKER_IDLE;
+            found_ids.push_back(ids[i]);
+            requests.push_back(PathRequest { info.from, info.to });
+        }
+
+        // get all the routes from navigation
+        std::vector<PathResult> results;
+        _nav->GetAgentRoutes(found_ids, requests, results);
+
+        for (size_t i = 0; i < found_ids.size(); ++i) {
+            auto it = _walkers.find(found_ids[i]);
+            if (it != _walkers.end()) {
+                AssignRoute(found_ids[i], it->second, results[i].path, results[i].area);
+            }
+        }
+
+        return found_ids.size() == ids.size();
+    }
+
+	// build the route of a walker from the path found
+    void WalkerManager::AssignRoute(ActorId id, WalkerInfo &info, std::vector<carla::geom::Location> &path,
+    std::vector<unsigned char> &area) {
         // create each point of the route
         info.route.clear();
         info.route.reserve(path.size());
@@ -159,7 +235,6 @@ namespace nav {
 
         // assign the first point to go (second in the list)
         SetWalkerNextPoint(id);
-        return true;
     }
 
     // set the next point in the route
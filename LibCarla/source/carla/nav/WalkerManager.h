@@ -62,6 +62,10 @@ namespace nav {
     bool SetWalkerRoute(ActorId id);
     bool SetWalkerRoute(ActorId id, carla::geom::Location to);
 
+    /// set new routes for many walkers at once, finding their paths in parallel
+    bool SetWalkerRoutes(const std::vector<ActorId> &ids);
+    bool SetWalkerRoutes(const std::vector<ActorId> &ids, const std::vector<carla::geom::Location> &to);
+
     /// set the next point in the route
     bool SetWalkerNextPoint(ActorId id);
   
@@ -78,7 +82,15 @@ namespace nav {
 
     EventResult ExecuteEvent(ActorId id, WalkerInfo &info, double delta);
 
+    /// build the route of a walker from the path found
+    void AssignRoute(ActorId id, WalkerInfo &info, std::vector<carla::geom::Location> &path,
+    std::vector<unsigned char> &area);
+
     std::unordered_map<ActorId, WalkerInfo> _walkers;
+    /// while updating, walkers needing a new random route are kept here to
+    /// find all their paths at once
+    bool _updating { false };
+    std::vector<ActorId> _pending_routes;
     Navigation *_nav { nullptr };
   };
 
@@ -33,6 +33,10 @@ namespace opendrive {
       return {};
     }
 
+    return Load(xml);
+  }
+
+  boost::optional<road::Map> OpenDriveParser::Load(const pugi::xml_document &xml) {
     carla::road::MapBuilder map_builder;
 
     parser::GeoReferenceParser::Parse(xml, map_builder);
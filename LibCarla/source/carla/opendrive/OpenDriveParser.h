@@ -12,6 +12,10 @@
 
 #include <string>
 
+namespace pugi {
+  class xml_document;
+} // namespace pugi
+
 namespace carla {
 namespace opendrive {
 
@@ -19,6 +23,8 @@ namespace opendrive {
   public:
 
     static boost::optional<road::Map> Load(const std::string &opendrive);
+
+    static boost::optional<road::Map> Load(const pugi::xml_document &xml);
   };
 
 } // namespace opendrive
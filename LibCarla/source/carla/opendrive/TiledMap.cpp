@@ -0,0 +1,379 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#include "carla/opendrive/TiledMap.h"
+
+#include "carla/Debug.h"
+#include "carla/Logging.h"
+#include "carla/opendrive/OpenDriveParser.h"
+
+#include <pugixml/pugixml.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <unordered_set>
+
+namespace carla {
+namespace opendrive {
+
+  /// Distance added around the reference line of each road to account for
+  /// the width of its lanes when computing its bounding box.
+  static constexpr double ROAD_MARGIN = 30.0;
+
+  /// Junction id of the roads that are not part of any junction. The links to
+  /// elements that are not loaded point to it: the parser reads it as a road
+  /// that does not exist and the map builder as a junction without
+  /// connections, hence the link is ignored.
+  static constexpr road::JuncId NO_JUNCTION_ID = -1;
+
+  struct RoadBounds {
+    double min_x = std::numeric_limits<double>::max();
+    double min_y = std::numeric_limits<double>::max();
+    double max_x = std::numeric_limits<double>::lowest();
+    double max_y = std::numeric_limits<double>::lowest();
+
+    void Add(double x, double y, double radius) {
+      min_x = std::min(min_x, x - radius);
+      min_y = std::min(min_y, y - radius);
+      max_x = std::max(max_x, x + radius);
+      max_y = std::max(max_y, y + radius);
+    }
+
+    bool IsValid() const {
+      return min_x <= max_x && min_y <= max_y;
+    }
+  };
+
+  /// Compute a conservative bounding box of a road from its plan view. Lines
+  /// are bounded by their end points, any other geometry by a circle of
+  /// radius its length around its start point.
+  static RoadBounds ComputeRoadBounds(const pugi::xml_node &road_node) {
+    RoadBounds bounds;
+    for (pugi::xml_node geometry : road_node.child("planView").children("geometry")) {
+      const double x = geometry.attribute("x").as_double();
+      const double y = geometry.attribute("y").as_double();
+      const double hdg = geometry.attribute("hdg").as_double();
+      const double length = geometry.attribute("length").as_double();
+      if (geometry.child("line")) {
+        bounds.Add(x, y, ROAD_MARGIN);
+        bounds.Add(x + length * std::cos(hdg), y + length * std::sin(hdg), ROAD_MARGIN);
+      } else {
+        bounds.Add(x, y, length + ROAD_MARGIN);
+      }
+    }
+    return bounds;
+  }
+
+  /// Point the road level links of @a road_node to nothing when the linked
+  /// element is not loaded.
+  static void CutUnloadedLinks(
+      pugi::xml_node road_node,
+      const std::unordered_set<road::RoadId> &roads,
+      const std::unordered_set<road::JuncId> &junctions) {
+    pugi::xml_node link = road_node.child("link");
+    if (!link) {
+      return;
+    }
+    for (pugi::xml_node element : link.children()) {
+      const std::string type = element.attribute("elementType").value();
+      bool loaded;
+      if (type == "junction") {
+        loaded = junctions.count(element.attribute("elementId").as_int()) > 0u;
+      } else {
+        loaded = roads.count(element.attribute("elementId").as_uint()) > 0u;
+      }
+      if (!loaded) {
+        element.attribute("elementType").set_value("junction");
+        element.attribute("elementId").set_value(
+            static_cast<unsigned int>(static_cast<road::RoadId>(NO_JUNCTION_ID)));
+      }
+    }
+  }
+
+  static std::string Serialize(const pugi::xml_node &node) {
+    std::ostringstream stream;
+    node.print(stream, "", pugi::format_raw);
+    return stream.str();
+  }
+
+  // ===========================================================================
+  // -- TiledMap ---------------------------------------------------------------
+  // ===========================================================================
+
+  std::unique_ptr<TiledMap> TiledMap::Load(
+      const std::string &opendrive,
+      const double tile_size,
+      const size_t max_loaded_tiles) {
+    DEBUG_ASSERT(tile_size > 0.0);
+    pugi::xml_document xml;
+    pugi::xml_parse_result parse_result = xml.load_string(opendrive.c_str());
+    if (parse_result == false) {
+      log_error("unable to parse the OpenDRIVE XML string");
+      return nullptr;
+    }
+    auto tiled_map = std::unique_ptr<TiledMap>(
+        new TiledMap(tile_size, std::max<size_t>(1u, max_loaded_tiles)));
+    tiled_map->Index(xml);
+    return tiled_map;
+  }
+
+  TiledMap::TiledMap(const double tile_size, const size_t max_loaded_tiles)
+    : _tile_size(tile_size),
+      _max_loaded_tiles(max_loaded_tiles) {}
+
+  TiledMap::~TiledMap() = default;
+
+  TiledMap::TileId TiledMap::GetTileId(int32_t x, int32_t y) const {
+    return (static_cast<TileId>(static_cast<uint32_t>(x)) << 32u) |
+        static_cast<TileId>(static_cast<uint32_t>(y));
+  }
+
+  void TiledMap::Index(const pugi::xml_document &xml) {
+    const pugi::xml_node source = xml.child("OpenDRIVE");
+    pugi::xml_document root;
+    pugi::xml_node opendrive = root.append_child("OpenDRIVE");
+    for (pugi::xml_attribute attribute : source.attributes()) {
+      opendrive.append_copy(attribute);
+    }
+    for (pugi::xml_node node : source.children()) {
+      const std::string name = node.name();
+      if (name == "junction") {
+        _junctions.emplace(node.attribute("id").as_int(), Serialize(node));
+      } else if (name == "controller") {
+        _controllers.push_back(Serialize(node));
+      } else if (name != "road") {
+        opendrive.append_copy(node);
+      }
+    }
+    _root = Serialize(root);
+
+    for (pugi::xml_node road_node : source.children("road")) {
+      const road::RoadId road_id = road_node.attribute("id").as_uint();
+      const road::JuncId junction_id = road_node.attribute("junction").as_int();
+      _roads.emplace(road_id, RoadData{junction_id, Serialize(road_node)});
+      if (junction_id != NO_JUNCTION_ID) {
+        _junction_roads[junction_id].push_back(road_id);
+      }
+      const RoadBounds bounds = ComputeRoadBounds(road_node);
+      if (!bounds.IsValid()) {
+        log_warning("TiledMap: road", road_id, "has no geometry, ignoring it");
+        continue;
+      }
+      const auto min_x = static_cast<int32_t>(std::floor(bounds.min_x / _tile_size));
+      const auto min_y = static_cast<int32_t>(std::floor(bounds.min_y / _tile_size));
+      const auto max_x = static_cast<int32_t>(std::floor(bounds.max_x / _tile_size));
+      const auto max_y = static_cast<int32_t>(std::floor(bounds.max_y / _tile_size));
+      for (int32_t x = min_x; x <= max_x; ++x) {
+        for (int32_t y = min_y; y <= max_y; ++y) {
+          _tile_roads[GetTileId(x, y)].push_back(road_id);
+        }
+      }
+    }
+  }
+
+  SharedPtr<const road::Map> TiledMap::GetMap(
+      const geom::Location &location,
+      const double radius) {
+    auto tile = LoadTile(location, radius);
+    return tile != nullptr ? tile->region.map : nullptr;
+  }
+
+  TiledMap::Region TiledMap::GetRegion(
+      const geom::Location &location,
+      const double radius) {
+    auto tile = LoadTile(location, radius);
+    return tile != nullptr ? tile->region : Region{};
+  }
+
+  std::shared_ptr<const TiledMap::LoadedTile> TiledMap::LoadTile(
+      const geom::Location &location,
+      const double radius) {
+    // OpenDRIVE uses a right-handed coordinate system, the y axis is inverted
+    // with respect to the simulator.
+    const auto tile_x = static_cast<int32_t>(std::floor(location.x / _tile_size));
+    const auto tile_y = static_cast<int32_t>(std::floor(-location.y / _tile_size));
+    // Any query centered in the tile is covered by the tiles around it up to
+    // the radius.
+    const int32_t ring = std::max(1, static_cast<int32_t>(std::ceil(radius / _tile_size)));
+    const auto key = std::make_pair(GetTileId(tile_x, tile_y), ring);
+
+    std::shared_ptr<LoadedTile> loaded_tile;
+    std::vector<road::RoadId> roads;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      auto it = std::find_if(_loaded_tiles.begin(), _loaded_tiles.end(),
+          [&key](const std::shared_ptr<LoadedTile> &tile) { return tile->key == key; });
+      if (it != _loaded_tiles.end()) {
+        _loaded_tiles.splice(_loaded_tiles.begin(), _loaded_tiles, it);
+        loaded_tile = _loaded_tiles.front();
+        // Wait for the map if another query is still building it.
+        _map_built.wait(lock, [&loaded_tile]() { return loaded_tile->built; });
+        return loaded_tile;
+      }
+      for (int32_t x = tile_x - ring; x <= tile_x + ring; ++x) {
+        for (int32_t y = tile_y - ring; y <= tile_y + ring; ++y) {
+          AddRoadsToLoad(GetTileId(x, y), roads);
+        }
+      }
+      if (roads.empty()) {
+        return nullptr;
+      }
+      loaded_tile = std::make_shared<LoadedTile>();
+      loaded_tile->key = key;
+      _loaded_tiles.push_front(loaded_tile);
+      while (_loaded_tiles.size() > _max_loaded_tiles) {
+        _loaded_tiles.pop_back();
+      }
+    }
+
+    // Mark the map as built even if it could not be built, otherwise the
+    // queries waiting for it would never return. On failure the tile keeps no
+    // map.
+    const auto publish = [this, &loaded_tile](Region *region) {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (region != nullptr) {
+          loaded_tile->region = std::move(*region);
+        }
+        loaded_tile->built = true;
+      }
+      _map_built.notify_all();
+    };
+
+    Region region;
+    try {
+      region = BuildRegion(std::move(roads));
+    } catch (...) {
+      publish(nullptr);
+      throw;
+    }
+    publish(&region);
+    return loaded_tile;
+  }
+
+  SharedPtr<const road::Map> TiledMap::GetLoadedMap() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _loaded_tiles.empty() ? nullptr : _loaded_tiles.front()->region.map;
+  }
+
+  boost::optional<road::element::Waypoint> TiledMap::GetClosestWaypointOnRoad(
+      const geom::Location &location,
+      const int32_t lane_type) {
+    auto map = GetMap(location, 0.5 * _tile_size);
+    if (map == nullptr) {
+      return {};
+    }
+    return map->GetClosestWaypointOnRoad(location, lane_type);
+  }
+
+  void TiledMap::Clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _loaded_tiles.clear();
+  }
+
+  size_t TiledMap::GetLoadedTileCount() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _loaded_tiles.size();
+  }
+
+  void TiledMap::AddRoadsToLoad(const TileId tile, std::vector<road::RoadId> &roads) const {
+    auto tile_roads = _tile_roads.find(tile);
+    if (tile_roads == _tile_roads.end()) {
+      return;
+    }
+    for (const road::RoadId road_id : tile_roads->second) {
+      roads.push_back(road_id);
+      const road::JuncId junction_id = _roads.at(road_id).junction;
+      if (junction_id != NO_JUNCTION_ID) {
+        const auto &junction_roads = _junction_roads.at(junction_id);
+        roads.insert(roads.end(), junction_roads.begin(), junction_roads.end());
+      }
+    }
+  }
+
+  TiledMap::Region TiledMap::BuildRegion(std::vector<road::RoadId> roads) const {
+    // Keep the order of the ids so the map does not depend on the hashing.
+    std::sort(roads.begin(), roads.end());
+    roads.erase(std::unique(roads.begin(), roads.end()), roads.end());
+    const std::unordered_set<road::RoadId> loaded_roads(roads.begin(), roads.end());
+    std::unordered_set<road::JuncId> junctions;
+    for (const road::RoadId road_id : roads) {
+      const road::JuncId junction_id = _roads.at(road_id).junction;
+      if (junction_id != NO_JUNCTION_ID) {
+        junctions.insert(junction_id);
+      }
+    }
+
+    // Parse the loaded elements into a new document.
+    pugi::xml_document xml;
+    xml.load_buffer(_root.data(), _root.size());
+    pugi::xml_node opendrive = xml.child("OpenDRIVE");
+    std::unordered_set<std::string> signals;
+    for (const road::RoadId road_id : roads) {
+      const std::string &road_xml = _roads.at(road_id).xml;
+      opendrive.append_buffer(road_xml.data(), road_xml.size());
+      pugi::xml_node road_node = opendrive.last_child();
+      CutUnloadedLinks(road_node, loaded_roads, junctions);
+      for (pugi::xml_node signal : road_node.child("signals").children("signal")) {
+        signals.insert(signal.attribute("id").value());
+      }
+    }
+    std::vector<road::JuncId> sorted_junctions(junctions.begin(), junctions.end());
+    std::sort(sorted_junctions.begin(), sorted_junctions.end());
+    for (const road::JuncId junction_id : sorted_junctions) {
+      auto junction = _junctions.find(junction_id);
+      if (junction != _junctions.end()) {
+        opendrive.append_buffer(junction->second.data(), junction->second.size());
+      }
+    }
+    for (const std::string &controller : _controllers) {
+      opendrive.append_buffer(controller.data(), controller.size());
+    }
+
+    // Drop the references to signals that are not loaded.
+    const auto is_loaded_signal = [&signals](pugi::xml_node node, const char *attribute) {
+      return signals.count(node.attribute(attribute).value()) > 0u;
+    };
+    for (pugi::xml_node road_node : opendrive.children("road")) {
+      pugi::xml_node signals_node = road_node.child("signals");
+      std::vector<pugi::xml_node> unloaded;
+      for (pugi::xml_node reference : signals_node.children("signalReference")) {
+        if (!is_loaded_signal(reference, "id")) {
+          unloaded.push_back(reference);
+        }
+      }
+      for (auto &node : unloaded) {
+        signals_node.remove_child(node);
+      }
+    }
+    for (pugi::xml_node controller : opendrive.children("controller")) {
+      std::vector<pugi::xml_node> unloaded;
+      for (pugi::xml_node control : controller.children("control")) {
+        if (!is_loaded_signal(control, "signalId")) {
+          unloaded.push_back(control);
+        }
+      }
+      for (auto &node : unloaded) {
+        controller.remove_child(node);
+      }
+    }
+
+    Region region;
+    region.opendrive = Serialize(xml);
+    auto map = OpenDriveParser::Load(xml);
+    if (!map.has_value()) {
+      log_error("TiledMap: unable to build the map of the loaded tiles");
+      return region;
+    }
+    log_debug("TiledMap: built a map with", roads.size(), "roads");
+    region.map = MakeShared<road::Map>(std::move(*map));
+    return region;
+  }
+
+} // namespace opendrive
+} // namespace carla
@@ -0,0 +1,182 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#pragma once
+
+#include "carla/Memory.h"
+#include "carla/NonCopyable.h"
+#include "carla/geom/Location.h"
+#include "carla/road/Map.h"
+#include "carla/road/RoadTypes.h"
+
+#include <boost/optional.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace pugi {
+  class xml_document;
+} // namespace pugi
+
+namespace carla {
+namespace opendrive {
+
+  /// OpenDRIVE map split in square tiles of @a tile_size meters. Only the
+  /// roads around the tiles in use are turned into a road::Map, so memory and
+  /// building time grow with the area queried instead of with the size of the
+  /// whole network.
+  ///
+  /// The OpenDRIVE document is only parsed once: each road and junction is
+  /// kept serialized on its own. The map of a tile holds the roads of the
+  /// tiles around it, enough to answer any query centered in the tile. It is
+  /// built the first time the tile is queried and kept for the next queries,
+  /// so moving around only builds the maps of the tiles reached, each one
+  /// from a fixed number of tiles. The least recently used maps are dropped
+  /// once more than @a max_loaded_tiles are kept; maps previously returned
+  /// stay valid as long as they are referenced. Road, section and lane ids are
+  /// the ones of the OpenDRIVE, hence a Waypoint obtained from one map can be
+  /// used in any other map that contains its road.
+  ///
+  /// Junctions are never split: loading any road of a junction loads all its
+  /// connecting roads. Links to roads that are not loaded are removed, so the
+  /// topology of the partial map ends at the border of the loaded region.
+  class TiledMap : private NonCopyable {
+  public:
+
+    using TileId = uint64_t;
+
+    /// Parse @a opendrive and index its roads by tile. Returns nullptr if the
+    /// string is not a valid OpenDRIVE.
+    static std::unique_ptr<TiledMap> Load(
+        const std::string &opendrive,
+        double tile_size = 500.0,
+        size_t max_loaded_tiles = 36u);
+
+    ~TiledMap();
+
+    /// Map of the roads around a tile, and the OpenDRIVE it was built from.
+    struct Region {
+      SharedPtr<const road::Map> map;
+      std::string opendrive;
+    };
+
+    /// Return a map containing, at least, all the roads within @a radius
+    /// meters of @a location, nullptr if there are no roads there. The map
+    /// holds the tiles within @a radius of the tile of @a location, and is
+    /// shared by the queries of that tile whose radius rounds up to the same
+    /// number of tiles. If building the map throws, the exception is
+    /// propagated and the queries of the same tile get nullptr until Clear is
+    /// called.
+    SharedPtr<const road::Map> GetMap(const geom::Location &location, double radius);
+
+    /// As GetMap, but return also the OpenDRIVE of the map.
+    Region GetRegion(const geom::Location &location, double radius);
+
+    /// Return the map of the tile most recently queried, nullptr if none or if
+    /// it is still being built.
+    SharedPtr<const road::Map> GetLoadedMap() const;
+
+    /// Return the closest waypoint on the road to @a location, as
+    /// road::Map::GetClosestWaypointOnRoad, from the map of its tile.
+    boost::optional<road::element::Waypoint> GetClosestWaypointOnRoad(
+        const geom::Location &location,
+        int32_t lane_type = static_cast<int32_t>(road::Lane::LaneType::Driving));
+
+    /// Drop all the maps kept.
+    void Clear();
+
+    double GetTileSize() const {
+      return _tile_size;
+    }
+
+    size_t GetMaxLoadedTiles() const {
+      return _max_loaded_tiles;
+    }
+
+    /// Number of tiles containing at least one road.
+    size_t GetTileCount() const {
+      return _tile_roads.size();
+    }
+
+    /// Number of tile maps kept.
+    size_t GetLoadedTileCount() const;
+
+  private:
+
+    /// A road of the OpenDRIVE, serialized.
+    struct RoadData {
+      road::JuncId junction;
+      std::string xml;
+    };
+
+    /// Map of a tile, shared by the queries of the tile while it is built.
+    struct LoadedTile {
+      /// Tile and number of tiles around it whose roads are in the map.
+      std::pair<TileId, int32_t> key;
+      /// False while the map is being built.
+      bool built = false;
+      Region region;
+    };
+
+    TiledMap(double tile_size, size_t max_loaded_tiles);
+
+    TileId GetTileId(int32_t x, int32_t y) const;
+
+    /// Keep each element of @a xml serialized and index the bounding box of
+    /// every road into the tiles it overlaps.
+    void Index(const pugi::xml_document &xml);
+
+    /// Return the map of the tile of @a location covering @a radius, building
+    /// it if needed, nullptr if there are no roads around. The region of the
+    /// tile returned is not modified anymore.
+    std::shared_ptr<const LoadedTile> LoadTile(const geom::Location &location, double radius);
+
+    /// Add the roads of @a tile to @a roads, including all the roads of its
+    /// junctions.
+    void AddRoadsToLoad(TileId tile, std::vector<road::RoadId> &roads) const;
+
+    /// Build a road::Map from @a roads. Only reads the elements kept at
+    /// loading, so it runs without holding the mutex.
+    Region BuildRegion(std::vector<road::RoadId> roads) const;
+
+    const double _tile_size;
+
+    const size_t _max_loaded_tiles;
+
+    /// Root of the OpenDRIVE with its attributes and header, but none of its
+    /// roads, junctions or controllers.
+    std::string _root;
+
+    std::unordered_map<road::RoadId, RoadData> _roads;
+
+    std::unordered_map<road::JuncId, std::string> _junctions;
+
+    std::vector<std::string> _controllers;
+
+    /// Roads overlapping each tile.
+    std::unordered_map<TileId, std::vector<road::RoadId>> _tile_roads;
+
+    /// Roads of each junction.
+    std::unordered_map<road::JuncId, std::vector<road::RoadId>> _junction_roads;
+
+    mutable std::mutex _mutex;
+
+    /// Notified every time the map of a tile is built.
+    std::condition_variable _map_built;
+
+    /// Maps of the tiles, the most recently used first.
+    std::list<std::shared_ptr<LoadedTile>> _loaded_tiles;
+  };
+
+} // namespace opendrive
+} // namespace carla
@@ -10,6 +10,7 @@
 #include "carla/NonCopyable.h"
 #include "carla/road/RoadTypes.h"
 
+#include <set>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -45,6 +46,24 @@ namespace road {
           lane_links() {}
     };
 
+    /// Zone where a lane of a connecting road overlaps a lane of another
+    /// connecting road of the same junction. Each conflict is stored once for
+    /// each of the two lanes involved.
+    struct LaneConflict {
+      RoadId road_id;
+      SectionId section_id;
+      LaneId lane_id;
+      /// Range of s of the lane inside the conflict zone.
+      double s_start;
+      double s_end;
+      RoadId other_road_id;
+      SectionId other_section_id;
+      LaneId other_lane_id;
+      /// Range of s of the other lane inside the conflict zone.
+      double other_s_start;
+      double other_s_end;
+    };
+
     Junction(const JuncId id, const std::string name)
       : _id(id),
         _name(name),
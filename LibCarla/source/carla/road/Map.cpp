@@ -6,6 +6,7 @@
 
 #include "carla/road/Map.h"
 #include "carla/Exception.h"
+#include "carla/ParallelFor.h"
 #include "carla/geom/Math.h"
 #include "carla/road/MeshFactory.h"
 #include "carla/road/element/LaneCrossingCalculator.h"
@@ -17,9 +18,13 @@
 #include "carla/road/element/RoadInfoMarkRecord.h"
 #include "carla/road/element/RoadInfoSignal.h"
 
+#include <algorithm>
+#include <cmath>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <stdexcept>
+#include <tuple>
 
 namespace carla {
 namespace road {
@@ -46,6 +51,29 @@ namespace road {
     return dst;
   }
 
+  /// Moves all the meshes of @a meshes into @a dst, reserving the buffers
+  /// beforehand.
+  static void MergeMeshes(
+      geom::Mesh &dst,
+      std::vector<std::unique_ptr<geom::Mesh>> &meshes) {
+    size_t vertices = dst.GetVerticesNum();
+    size_t normals = dst.GetNormals().size();
+    size_t indexes = dst.GetIndexesNum();
+    size_t uvs = dst.GetUVs().size();
+    size_t materials = dst.GetMaterials().size();
+    for (const auto &mesh : meshes) {
+      vertices += mesh->GetVerticesNum();
+      normals += mesh->GetNormals().size();
+      indexes += mesh->GetIndexesNum();
+      uvs += mesh->GetUVs().size();
+      materials += mesh->GetMaterials().size();
+    }
+    dst.Reserve(vertices, normals, indexes, uvs, materials);
+    for (auto &mesh : meshes) {
+      dst += std::move(*mesh);
+    }
+  }
+
   static double GetDistanceAtStartOfLane(const Lane &lane) {
     if (lane.GetId() <= 0) {
       return lane.GetDistance() + 10.0 * EPSILON;
@@ -318,109 +346,89 @@ namespace road {
     return std::make_pair(current_lane_info, inner_lane_info);
   }
 
-  std::vector<Map::SignalSearchData> Map::GetSignalsInDistance(
-      Waypoint waypoint, double distance, bool stop_at_junction) const {
+  template <typename EnumT>
+  static EnumT operator&(EnumT lhs, EnumT rhs) {
+    return static_cast<EnumT>(
+        static_cast<typename std::underlying_type<EnumT>::type>(lhs) &
+        static_cast<typename std::underlying_type<EnumT>::type>(rhs));
+  }
 
-    const auto &lane = GetLane(waypoint);
-    const bool forward = (waypoint.lane_id <= 0);
-    const double signed_distance = forward ? distance : -distance;
-    const double relative_s = waypoint.s - lane.GetDistance();
-    const double remaining_lane_length = forward ? lane.GetLength() - relative_s : relative_s;
-    DEBUG_ASSERT(remaining_lane_length >= 0.0);
+  template <typename EnumT>
+  static EnumT operator|(EnumT lhs, EnumT rhs) {
+    return static_cast<EnumT>(
+        static_cast<typename std::underlying_type<EnumT>::type>(lhs) |
+        static_cast<typename std::underlying_type<EnumT>::type>(rhs));
+  }
 
-    auto &road =_data.GetRoad(waypoint.road_id);
-    std::vector<SignalSearchData> result;
+  LaneMarking::LaneChange Map::GetLaneChange(
+      const Waypoint waypoint,
+      const std::pair<const RoadInfoMarkRecord *, const RoadInfoMarkRecord *> mark_record) {
+    using lane_change_type = LaneMarking::LaneChange;
+
+    const auto lane_change_right_info = mark_record.first;
+    lane_change_type c_right;
+    if (lane_change_right_info != nullptr) {
+      const auto lane_change_right = lane_change_right_info->GetLaneChange();
+      c_right = static_cast<lane_change_type>(lane_change_right);
+    } else {
+      c_right = lane_change_type::Both;
+    }
 
-    // If after subtracting the distance we are still in the same lane, return
-    // same waypoint with the extra distance.
-    if (distance <= remaining_lane_length) {
-      auto signals = road.GetInfosInRange<RoadInfoSignal>(
-          waypoint.s, waypoint.s + signed_distance);
-      for(auto* signal : signals){
-        double distance_to_signal = 0;
-        if (waypoint.lane_id < 0){
-          distance_to_signal = signal->GetDistance() - waypoint.s;
-        } else {
-          distance_to_signal = waypoint.s - signal->GetDistance();
-        }
-        // check that the signal affects the waypoint
-        bool is_valid = false;
-        for (auto &validity : signal->GetValidities()) {
-          if (waypoint.lane_id >= validity._from_lane &&
-              waypoint.lane_id <= validity._to_lane) {
-            is_valid = true;
-            break;
-          }
-        }
-        if(!is_valid){
-          continue;
-        }
-        if (distance_to_signal == 0) {
-          result.emplace_back(SignalSearchData
-              {signal, waypoint,
-              distance_to_signal});
-        } else {
-          result.emplace_back(SignalSearchData
-              {signal, GetNext(waypoint, distance_to_signal).front(),
-              distance_to_signal});
-        }
+    const auto lane_change_left_info = mark_record.second;
+    lane_change_type c_left;
+    if (lane_change_left_info != nullptr) {
+      const auto lane_change_left = lane_change_left_info->GetLaneChange();
+      c_left = static_cast<lane_change_type>(lane_change_left);
+    } else {
+      c_left = lane_change_type::Both;
+    }
 
+    if (waypoint.lane_id > 0) {
+      // if road goes backward
+      if (c_right == lane_change_type::Right) {
+        c_right = lane_change_type::Left;
+      } else if (c_right == lane_change_type::Left) {
+        c_right = lane_change_type::Right;
       }
-      return result;
     }
-    const double signed_remaining_length = forward ? remaining_lane_length : -remaining_lane_length;
 
-    //result = road.GetInfosInRange<RoadInfoSignal>(waypoint.s, waypoint.s + signed_remaining_length);
-    auto signals = road.GetInfosInRange<RoadInfoSignal>(
-        waypoint.s, waypoint.s + signed_remaining_length);
-    for(auto* signal : signals){
-      double distance_to_signal = 0;
-      if (waypoint.lane_id < 0){
-        distance_to_signal = signal->GetDistance() - waypoint.s;
-      } else {
-        distance_to_signal = waypoint.s - signal->GetDistance();
-      }
-      // check that the signal affects the waypoint
-      bool is_valid = false;
-      for (auto &validity : signal->GetValidities()) {
-        if (waypoint.lane_id >= validity._from_lane &&
-            waypoint.lane_id <= validity._to_lane) {
-          is_valid = true;
-          break;
-        }
-      }
-      if(!is_valid){
-        continue;
-      }
-      if (distance_to_signal == 0) {
-        result.emplace_back(SignalSearchData
-            {signal, waypoint,
-            distance_to_signal});
-      } else {
-        result.emplace_back(SignalSearchData
-            {signal, GetNext(waypoint, distance_to_signal).front(),
-            distance_to_signal});
+    if (((waypoint.lane_id > 0) ? waypoint.lane_id - 1 : waypoint.lane_id + 1) > 0) {
+      // if road goes backward
+      if (c_left == lane_change_type::Right) {
+        c_left = lane_change_type::Left;
+      } else if (c_left == lane_change_type::Left) {
+        c_left = lane_change_type::Right;
       }
     }
-    // If we run out of remaining_lane_length we have to go to the successors.
-    for (auto &successor : GetSuccessors(waypoint)) {
-      if(_data.GetRoad(successor.road_id).IsJunction() && stop_at_junction){
-        continue;
-      }
-      auto& sucessor_lane = _data.GetRoad(successor.road_id).
-            GetLaneByDistance(successor.s, successor.lane_id);
-      if (successor.lane_id < 0) {
-        successor.s = sucessor_lane.GetDistance();
-      } else {
-        successor.s = sucessor_lane.GetDistance() + sucessor_lane.GetLength();
-      }
-      auto sucessor_signals = GetSignalsInDistance(
-          successor, distance - remaining_lane_length, stop_at_junction);
-      for(auto& signal : sucessor_signals){
-        signal.accumulated_s += remaining_lane_length;
-      }
-      result = ConcatVectors(result, sucessor_signals);
+
+    return (c_right & lane_change_type::Right) | (c_left & lane_change_type::Left);
+  }
+
+  LaneMarking::LaneChange Map::GetLaneChange(const Waypoint waypoint) const {
+    return GetLaneChange(waypoint, GetMarkRecord(waypoint));
+  }
+
+  std::vector<Map::SignalSearchData> Map::GetSignalsInDistance(
+      Waypoint waypoint, double distance, bool stop_at_junction) const {
+    std::vector<SignalSearchData> result;
+    const auto &lane = GetLane(waypoint);
+    auto it = _lane_signal_ids.find(&lane);
+    DEBUG_ASSERT(it != _lane_signal_ids.end());
+    if (it == _lane_signal_ids.end()) {
+      return result;
     }
+    const bool forward = (waypoint.lane_id <= 0);
+    const double relative_s = waypoint.s - lane.GetDistance();
+    const double remaining_lane_length = forward ? lane.GetLength() - relative_s : relative_s;
+    DEBUG_ASSERT(remaining_lane_length >= 0.0);
+    CollectSignalsInDistance(
+        it->second,
+        waypoint,
+        distance,
+        remaining_lane_length,
+        0.0,
+        stop_at_junction,
+        result);
     return result;
   }
 
@@ -822,6 +830,271 @@ namespace road {
     return conflicts;
   }
 
+  std::vector<Junction::LaneConflict> Map::ComputeJunctionLaneConflicts(JuncId id) const {
+    using LaneConflict = Junction::LaneConflict;
+    constexpr double SAMPLE_DISTANCE = 1.0;
+    // Fraction of the summed half widths below which two lanes overlap, so
+    // lanes that only touch side by side are not considered in conflict.
+    constexpr double OVERLAP_FACTOR = 0.8;
+    // Lanes with an end closer than this start or end at the same point.
+    constexpr double SHARED_POINT_DISTANCE = 0.5;
+
+    typedef boost::geometry::model::point
+        <double, 2, boost::geometry::cs::cartesian> Point2d;
+    typedef boost::geometry::model::segment<Point2d> Segment2d;
+
+    /// Bounding box of a segment between two samples, enlarged by the half
+    /// width of the lane.
+    struct SegmentBounds {
+      double min_x;
+      double min_y;
+      double max_x;
+      double max_y;
+      double half_width;
+
+      bool Overlaps(const SegmentBounds &rhs) const {
+        return min_x <= rhs.max_x && rhs.min_x <= max_x &&
+            min_y <= rhs.max_y && rhs.min_y <= max_y;
+      }
+    };
+
+    struct LaneSamples {
+      RoadId road_id;
+      SectionId section_id;
+      LaneId lane_id;
+      std::vector<double> s;
+      std::vector<Point2d> points;
+      std::vector<SegmentBounds> segments;
+      SegmentBounds bounds;
+    };
+
+    const Junction *junction = GetJunction(id);
+    std::vector<LaneConflict> result;
+    if (junction == nullptr) {
+      return result;
+    }
+
+    // Sample the center of every driving lane of the connecting roads.
+    std::unordered_set<RoadId> roads;
+    for (const auto &connection : junction->GetConnections()) {
+      roads.insert(connection.second.connecting_road);
+    }
+    std::vector<LaneSamples> lanes;
+    for (const auto road_id : roads) {
+      if (!_data.ContainsRoad(road_id)) {
+        continue;
+      }
+      const auto &road = _data.GetRoad(road_id);
+      for (const auto &lane_section : road.GetLaneSections()) {
+        for (const auto &pair : lane_section.GetLanes()) {
+          const auto &lane = pair.second;
+          if (lane.GetId() == 0 ||
+              (static_cast<uint32_t>(lane.GetType()) & static_cast<uint32_t>(Lane::LaneType::Driving)) == 0u) {
+            continue;
+          }
+          LaneSamples samples;
+          samples.road_id = road_id;
+          samples.section_id = lane_section.GetId();
+          samples.lane_id = lane.GetId();
+          const double start = lane.GetDistance() + EPSILON;
+          const double length = std::max(0.0, lane.GetLength() - 2.0 * EPSILON);
+          const auto count = std::max<size_t>(1u,
+              static_cast<size_t>(std::ceil(length / SAMPLE_DISTANCE)));
+          std::vector<double> half_widths;
+          for (size_t i = 0u; i <= count; ++i) {
+            const Waypoint waypoint{
+                road_id,
+                lane_section.GetId(),
+                lane.GetId(),
+                start + length * static_cast<double>(i) / static_cast<double>(count)};
+            const auto location = ComputeTransform(waypoint).location;
+            samples.s.emplace_back(waypoint.s);
+            samples.points.emplace_back(location.x, location.y);
+            half_widths.emplace_back(0.5 * GetLaneWidth(waypoint));
+          }
+          samples.bounds = SegmentBounds{
+              std::numeric_limits<double>::max(), std::numeric_limits<double>::max(),
+              std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest(),
+              0.0};
+          for (size_t i = 0u; i < count; ++i) {
+            const auto &p0 = samples.points[i];
+            const auto &p1 = samples.points[i + 1u];
+            const double half_width = std::max(half_widths[i], half_widths[i + 1u]);
+            const SegmentBounds segment{
+                std::min(p0.get<0>(), p1.get<0>()) - half_width,
+                std::min(p0.get<1>(), p1.get<1>()) - half_width,
+                std::max(p0.get<0>(), p1.get<0>()) + half_width,
+                std::max(p0.get<1>(), p1.get<1>()) + half_width,
+                half_width};
+            samples.segments.emplace_back(segment);
+            samples.bounds.min_x = std::min(samples.bounds.min_x, segment.min_x);
+            samples.bounds.min_y = std::min(samples.bounds.min_y, segment.min_y);
+            samples.bounds.max_x = std::max(samples.bounds.max_x, segment.max_x);
+            samples.bounds.max_y = std::max(samples.bounds.max_y, segment.max_y);
+          }
+          lanes.emplace_back(std::move(samples));
+        }
+      }
+    }
+
+    const auto is_same_point = [&](const Point2d &lhs, const Point2d &rhs) {
+      return boost::geometry::distance(lhs, rhs) < SHARED_POINT_DISTANCE;
+    };
+    // Number of consecutive overlapping segments from one end of a lane.
+    const auto count_overlapping = [](const std::vector<bool> &overlapping, bool from_back) {
+      size_t count = 0u;
+      while (count < overlapping.size() &&
+          overlapping[from_back ? overlapping.size() - 1u - count : count]) {
+        ++count;
+      }
+      return count;
+    };
+
+    /// Segments next to an end shared by the two lanes.
+    struct SharedEnd {
+      bool back1;
+      size_t count1;
+      bool back2;
+      size_t count2;
+    };
+
+    for (size_t i = 0u; i < lanes.size(); ++i) {
+      const auto &lane1 = lanes[i];
+      for (size_t j = i + 1u; j < lanes.size(); ++j) {
+        const auto &lane2 = lanes[j];
+        // Discard same road and lanes that are far away.
+        if (lane1.road_id == lane2.road_id || !lane1.bounds.Overlaps(lane2.bounds)) {
+          continue;
+        }
+
+        // Overlapping segments, the boxes discard most of the pairs before
+        // computing the distance.
+        std::vector<std::pair<size_t, size_t>> overlaps;
+        std::vector<bool> overlapping1(lane1.segments.size(), false);
+        std::vector<bool> overlapping2(lane2.segments.size(), false);
+        for (size_t k = 0u; k < lane1.segments.size(); ++k) {
+          const auto &bounds1 = lane1.segments[k];
+          if (!bounds1.Overlaps(lane2.bounds)) {
+            continue;
+          }
+          const Segment2d segment1{lane1.points[k], lane1.points[k + 1u]};
+          for (size_t l = 0u; l < lane2.segments.size(); ++l) {
+            const auto &bounds2 = lane2.segments[l];
+            if (!bounds1.Overlaps(bounds2)) {
+              continue;
+            }
+            const Segment2d segment2{lane2.points[l], lane2.points[l + 1u]};
+            const double distance = boost::geometry::distance(segment1, segment2);
+            if (distance >= OVERLAP_FACTOR * (bounds1.half_width + bounds2.half_width)) {
+              continue;
+            }
+            overlaps.emplace_back(k, l);
+            overlapping1[k] = true;
+            overlapping2[l] = true;
+          }
+        }
+        if (overlaps.empty()) {
+          continue;
+        }
+
+        // Lanes starting or ending at the same point, like the lanes leaving
+        // from or merging into the same lane, overlap next to it without
+        // crossing; ignore these segments until the lanes are apart.
+        std::vector<SharedEnd> shared_ends;
+        for (const bool back1 : {false, true}) {
+          for (const bool back2 : {false, true}) {
+            if (is_same_point(
+                    back1 ? lane1.points.back() : lane1.points.front(),
+                    back2 ? lane2.points.back() : lane2.points.front())) {
+              shared_ends.emplace_back(SharedEnd{
+                  back1, count_overlapping(overlapping1, back1),
+                  back2, count_overlapping(overlapping2, back2)});
+            }
+          }
+        }
+        const auto is_next_to = [](size_t index, size_t size, bool back, size_t count) {
+          return back ? index + count >= size : index < count;
+        };
+
+        LaneConflict conflict{
+            lane1.road_id, lane1.section_id, lane1.lane_id,
+            std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest(),
+            lane2.road_id, lane2.section_id, lane2.lane_id,
+            std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest()};
+        for (const auto &overlap : overlaps) {
+          const size_t k = overlap.first;
+          const size_t l = overlap.second;
+          const bool is_shared = std::any_of(shared_ends.begin(), shared_ends.end(),
+              [&](const SharedEnd &end) {
+                return is_next_to(k, lane1.segments.size(), end.back1, end.count1) &&
+                    is_next_to(l, lane2.segments.size(), end.back2, end.count2);
+              });
+          if (is_shared) {
+            continue;
+          }
+          conflict.s_start = std::min(conflict.s_start, std::min(lane1.s[k], lane1.s[k + 1u]));
+          conflict.s_end = std::max(conflict.s_end, std::max(lane1.s[k], lane1.s[k + 1u]));
+          conflict.other_s_start = std::min(conflict.other_s_start, std::min(lane2.s[l], lane2.s[l + 1u]));
+          conflict.other_s_end = std::max(conflict.other_s_end, std::max(lane2.s[l], lane2.s[l + 1u]));
+        }
+        if (conflict.s_start > conflict.s_end) {
+          continue;
+        }
+        result.emplace_back(conflict);
+        result.emplace_back(LaneConflict{
+            conflict.other_road_id, conflict.other_section_id, conflict.other_lane_id,
+            conflict.other_s_start, conflict.other_s_end,
+            conflict.road_id, conflict.section_id, conflict.lane_id,
+            conflict.s_start, conflict.s_end});
+      }
+    }
+
+    std::sort(result.begin(), result.end(), [](const LaneConflict &lhs, const LaneConflict &rhs) {
+      return std::tie(lhs.road_id, lhs.section_id, lhs.lane_id,
+                      lhs.other_road_id, lhs.other_section_id, lhs.other_lane_id) <
+             std::tie(rhs.road_id, rhs.section_id, rhs.lane_id,
+                      rhs.other_road_id, rhs.other_section_id, rhs.other_lane_id);
+    });
+    return result;
+  }
+
+  const std::vector<Junction::LaneConflict> &Map::GetJunctionLaneConflicts(JuncId id) const {
+    static const std::vector<Junction::LaneConflict> no_conflicts;
+    if (GetJunction(id) == nullptr) {
+      return no_conflicts;
+    }
+    {
+      std::lock_guard<std::mutex> lock(_lane_conflicts->mutex);
+      auto it = _lane_conflicts->junctions.find(id);
+      if (it != _lane_conflicts->junctions.end()) {
+        return it->second;
+      }
+    }
+    // Computed without the lock so other junctions can be queried meanwhile,
+    // the first one computed is kept.
+    auto conflicts = ComputeJunctionLaneConflicts(id);
+    std::lock_guard<std::mutex> lock(_lane_conflicts->mutex);
+    return _lane_conflicts->junctions.emplace(id, std::move(conflicts)).first->second;
+  }
+
+  std::vector<Junction::LaneConflict> Map::GetLaneConflicts(const Waypoint waypoint) const {
+    const auto &road = _data.GetRoad(waypoint.road_id);
+    if (!road.IsJunction()) {
+      return {};
+    }
+    const auto &conflicts = GetJunctionLaneConflicts(road.GetJunctionId());
+    const auto less = [](const Junction::LaneConflict &lhs, const Junction::LaneConflict &rhs) {
+      return std::tie(lhs.road_id, lhs.section_id, lhs.lane_id) <
+             std::tie(rhs.road_id, rhs.section_id, rhs.lane_id);
+    };
+    Junction::LaneConflict key{};
+    key.road_id = waypoint.road_id;
+    key.section_id = waypoint.section_id;
+    key.lane_id = waypoint.lane_id;
+    const auto range = std::equal_range(conflicts.begin(), conflicts.end(), key, less);
+    return {range.first, range.second};
+  }
+
   const Lane &Map::GetLane(Waypoint waypoint) const {
     return _data.GetRoad(waypoint.road_id).GetLaneById(waypoint.section_id, waypoint.lane_id);
   }
@@ -875,6 +1148,111 @@ namespace road {
     }
   }
 
+  void Map::CreateSignalIndex() {
+    _lane_signal_index.clear();
+    _lane_signal_ids.clear();
+    for (const auto &pair : _data.GetRoads()) {
+      const auto &road = pair.second;
+      for (const auto &lane_section : road.GetLaneSections()) {
+        for (const auto &lane_pair : lane_section.GetLanes()) {
+          const auto &lane = lane_pair.second;
+          if (lane.GetId() == 0) {
+            continue;
+          }
+          LaneSignalIndex index;
+          index.lane = &lane;
+          index.is_junction = road.IsJunction();
+          const double start_s = lane.GetDistance();
+          const double end_s = start_s + lane.GetLength();
+          for (auto *signal : road.GetInfosInRange<RoadInfoSignal>(start_s, end_s)) {
+            for (auto &validity : signal->GetValidities()) {
+              if (lane.GetId() >= validity._from_lane &&
+                  lane.GetId() <= validity._to_lane) {
+                index.signals.emplace_back(signal);
+                break;
+              }
+            }
+          }
+          // Sort the signals in the driving direction of the lane.
+          const bool forward = (lane.GetId() <= 0);
+          std::stable_sort(index.signals.begin(), index.signals.end(),
+              [forward](const RoadInfoSignal *lhs, const RoadInfoSignal *rhs) {
+                return forward ?
+                    lhs->GetDistance() < rhs->GetDistance() :
+                    lhs->GetDistance() > rhs->GetDistance();
+              });
+          _lane_signal_ids.emplace(&lane, _lane_signal_index.size());
+          _lane_signal_index.emplace_back(std::move(index));
+        }
+      }
+    }
+    for (auto &index : _lane_signal_index) {
+      for (auto *next_lane : index.lane->GetNextLanes()) {
+        auto it = _lane_signal_ids.find(next_lane);
+        if (it != _lane_signal_ids.end()) {
+          index.successors.emplace_back(it->second);
+        }
+      }
+    }
+  }
+
+  void Map::CollectSignalsInDistance(
+      const size_t lane_index,
+      const Waypoint waypoint,
+      const double distance,
+      const double remaining_lane_length,
+      const double accumulated_s,
+      const bool stop_at_junction,
+      std::vector<SignalSearchData> &result) const {
+    const auto &index = _lane_signal_index[lane_index];
+    const bool forward = (waypoint.lane_id <= 0);
+    const double max_distance = std::min(distance, remaining_lane_length);
+    const double min_s = forward ? waypoint.s : waypoint.s - max_distance;
+    const double max_s = forward ? waypoint.s + max_distance : waypoint.s;
+    for (auto *signal : index.signals) {
+      const double signal_s = signal->GetDistance();
+      if (signal_s < min_s || signal_s > max_s) {
+        continue;
+      }
+      const double distance_to_signal = (waypoint.lane_id < 0) ?
+          signal_s - waypoint.s :
+          waypoint.s - signal_s;
+      // Same waypoint GetNext would return, we know it is in this lane.
+      Waypoint signal_waypoint = waypoint;
+      if (distance_to_signal > EPSILON) {
+        signal_waypoint.s += forward ? distance_to_signal : -distance_to_signal;
+        signal_waypoint.s += forward ? -EPSILON : EPSILON;
+      }
+      result.emplace_back(SignalSearchData{
+          signal,
+          signal_waypoint,
+          accumulated_s + distance_to_signal});
+    }
+    if (distance <= remaining_lane_length) {
+      return;
+    }
+    // If we run out of remaining_lane_length we have to go to the successors.
+    for (const auto successor_index : index.successors) {
+      const auto &successor = _lane_signal_index[successor_index];
+      if (successor.is_junction && stop_at_junction) {
+        continue;
+      }
+      const auto &lane = *successor.lane;
+      const auto lane_id = lane.GetId();
+      const double s = lane_id < 0 ?
+          lane.GetDistance() :
+          lane.GetDistance() + lane.GetLength();
+      CollectSignalsInDistance(
+          successor_index,
+          Waypoint{lane.GetRoad()->GetId(), lane.GetLaneSection()->GetId(), lane_id, s},
+          distance - remaining_lane_length,
+          lane.GetLength(),
+          accumulated_s + remaining_lane_length,
+          stop_at_junction,
+          result);
+    }
+  }
+
   void Map::CreateRtree() {
     const double epsilon = 0.000001; // small delta in the road (set to 1
                                      // micrometer to prevent numeric errors)
@@ -993,10 +1371,22 @@ namespace road {
     return _data.GetJunction(id);
   }
 
+  std::vector<const Road *> Map::GetNonJunctionRoads() const {
+    std::vector<const Road *> roads;
+    roads.reserve(_data.GetRoadCount());
+    for (auto &&pair : _data.GetRoads()) {
+      if (!pair.second.IsJunction()) {
+        roads.push_back(&pair.second);
+      }
+    }
+    return roads;
+  }
+
   geom::Mesh Map::GenerateMesh(
       const double distance,
       const float extra_width,
-      const  bool smooth_junctions) const {
+      const  bool smooth_junctions,
+      const  bool weld_vertices) const {
     RELEASE_ASSERT(distance > 0.0);
     geom::MeshFactory mesh_factory;
     geom::Mesh out_mesh;
@@ -1004,20 +1394,28 @@ namespace road {
     mesh_factory.road_param.resolution = static_cast<float>(distance);
     mesh_factory.road_param.extra_lane_width = extra_width;
 
+    ThreadPool pool;
+    const size_t threads = GetParallelThreads();
+    pool.AsyncRun(threads);
+
     // Generate roads outside junctions
-    for (auto &&pair : _data.GetRoads()) {
-      const auto &road = pair.second;
-      if (road.IsJunction()) {
-        continue;
-      }
-      out_mesh += *mesh_factory.Generate(road);
-    }
+    std::vector<std::unique_ptr<geom::Mesh>> road_meshes = ParallelTransform(
+        pool, threads,
+        GetNonJunctionRoads(),
+        [&](const Road *road) { return mesh_factory.Generate(*road); });
 
     // Generate roads within junctions and smooth them
+    std::vector<const Junction *> junctions;
+    junctions.reserve(_data.GetJunctions().size());
     for (const auto &junc_pair : _data.GetJunctions()) {
-      const auto &junction = junc_pair.second;
+      junctions.push_back(&junc_pair.second);
+    }
+    std::vector<std::unique_ptr<geom::Mesh>> junction_meshes = ParallelTransform(
+        pool, threads,
+        junctions,
+        [&](const Junction *junction) {
       std::vector<std::unique_ptr<geom::Mesh>> lane_meshes;
-      for(const auto &connection_pair : junction.GetConnections()) {
+      for(const auto &connection_pair : junction->GetConnections()) {
         const auto &connection = connection_pair.second;
         const auto &road = _data.GetRoads().at(connection.connecting_road);
         for (auto &&lane_section : road.GetLaneSections()) {
@@ -1027,14 +1425,21 @@ namespace road {
         }
       }
       if(smooth_junctions) {
-        out_mesh += *mesh_factory.MergeAndSmooth(lane_meshes);
-      } else {
-        geom::Mesh junction_mesh;
-        for(auto& lane : lane_meshes) {
-          junction_mesh += *lane;
-        }
-        out_mesh += junction_mesh;
+        return mesh_factory.MergeAndSmooth(lane_meshes);
       }
+      auto junction_mesh = std::make_unique<geom::Mesh>();
+      MergeMeshes(*junction_mesh, lane_meshes);
+      return junction_mesh;
+    });
+
+    road_meshes.insert(
+        road_meshes.end(),
+        std::make_move_iterator(junction_meshes.begin()),
+        std::make_move_iterator(junction_meshes.end()));
+    MergeMeshes(out_mesh, road_meshes);
+
+    if (weld_vertices) {
+      out_mesh.WeldVertices();
     }
 
     return out_mesh;
@@ -1045,26 +1450,35 @@ namespace road {
     geom::MeshFactory mesh_factory(params);
     std::vector<std::unique_ptr<geom::Mesh>> out_mesh_list;
 
-    std::unordered_map<JuncId, geom::Mesh> junction_map;
-    for (auto &&pair : _data.GetRoads()) {
-      const auto &road = pair.second;
-      if (!road.IsJunction()) {
-        std::vector<std::unique_ptr<geom::Mesh>> road_mesh_list =
-            mesh_factory.GenerateAllWithMaxLen(road);
-
-        out_mesh_list.insert(
-            out_mesh_list.end(),
-            std::make_move_iterator(road_mesh_list.begin()),
-            std::make_move_iterator(road_mesh_list.end()));
-      }
+    ThreadPool pool;
+    const size_t threads = GetParallelThreads();
+    pool.AsyncRun(threads);
+
+    std::vector<std::vector<std::unique_ptr<geom::Mesh>>> road_mesh_lists =
+        ParallelTransform(
+            pool, threads,
+            GetNonJunctionRoads(),
+            [&](const Road *road) { return mesh_factory.GenerateAllWithMaxLen(*road); });
+    for (auto &road_mesh_list : road_mesh_lists) {
+      out_mesh_list.insert(
+          out_mesh_list.end(),
+          std::make_move_iterator(road_mesh_list.begin()),
+          std::make_move_iterator(road_mesh_list.end()));
     }
 
     // Generate roads within junctions and smooth them
+    std::vector<const Junction *> junctions;
+    junctions.reserve(_data.GetJunctions().size());
     for (const auto &junc_pair : _data.GetJunctions()) {
-      const auto &junction = junc_pair.second;
+      junctions.push_back(&junc_pair.second);
+    }
+    std::vector<std::unique_ptr<geom::Mesh>> junction_meshes = ParallelTransform(
+        pool, threads,
+        junctions,
+        [&](const Junction *junction) {
       std::vector<std::unique_ptr<geom::Mesh>> lane_meshes;
       std::vector<std::unique_ptr<geom::Mesh>> sidewalk_lane_meshes;
-      for(const auto &connection_pair : junction.GetConnections()) {
+      for(const auto &connection_pair : junction->GetConnections()) {
         const auto &connection = connection_pair.second;
         const auto &road = _data.GetRoads().at(connection.connecting_road);
         for (auto &&lane_section : road.GetLaneSections()) {
@@ -1078,22 +1492,30 @@ namespace road {
           }
         }
       }
+      std::unique_ptr<geom::Mesh> junction_mesh;
       if(params.smooth_junctions) {
-        auto merged_mesh = mesh_factory.MergeAndSmooth(lane_meshes);
-        for(auto& lane : sidewalk_lane_meshes) {
-          *merged_mesh += *lane;
-        }
-        out_mesh_list.push_back(std::move(merged_mesh));
+        junction_mesh = mesh_factory.MergeAndSmooth(lane_meshes);
       } else {
-        std::unique_ptr<geom::Mesh> junction_mesh = std::make_unique<geom::Mesh>();
-        for(auto& lane : lane_meshes) {
-          *junction_mesh += *lane;
-        }
-        for(auto& lane : sidewalk_lane_meshes) {
-          *junction_mesh += *lane;
-        }
-        out_mesh_list.push_back(std::move(junction_mesh));
+        junction_mesh = std::make_unique<geom::Mesh>();
+        MergeMeshes(*junction_mesh, lane_meshes);
       }
+      MergeMeshes(*junction_mesh, sidewalk_lane_meshes);
+      return junction_mesh;
+    });
+    out_mesh_list.insert(
+        out_mesh_list.end(),
+        std::make_move_iterator(junction_meshes.begin()),
+        std::make_move_iterator(junction_meshes.end()));
+
+    // Empty meshes can not be placed in any chunk.
+    out_mesh_list.erase(
+        std::remove_if(out_mesh_list.begin(), out_mesh_list.end(),
+            [](const std::unique_ptr<geom::Mesh> &mesh) {
+              return mesh->GetVerticesNum() == 0u;
+            }),
+        out_mesh_list.end());
+    if (out_mesh_list.empty()) {
+      return out_mesh_list;
     }
 
     auto min_pos = geom::Vector2D(
@@ -1109,19 +1531,28 @@ namespace road {
     }
     size_t mesh_amount_x = static_cast<size_t>((max_pos.x - min_pos.x)/params.max_road_length) + 1;
     size_t mesh_amount_y = static_cast<size_t>((max_pos.y - min_pos.y)/params.max_road_length) + 1;
-    std::vector<std::unique_ptr<geom::Mesh>> result;
-    result.reserve(mesh_amount_x*mesh_amount_y);
-    for (size_t i = 0; i < mesh_amount_x*mesh_amount_y; ++i) {
-      result.emplace_back(std::make_unique<geom::Mesh>());
-    }
+
+    // Bin the meshes by chunk first so each chunk is merged in a single pass.
+    std::vector<std::vector<std::unique_ptr<geom::Mesh>>> chunks(mesh_amount_x*mesh_amount_y);
     for (auto & mesh : out_mesh_list) {
       auto vertex = mesh->GetVertices().front();
       size_t x_pos = static_cast<size_t>((vertex.x - min_pos.x) / params.max_road_length);
       size_t y_pos = static_cast<size_t>((vertex.y - min_pos.y) / params.max_road_length);
-      *(result[x_pos + mesh_amount_x*y_pos]) += *mesh;
+      chunks[x_pos + mesh_amount_x*y_pos].push_back(std::move(mesh));
     }
 
-    return result;
+    std::vector<size_t> chunk_ids(chunks.size());
+    for (size_t i = 0; i < chunk_ids.size(); ++i) {
+      chunk_ids[i] = i;
+    }
+    return ParallelTransform(pool, threads, chunk_ids, [&](size_t chunk_id) {
+      auto chunk_mesh = std::make_unique<geom::Mesh>();
+      MergeMeshes(*chunk_mesh, chunks[chunk_id]);
+      if (params.enable_vertex_welding) {
+        chunk_mesh->WeldVertices();
+      }
+      return chunk_mesh;
+    });
   }
 
   geom::Mesh Map::GetAllCrosswalkMesh() const {
@@ -19,11 +19,16 @@
 
 #include <boost/optional.hpp>
 
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 namespace carla {
 namespace road {
 
+  class RoutePlanner;
+
   class Map : private MovableNonCopyable {
   public:
 
@@ -33,8 +38,11 @@ namespace road {
     /// -- Constructor ---------------------------------------------------------
     /// ========================================================================
 
-    Map(MapData m) : _data(std::move(m)) {
+    Map(MapData m)
+      : _data(std::move(m)),
+        _lane_conflicts(std::make_unique<LaneConflictCache>()) {
       CreateRtree();
+      CreateSignalIndex();
     }
 
     /// ========================================================================
@@ -81,6 +89,15 @@ namespace road {
     std::pair<const element::RoadInfoMarkRecord *, const element::RoadInfoMarkRecord *>
         GetMarkRecord(Waypoint waypoint) const;
 
+    /// Lane changes allowed at @a waypoint by the lane markings of
+    /// @a mark_record, as returned by GetMarkRecord.
+    static element::LaneMarking::LaneChange GetLaneChange(
+        Waypoint waypoint,
+        std::pair<const element::RoadInfoMarkRecord *, const element::RoadInfoMarkRecord *> mark_record);
+
+    /// Lane changes allowed at @a waypoint by its lane markings.
+    element::LaneMarking::LaneChange GetLaneChange(Waypoint waypoint) const;
+
     std::vector<element::LaneMarking> CalculateCrossedLanes(
         const geom::Location &origin,
         const geom::Location &destination) const;
@@ -150,12 +167,31 @@ namespace road {
     std::unordered_map<road::RoadId, std::unordered_set<road::RoadId>>
         ComputeJunctionConflicts(JuncId id) const;
 
-    /// Buids a mesh based on the OpenDRIVE
+    /// Compute, from the lane geometry, the zones where the driving lanes of
+    /// different connecting roads of junction @a id overlap. The result is
+    /// sorted by road, section and lane. Lanes leaving from or merging into
+    /// the same point only conflict where they overlap once apart. Use
+    /// GetJunctionLaneConflicts instead, that computes them once.
+    std::vector<Junction::LaneConflict> ComputeJunctionLaneConflicts(JuncId id) const;
+
+    /// Return the lane conflicts of junction @a id, computed the first time
+    /// the junction is queried, empty if there is no such junction.
+    const std::vector<Junction::LaneConflict> &GetJunctionLaneConflicts(JuncId id) const;
+
+    /// Return the conflicts of the lane of @a waypoint with other lanes of its
+    /// junction, empty if it is not inside a junction.
+    std::vector<Junction::LaneConflict> GetLaneConflicts(Waypoint waypoint) const;
+
+    /// Buids a mesh based on the OpenDRIVE. Roads and junctions are generated
+    /// in parallel; if @a weld_vertices is set, coincident vertices are merged.
     geom::Mesh GenerateMesh(
         const double distance,
         const float extra_width = 0.6f,
-        const  bool smooth_junctions = true) const;
+        const  bool smooth_junctions = true,
+        const  bool weld_vertices = false) const;
 
+    /// Buids a mesh based on the OpenDRIVE split in square chunks of
+    /// @a params.max_road_length.
     std::vector<std::unique_ptr<geom::Mesh>> GenerateChunkedMesh(
         const rpc::OpendriveGenerationParameters& params) const;
 
@@ -176,11 +212,16 @@ namespace road {
     MapData &GetMap() {
       return _data;
     }
+
+    const MapData &GetMap() const {
+      return _data;
+    }
 #endif // LIBCARLA_WITH_GTEST
 
 private:
 
     friend MapBuilder;
+    friend RoutePlanner;
     MapData _data;
 
     using Rtree = geom::SegmentCloudRtree<Waypoint>;
@@ -188,6 +229,46 @@ private:
 
     void CreateRtree();
 
+    /// Lane conflicts of the junctions queried so far, sorted by road, section
+    /// and lane.
+    struct LaneConflictCache {
+      std::mutex mutex;
+      std::unordered_map<JuncId, std::vector<Junction::LaneConflict>> junctions;
+    };
+
+    std::unique_ptr<LaneConflictCache> _lane_conflicts;
+
+    /// Signals affecting a lane, sorted in its driving direction, and the
+    /// lanes that follow it.
+    struct LaneSignalIndex {
+      const Lane *lane = nullptr;
+      bool is_junction = false;
+      std::vector<const element::RoadInfoSignal *> signals;
+      std::vector<size_t> successors;
+    };
+
+    std::vector<LaneSignalIndex> _lane_signal_index;
+
+    std::unordered_map<const Lane *, size_t> _lane_signal_ids;
+
+    /// Precompute the signals of each lane used by GetSignalsInDistance.
+    void CreateSignalIndex();
+
+    /// Append to @a result the signals within @a distance of @a waypoint,
+    /// walking the successors of the lane once its remaining length is
+    /// consumed.
+    void CollectSignalsInDistance(
+        size_t lane_index,
+        Waypoint waypoint,
+        double distance,
+        double remaining_lane_length,
+        double accumulated_s,
+        bool stop_at_junction,
+        std::vector<SignalSearchData> &result) const;
+
+    /// Return all the roads that are not part of a junction.
+    std::vector<const Road *> GetNonJunctionRoads() const;
+
     /// Helper Functions for constructing the rtree element list
     void AddElementToRtree(
         std::vector<Rtree::TreeElement> &rtree_elements,
@@ -0,0 +1,810 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#include "carla/road/RoutePlanner.h"
+
+#include "carla/Debug.h"
+#include "carla/Logging.h"
+#include "carla/ParallelFor.h"
+#include "carla/road/Map.h"
+#include "carla/road/element/LaneMarking.h"
+#include "carla/road/element/RoadInfoMarkRecord.h"
+
+#include <boost/container_hash/hash.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+
+namespace carla {
+namespace road {
+
+  using namespace carla::road::element;
+
+  using NodeId = RoutePlanner::NodeId;
+
+  static constexpr float INF = std::numeric_limits<float>::infinity();
+
+  /// Maximum number of nodes settled by each witness search while building the
+  /// contraction hierarchy. Missing a witness only adds a redundant shortcut.
+  static constexpr size_t MAX_WITNESS_SETTLED_NODES = 200u;
+
+  // ===========================================================================
+  // -- Static local methods ---------------------------------------------------
+  // ===========================================================================
+
+  /// Same as in road::Map, keep the entry of each lane slightly inside it.
+  static double GetDistanceAtStartOfLane(const Lane &lane) {
+    constexpr double EPSILON = 100.0 * std::numeric_limits<double>::epsilon();
+    if (lane.GetId() <= 0) {
+      return lane.GetDistance() + EPSILON;
+    } else {
+      return lane.GetDistance() + lane.GetLength() - EPSILON;
+    }
+  }
+
+  /// Distance driven along the lane of @a waypoint from its start to
+  /// @a waypoint.
+  static double GetDistanceFromStartOfLane(const Map &map, const Waypoint &waypoint) {
+    const auto &lane = map.GetLane(waypoint);
+    const double distance = waypoint.lane_id <= 0 ?
+        waypoint.s - lane.GetDistance() :
+        lane.GetDistance() + lane.GetLength() - waypoint.s;
+    return std::max(0.0, distance);
+  }
+
+  /// Build a CSR adjacency from a list of (source, edge) pairs.
+  template <typename EdgeT>
+  static void BuildCSR(
+      size_t node_count,
+      std::vector<std::pair<NodeId, EdgeT>> &edges,
+      std::vector<uint32_t> &offsets,
+      std::vector<EdgeT> &result) {
+    std::stable_sort(edges.begin(), edges.end(), [](const auto &lhs, const auto &rhs) {
+      return lhs.first < rhs.first;
+    });
+    offsets.assign(node_count + 1u, 0u);
+    for (const auto &edge : edges) {
+      ++offsets[edge.first + 1u];
+    }
+    for (size_t i = 0u; i < node_count; ++i) {
+      offsets[i + 1u] += offsets[i];
+    }
+    result.clear();
+    result.reserve(edges.size());
+    for (const auto &edge : edges) {
+      result.emplace_back(edge.second);
+    }
+  }
+
+  /// Follow @a parents from @a node back to a node without parent.
+  static std::vector<NodeId> TracePath(const std::vector<NodeId> &parents, NodeId node) {
+    std::vector<NodeId> path;
+    for (; node != RoutePlanner::INVALID_NODE; node = parents[node]) {
+      path.emplace_back(node);
+    }
+    std::reverse(path.begin(), path.end());
+    return path;
+  }
+
+  using QueueItem = std::pair<float, NodeId>;
+
+  using Queue = std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>>;
+
+  // ===========================================================================
+  // -- RoutePlanner: Graph construction ---------------------------------------
+  // ===========================================================================
+
+  RoutePlanner::RoutePlanner(const Map &map, const double lane_change_cost)
+    : _map(map) {
+    BuildGraph(lane_change_cost);
+  }
+
+  void RoutePlanner::BuildGraph(const double lane_change_cost) {
+    // Nodes, one per drivable lane.
+    for (const auto &pair : _map._data.GetRoads()) {
+      const auto &road = pair.second;
+      for (const auto &lane_section : road.GetLaneSections()) {
+        for (const auto &lane_pair : lane_section.GetLanes()) {
+          const auto &lane = lane_pair.second;
+          if (lane.GetId() == 0 ||
+              (static_cast<uint32_t>(lane.GetType()) & static_cast<uint32_t>(Lane::LaneType::Driving)) == 0u) {
+            continue;
+          }
+          const Waypoint entry{
+              road.GetId(),
+              lane_section.GetId(),
+              lane.GetId(),
+              GetDistanceAtStartOfLane(lane)};
+          _node_ids.emplace(
+              LaneKey{entry.road_id, entry.section_id, entry.lane_id},
+              static_cast<NodeId>(_entries.size()));
+          _entries.emplace_back(entry);
+          _locations.emplace_back(_map.ComputeTransform(entry).location);
+          _lengths.emplace_back(static_cast<float>(lane.GetLength()));
+        }
+      }
+    }
+
+    // Edges.
+    std::vector<std::pair<NodeId, Edge>> edges;
+    for (NodeId node = 0u; node < _entries.size(); ++node) {
+      const auto &entry = _entries[node];
+      for (const auto &successor : _map.GetSuccessors(entry)) {
+        const NodeId target = GetNodeId(successor);
+        if (target != INVALID_NODE) {
+          edges.push_back({node, Edge{target, _lengths[node], EdgeType::LaneFollow}});
+        }
+      }
+      if (_map.GetLaneType(entry) != Lane::LaneType::Driving) {
+        continue;
+      }
+      // Check the lane markings at the middle of the lane.
+      const auto &lane = _map.GetLane(entry);
+      Waypoint middle = entry;
+      middle.s = lane.GetDistance() + 0.5 * lane.GetLength();
+      const uint8_t lane_change = static_cast<uint8_t>(_map.GetLaneChange(middle));
+      const auto add_lane_change = [&](boost::optional<Waypoint> other, EdgeType type) {
+        // Never change to a lane of the opposite direction.
+        if (!other.has_value() || (other->lane_id > 0) != (entry.lane_id > 0)) {
+          return;
+        }
+        const NodeId target = GetNodeId(*other);
+        if (target == INVALID_NODE || _map.GetLaneType(*other) != Lane::LaneType::Driving) {
+          return;
+        }
+        edges.push_back({node, Edge{target, static_cast<float>(lane_change_cost), type}});
+      };
+      if (lane_change & static_cast<uint8_t>(LaneMarking::LaneChange::Right)) {
+        add_lane_change(_map.GetRight(entry), EdgeType::ChangeLaneRight);
+      }
+      if (lane_change & static_cast<uint8_t>(LaneMarking::LaneChange::Left)) {
+        add_lane_change(_map.GetLeft(entry), EdgeType::ChangeLaneLeft);
+      }
+    }
+
+    std::vector<std::pair<NodeId, Edge>> reverse_edges;
+    reverse_edges.reserve(edges.size());
+    for (const auto &edge : edges) {
+      reverse_edges.push_back({edge.second.target, Edge{edge.first, edge.second.cost, edge.second.type}});
+    }
+
+    // The straight line distance scaled by the smallest ratio between the cost
+    // and the length of an edge is a consistent heuristic for A*.
+    _heuristic_scale = 1.0f;
+    for (const auto &edge : edges) {
+      const float distance = _locations[edge.first].Distance(_locations[edge.second.target]);
+      if (distance > 0.0f) {
+        _heuristic_scale = std::min(_heuristic_scale, edge.second.cost / distance);
+      }
+    }
+    _heuristic_scale = std::max(0.0f, 0.99f * _heuristic_scale);
+
+    BuildCSR(_entries.size(), edges, _offsets, _edges);
+    BuildCSR(_entries.size(), reverse_edges, _reverse_offsets, _reverse_edges);
+    log_debug("RoutePlanner: built graph with", _entries.size(), "lanes and", _edges.size(), "edges");
+  }
+
+  size_t RoutePlanner::LaneKeyHash::operator()(const LaneKey &key) const {
+    size_t seed = 0u;
+    boost::hash_combine(seed, key.road_id);
+    boost::hash_combine(seed, key.section_id);
+    boost::hash_combine(seed, key.lane_id);
+    return seed;
+  }
+
+  NodeId RoutePlanner::GetNodeId(const Waypoint &waypoint) const {
+    auto it = _node_ids.find(LaneKey{waypoint.road_id, waypoint.section_id, waypoint.lane_id});
+    return it != _node_ids.end() ? it->second : INVALID_NODE;
+  }
+
+  const RoutePlanner::Edge *RoutePlanner::FindEdge(const NodeId from, const NodeId to) const {
+    const Edge *result = nullptr;
+    for (auto i = _offsets[from]; i < _offsets[from + 1u]; ++i) {
+      const Edge &edge = _edges[i];
+      if (edge.target != to) {
+        continue;
+      }
+      if (result == nullptr ||
+          edge.type == EdgeType::LaneFollow ||
+          (result->type != EdgeType::LaneFollow && edge.cost < result->cost)) {
+        result = &edge;
+      }
+    }
+    return result;
+  }
+
+  // ===========================================================================
+  // -- RoutePlanner: Contraction hierarchy ------------------------------------
+  // ===========================================================================
+
+  void RoutePlanner::BuildContractionHierarchy() {
+    const size_t node_count = _entries.size();
+    std::vector<std::vector<ShortcutEdge>> out(node_count);
+    std::vector<std::vector<ShortcutEdge>> in(node_count);
+
+    // Keep only the cheapest edge between each pair of nodes.
+    const auto add_edge = [&](NodeId from, NodeId to, float cost, NodeId middle) {
+      for (auto &edge : out[from]) {
+        if (edge.target == to) {
+          if (cost < edge.cost) {
+            edge.cost = cost;
+            edge.middle = middle;
+            for (auto &reverse : in[to]) {
+              if (reverse.target == from) {
+                reverse.cost = cost;
+                reverse.middle = middle;
+              }
+            }
+          }
+          return;
+        }
+      }
+      out[from].push_back(ShortcutEdge{to, cost, middle});
+      in[to].push_back(ShortcutEdge{from, cost, middle});
+    };
+    for (NodeId node = 0u; node < node_count; ++node) {
+      for (auto i = _offsets[node]; i < _offsets[node + 1u]; ++i) {
+        if (_edges[i].target != node) {
+          add_edge(node, _edges[i].target, _edges[i].cost, INVALID_NODE);
+        }
+      }
+    }
+
+    std::vector<bool> contracted(node_count, false);
+    std::vector<uint32_t> contracted_neighbours(node_count, 0u);
+
+    // Scratch space of the witness searches.
+    std::vector<float> distances(node_count, INF);
+    std::vector<NodeId> touched;
+
+    // Find the shortcuts needed to contract @a node, only counting them if
+    // @a shortcuts is null.
+    const auto find_shortcuts = [&](
+        NodeId node,
+        std::vector<std::pair<NodeId, ShortcutEdge>> *shortcuts) -> size_t {
+      size_t count = 0u;
+      for (const auto &incoming : in[node]) {
+        const NodeId source = incoming.target;
+        if (contracted[source]) {
+          continue;
+        }
+        bool has_targets = false;
+        float max_cost = 0.0f;
+        for (const auto &outgoing : out[node]) {
+          if (!contracted[outgoing.target] && outgoing.target != source) {
+            has_targets = true;
+            max_cost = std::max(max_cost, incoming.cost + outgoing.cost);
+          }
+        }
+        // Paths through zero length lanes cost nothing, but still need a
+        // shortcut unless there is a witness of the same cost.
+        if (!has_targets) {
+          continue;
+        }
+        // Limited Dijkstra from source avoiding node.
+        Queue queue;
+        distances[source] = 0.0f;
+        touched.push_back(source);
+        queue.push({0.0f, source});
+        size_t settled = 0u;
+        while (!queue.empty() && settled < MAX_WITNESS_SETTLED_NODES) {
+          const auto current = queue.top();
+          queue.pop();
+          if (current.first > distances[current.second]) {
+            continue;
+          }
+          if (current.first > max_cost) {
+            break;
+          }
+          ++settled;
+          for (const auto &edge : out[current.second]) {
+            if (contracted[edge.target] || edge.target == node) {
+              continue;
+            }
+            const float distance = current.first + edge.cost;
+            if (distance < distances[edge.target]) {
+              if (distances[edge.target] == INF) {
+                touched.push_back(edge.target);
+              }
+              distances[edge.target] = distance;
+              queue.push({distance, edge.target});
+            }
+          }
+        }
+        for (const auto &outgoing : out[node]) {
+          const NodeId target = outgoing.target;
+          if (contracted[target] || target == source) {
+            continue;
+          }
+          const float cost = incoming.cost + outgoing.cost;
+          if (distances[target] > cost) {
+            ++count;
+            if (shortcuts != nullptr) {
+              shortcuts->push_back({source, ShortcutEdge{target, cost, node}});
+            }
+          }
+        }
+        for (const NodeId touched_node : touched) {
+          distances[touched_node] = INF;
+        }
+        touched.clear();
+      }
+      return count;
+    };
+
+    const auto get_priority = [&](NodeId node) {
+      size_t degree = 0u;
+      for (const auto &edge : in[node]) {
+        degree += contracted[edge.target] ? 0u : 1u;
+      }
+      for (const auto &edge : out[node]) {
+        degree += contracted[edge.target] ? 0u : 1u;
+      }
+      const auto shortcuts = static_cast<float>(find_shortcuts(node, nullptr));
+      return shortcuts - static_cast<float>(degree) + static_cast<float>(contracted_neighbours[node]);
+    };
+
+    Queue order;
+    for (NodeId node = 0u; node < node_count; ++node) {
+      order.push({get_priority(node), node});
+    }
+
+    std::vector<std::pair<NodeId, ShortcutEdge>> up_edges;
+    std::vector<std::pair<NodeId, ShortcutEdge>> down_edges;
+    std::vector<std::pair<NodeId, ShortcutEdge>> shortcuts;
+    std::vector<uint32_t> ranks(node_count, 0u);
+    uint32_t rank = 0u;
+    while (!order.empty()) {
+      const NodeId node = order.top().second;
+      order.pop();
+      if (contracted[node]) {
+        continue;
+      }
+      // Lazy update, re-insert if the priority is no longer the lowest.
+      const float priority = get_priority(node);
+      if (!order.empty() && priority > order.top().first) {
+        order.push({priority, node});
+        continue;
+      }
+
+      shortcuts.clear();
+      find_shortcuts(node, &shortcuts);
+      ranks[node] = rank++;
+      contracted[node] = true;
+
+      // The remaining edges of the node go to higher ranked nodes.
+      for (const auto &edge : out[node]) {
+        if (!contracted[edge.target]) {
+          up_edges.push_back({node, edge});
+          ++contracted_neighbours[edge.target];
+        }
+      }
+      for (const auto &edge : in[node]) {
+        if (!contracted[edge.target]) {
+          down_edges.push_back({node, edge});
+          ++contracted_neighbours[edge.target];
+        }
+      }
+      for (const auto &shortcut : shortcuts) {
+        add_edge(shortcut.first, shortcut.second.target, shortcut.second.cost, shortcut.second.middle);
+      }
+    }
+
+    _ranks = std::move(ranks);
+    BuildCSR(node_count, up_edges, _ch_up_offsets, _ch_up_edges);
+    BuildCSR(node_count, down_edges, _ch_down_offsets, _ch_down_edges);
+    log_debug(
+        "RoutePlanner: built contraction hierarchy with",
+        _ch_up_edges.size() + _ch_down_edges.size(),
+        "edges");
+  }
+
+  // ===========================================================================
+  // -- RoutePlanner: Queries --------------------------------------------------
+  // ===========================================================================
+
+  std::vector<NodeId> RoutePlanner::AStar(
+      const Sources &sources,
+      const NodeId target,
+      float &cost) const {
+    const auto &goal = _locations[target];
+    const auto heuristic = [&](NodeId node) {
+      return _heuristic_scale * _locations[node].Distance(goal);
+    };
+    std::vector<float> distances(_entries.size(), INF);
+    std::vector<NodeId> parents(_entries.size(), INVALID_NODE);
+    Queue queue;
+    for (const auto &source : sources) {
+      if (source.second < distances[source.first]) {
+        distances[source.first] = source.second;
+        queue.push({source.second + heuristic(source.first), source.first});
+      }
+    }
+    while (!queue.empty()) {
+      const NodeId node = queue.top().second;
+      const float estimate = queue.top().first;
+      queue.pop();
+      if (estimate > distances[node] + heuristic(node)) {
+        continue;
+      }
+      if (node == target) {
+        cost = distances[node];
+        return TracePath(parents, node);
+      }
+      for (auto i = _offsets[node]; i < _offsets[node + 1u]; ++i) {
+        const Edge &edge = _edges[i];
+        const float distance = distances[node] + edge.cost;
+        if (distance < distances[edge.target]) {
+          distances[edge.target] = distance;
+          parents[edge.target] = node;
+          queue.push({distance + heuristic(edge.target), edge.target});
+        }
+      }
+    }
+    return {};
+  }
+
+  std::vector<NodeId> RoutePlanner::BidirectionalDijkstra(
+      const Sources &sources,
+      const NodeId target,
+      float &cost) const {
+    const size_t node_count = _entries.size();
+    std::vector<float> distances[2u] = {
+        std::vector<float>(node_count, INF),
+        std::vector<float>(node_count, INF)};
+    std::vector<NodeId> parents[2u] = {
+        std::vector<NodeId>(node_count, INVALID_NODE),
+        std::vector<NodeId>(node_count, INVALID_NODE)};
+    Queue queues[2u];
+    for (const auto &source : sources) {
+      if (source.second < distances[0u][source.first]) {
+        distances[0u][source.first] = source.second;
+        queues[0u].push({source.second, source.first});
+      }
+    }
+    distances[1u][target] = 0.0f;
+    queues[1u].push({0.0f, target});
+
+    float best = INF;
+    NodeId meeting = INVALID_NODE;
+    const auto update_best = [&](NodeId node) {
+      const float total = distances[0u][node] + distances[1u][node];
+      if (total < best) {
+        best = total;
+        meeting = node;
+      }
+    };
+    for (const auto &source : sources) {
+      update_best(source.first);
+    }
+
+    while (!queues[0u].empty() && !queues[1u].empty()) {
+      if (queues[0u].top().first + queues[1u].top().first >= best) {
+        break;
+      }
+      // Expand the direction with the smallest frontier.
+      const size_t side = queues[0u].size() <= queues[1u].size() ? 0u : 1u;
+      const auto &offsets = side == 0u ? _offsets : _reverse_offsets;
+      const auto &edges = side == 0u ? _edges : _reverse_edges;
+      const auto current = queues[side].top();
+      queues[side].pop();
+      if (current.first > distances[side][current.second]) {
+        continue;
+      }
+      for (auto i = offsets[current.second]; i < offsets[current.second + 1u]; ++i) {
+        const Edge &edge = edges[i];
+        const float distance = current.first + edge.cost;
+        if (distance < distances[side][edge.target]) {
+          distances[side][edge.target] = distance;
+          parents[side][edge.target] = current.second;
+          queues[side].push({distance, edge.target});
+          update_best(edge.target);
+        }
+      }
+    }
+    if (meeting == INVALID_NODE) {
+      return {};
+    }
+    cost = best;
+    auto path = TracePath(parents[0u], meeting);
+    for (NodeId node = parents[1u][meeting]; node != INVALID_NODE; node = parents[1u][node]) {
+      path.emplace_back(node);
+    }
+    return path;
+  }
+
+  std::vector<NodeId> RoutePlanner::ContractionHierarchyQuery(
+      const Sources &sources,
+      const NodeId target,
+      float &cost) const {
+    DEBUG_ASSERT(HasContractionHierarchy());
+    const size_t node_count = _entries.size();
+    std::vector<float> distances[2u] = {
+        std::vector<float>(node_count, INF),
+        std::vector<float>(node_count, INF)};
+    std::vector<NodeId> parents[2u] = {
+        std::vector<NodeId>(node_count, INVALID_NODE),
+        std::vector<NodeId>(node_count, INVALID_NODE)};
+    Queue queues[2u];
+    for (const auto &source : sources) {
+      if (source.second < distances[0u][source.first]) {
+        distances[0u][source.first] = source.second;
+        queues[0u].push({source.second, source.first});
+      }
+    }
+    distances[1u][target] = 0.0f;
+    queues[1u].push({0.0f, target});
+
+    // Both searches only go up in the hierarchy, each one can stop once its
+    // frontier is further than the best route found.
+    float best = INF;
+    NodeId meeting = INVALID_NODE;
+    for (size_t side = 0u; side < 2u; ++side) {
+      const auto &offsets = side == 0u ? _ch_up_offsets : _ch_down_offsets;
+      const auto &edges = side == 0u ? _ch_up_edges : _ch_down_edges;
+      auto &queue = queues[side];
+      while (!queue.empty() && queue.top().first < best) {
+        const auto current = queue.top();
+        queue.pop();
+        if (current.first > distances[side][current.second]) {
+          continue;
+        }
+        if (side == 1u) {
+          const float total = distances[0u][current.second] + current.first;
+          if (total < best) {
+            best = total;
+            meeting = current.second;
+          }
+        }
+        for (auto i = offsets[current.second]; i < offsets[current.second + 1u]; ++i) {
+          const auto &edge = edges[i];
+          const float distance = current.first + edge.cost;
+          if (distance < distances[side][edge.target]) {
+            distances[side][edge.target] = distance;
+            parents[side][edge.target] = current.second;
+            queue.push({distance, edge.target});
+          }
+        }
+      }
+      if (side == 0u) {
+        // The forward search runs to completion, the backward search looks up
+        // the forward distances as it settles nodes.
+        best = INF;
+      }
+    }
+    if (meeting == INVALID_NODE) {
+      return {};
+    }
+    cost = best;
+
+    // Unpack the shortcuts of both halves of the route.
+    const auto up_path = TracePath(parents[0u], meeting);
+    std::vector<NodeId> path{up_path.front()};
+    for (size_t i = 1u; i < up_path.size(); ++i) {
+      UnpackShortcut(up_path[i - 1u], up_path[i], path);
+    }
+    for (NodeId node = meeting; parents[1u][node] != INVALID_NODE; node = parents[1u][node]) {
+      UnpackShortcut(node, parents[1u][node], path);
+    }
+    return path;
+  }
+
+  void RoutePlanner::UnpackShortcut(
+      const NodeId from,
+      const NodeId to,
+      std::vector<NodeId> &path) const {
+    // Find the edge in the upward graph of the lowest ranked end point.
+    const ShortcutEdge *shortcut = nullptr;
+    if (_ranks[from] < _ranks[to]) {
+      for (auto i = _ch_up_offsets[from]; i < _ch_up_offsets[from + 1u]; ++i) {
+        if (_ch_up_edges[i].target == to) {
+          shortcut = &_ch_up_edges[i];
+        }
+      }
+    } else {
+      for (auto i = _ch_down_offsets[to]; i < _ch_down_offsets[to + 1u]; ++i) {
+        if (_ch_down_edges[i].target == from) {
+          shortcut = &_ch_down_edges[i];
+        }
+      }
+    }
+    DEBUG_ASSERT(shortcut != nullptr);
+    if (shortcut == nullptr || shortcut->middle == INVALID_NODE) {
+      path.emplace_back(to);
+    } else {
+      UnpackShortcut(from, shortcut->middle, path);
+      UnpackShortcut(shortcut->middle, to, path);
+    }
+  }
+
+  RoutePlanner::Route RoutePlanner::ComputeRoute(
+      const Waypoint &origin,
+      const Waypoint &destination,
+      const Algorithm algorithm) const {
+    Route route;
+    const NodeId origin_node = GetNodeId(origin);
+    const NodeId destination_node = GetNodeId(destination);
+    if (origin_node == INVALID_NODE || destination_node == INVALID_NODE) {
+      log_warning("RoutePlanner: origin or destination not on a drivable lane");
+      return route;
+    }
+    const double origin_distance = GetDistanceFromStartOfLane(_map, origin);
+    const double destination_distance = GetDistanceFromStartOfLane(_map, destination);
+
+    // Lane changes from the origin happen at the origin's position instead of
+    // at the start of the lane, find the neighbouring lanes reachable there.
+    struct Lateral {
+      NodeId node;
+      float cost;
+      std::vector<NodeId> path;
+    };
+    std::vector<Lateral> laterals{Lateral{origin_node, 0.0f, {}}};
+    for (size_t i = 0u; i < laterals.size(); ++i) {
+      for (auto j = _offsets[laterals[i].node]; j < _offsets[laterals[i].node + 1u]; ++j) {
+        const Edge &edge = _edges[j];
+        if (edge.type == EdgeType::LaneFollow ||
+            std::any_of(laterals.begin(), laterals.end(), [&](const Lateral &lateral) {
+              return lateral.node == edge.target;
+            })) {
+          continue;
+        }
+        Lateral lateral{edge.target, laterals[i].cost + edge.cost, laterals[i].path};
+        lateral.path.emplace_back(edge.target);
+        laterals.emplace_back(std::move(lateral));
+      }
+    }
+
+    // The search starts at the successors of these lanes, the destination may
+    // also be ahead in one of them.
+    float best_cost = INF;
+    std::vector<NodeId> best_path;
+    Sources sources;
+    std::vector<const Lateral *> source_laterals;
+    std::unordered_map<NodeId, size_t> source_indices;
+    for (const auto &lateral : laterals) {
+      if (lateral.node == destination_node && origin_distance <= destination_distance) {
+        const float cost = lateral.cost + static_cast<float>(destination_distance - origin_distance);
+        if (cost < best_cost) {
+          best_cost = cost;
+          best_path = lateral.path;
+        }
+      }
+      const float remaining = lateral.cost + static_cast<float>(
+          std::max(0.0, static_cast<double>(_lengths[lateral.node]) - origin_distance));
+      for (auto i = _offsets[lateral.node]; i < _offsets[lateral.node + 1u]; ++i) {
+        const Edge &edge = _edges[i];
+        if (edge.type != EdgeType::LaneFollow) {
+          continue;
+        }
+        auto result = source_indices.emplace(edge.target, sources.size());
+        if (result.second) {
+          sources.push_back({edge.target, remaining});
+          source_laterals.emplace_back(&lateral);
+        } else if (remaining < sources[result.first->second].second) {
+          sources[result.first->second].second = remaining;
+          source_laterals[result.first->second] = &lateral;
+        }
+      }
+    }
+
+    float cost = INF;
+    std::vector<NodeId> path;
+    if (!sources.empty()) {
+      switch (algorithm) {
+        case Algorithm::AStar:
+          path = AStar(sources, destination_node, cost);
+          break;
+        case Algorithm::BidirectionalDijkstra:
+          path = BidirectionalDijkstra(sources, destination_node, cost);
+          break;
+        case Algorithm::ContractionHierarchy:
+          if (!HasContractionHierarchy()) {
+            log_warning("RoutePlanner: contraction hierarchy not built, falling back to A*");
+            path = AStar(sources, destination_node, cost);
+          } else {
+            path = ContractionHierarchyQuery(sources, destination_node, cost);
+          }
+          break;
+      }
+    }
+    if (!path.empty() && cost + static_cast<float>(destination_distance) < best_cost) {
+      best_cost = cost + static_cast<float>(destination_distance);
+      best_path = source_laterals[source_indices.at(path.front())]->path;
+      best_path.insert(best_path.end(), path.begin(), path.end());
+    } else if (best_cost == INF) {
+      return route;
+    }
+
+    route.lanes.emplace_back(origin);
+    route.edges.emplace_back(EdgeType::LaneFollow);
+    NodeId previous = origin_node;
+    for (const NodeId node : best_path) {
+      const Edge *edge = FindEdge(previous, node);
+      DEBUG_ASSERT(edge != nullptr);
+      route.lanes.emplace_back(_entries[node]);
+      route.edges.emplace_back(edge != nullptr ? edge->type : EdgeType::LaneFollow);
+      previous = node;
+    }
+    route.cost = best_cost;
+    return route;
+  }
+
+  std::vector<Waypoint> RoutePlanner::TraceRoute(
+      const Waypoint &origin,
+      const Waypoint &destination,
+      const double resolution,
+      const Algorithm algorithm) const {
+    DEBUG_ASSERT(resolution > 0.0);
+    const Route route = ComputeRoute(origin, destination, algorithm);
+    std::vector<Waypoint> result;
+    if (route.lanes.empty()) {
+      return result;
+    }
+    const auto is_same_lane = [](const Waypoint &lhs, const Waypoint &rhs) {
+      return lhs.road_id == rhs.road_id &&
+          lhs.section_id == rhs.section_id &&
+          lhs.lane_id == rhs.lane_id;
+    };
+
+    Waypoint current = route.lanes.front();
+    result.emplace_back(current);
+    for (size_t i = 0u; i < route.lanes.size(); ++i) {
+      const bool is_last = (i + 1u == route.lanes.size());
+      if (i > 0u) {
+        if (route.edges[i] == EdgeType::LaneFollow) {
+          current = route.lanes[i];
+        } else {
+          // Change lane at the current position.
+          current = Waypoint{
+              route.lanes[i].road_id,
+              route.lanes[i].section_id,
+              route.lanes[i].lane_id,
+              current.s};
+        }
+        result.emplace_back(current);
+      }
+      // If the next step is a lane change do it right away.
+      if (!is_last && route.edges[i + 1u] != EdgeType::LaneFollow) {
+        continue;
+      }
+      // Drive along the lane up to its end, or up to the destination.
+      const double end = is_last ?
+          GetDistanceFromStartOfLane(_map, destination) :
+          static_cast<double>(_lengths[GetNodeId(current)]);
+      double position = GetDistanceFromStartOfLane(_map, current);
+      while (end - position > resolution) {
+        const auto next = _map.GetNext(current, resolution);
+        if (next.size() != 1u || !is_same_lane(next.front(), current)) {
+          break;
+        }
+        current = next.front();
+        position += resolution;
+        result.emplace_back(current);
+      }
+      if (is_last && !(result.back() == destination)) {
+        result.emplace_back(destination);
+      }
+    }
+    return result;
+  }
+
+  std::vector<std::vector<Waypoint>> RoutePlanner::TraceRoutes(
+      const std::vector<std::pair<Waypoint, Waypoint>> &queries,
+      const double resolution,
+      const Algorithm algorithm,
+      ThreadPool &pool,
+      const size_t threads) const {
+    std::vector<std::vector<Waypoint>> routes(queries.size());
+    ParallelFor(pool, threads, queries.size(), 1u, [&](const size_t i) {
+      routes[i] = TraceRoute(queries[i].first, queries[i].second, resolution, algorithm);
+    });
+    return routes;
+  }
+
+} // namespace road
+} // namespace carla
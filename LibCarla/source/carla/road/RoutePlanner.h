@@ -0,0 +1,218 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#pragma once
+
+#include "carla/NonCopyable.h"
+#include "carla/geom/Location.h"
+#include "carla/road/RoadTypes.h"
+#include "carla/road/element/Waypoint.h"
+
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace carla {
+
+  class ThreadPool;
+
+namespace road {
+
+  class Map;
+
+  /// Routing engine over the lane topology of a road::Map.
+  ///
+  /// Every drivable lane is a node of a directed graph stored in compressed
+  /// sparse row format. Edges link each lane with its successors, at the cost
+  /// of the length of the lane, and with its left and right neighbours when
+  /// the lane markings allow changing lanes. Routes can be found with A*,
+  /// bidirectional Dijkstra or, once BuildContractionHierarchy has been
+  /// called, with a contraction hierarchy query.
+  ///
+  /// @warning The planner keeps a reference to @a map, it must outlive it.
+  class RoutePlanner : private NonCopyable {
+  public:
+
+    using Waypoint = element::Waypoint;
+
+    using NodeId = uint32_t;
+
+    static constexpr NodeId INVALID_NODE = std::numeric_limits<NodeId>::max();
+
+    enum class Algorithm : uint8_t {
+      AStar,
+      BidirectionalDijkstra,
+      ContractionHierarchy
+    };
+
+    enum class EdgeType : uint8_t {
+      LaneFollow,
+      ChangeLaneLeft,
+      ChangeLaneRight
+    };
+
+    struct Route {
+      /// Waypoint at the origin followed by the entry waypoint of each lane
+      /// of the route. Lanes reached changing lanes are entered at the
+      /// position of the previous one instead.
+      std::vector<Waypoint> lanes;
+      /// How each lane is reached from the previous one, the first one is
+      /// always LaneFollow.
+      std::vector<EdgeType> edges;
+      /// Cost of the route in meters.
+      double cost = 0.0;
+    };
+
+    /// Build the lane graph of @a map. Changing lanes costs at least
+    /// @a lane_change_cost meters.
+    explicit RoutePlanner(const Map &map, double lane_change_cost = 10.0);
+
+    /// Preprocess the graph into a contraction hierarchy, required by
+    /// Algorithm::ContractionHierarchy. May take a few seconds on big maps.
+    void BuildContractionHierarchy();
+
+    bool HasContractionHierarchy() const {
+      return !_ch_up_offsets.empty();
+    }
+
+    /// Compute the sequence of lanes to drive from @a origin to
+    /// @a destination. Returns an empty route if there is none.
+    Route ComputeRoute(
+        const Waypoint &origin,
+        const Waypoint &destination,
+        Algorithm algorithm = Algorithm::AStar) const;
+
+    /// Compute the route from @a origin to @a destination and sample it every
+    /// @a resolution meters. Returns an empty list if there is no route.
+    std::vector<Waypoint> TraceRoute(
+        const Waypoint &origin,
+        const Waypoint &destination,
+        double resolution,
+        Algorithm algorithm = Algorithm::AStar) const;
+
+    /// Trace the route between each origin and destination of @a queries, as
+    /// TraceRoute, splitting the queries across the @a threads threads
+    /// running in @a pool. Routes are returned in the order of @a queries.
+    std::vector<std::vector<Waypoint>> TraceRoutes(
+        const std::vector<std::pair<Waypoint, Waypoint>> &queries,
+        double resolution,
+        Algorithm algorithm,
+        ThreadPool &pool,
+        size_t threads) const;
+
+    /// Node of the lane of @a waypoint, INVALID_NODE if it is not drivable.
+    NodeId GetNodeId(const Waypoint &waypoint) const;
+
+    size_t GetNodeCount() const {
+      return _entries.size();
+    }
+
+    size_t GetEdgeCount() const {
+      return _edges.size();
+    }
+
+  private:
+
+    struct Edge {
+      NodeId target;
+      float cost;
+      EdgeType type;
+    };
+
+    /// Edge of the contraction hierarchy, @a middle is the contracted node of
+    /// a shortcut or INVALID_NODE for an edge of the original graph.
+    struct ShortcutEdge {
+      NodeId target;
+      float cost;
+      NodeId middle;
+    };
+
+    /// Ids of a lane.
+    struct LaneKey {
+      RoadId road_id;
+      SectionId section_id;
+      LaneId lane_id;
+
+      bool operator==(const LaneKey &rhs) const {
+        return road_id == rhs.road_id &&
+            section_id == rhs.section_id &&
+            lane_id == rhs.lane_id;
+      }
+    };
+
+    struct LaneKeyHash {
+      size_t operator()(const LaneKey &key) const;
+    };
+
+    using Sources = std::vector<std::pair<NodeId, float>>;
+
+    void BuildGraph(double lane_change_cost);
+
+    std::vector<NodeId> AStar(const Sources &sources, NodeId target, float &cost) const;
+
+    std::vector<NodeId> BidirectionalDijkstra(const Sources &sources, NodeId target, float &cost) const;
+
+    std::vector<NodeId> ContractionHierarchyQuery(const Sources &sources, NodeId target, float &cost) const;
+
+    /// Append to @a path the nodes of the hierarchy edge from @a from to
+    /// @a to, expanding shortcuts, excluding @a from.
+    void UnpackShortcut(NodeId from, NodeId to, std::vector<NodeId> &path) const;
+
+    /// Cheapest edge of the original graph between two nodes.
+    const Edge *FindEdge(NodeId from, NodeId to) const;
+
+    const Map &_map;
+
+    /// @name Nodes
+    /// @{
+
+    std::vector<Waypoint> _entries;
+
+    std::vector<geom::Location> _locations;
+
+    std::vector<float> _lengths;
+
+    std::unordered_map<LaneKey, NodeId, LaneKeyHash> _node_ids;
+
+    /// Scale applied to the straight line distance to keep the A* heuristic
+    /// below the cost of any route.
+    float _heuristic_scale = 1.0f;
+
+    /// @}
+    /// @name Graph and its transpose in CSR format
+    /// @{
+
+    std::vector<uint32_t> _offsets;
+
+    std::vector<Edge> _edges;
+
+    std::vector<uint32_t> _reverse_offsets;
+
+    std::vector<Edge> _reverse_edges;
+
+    /// @}
+    /// @name Contraction hierarchy
+    /// @{
+
+    std::vector<uint32_t> _ranks;
+
+    /// Edges to higher ranked nodes.
+    std::vector<uint32_t> _ch_up_offsets;
+
+    std::vector<ShortcutEdge> _ch_up_edges;
+
+    /// Edges from higher ranked nodes, stored at their target.
+    std::vector<uint32_t> _ch_down_offsets;
+
+    std::vector<ShortcutEdge> _ch_down_edges;
+
+    /// @}
+  };
+
+} // namespace road
+} // namespace carla
@@ -281,6 +281,41 @@ namespace rpc {
       MSGPACK_DEFINE_ARRAY(actor, traffic_light_state);
     };
 
+    /// Transforms of many actors applied by a single command.
+    struct ApplyTransforms : CommandBase<ApplyTransforms> {
+      ApplyTransforms() = default;
+      ApplyTransforms(std::vector<ActorId> ids, std::vector<geom::Transform> values)
+        : actors(std::move(ids)),
+          transforms(std::move(values)) {}
+      std::vector<ActorId> actors;
+      std::vector<geom::Transform> transforms;
+      MSGPACK_DEFINE_ARRAY(actors, transforms);
+    };
+
+    /// Light states of many vehicles applied by a single command.
+    struct SetVehicleLightStates : CommandBase<SetVehicleLightStates> {
+      SetVehicleLightStates() = default;
+      SetVehicleLightStates(std::vector<ActorId> ids, std::vector<VehicleLightState::flag_type> values)
+        : actors(std::move(ids)),
+          light_states(std::move(values)) {}
+      std::vector<ActorId> actors;
+      std::vector<VehicleLightState::flag_type> light_states;
+      MSGPACK_DEFINE_ARRAY(actors, light_states);
+    };
+
+    /// States of many walkers applied by a single command.
+    struct ApplyWalkerStates : CommandBase<ApplyWalkerStates> {
+      ApplyWalkerStates() = default;
+      ApplyWalkerStates(std::vector<ActorId> ids, std::vector<geom::Transform> values, std::vector<float> walker_speeds)
+        : actors(std::move(ids)),
+          transforms(std::move(values)),
+          speeds(std::move(walker_speeds)) {}
+      std::vector<ActorId> actors;
+      std::vector<geom::Transform> transforms;
+      std::vector<float> speeds;
+      MSGPACK_DEFINE_ARRAY(actors, transforms, speeds);
+    };
+
     using CommandType = boost::variant2::variant<
         SpawnActor,
         DestroyActor,
@@ -303,7 +338,10 @@ namespace rpc {
         SetVehicleLightState,
         ApplyLocation,
         ConsoleCommand,
-        SetTrafficLightState>;
+        SetTrafficLightState,
+        ApplyTransforms,
+        SetVehicleLightStates,
+        ApplyWalkerStates>;
 
     CommandType command;
 
@@ -14,6 +14,8 @@
 namespace carla {
 namespace traffic_manager {
 
+using constants::TrackTraffic::UNREGISTERED_WAYPOINT_UPDATE_DISTANCE;
+
 ALSM::ALSM(
   AtomicActorSet &registered_vehicles,
   BufferMap &buffer_map,
@@ -27,7 +29,8 @@ ALSM::ALSM(
   CollisionStage &collision_stage,
   TrafficLightStage &traffic_light_stage,
   MotionPlanStage &motion_plan_stage,
-  VehicleLightStage &vehicle_light_stage)
+  VehicleLightStage &vehicle_light_stage,
+  RandomGeneratorMap &random_devices)
   : registered_vehicles(registered_vehicles),
     buffer_map(buffer_map),
     track_traffic(track_traffic),
@@ -40,21 +43,22 @@ ALSM::ALSM(
     collision_stage(collision_stage),
     traffic_light_stage(traffic_light_stage),
     motion_plan_stage(motion_plan_stage),
-    vehicle_light_stage(vehicle_light_stage) {}
+    vehicle_light_stage(vehicle_light_stage),
+    random_devices(random_devices) {}
 
 void ALSM::Update() {
 
   bool hybrid_physics_mode = parameters.GetHybridPhysicsMode();
 
-  std::set<ActorId> world_vehicle_ids;
-  std::set<ActorId> world_pedestrian_ids;
-  std::vector<ActorId> unregistered_list_to_be_deleted;
+  const cc::WorldSnapshot world_snapshot = world.GetSnapshot();
+  current_timestamp = world_snapshot.GetTimestamp();
 
-  current_timestamp = world.GetSnapshot().GetTimestamp();
-  ActorList world_actors = world.GetActors();
+  const int current_registered_vehicles_state = registered_vehicles.GetState();
+  const bool registration_changed = current_registered_vehicles_state != registered_vehicles_state;
+  registered_vehicles_state = current_registered_vehicles_state;
 
   // Find destroyed actors and perform clean up.
-  const ALSM::DestroyeddActors destroyed_actors = IdentifyDestroyedActors(world_actors);
+  const ALSM::DestroyeddActors destroyed_actors = IdentifyDestroyedActors(world_snapshot, registration_changed);
 
   const ActorIdSet &destroyed_registered = destroyed_actors.first;
   for (const auto &deletion_id: destroyed_registered) {
@@ -67,24 +71,16 @@ void ALSM::Update() {
   }
 
   // Invalidate hero actor if it is not alive anymore.
-  if (hero_actors.size() != 0u) {
-    ActorIdSet hero_actors_to_delete;
-    for (auto &hero_actor_info: hero_actors) {
-      if (destroyed_unregistered.find(hero_actor_info.first) != destroyed_unregistered.end()) {
-        hero_actors_to_delete.insert(hero_actor_info.first);
-      }
-      if (destroyed_registered.find(hero_actor_info.first) != destroyed_registered.end()) {
-        hero_actors_to_delete.insert(hero_actor_info.first);
-      }
-    }
-
-    for (auto &deletion_id: hero_actors_to_delete) {
-      hero_actors.erase(deletion_id);
+  for (auto iter = hero_actors.begin(); iter != hero_actors.end();) {
+    if (!world_snapshot.Contains(iter->first)) {
+      iter = hero_actors.erase(iter);
+    } else {
+      ++iter;
     }
   }
 
   // Scan for new unregistered actors.
-  IdentifyNewActors(world_actors);
+  IdentifyNewActors(world_snapshot, registration_changed);
 
   // Update dynamic state and static attributes for all registered vehicles.
   ALSM::IdleInfo max_idle_time = std::make_pair(0u, current_timestamp.elapsed_seconds);
@@ -112,54 +108,83 @@ void ALSM::Update() {
   UpdateUnregisteredActorsData();
 }
 
-void ALSM::IdentifyNewActors(const ActorList &actor_list) {
-  for (auto iter = actor_list->begin(); iter != actor_list->end(); ++iter) {
-    ActorPtr actor = *iter;
-    ActorId actor_id = actor->GetId();
-    // Identify any new hero vehicle
-    if (actor->GetTypeId().front() == 'v') {
-     if (hero_actors.size() == 0u || hero_actors.find(actor_id) == hero_actors.end()) {
-      for (auto&& attribute: actor->GetAttributes()) {
-        if (attribute.GetId() == "role_name" && attribute.GetValue() == "hero") {
-          hero_actors.insert({actor_id, actor});
+void ALSM::IdentifyNewActors(const cc::WorldSnapshot &world_snapshot, const bool registration_changed) {
+
+  std::vector<ActorId> new_actor_ids;
+  for (const auto &actor_snapshot : world_snapshot) {
+    if (world_actor_ids.insert(actor_snapshot.id).second) {
+      new_actor_ids.push_back(actor_snapshot.id);
+    }
+  }
+
+  if (!new_actor_ids.empty()) {
+    ActorList new_actors = world.GetActors(new_actor_ids);
+    for (auto iter = new_actors->begin(); iter != new_actors->end(); ++iter) {
+      ActorPtr actor = *iter;
+      ActorId actor_id = actor->GetId();
+      const char type = actor->GetTypeId().front();
+      if (type == 'v') {
+        world_vehicles.insert({actor_id, actor});
+        // Identify any new hero vehicle
+        for (auto&& attribute: actor->GetAttributes()) {
+          if (attribute.GetId() == "role_name" && attribute.GetValue() == "hero") {
+            hero_actors.insert({actor_id, actor});
+          }
         }
       }
+      // Other actors, like props or sensors, are never on the road.
+      if ((type == 'v' || type == 'w') && !registered_vehicles.Contains(actor_id)) {
+        unregistered_actors.insert({actor_id, actor});
+      }
     }
   }
-    if (!registered_vehicles.Contains(actor_id)
-        && unregistered_actors.find(actor_id) == unregistered_actors.end()) {
 
-      unregistered_actors.insert({actor_id, actor});
+  // Vehicles no longer registered are tracked as any other actor.
+  if (registration_changed) {
+    for (const auto &vehicle_info : world_vehicles) {
+      if (!registered_vehicles.Contains(vehicle_info.first)
+          && unregistered_actors.find(vehicle_info.first) == unregistered_actors.end()) {
+        unregistered_actors.insert(vehicle_info);
+      }
     }
   }
 }
 
-ALSM::DestroyeddActors ALSM::IdentifyDestroyedActors(const ActorList &actor_list) {
+ALSM::DestroyeddActors ALSM::IdentifyDestroyedActors(const cc::WorldSnapshot &world_snapshot,
+                                                     const bool registration_changed) {
 
   ALSM::DestroyeddActors destroyed_actors;
   ActorIdSet &deleted_registered = destroyed_actors.first;
   ActorIdSet &deleted_unregistered = destroyed_actors.second;
 
-  // Building hash set of actors present in current frame.
-  ActorIdSet current_actors;
-  for  (auto iter = actor_list->begin(); iter != actor_list->end(); ++iter) {
-    current_actors.insert((*iter)->GetId());
-  }
-
   // Searching for destroyed registered actors.
   std::vector<ActorId> registered_ids = registered_vehicles.GetIDList();
   for (const ActorId &actor_id : registered_ids) {
-    if (current_actors.find(actor_id) == current_actors.end()) {
+    if (!world_snapshot.Contains(actor_id)) {
       deleted_registered.insert(actor_id);
     }
   }
 
-  // Searching for destroyed unregistered actors.
-  for (const auto &actor_info: unregistered_actors) {
-    const ActorId &actor_id = actor_info.first;
-     if (current_actors.find(actor_id) == current_actors.end()
-         || registered_vehicles.Contains(actor_id)) {
-      deleted_unregistered.insert(actor_id);
+  // Searching for actors destroyed since the last update.
+  for (auto iter = world_actor_ids.begin(); iter != world_actor_ids.end();) {
+    const ActorId actor_id = *iter;
+    if (!world_snapshot.Contains(actor_id)) {
+      if (unregistered_actors.find(actor_id) != unregistered_actors.end()) {
+        deleted_unregistered.insert(actor_id);
+      }
+      world_vehicles.erase(actor_id);
+      iter = world_actor_ids.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+
+  // Searching for unregistered actors that have been registered.
+  if (registration_changed) {
+    for (const auto &actor_info: unregistered_actors) {
+      if (registered_vehicles.Contains(actor_info.first)) {
+        deleted_unregistered.insert(actor_info.first);
+      }
     }
   }
 
@@ -203,6 +228,10 @@ void ALSM::UpdateData(const bool hybrid_physics_mode,
   cg::Vector3D vehicle_velocity = vehicle->GetVelocity();
   bool state_entry_present = simulation_state.ContainsActor(actor_id);
 
+  // Vehicles registered since the last update get their random generator
+  // before the stages sample it.
+  random_devices.Add(actor_id);
+
   // Initializing idle times.
   if (idle_time.find(actor_id) == idle_time.end() && current_timestamp.elapsed_seconds != 0.0) {
     idle_time.insert({actor_id, current_timestamp.elapsed_seconds});
@@ -284,10 +313,18 @@ void ALSM::UpdateUnregisteredActorsData() {
     const bool actor_is_dormant = actor_ptr->IsDormant();
     KinematicState kinematic_state {actor_location, actor_rotation, actor_velocity, -1.0f, true, actor_is_dormant, cg::Location()};
 
+    // The bounding box is read once per actor.
+    auto cache_it = unregistered_cache.find(actor_id);
+    const bool cache_entry_present = cache_it != unregistered_cache.end();
+    if (!cache_entry_present) {
+      cache_it = unregistered_cache.insert({actor_id, UnregisteredActorCache{}}).first;
+      cache_it->second.extent = actor_ptr->GetBoundingBox().extent;
+    }
+    UnregisteredActorCache &cache = cache_it->second;
+    const cg::Vector3D &dimensions = cache.extent;
+
     TrafficLightState tl_state;
-    ActorType actor_type = ActorType::Any;
-    cg::Vector3D dimensions;
-    std::vector<SimpleWaypointPtr> nearest_waypoints;
+    std::vector<cg::Location> corners;
 
     bool state_entry_not_present = !simulation_state.ContainsActor(actor_id);
     if (type_id.front() == 'v') {
@@ -297,9 +334,7 @@ void ALSM::UpdateUnregisteredActorsData() {
       tl_state = {vehicle_ptr->GetTrafficLightState(), vehicle_ptr->IsAtTrafficLight()};
 
       if (state_entry_not_present) {
-        dimensions = vehicle_ptr->GetBoundingBox().extent;
-        actor_type = ActorType::Vehicle;
-        StaticAttributes attributes {actor_type, dimensions.x, dimensions.y, dimensions.z};
+        StaticAttributes attributes {ActorType::Vehicle, dimensions.x, dimensions.y, dimensions.z};
 
         simulation_state.AddActor(actor_id, kinematic_state, attributes, tl_state);
       } else {
@@ -307,36 +342,40 @@ void ALSM::UpdateUnregisteredActorsData() {
         simulation_state.UpdateTrafficLightState(actor_id, tl_state);
       }
 
-      // Identify occupied waypoints.
-      cg::Vector3D extent = vehicle_ptr->GetBoundingBox().extent;
-      cg::Vector3D heading_vector = vehicle_ptr->GetTransform().GetForwardVector();
-      std::vector<cg::Location> corners = {actor_location + cg::Location(extent.x * heading_vector),
-                                           actor_location,
-                                           actor_location + cg::Location(-extent.x * heading_vector)};
-      for (cg::Location &vertex: corners) {
-        SimpleWaypointPtr nearest_waypoint = local_map->GetWaypoint(vertex);
-        nearest_waypoints.push_back(nearest_waypoint);
-      }
+      // Occupied waypoints are the ones nearest to the front, center and back.
+      cg::Vector3D heading_vector = actor_transform.GetForwardVector();
+      corners = {actor_location + cg::Location(dimensions.x * heading_vector),
+                 actor_location,
+                 actor_location + cg::Location(-dimensions.x * heading_vector)};
     }
     else if (type_id.front() == 'w') {
-      auto walker_ptr = boost::static_pointer_cast<cc::Walker>(actor_ptr);
-
       if (state_entry_not_present) {
-        dimensions = walker_ptr->GetBoundingBox().extent;
-        actor_type = ActorType::Pedestrian;
-        StaticAttributes attributes {actor_type, dimensions.x, dimensions.y, dimensions.z};
+        StaticAttributes attributes {ActorType::Pedestrian, dimensions.x, dimensions.y, dimensions.z};
 
         simulation_state.AddActor(actor_id, kinematic_state, attributes, tl_state);
       } else {
         simulation_state.UpdateKinematicState(actor_id, kinematic_state);
       }
 
-      // Identify occupied waypoints.
-      SimpleWaypointPtr nearest_waypoint = local_map->GetWaypoint(actor_location);
-      nearest_waypoints.push_back(nearest_waypoint);
+      // Occupied waypoint is the one nearest to the walker.
+      corners = {actor_location};
     }
 
-    track_traffic.UpdateUnregisteredGridPosition(actor_id, nearest_waypoints);
+    // The occupied waypoints are searched again only once a point moved far
+    // enough from where they were last searched.
+    bool moved = !cache_entry_present || corners.size() != cache.corners.size();
+    for (size_t i = 0u; !moved && i < corners.size(); ++i) {
+      moved = (corners[i] - cache.corners[i]).SquaredLength()
+          > SQUARE(UNREGISTERED_WAYPOINT_UPDATE_DISTANCE);
+    }
+    if (moved) {
+      cache.nearest_waypoints.clear();
+      for (const cg::Location &vertex: corners) {
+        cache.nearest_waypoints.push_back(local_map->GetWaypoint(vertex));
+      }
+      cache.corners = std::move(corners);
+      track_traffic.UpdateUnregisteredGridPosition(actor_id, cache.nearest_waypoints);
+    }
   }
 }
 
@@ -376,10 +415,11 @@ void ALSM::RemoveActor(const ActorId actor_id, const bool registered_actor) {
     traffic_light_stage.RemoveActor(actor_id);
     motion_plan_stage.RemoveActor(actor_id);
     vehicle_light_stage.RemoveActor(actor_id);
+    random_devices.Remove(actor_id);
   }
   else {
     unregistered_actors.erase(actor_id);
-    hero_actors.erase(actor_id);
+    unregistered_cache.erase(actor_id);
   }
 
   track_traffic.DeleteActor(actor_id);
@@ -388,6 +428,10 @@ void ALSM::RemoveActor(const ActorId actor_id, const bool registered_actor) {
 
 void ALSM::Reset() {
   unregistered_actors.clear();
+  unregistered_cache.clear();
+  world_actor_ids.clear();
+  world_vehicles.clear();
+  registered_vehicles_state = -1;
   idle_time.clear();
   hero_actors.clear();
   elapsed_last_actor_destruction = 0.0;
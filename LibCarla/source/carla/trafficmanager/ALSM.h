@@ -6,6 +6,7 @@
 #include "carla/client/ActorList.h"
 #include "carla/client/Timestamp.h"
 #include "carla/client/World.h"
+#include "carla/client/WorldSnapshot.h"
 #include "carla/Memory.h"
 
 #include "carla/trafficmanager/AtomicActorSet.h"
@@ -42,8 +43,24 @@ class ALSM {
 
 private:
   AtomicActorSet &registered_vehicles;
-  // Structure containing vehicles in the simulator not registered with the traffic manager.
+  // Structure containing vehicles and walkers in the simulator not registered with the traffic manager.
   ActorMap unregistered_actors;
+  // Bounding box of an unregistered actor, and the points of it whose nearest
+  // waypoints it occupies, as they were when these waypoints were searched.
+  struct UnregisteredActorCache {
+    cg::Vector3D extent;
+    std::vector<cg::Location> corners;
+    std::vector<SimpleWaypointPtr> nearest_waypoints;
+  };
+  // Entries are added on the first update of an unregistered actor and
+  // removed with it.
+  std::unordered_map<ActorId, UnregisteredActorCache> unregistered_cache;
+  // Ids of all the actors in the simulator at the last update.
+  ActorIdSet world_actor_ids;
+  // Structure containing all vehicles in the simulator, registered or not.
+  ActorMap world_vehicles;
+  // State of the registered vehicles set at the last update.
+  int registered_vehicles_state {-1};
   BufferMap &buffer_map;
   // Structure keeping track of duration of vehicles stuck in a location.
   IdleTimeMap idle_time;
@@ -61,6 +78,7 @@ private:
   TrafficLightStage &traffic_light_stage;
   MotionPlanStage &motion_plan_stage;
   VehicleLightStage &vehicle_light_stage;
+  RandomGeneratorMap &random_devices;
   // Time elapsed since last vehicle destruction due to being idle for too long.
   double elapsed_last_actor_destruction {0.0};
   cc::Timestamp current_timestamp;
@@ -73,12 +91,15 @@ private:
   bool IsVehicleStuck(const ActorId& actor_id);
 
   // Method to identify actors newly spawned in the simulation since last tick.
-  void IdentifyNewActors(const ActorList &actor_list);
+  // Only the new actors are retrieved from the world. If the registered
+  // vehicles changed, vehicles no longer registered are tracked again.
+  void IdentifyNewActors(const cc::WorldSnapshot &world_snapshot, const bool registration_changed);
 
   using DestroyeddActors = std::pair<ActorIdSet, ActorIdSet>;
-  // Method to identify actors deleted in the last frame.
-  // Arrays of registered and unregistered actors are returned separately.
-  DestroyeddActors IdentifyDestroyedActors(const ActorList &actor_list);
+  // Method to identify actors deleted in the last frame, by comparing the
+  // actors of the snapshot with the ones at the last update. Arrays of
+  // registered and unregistered actors are returned separately.
+  DestroyeddActors IdentifyDestroyedActors(const cc::WorldSnapshot &world_snapshot, const bool registration_changed);
 
   using IdleInfo = std::pair<ActorId, double>;
   void UpdateRegisteredActorsData(const bool hybrid_physics_mode, IdleInfo &max_idle_time);
@@ -102,7 +123,8 @@ public:
        CollisionStage &collision_stage,
        TrafficLightStage &traffic_light_stage,
        MotionPlanStage &motion_plan_stage,
-       VehicleLightStage &vehicle_light_stage);
+       VehicleLightStage &vehicle_light_stage,
+       RandomGeneratorMap &random_devices);
 
   void Update();
 
@@ -9,15 +9,13 @@
 namespace carla {
 namespace traffic_manager {
 
-  using SimpleWaypointPtr = std::shared_ptr<SimpleWaypoint>;
-
   CachedSimpleWaypoint::CachedSimpleWaypoint(const SimpleWaypointPtr& simple_waypoint) {
     this->waypoint_id = simple_waypoint->GetId();
 
-    this->road_id = simple_waypoint->GetWaypoint()->GetRoadId();
-    this->section_id = simple_waypoint->GetWaypoint()->GetSectionId();
-    this->lane_id = simple_waypoint->GetWaypoint()->GetLaneId();
-    this->s = static_cast<float>(simple_waypoint->GetWaypoint()->GetDistance());
+    this->road_id = simple_waypoint->GetRoadId();
+    this->section_id = simple_waypoint->GetSectionId();
+    this->lane_id = simple_waypoint->GetLaneId();
+    this->s = static_cast<float>(simple_waypoint->GetDistance());
 
     for (auto &wp : simple_waypoint->GetNextWaypoint()) {
       this->next_waypoints.push_back(wp->GetId());
@@ -118,45 +116,55 @@ namespace traffic_manager {
     ReadValue<uint8_t>(in_file, this->road_option);
   }
 
-  void CachedSimpleWaypoint::Read(const std::vector<uint8_t>& content, unsigned long& start) {
-    ReadValue<uint64_t>(content, start, this->waypoint_id);
+  bool CachedSimpleWaypoint::Read(const std::vector<uint8_t>& content, unsigned long& start) {
+    if (!ReadValue<uint64_t>(content, start, this->waypoint_id)) {
+      return false;
+    }
 
     // road_id, section_id, lane_id, s
-    ReadValue<uint32_t>(content, start, this->road_id);
-    ReadValue<uint32_t>(content, start, this->section_id);
-    ReadValue<int32_t>(content, start, this->lane_id);
-    ReadValue<float>(content, start, this->s);
+    if (!ReadValue<uint32_t>(content, start, this->road_id) ||
+        !ReadValue<uint32_t>(content, start, this->section_id) ||
+        !ReadValue<int32_t>(content, start, this->lane_id) ||
+        !ReadValue<float>(content, start, this->s)) {
+      return false;
+    }
 
     // list_of_next
     uint16_t total_next;
-    ReadValue<uint16_t>(content, start, total_next);
+    if (!ReadValue<uint16_t>(content, start, total_next)) {
+      return false;
+    }
     for (uint16_t i = 0; i < total_next; i++) {
       uint64_t id;
-      ReadValue<uint64_t>(content, start, id);
+      if (!ReadValue<uint64_t>(content, start, id)) {
+        return false;
+      }
       this->next_waypoints.push_back(id);
     }
 
     // list_of_previous
     uint16_t total_previous;
-    ReadValue<uint16_t>(content, start, total_previous);
+    if (!ReadValue<uint16_t>(content, start, total_previous)) {
+      return false;
+    }
     for (uint16_t i = 0; i < total_previous; i++) {
       uint64_t id;
-      ReadValue<uint64_t>(content, start, id);
+      if (!ReadValue<uint64_t>(content, start, id)) {
+        return false;
+      }
       this->previous_waypoints.push_back(id);
     }
 
     // left, right
-    ReadValue<uint64_t>(content, start, this->next_left_waypoint);
-    ReadValue<uint64_t>(content, start, this->next_right_waypoint);
-
-    // geo_grid_id
-    ReadValue<int32_t>(content, start, this->geodesic_grid_id);
-
-    // is_junction
-    ReadValue<bool>(content, start, this->is_junction);
+    if (!ReadValue<uint64_t>(content, start, this->next_left_waypoint) ||
+        !ReadValue<uint64_t>(content, start, this->next_right_waypoint)) {
+      return false;
+    }
 
-    // road_option
-    ReadValue<uint8_t>(content, start, this->road_option);
+    // geo_grid_id, is_junction, road_option
+    return ReadValue<int32_t>(content, start, this->geodesic_grid_id) &&
+        ReadValue<bool>(content, start, this->is_junction) &&
+        ReadValue<uint8_t>(content, start, this->road_option);
   }
 
 } // namespace traffic_manager
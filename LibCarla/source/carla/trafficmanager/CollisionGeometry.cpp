@@ -0,0 +1,188 @@
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "carla/trafficmanager/CollisionGeometry.h"
+
+namespace carla {
+namespace traffic_manager {
+
+CollisionPolygon::CollisionPolygon(const std::vector<cg::Location> &boundary) {
+  const size_t size = boundary.size();
+  x.reserve(size);
+  y.reserve(size);
+  dx.reserve(size);
+  dy.reserve(size);
+  inverse_squared_length.reserve(size);
+
+  min_x = min_y = std::numeric_limits<float>::infinity();
+  max_x = max_y = -std::numeric_limits<float>::infinity();
+  for (const cg::Location &location : boundary) {
+    x.push_back(location.x);
+    y.push_back(location.y);
+    min_x = std::min(min_x, location.x);
+    min_y = std::min(min_y, location.y);
+    max_x = std::max(max_x, location.x);
+    max_y = std::max(max_y, location.y);
+  }
+
+  for (size_t i = 0u; i < size; ++i) {
+    const size_t next = (i + 1u == size) ? 0u : i + 1u;
+    const float edge_x = x[next] - x[i];
+    const float edge_y = y[next] - y[i];
+    const float squared_length = edge_x * edge_x + edge_y * edge_y;
+    dx.push_back(edge_x);
+    dy.push_back(edge_y);
+    // Degenerate edges are treated as their first vertex.
+    inverse_squared_length.push_back(squared_length > 0.0f ? 1.0f / squared_length : 0.0f);
+  }
+
+  // The polygon is convex if consecutive edges always turn to the same side.
+  bool turns_left = false;
+  bool turns_right = false;
+  for (size_t i = 0u; i < size; ++i) {
+    const size_t next = (i + 1u == size) ? 0u : i + 1u;
+    const float cross = dx[i] * dy[next] - dy[i] * dx[next];
+    turns_left = turns_left || cross > 0.0f;
+    turns_right = turns_right || cross < 0.0f;
+  }
+  convex = size >= 3u && !(turns_left && turns_right);
+}
+
+float CollisionPolygon::BoundingBoxDistance(const CollisionPolygon &other) const {
+  const float gap_x = std::max(0.0f, std::max(min_x - other.max_x, other.min_x - max_x));
+  const float gap_y = std::max(0.0f, std::max(min_y - other.max_y, other.min_y - max_y));
+  return std::sqrt(gap_x * gap_x + gap_y * gap_y);
+}
+
+float CollisionPolygon::Distance(const CollisionPolygon &other) const {
+  if (Empty() || other.Empty()) {
+    return std::numeric_limits<float>::infinity();
+  }
+
+  bool overlapping;
+  if (convex && other.convex) {
+    overlapping = !SeparatedByAxis(other);
+  } else {
+    // Without crossing edges the polygons either are disjoint or one contains
+    // the other, in which case it also contains any vertex of the other.
+    overlapping = EdgesCross(other)
+        || other.Contains(x.front(), y.front())
+        || Contains(other.x.front(), other.y.front());
+  }
+  if (overlapping) {
+    return 0.0f;
+  }
+
+  // The closest points of two disjoint polygons always include a vertex.
+  float squared_distance = std::numeric_limits<float>::infinity();
+  for (size_t i = 0u; i < x.size(); ++i) {
+    squared_distance = std::min(squared_distance, other.SquaredDistanceToEdges(x[i], y[i]));
+  }
+  for (size_t i = 0u; i < other.x.size(); ++i) {
+    squared_distance = std::min(squared_distance, SquaredDistanceToEdges(other.x[i], other.y[i]));
+  }
+  return std::sqrt(squared_distance);
+}
+
+float CollisionPolygon::SquaredDistanceToEdges(const float px, const float py) const {
+  const size_t size = x.size();
+  const float *vertex_x = x.data();
+  const float *vertex_y = y.data();
+  const float *edge_x = dx.data();
+  const float *edge_y = dy.data();
+  const float *inverse_length = inverse_squared_length.data();
+
+  // Branchless so that the loop can be vectorized.
+  float squared_distance = std::numeric_limits<float>::infinity();
+  for (size_t i = 0u; i < size; ++i) {
+    const float relative_x = px - vertex_x[i];
+    const float relative_y = py - vertex_y[i];
+    float t = (relative_x * edge_x[i] + relative_y * edge_y[i]) * inverse_length[i];
+    t = std::min(std::max(t, 0.0f), 1.0f);
+    const float offset_x = relative_x - t * edge_x[i];
+    const float offset_y = relative_y - t * edge_y[i];
+    squared_distance = std::min(squared_distance, offset_x * offset_x + offset_y * offset_y);
+  }
+  return squared_distance;
+}
+
+bool CollisionPolygon::Contains(const float px, const float py) const {
+  const size_t size = x.size();
+  bool inside = false;
+  for (size_t i = 0u, previous = size - 1u; i < size; previous = i++) {
+    if ((y[i] > py) != (y[previous] > py)
+        && px < (x[previous] - x[i]) * (py - y[i]) / (y[previous] - y[i]) + x[i]) {
+      inside = !inside;
+    }
+  }
+  return inside;
+}
+
+bool CollisionPolygon::EdgesCross(const CollisionPolygon &other) const {
+  const size_t other_size = other.x.size();
+  const float *other_x = other.x.data();
+  const float *other_y = other.y.data();
+  const float *other_dx = other.dx.data();
+  const float *other_dy = other.dy.data();
+
+  for (size_t i = 0u; i < x.size(); ++i) {
+    const float start_x = x[i];
+    const float start_y = y[i];
+    const float edge_x = dx[i];
+    const float edge_y = dy[i];
+
+    // Edges cross if the end points of each one lie strictly on opposite
+    // sides of the other one. Touching edges are left to the distance
+    // computation, which returns zero for them.
+    bool crossing = false;
+    for (size_t j = 0u; j < other_size; ++j) {
+      const float relative_x = start_x - other_x[j];
+      const float relative_y = start_y - other_y[j];
+      const float side_start = other_dx[j] * relative_y - other_dy[j] * relative_x;
+      const float side_end = other_dx[j] * (relative_y + edge_y) - other_dy[j] * (relative_x + edge_x);
+      const float other_side_start = edge_y * relative_x - edge_x * relative_y;
+      const float other_side_end = edge_y * (relative_x - other_dx[j]) - edge_x * (relative_y - other_dy[j]);
+      crossing |= (side_start * side_end < 0.0f) & (other_side_start * other_side_end < 0.0f);
+    }
+    if (crossing) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool CollisionPolygon::SeparatedByAxis(const CollisionPolygon &other) const {
+  auto separated_by_normals_of = [this, &other](const CollisionPolygon &polygon) {
+    for (size_t i = 0u; i < polygon.dx.size(); ++i) {
+      const float axis_x = -polygon.dy[i];
+      const float axis_y = polygon.dx[i];
+
+      float min_projection = std::numeric_limits<float>::infinity();
+      float max_projection = -std::numeric_limits<float>::infinity();
+      for (size_t j = 0u; j < x.size(); ++j) {
+        const float projection = x[j] * axis_x + y[j] * axis_y;
+        min_projection = std::min(min_projection, projection);
+        max_projection = std::max(max_projection, projection);
+      }
+      float other_min_projection = std::numeric_limits<float>::infinity();
+      float other_max_projection = -std::numeric_limits<float>::infinity();
+      for (size_t j = 0u; j < other.x.size(); ++j) {
+        const float projection = other.x[j] * axis_x + other.y[j] * axis_y;
+        other_min_projection = std::min(other_min_projection, projection);
+        other_max_projection = std::max(other_max_projection, projection);
+      }
+
+      if (max_projection < other_min_projection || other_max_projection < min_projection) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  return separated_by_normals_of(*this) || separated_by_normals_of(other);
+}
+
+} // namespace traffic_manager
+} // namespace carla
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+
+#include "carla/geom/Location.h"
+
+namespace carla {
+namespace traffic_manager {
+
+namespace cg = carla::geom;
+
+/// Polygon in the horizontal plane stored as flat arrays of vertices and
+/// edges, so that the distance kernels iterate contiguous floats and can be
+/// vectorized by the compiler. The polygon is implicitly closed between its
+/// last and first vertex, and is expected to be simple (not self-crossing).
+class CollisionPolygon {
+public:
+
+  CollisionPolygon() = default;
+
+  explicit CollisionPolygon(const std::vector<cg::Location> &boundary);
+
+  bool Empty() const {
+    return x.empty();
+  }
+
+  /// Distance between the axis aligned bounding boxes of both polygons, a
+  /// lower bound of their distance used as a broad phase.
+  float BoundingBoxDistance(const CollisionPolygon &other) const;
+
+  /// Distance between both polygons, zero if they touch, cross or one of them
+  /// contains the other. Equivalent to boost::geometry::distance.
+  float Distance(const CollisionPolygon &other) const;
+
+private:
+
+  // Squared distance from a point to the closest edge of the polygon.
+  float SquaredDistanceToEdges(const float px, const float py) const;
+
+  // Whether the polygon contains a point (crossing number test).
+  bool Contains(const float px, const float py) const;
+
+  // Whether an edge of the polygon properly crosses one of @a other.
+  bool EdgesCross(const CollisionPolygon &other) const;
+
+  // Separating axis test, only valid if both polygons are convex.
+  bool SeparatedByAxis(const CollisionPolygon &other) const;
+
+  // Vertices.
+  std::vector<float> x;
+  std::vector<float> y;
+  // Edge i goes from vertex i to vertex i + 1 (or 0).
+  std::vector<float> dx;
+  std::vector<float> dy;
+  std::vector<float> inverse_squared_length;
+
+  float min_x = 0.0f;
+  float min_y = 0.0f;
+  float max_x = 0.0f;
+  float max_y = 0.0f;
+  bool convex = false;
+};
+
+} // namespace traffic_manager
+} // namespace carla
@@ -9,7 +9,6 @@
 namespace carla {
 namespace traffic_manager {
 
-using Point2D = bg::model::point<double, 2, bg::cs::cartesian>;
 using TLS = carla::rpc::TrafficLightState;
 
 using namespace constants::Collision;
@@ -22,14 +21,49 @@ CollisionStage::CollisionStage(
   const TrackTraffic &track_traffic,
   const Parameters &parameters,
   CollisionFrame &output_array,
-  RandomGenerator &random_device)
+  RandomGeneratorMap &random_devices)
   : vehicle_id_list(vehicle_id_list),
     simulation_state(simulation_state),
     buffer_map(buffer_map),
     track_traffic(track_traffic),
     parameters(parameters),
     output_array(output_array),
-    random_device(random_device) {}
+    random_devices(random_devices) {}
+
+void CollisionStage::PrepareCycle() {
+  actors_by_x.clear();
+  for (const ActorId actor_id : simulation_state.GetActorIds()) {
+    actors_by_x.emplace_back(simulation_state.GetLocation(actor_id), actor_id);
+  }
+  std::sort(actors_by_x.begin(), actors_by_x.end(),
+            [](const std::pair<cg::Location, ActorId> &lhs, const std::pair<cg::Location, ActorId> &rhs) {
+              return lhs.first.x < rhs.first.x || (lhs.first.x == rhs.first.x && lhs.second < rhs.second);
+            });
+
+  geodesic_polygon_map.clear();
+  geometry_cache.clear();
+  cycle_collision_locks.clear();
+  cycle_collision_locks.reserve(vehicle_id_list.size());
+  for (const ActorId actor_id : vehicle_id_list) {
+    // Inserting every registered vehicle beforehand, so that the map is not
+    // modified but only its values while updating vehicles concurrently.
+    geodesic_polygon_map.insert({actor_id, CollisionPolygon()});
+    auto lock = collision_locks.find(actor_id);
+    if (lock != collision_locks.end()) {
+      cycle_collision_locks.emplace_back(lock->second);
+    } else {
+      cycle_collision_locks.emplace_back();
+    }
+  }
+}
+
+void CollisionStage::UpdateGeodesicBoundary(const unsigned long index) {
+  const ActorId actor_id = vehicle_id_list.at(index);
+  if (simulation_state.ContainsActor(actor_id)) {
+    geodesic_polygon_map.at(actor_id) =
+        CollisionPolygon(ComputeGeodesicBoundary(actor_id, parameters.GetSnapshot().at(index)));
+  }
+}
 
 void CollisionStage::Update(const unsigned long index) {
   ActorId obstacle_id = 0u;
@@ -37,16 +71,17 @@ void CollisionStage::Update(const unsigned long index) {
   float available_distance_margin = std::numeric_limits<float>::infinity();
 
   const ActorId ego_actor_id = vehicle_id_list.at(index);
+  const VehicleParameters &ego_parameters = parameters.GetSnapshot().at(index);
+  OptionalCollisionLock &ego_lock = cycle_collision_locks.at(index);
   if (simulation_state.ContainsActor(ego_actor_id)) {
     const cg::Location ego_location = simulation_state.GetLocation(ego_actor_id);
     const Buffer &ego_buffer = buffer_map.at(ego_actor_id);
     const unsigned long look_ahead_index = GetTargetWaypoint(ego_buffer, JUNCTION_LOOK_AHEAD).second;
     const float velocity = simulation_state.GetVelocity(ego_actor_id).Length();
 
-    ActorIdSet overlapping_actors = track_traffic.GetOverlappingVehicles(ego_actor_id);
     std::vector<ActorId> collision_candidate_ids;
     // Run through vehicles with overlapping paths and filter them;
-    const float distance_to_leading = parameters.GetDistanceToLeadingVehicle(ego_actor_id);
+    const float distance_to_leading = ego_parameters.distance_to_leading_vehicle;
     float collision_radius_square = SQUARE(COLLISION_RADIUS_RATE * velocity + COLLISION_RADIUS_MIN);
     if (velocity < 2.0f) {
       const float length = simulation_state.GetDimensions(ego_actor_id).x;
@@ -57,13 +92,22 @@ void CollisionStage::Update(const unsigned long index) {
         collision_radius_square = SQUARE(distance_to_leading);
     }
 
-    for (ActorId overlapping_actor_id : overlapping_actors) {
-      // If actor is within maximum collision avoidance and vertical overlap range.
-      const cg::Location &overlapping_actor_location = simulation_state.GetLocation(overlapping_actor_id);
-      if (overlapping_actor_id != ego_actor_id
-          && cg::Math::DistanceSquared(overlapping_actor_location, ego_location) < collision_radius_square
-          && std::abs(ego_location.z - overlapping_actor_location.z) < VERTICAL_OVERLAP_THRESHOLD) {
-        collision_candidate_ids.push_back(overlapping_actor_id);
+    // Sweep the actors within the collision radius along x, and keep the ones
+    // with overlapping paths in the vertical overlap range.
+    const float collision_radius = std::sqrt(collision_radius_square);
+    const std::vector<GeoGridId> ego_grids = track_traffic.GetGrids(ego_actor_id);
+    auto sweep = std::lower_bound(actors_by_x.begin(), actors_by_x.end(), ego_location.x - collision_radius,
+                                  [](const std::pair<cg::Location, ActorId> &actor, const float x) {
+                                    return actor.first.x < x;
+                                  });
+    for (; sweep != actors_by_x.end() && sweep->first.x <= ego_location.x + collision_radius; ++sweep) {
+      const cg::Location &other_actor_location = sweep->first;
+      const ActorId other_actor_id = sweep->second;
+      if (other_actor_id != ego_actor_id
+          && cg::Math::DistanceSquared(other_actor_location, ego_location) < collision_radius_square
+          && std::abs(ego_location.z - other_actor_location.z) < VERTICAL_OVERLAP_THRESHOLD
+          && track_traffic.IsInAnyGrid(other_actor_id, ego_grids)) {
+        collision_candidate_ids.push_back(other_actor_id);
       }
     }
 
@@ -83,17 +127,19 @@ void CollisionStage::Update(const unsigned long index) {
       const ActorId other_actor_id = *iter;
       const ActorType other_actor_type = simulation_state.GetType(other_actor_id);
 
-      if (parameters.GetCollisionDetection(ego_actor_id, other_actor_id)
+      if (ego_parameters.GetCollisionDetection(other_actor_id)
           && buffer_map.find(ego_actor_id) != buffer_map.end()
           && simulation_state.ContainsActor(other_actor_id)) {
         std::pair<bool, float> negotiation_result = NegotiateCollision(ego_actor_id,
+                                                                       ego_parameters,
                                                                        other_actor_id,
-                                                                       look_ahead_index);
+                                                                       look_ahead_index,
+                                                                       ego_lock);
         if (negotiation_result.first) {
           if ((other_actor_type == ActorType::Vehicle
-               && parameters.GetPercentageIgnoreVehicles(ego_actor_id) <= random_device.next())
+               && ego_parameters.perc_ignore_vehicles <= random_devices.At(ego_actor_id).next())
               || (other_actor_type == ActorType::Pedestrian
-                  && parameters.GetPercentageIgnoreWalkers(ego_actor_id) <= random_device.next())) {
+                  && ego_parameters.perc_ignore_walkers <= random_devices.At(ego_actor_id).next())) {
             collision_hazard = true;
             obstacle_id = other_actor_id;
             available_distance_margin = negotiation_result.second;
@@ -118,6 +164,14 @@ void CollisionStage::Reset() {
 }
 
 float CollisionStage::GetBoundingBoxExtention(const ActorId actor_id) {
+  auto lock = collision_locks.find(actor_id);
+  if (lock != collision_locks.end()) {
+    return GetBoundingBoxExtention(actor_id, OptionalCollisionLock(lock->second));
+  }
+  return GetBoundingBoxExtention(actor_id, OptionalCollisionLock());
+}
+
+float CollisionStage::GetBoundingBoxExtention(const ActorId actor_id, const OptionalCollisionLock &lock) {
 
   const float velocity = cg::Math::Dot(simulation_state.GetVelocity(actor_id), simulation_state.GetHeading(actor_id));
   float bbox_extension;
@@ -125,12 +179,11 @@ float CollisionStage::GetBoundingBoxExtention(const ActorId actor_id) {
   float velocity_extension = VEL_EXT_FACTOR * velocity;
   bbox_extension = BOUNDARY_EXTENSION_MINIMUM + velocity_extension * velocity_extension;
   // If a valid collision lock present, change boundary length to maintain lock.
-  if (collision_locks.find(actor_id) != collision_locks.end()) {
-    const CollisionLock &lock = collision_locks.at(actor_id);
-    float lock_boundary_length = static_cast<float>(lock.distance_to_lead_vehicle + LOCKING_DISTANCE_PADDING);
+  if (lock) {
+    float lock_boundary_length = static_cast<float>(lock->distance_to_lead_vehicle + LOCKING_DISTANCE_PADDING);
     // Only extend boundary track vehicle if the leading vehicle
     // if it is not further than velocity dependent extension by MAX_LOCKING_EXTENSION.
-    if ((lock_boundary_length - lock.initial_lock_distance) < MAX_LOCKING_EXTENSION) {
+    if ((lock_boundary_length - lock->initial_lock_distance) < MAX_LOCKING_EXTENSION) {
       bbox_extension = lock_boundary_length;
     }
   }
@@ -169,96 +222,93 @@ LocationVector CollisionStage::GetBoundary(const ActorId actor_id) {
   return bbox_boundary;
 }
 
-LocationVector CollisionStage::GetGeodesicBoundary(const ActorId actor_id) {
-  LocationVector geodesic_boundary;
+const CollisionPolygon &CollisionStage::GetGeodesicPolygon(const ActorId actor_id,
+                                                           const CollisionPolygon &bbox_polygon) const {
+  // Boundaries of registered vehicles are computed by UpdateGeodesicBoundary,
+  // the ones of any other actor only contain its bounding box.
+  auto boundary = geodesic_polygon_map.find(actor_id);
+  if (boundary != geodesic_polygon_map.end() && !boundary->second.Empty()) {
+    return boundary->second;
+  }
+  return bbox_polygon;
+}
 
-  if (geodesic_boundary_map.find(actor_id) != geodesic_boundary_map.end()) {
-    geodesic_boundary = geodesic_boundary_map.at(actor_id);
-  } else {
-    const LocationVector bbox = GetBoundary(actor_id);
-
-    if (buffer_map.find(actor_id) != buffer_map.end()) {
-      float bbox_extension = GetBoundingBoxExtention(actor_id);
-      const float specific_lead_distance = parameters.GetDistanceToLeadingVehicle(actor_id);
-      bbox_extension = std::max(specific_lead_distance, bbox_extension);
-      const float bbox_extension_square = SQUARE(bbox_extension);
-
-      LocationVector left_boundary;
-      LocationVector right_boundary;
-      cg::Vector3D dimensions = simulation_state.GetDimensions(actor_id);
-      const float width = dimensions.y;
-      const float length = dimensions.x;
-
-      const Buffer &waypoint_buffer = buffer_map.at(actor_id);
-      const TargetWPInfo target_wp_info = GetTargetWaypoint(waypoint_buffer, length);
-      const SimpleWaypointPtr boundary_start = target_wp_info.first;
-      const uint64_t boundary_start_index = target_wp_info.second;
-
-      // At non-signalized junctions, we extend the boundary across the junction
-      // and in all other situations, boundary length is velocity-dependent.
-      SimpleWaypointPtr boundary_end = nullptr;
-      SimpleWaypointPtr current_point = waypoint_buffer.at(boundary_start_index);
-      bool reached_distance = false;
-      for (uint64_t j = boundary_start_index; !reached_distance && (j < waypoint_buffer.size()); ++j) {
-        if (boundary_start->DistanceSquared(current_point) > bbox_extension_square || j == waypoint_buffer.size() - 1) {
-          reached_distance = true;
-        }
-        if (boundary_end == nullptr
-            || cg::Math::Dot(boundary_end->GetForwardVector(), current_point->GetForwardVector()) < COS_10_DEGREES
-            || reached_distance) {
-
-          const cg::Vector3D heading_vector = current_point->GetForwardVector();
-          const cg::Location location = current_point->GetLocation();
-          cg::Vector3D perpendicular_vector = cg::Vector3D(-heading_vector.y, heading_vector.x, 0.0f);
-          perpendicular_vector = perpendicular_vector.MakeSafeUnitVector(EPSILON);
-          // Direction determined for the left-handed system.
-          const cg::Vector3D scaled_perpendicular = perpendicular_vector * width;
-          left_boundary.push_back(location + cg::Location(scaled_perpendicular));
-          right_boundary.push_back(location + cg::Location(-1.0f * scaled_perpendicular));
-
-          boundary_end = current_point;
-        }
+LocationVector CollisionStage::ComputeGeodesicBoundary(const ActorId actor_id,
+                                                       const VehicleParameters &vehicle_parameters) {
+  LocationVector geodesic_boundary;
 
-        current_point = waypoint_buffer.at(j);
+  const LocationVector bbox = GetBoundary(actor_id);
+
+  if (buffer_map.find(actor_id) != buffer_map.end()) {
+    float bbox_extension = GetBoundingBoxExtention(actor_id);
+    const float specific_lead_distance = vehicle_parameters.distance_to_leading_vehicle;
+    bbox_extension = std::max(specific_lead_distance, bbox_extension);
+    const float bbox_extension_square = SQUARE(bbox_extension);
+
+    LocationVector left_boundary;
+    LocationVector right_boundary;
+    cg::Vector3D dimensions = simulation_state.GetDimensions(actor_id);
+    const float width = dimensions.y;
+    const float length = dimensions.x;
+
+    const Buffer &waypoint_buffer = buffer_map.at(actor_id);
+    const TargetWPInfo target_wp_info = GetTargetWaypoint(waypoint_buffer, length);
+    const SimpleWaypointPtr boundary_start = target_wp_info.first;
+    const uint64_t boundary_start_index = target_wp_info.second;
+
+    // At non-signalized junctions, we extend the boundary across the junction
+    // and in all other situations, boundary length is velocity-dependent.
+    SimpleWaypointPtr boundary_end = nullptr;
+    SimpleWaypointPtr current_point = waypoint_buffer.at(boundary_start_index);
+    bool reached_distance = false;
+    for (uint64_t j = boundary_start_index; !reached_distance && (j < waypoint_buffer.size()); ++j) {
+      if (boundary_start->DistanceSquared(current_point) > bbox_extension_square || j == waypoint_buffer.size() - 1) {
+        reached_distance = true;
+      }
+      if (boundary_end == nullptr
+          || cg::Math::Dot(boundary_end->GetForwardVector(), current_point->GetForwardVector()) < COS_10_DEGREES
+          || reached_distance) {
+
+        const cg::Vector3D heading_vector = current_point->GetForwardVector();
+        const cg::Location location = current_point->GetLocation();
+        cg::Vector3D perpendicular_vector = cg::Vector3D(-heading_vector.y, heading_vector.x, 0.0f);
+        perpendicular_vector = perpendicular_vector.MakeSafeUnitVector(EPSILON);
+        // Direction determined for the left-handed system.
+        const cg::Vector3D scaled_perpendicular = perpendicular_vector * width;
+        left_boundary.push_back(location + cg::Location(scaled_perpendicular));
+        right_boundary.push_back(location + cg::Location(-1.0f * scaled_perpendicular));
+
+        boundary_end = current_point;
       }
 
-      // Reversing right boundary to construct clockwise (left-hand system)
-      // boundary. This is so because both left and right boundary vectors have
-      // the closest point to the vehicle at their starting index for the right
-      // boundary,
-      // we want to begin at the farthest point to have a clockwise trace.
-      std::reverse(right_boundary.begin(), right_boundary.end());
-      geodesic_boundary.insert(geodesic_boundary.end(), right_boundary.begin(), right_boundary.end());
-      geodesic_boundary.insert(geodesic_boundary.end(), bbox.begin(), bbox.end());
-      geodesic_boundary.insert(geodesic_boundary.end(), left_boundary.begin(), left_boundary.end());
-    } else {
-
-      geodesic_boundary = bbox;
+      current_point = waypoint_buffer.at(j);
     }
 
-    geodesic_boundary_map.insert({actor_id, geodesic_boundary});
-  }
-
-  return geodesic_boundary;
-}
-
-Polygon CollisionStage::GetPolygon(const LocationVector &boundary) {
+    // Reversing right boundary to construct clockwise (left-hand system)
+    // boundary. This is so because both left and right boundary vectors have
+    // the closest point to the vehicle at their starting index for the right
+    // boundary,
+    // we want to begin at the farthest point to have a clockwise trace.
+    std::reverse(right_boundary.begin(), right_boundary.end());
+    geodesic_boundary.insert(geodesic_boundary.end(), right_boundary.begin(), right_boundary.end());
+    geodesic_boundary.insert(geodesic_boundary.end(), bbox.begin(), bbox.end());
+    geodesic_boundary.insert(geodesic_boundary.end(), left_boundary.begin(), left_boundary.end());
+  } else {
 
-  traffic_manager::Polygon boundary_polygon;
-  for (const cg::Location &location : boundary) {
-    bg::append(boundary_polygon.outer(), Point2D(location.x, location.y));
+    geodesic_boundary = bbox;
   }
-  bg::append(boundary_polygon.outer(), Point2D(boundary.front().x, boundary.front().y));
 
-  return boundary_polygon;
+  return geodesic_boundary;
 }
 
 GeometryComparison CollisionStage::GetGeometryBetweenActors(const ActorId reference_vehicle_id,
                                                             const ActorId other_actor_id) {
 
 
+  // Comparisons are cached with the lowest actor id as the reference.
+  const bool reference_is_first = reference_vehicle_id < other_actor_id;
   std::pair<ActorId, ActorId> key_parts;
-  if (reference_vehicle_id < other_actor_id) {
+  if (reference_is_first) {
     key_parts = {reference_vehicle_id, other_actor_id};
   } else {
     key_parts = {other_actor_id, reference_vehicle_id};
@@ -271,40 +321,62 @@ GeometryComparison CollisionStage::GetGeometryBetweenActors(const ActorId refere
 
   GeometryComparison comparision_result{-1.0, -1.0, -1.0, -1.0};
 
-  if (geometry_cache.find(actor_id_key) != geometry_cache.end()) {
-
-    comparision_result = geometry_cache.at(actor_id_key);
-    double mref_veh_other = comparision_result.reference_vehicle_to_other_geodesic;
-    comparision_result.reference_vehicle_to_other_geodesic = comparision_result.other_vehicle_to_reference_geodesic;
-    comparision_result.other_vehicle_to_reference_geodesic = mref_veh_other;
-  } else {
-
-    const Polygon reference_polygon = GetPolygon(GetBoundary(reference_vehicle_id));
-    const Polygon other_polygon = GetPolygon(GetBoundary(other_actor_id));
+  bool is_cached = false;
+  {
+    std::lock_guard<std::mutex> lock(geometry_cache_mutex);
+    auto cached_result = geometry_cache.find(actor_id_key);
+    if (cached_result != geometry_cache.end()) {
+      comparision_result = cached_result->second;
+      is_cached = true;
+    }
+  }
 
-    const Polygon reference_geodesic_polygon = GetPolygon(GetGeodesicBoundary(reference_vehicle_id));
+  // The comparison only depends on the boundaries computed at the beginning
+  // of the cycle, so it does not matter which vehicle computes it first.
+  if (!is_cached) {
 
-    const Polygon other_geodesic_polygon = GetPolygon(GetGeodesicBoundary(other_actor_id));
+    const CollisionPolygon reference_polygon(GetBoundary(key_parts.first));
+    const CollisionPolygon other_polygon(GetBoundary(key_parts.second));
 
-    const double reference_vehicle_to_other_geodesic = bg::distance(reference_polygon, other_geodesic_polygon);
-    const double other_vehicle_to_reference_geodesic = bg::distance(other_polygon, reference_geodesic_polygon);
-    const auto inter_geodesic_distance = bg::distance(reference_geodesic_polygon, other_geodesic_polygon);
-    const auto inter_bbox_distance = bg::distance(reference_polygon, other_polygon);
+    const CollisionPolygon &reference_geodesic_polygon = GetGeodesicPolygon(key_parts.first, reference_polygon);
+    const CollisionPolygon &other_geodesic_polygon = GetGeodesicPolygon(key_parts.second, other_polygon);
 
-    comparision_result = {reference_vehicle_to_other_geodesic,
-              other_vehicle_to_reference_geodesic,
-              inter_geodesic_distance,
-              inter_bbox_distance};
+    // Broad phase: if the bounding boxes of the paths are apart, the paths can
+    // not touch and no hazard is negotiated, so the gap between the boxes,
+    // which bounds every distance from below, is enough as a result.
+    const double geodesic_bbox_gap = reference_geodesic_polygon.BoundingBoxDistance(other_geodesic_polygon);
+    if (geodesic_bbox_gap >= OVERLAP_THRESHOLD) {
+      comparision_result = {geodesic_bbox_gap, geodesic_bbox_gap, geodesic_bbox_gap, geodesic_bbox_gap};
+    } else {
+      const double reference_vehicle_to_other_geodesic = reference_polygon.Distance(other_geodesic_polygon);
+      const double other_vehicle_to_reference_geodesic = other_polygon.Distance(reference_geodesic_polygon);
+      const double inter_geodesic_distance = reference_geodesic_polygon.Distance(other_geodesic_polygon);
+      const double inter_bbox_distance = reference_polygon.Distance(other_polygon);
+
+      comparision_result = {reference_vehicle_to_other_geodesic,
+                other_vehicle_to_reference_geodesic,
+                inter_geodesic_distance,
+                inter_bbox_distance};
+    }
 
+    std::lock_guard<std::mutex> lock(geometry_cache_mutex);
     geometry_cache.insert({actor_id_key, comparision_result});
   }
 
+  if (!reference_is_first) {
+    double mref_veh_other = comparision_result.reference_vehicle_to_other_geodesic;
+    comparision_result.reference_vehicle_to_other_geodesic = comparision_result.other_vehicle_to_reference_geodesic;
+    comparision_result.other_vehicle_to_reference_geodesic = mref_veh_other;
+  }
+
   return comparision_result;
 }
 
 std::pair<bool, float> CollisionStage::NegotiateCollision(const ActorId reference_vehicle_id,
+                                                          const VehicleParameters &reference_parameters,
                                                           const ActorId other_actor_id,
-                                                          const uint64_t reference_junction_look_ahead_index) {
+                                                          const uint64_t reference_junction_look_ahead_index,
+                                                          OptionalCollisionLock &reference_lock) {
   // Output variables for the method.
   bool hazard = false;
   float available_distance_margin = std::numeric_limits<float>::infinity();
@@ -328,7 +400,7 @@ std::pair<bool, float> CollisionStage::NegotiateCollision(const ActorId referenc
   float other_vehicle_length = simulation_state.GetDimensions(other_actor_id).x * SQUARE_ROOT_OF_TWO;
 
   float inter_vehicle_distance = cg::Math::DistanceSquared(reference_location, other_location);
-  float ego_bounding_box_extension = GetBoundingBoxExtention(reference_vehicle_id);
+  float ego_bounding_box_extension = GetBoundingBoxExtention(reference_vehicle_id, reference_lock);
   float other_bounding_box_extension = GetBoundingBoxExtention(other_actor_id);
   // Calculate minimum distance between vehicle to consider collision negotiation.
   float inter_vehicle_length = reference_vehicle_length + other_vehicle_length;
@@ -374,7 +446,7 @@ std::pair<bool, float> CollisionStage::NegotiateCollision(const ActorId referenc
 
       hazard = true;
 
-      const float reference_lead_distance = parameters.GetDistanceToLeadingVehicle(reference_vehicle_id);
+      const float reference_lead_distance = reference_parameters.distance_to_leading_vehicle;
       const float specific_distance_margin = std::max(reference_lead_distance, MIN_REFERENCE_DISTANCE);
       available_distance_margin = static_cast<float>(std::max(geometry_comparison.reference_vehicle_to_other_geodesic
                                                               - static_cast<double>(specific_distance_margin), 0.0));
@@ -385,8 +457,8 @@ std::pair<bool, float> CollisionStage::NegotiateCollision(const ActorId referenc
       // This enables us to smoothly approach the lead vehicle.
 
       // When possible collision found, check if an entry for collision lock present.
-      if (collision_locks.find(reference_vehicle_id) != collision_locks.end()) {
-        CollisionLock &lock = collision_locks.at(reference_vehicle_id);
+      if (reference_lock) {
+        CollisionLock &lock = *reference_lock;
         // Check if the same vehicle is under lock.
         if (other_actor_id == lock.lead_vehicle_id) {
           // If the body of the lead vehicle is touching the reference vehicle bounding box.
@@ -403,24 +475,33 @@ std::pair<bool, float> CollisionStage::NegotiateCollision(const ActorId referenc
         }
       } else {
         // Insert and initialize lock entry if not present.
-        collision_locks.insert({reference_vehicle_id,
-                                {geometry_comparison.inter_bbox_distance,
-                                 geometry_comparison.inter_bbox_distance,
-                                 other_actor_id}});
+        reference_lock = CollisionLock{geometry_comparison.inter_bbox_distance,
+                                       geometry_comparison.inter_bbox_distance,
+                                       other_actor_id};
       }
     }
   }
 
   // If no collision hazard detected, then flush collision lock held by the vehicle.
-  if (!hazard && collision_locks.find(reference_vehicle_id) != collision_locks.end()) {
-    collision_locks.erase(reference_vehicle_id);
+  if (!hazard && reference_lock) {
+    reference_lock = boost::none;
   }
 
   return {hazard, available_distance_margin};
 }
 
 void CollisionStage::ClearCycleCache() {
-  geodesic_boundary_map.clear();
+  for (unsigned long index = 0u; index < cycle_collision_locks.size(); ++index) {
+    const ActorId actor_id = vehicle_id_list.at(index);
+    const OptionalCollisionLock &lock = cycle_collision_locks.at(index);
+    if (lock) {
+      collision_locks[actor_id] = *lock;
+    } else {
+      collision_locks.erase(actor_id);
+    }
+  }
+  cycle_collision_locks.clear();
+  geodesic_polygon_map.clear();
   geometry_cache.clear();
 }
 
@@ -2,17 +2,17 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
 
-#include "boost/geometry.hpp"
-#include "boost/geometry/geometries/geometries.hpp"
-#include "boost/geometry/geometries/point_xy.hpp"
-#include "boost/geometry/geometries/polygon.hpp"
+#include <boost/optional.hpp>
 
+#include "carla/trafficmanager/CollisionGeometry.h"
 #include "carla/trafficmanager/DataStructures.h"
 #include "carla/trafficmanager/Parameters.h"
 #include "carla/trafficmanager/RandomGenerator.h"
 #include "carla/trafficmanager/SimulationState.h"
 #include "carla/trafficmanager/Stage.h"
+#include "carla/trafficmanager/TrackTraffic.h"
 
 namespace carla {
 namespace traffic_manager {
@@ -30,18 +30,32 @@ struct CollisionLock {
   ActorId lead_vehicle_id;
 };
 using CollisionLockMap = std::unordered_map<ActorId, CollisionLock>;
+using OptionalCollisionLock = boost::optional<CollisionLock>;
 
 namespace cc = carla::client;
-namespace bg = boost::geometry;
 
-using Buffer = std::deque<std::shared_ptr<SimpleWaypoint>>;
+using Buffer = WaypointBuffer;
 using BufferMap = std::unordered_map<carla::ActorId, Buffer>;
 using LocationVector = std::vector<cg::Location>;
-using GeodesicBoundaryMap = std::unordered_map<ActorId, LocationVector>;
+using GeodesicPolygonMap = std::unordered_map<ActorId, CollisionPolygon>;
 using GeometryComparisonMap = std::unordered_map<uint64_t, GeometryComparison>;
-using Polygon = bg::model::polygon<bg::model::d2::point_xy<double>>;
 
 /// This class has functionality to detect potential collision with a nearby actor.
+///
+/// A cycle is run in three steps so that vehicles can be updated concurrently:
+/// PrepareCycle() is called from a single thread, then UpdateGeodesicBoundary()
+/// and afterwards Update() may be called concurrently for different indices,
+/// and ClearCycleCache() commits the collision locks from a single thread.
+/// During the concurrent steps the buffers, the tracked traffic and the
+/// collision locks of the previous cycle are only read, so the result does
+/// not depend on the order in which vehicles are updated.
+///
+/// The candidates of each vehicle are found by sweeping the actors sorted by
+/// their x coordinate within the collision radius, and keeping the ones that
+/// share a geodesic grid with the vehicle. Pairs of actors whose path
+/// boundaries are farther apart than the overlap threshold are then discarded
+/// by comparing the bounding boxes of the boundaries, before computing the
+/// exact distances between the polygons.
 class CollisionStage : Stage {
 private:
   const std::vector<ActorId> &vehicle_id_list;
@@ -56,24 +70,41 @@ private:
   // comparision between vehicle boundaries
   // to avoid repeated computation within a cycle.
   GeometryComparisonMap geometry_cache;
-  GeodesicBoundaryMap geodesic_boundary_map;
-  RandomGenerator &random_device;
+  std::mutex geometry_cache_mutex;
+  // Boundaries of the registered vehicles, filled by UpdateGeodesicBoundary.
+  GeodesicPolygonMap geodesic_polygon_map;
+  // Locations of all the actors sorted by their x coordinate, swept to find
+  // the collision candidates of each vehicle.
+  std::vector<std::pair<cg::Location, ActorId>> actors_by_x;
+  // Collision locks of the registered vehicles updated during the current
+  // cycle, in the order of vehicle_id_list.
+  std::vector<OptionalCollisionLock> cycle_collision_locks;
+  RandomGeneratorMap &random_devices;
 
   // Method to determine if a vehicle is on a collision path to another.
   std::pair<bool, float> NegotiateCollision(const ActorId reference_vehicle_id,
+                                            const VehicleParameters &reference_parameters,
                                             const ActorId other_actor_id,
-                                            const uint64_t reference_junction_look_ahead_index);
+                                            const uint64_t reference_junction_look_ahead_index,
+                                            OptionalCollisionLock &reference_lock);
 
   // Method to calculate bounding box extention length ahead of the vehicle.
+  float GetBoundingBoxExtention(const ActorId actor_id, const OptionalCollisionLock &lock);
+
+  // Same as above using the collision lock of the previous cycle.
   float GetBoundingBoxExtention(const ActorId actor_id);
 
   // Method to calculate polygon points around the vehicle's bounding box.
   LocationVector GetBoundary(const ActorId actor_id);
 
   // Method to construct polygon points around the path boundary of the vehicle.
-  LocationVector GetGeodesicBoundary(const ActorId actor_id);
+  LocationVector ComputeGeodesicBoundary(const ActorId actor_id,
+                                         const VehicleParameters &vehicle_parameters);
 
-  Polygon GetPolygon(const LocationVector &boundary);
+  // Method to retrieve the path boundary of an actor, which is its bounding
+  // box @a bbox_polygon if it is not a registered vehicle.
+  const CollisionPolygon &GetGeodesicPolygon(const ActorId actor_id,
+                                             const CollisionPolygon &bbox_polygon) const;
 
   // Method to compare path boundaries, bounding boxes of vehicles
   // and cache the results for reuse in current update cycle.
@@ -90,7 +121,13 @@ public:
                  const TrackTraffic &track_traffic,
                  const Parameters &parameters,
                  CollisionFrame &output_array,
-                 RandomGenerator &random_device);
+                 RandomGeneratorMap &random_devices);
+
+  // Method to allocate the per vehicle structures of the current update cycle.
+  void PrepareCycle();
+
+  // Method to compute the path boundary of a registered vehicle.
+  void UpdateGeodesicBoundary(const unsigned long index);
 
   void Update (const unsigned long index) override;
 
@@ -98,7 +135,7 @@ public:
 
   void Reset() override;
 
-  // Method to flush cache for current update cycle.
+  // Method to commit the collision locks and flush cache for current update cycle.
   void ClearCycleCache();
 };
 
@@ -48,6 +48,7 @@ static const float MAX_START_DISTANCE = 20.0f;
 static const float MINIMUM_HORIZON_LENGTH = 15.0f;
 static const float HORIZON_RATE = 2.0f;
 static const float HIGH_SPEED_HORIZON_RATE = 4.0f;
+static const uint32_t WAYPOINT_BUFFER_CAPACITY = 64u;
 } // namespace PathBufferUpdate
 
 namespace WaypointSelection {
@@ -95,6 +96,18 @@ static const uint64_t GROWTH_STEP_SIZE = 50u;
 static const float INV_GROWTH_STEP_SIZE = 1.0f / static_cast<float>(GROWTH_STEP_SIZE);
 } // namespace FrameMemory
 
+namespace StageExecution {
+static const unsigned long MAX_STAGE_WORKERS = 8u;
+static const unsigned long MIN_VEHICLES_PER_WORKER = 16u;
+} // namespace StageExecution
+
+namespace Sharding {
+static const unsigned long MIN_VEHICLES_PER_SHARD = 64u;
+static const float MIN_SHARD_WIDTH = 200.0f;
+// Length a path may grow beyond its horizon to get past a junction.
+static const float JUNCTION_EXTENSION_MARGIN = 50.0f;
+} // namespace Sharding
+
 namespace Map {
 static const float INFINITE_DISTANCE = std::numeric_limits<float>::max();
 static const float MAX_GEODESIC_GRID_LENGTH = 20.0f;
@@ -110,6 +123,7 @@ static float const STRAIGHT_DEG = 19.0f;
 namespace TrafficLight {
 static const double MINIMUM_STOP_TIME = 2.0;
 static const double EXIT_JUNCTION_THRESHOLD = 0;  // Dot product of 90º
+static const float MAX_APPROACH_DISTANCE = 50.0f;
 } // namespace TrafficLight
 
 namespace MotionPlan {
@@ -139,6 +153,8 @@ static const float SUN_ALTITUDE_DEGREES_JUST_BEFORE_SUNSET = 145.0f;
 static const float HEAVY_PRECIPITATION_THRESHOLD = 80.0f;
 static const float FOG_DENSITY_THRESHOLD = 20.0f;
 static const float MAX_DISTANCE_LIGHT_CHECK = 225.0f;
+static const double WORLD_INFO_REFRESH_PERIOD = 5.0;
+static const double LIGHT_STATES_REFRESH_PERIOD = 1.0;
 } // namespace VehicleLight
 
 namespace PID {
@@ -157,6 +173,9 @@ static const std::vector<float> LATERAL_HIGHWAY_PARAM = {2.0f, 0.02f, 0.04f};
 namespace TrackTraffic {
 static const uint64_t BUFFER_STEP_THROUGH = 5;
 static const float INV_BUFFER_STEP_THROUGH = 1.0f / static_cast<float>(BUFFER_STEP_THROUGH);
+// Distance an actor not registered with the traffic manager has to move
+// before the waypoints it occupies are searched again.
+static const float UNREGISTERED_WAYPOINT_UPDATE_DISTANCE = 1.0f;
 } // namespace TrackTraffic
 
 } // namespace constants
@@ -4,11 +4,19 @@
 // This work is licensed under the terms of the MIT license.
 // For a copy, see <https://opensource.org/licenses/MIT>.
 
+#include <algorithm>
+#include <map>
+#include <string>
+
+#include "carla/client/Landmark.h"
 #include "carla/Logging.h"
+#include "carla/ParallelFor.h"
 
 #include "carla/trafficmanager/Constants.h"
 #include "carla/trafficmanager/InMemoryMap.h"
 #include <boost/geometry/geometries/box.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 namespace carla {
 namespace traffic_manager {
@@ -16,9 +24,26 @@ namespace traffic_manager {
   namespace cg = carla::geom;
   using namespace constants::Map;
 
+  namespace bip = boost::interprocess;
+
   using TopologyList = std::vector<std::pair<WaypointPtr, WaypointPtr>>;
   using RawNodeList = std::vector<WaypointPtr>;
 
+  // Size of a waypoint of the caches cooked before the graph format, with no
+  // next or previous waypoints.
+  static const size_t MIN_CACHED_WAYPOINT_SIZE =
+      sizeof(uint64_t) + 3u * sizeof(uint32_t) + sizeof(float) + 2u * sizeof(uint16_t) +
+      2u * sizeof(uint64_t) + sizeof(int32_t) + sizeof(bool) + sizeof(uint8_t);
+
+  static std::vector<cg::Location> GetLocations(const WaypointGraph &graph) {
+    std::vector<cg::Location> locations;
+    locations.reserve(graph.Size());
+    for (WaypointIndex index = 0u; index < graph.Size(); ++index) {
+      locations.push_back(graph.GetLocation(index));
+    }
+    return locations;
+  }
+
   InMemoryMap::InMemoryMap(WorldMap world_map) : _world_map(world_map) {}
   InMemoryMap::~InMemoryMap() {}
 
@@ -26,14 +51,10 @@ namespace traffic_manager {
     return std::make_tuple(wp->GetRoadId(), wp->GetLaneId(), wp->GetSectionId());
   }
 
-  SegmentId InMemoryMap::GetSegmentId(const SimpleWaypointPtr &swp) const {
-    return GetSegmentId(swp->GetWaypoint());
-  }
-
-  NodeList InMemoryMap::GetSuccessors(const SegmentId segment_id,
-                                      const SegmentTopology &segment_topology,
-                                      const SegmentMap &segment_map) {
-    NodeList result;
+  std::vector<WaypointIndex> InMemoryMap::GetSuccessors(const SegmentId segment_id,
+                                                        const SegmentTopology &segment_topology,
+                                                        const SegmentMap &segment_map) {
+    std::vector<WaypointIndex> result;
     if (segment_topology.find(segment_id) == segment_topology.end()) {
       return result;
     }
@@ -49,10 +70,10 @@ namespace traffic_manager {
     return result;
   }
 
-  NodeList InMemoryMap::GetPredecessors(const SegmentId segment_id,
-                                        const SegmentTopology &segment_topology,
-                                        const SegmentMap &segment_map) {
-    NodeList result;
+  std::vector<WaypointIndex> InMemoryMap::GetPredecessors(const SegmentId segment_id,
+                                                          const SegmentTopology &segment_topology,
+                                                          const SegmentMap &segment_map) {
+    std::vector<WaypointIndex> result;
     if (segment_topology.find(segment_id) == segment_topology.end()) {
       return result;
     }
@@ -89,82 +110,135 @@ namespace traffic_manager {
       return;
     }
 
-    // write total records
-    uint32_t total = static_cast<uint32_t>(dense_topology.size());
-    out_file.write(reinterpret_cast<const char *>(&total), sizeof(uint32_t));
-
-    // write simple waypoints
-    std::unordered_set<uint64_t> used_ids;
-    for (auto& wp: dense_topology) {
-      if (used_ids.find(wp->GetId()) != used_ids.end()) {
-        log_error("Could not generate the binary file. There are repeated waypoints");
-      }
-      CachedSimpleWaypoint cached_wp(wp);
-      cached_wp.Write(out_file);
-
-      used_ids.insert(wp->GetId());
-    }
+    // The cache is the buffer of the graph as it is, so it can be mapped
+    // and used in place when loaded.
+    graph.Write(out_file);
 
     out_file.close();
     return;
   }
 
   bool InMemoryMap::Load(const std::vector<uint8_t>& content) {
+    if (WaypointGraph::IsGraphData(content.data(), content.size())) {
+      std::shared_ptr<uint8_t> data(new uint8_t[content.size()], std::default_delete<uint8_t[]>());
+      std::memcpy(data.get(), content.data(), content.size());
+      if (!graph.Load(_world_map, data, content.size())) {
+        log_error("Invalid InMemoryMap cache");
+        return false;
+      }
+      SetUpSpatialTree(GetLocations(graph));
+      return true;
+    }
+    if (WaypointGraph::HasGraphMagic(content.data(), content.size())) {
+      // A graph of another version, it has to be built again.
+      log_warning("InMemoryMap cache of an old version, ignoring it");
+      return false;
+    }
+
+    // Caches cooked before the graph format are parsed waypoint by waypoint.
     unsigned long pos = 0;
     std::vector<CachedSimpleWaypoint> cached_waypoints;
     std::unordered_map<uint64_t, uint32_t> id2index;
 
-    // read total records
+    // read total records, each one takes at least MIN_CACHED_WAYPOINT_SIZE
     uint32_t total;
+    if (content.size() < sizeof(total)) {
+      return false;
+    }
     memcpy(&total, &content[pos], sizeof(total));
     pos += sizeof(total);
+    if (total > (content.size() - pos) / MIN_CACHED_WAYPOINT_SIZE) {
+      log_error("Invalid InMemoryMap cache");
+      return false;
+    }
 
     // read simple waypoints
+    GraphNodeList nodes;
+    nodes.reserve(total);
     for (uint32_t i=0; i < total; i++) {
       CachedSimpleWaypoint cached_wp;
-      cached_wp.Read(content, pos);
+      if (!cached_wp.Read(content, pos)) {
+        log_error("Invalid InMemoryMap cache");
+        return false;
+      }
       cached_waypoints.push_back(cached_wp);
       id2index.insert({cached_wp.waypoint_id, i});
 
-      WaypointPtr waypoint_ptr = _world_map->GetWaypointXODR(cached_wp.road_id, cached_wp.lane_id, cached_wp.s);
-      SimpleWaypointPtr wp = std::make_shared<SimpleWaypoint>(waypoint_ptr);
-      wp->SetGeodesicGridId(cached_wp.geodesic_grid_id);
-      wp->SetIsJunction(cached_wp.is_junction);
-      wp->SetRoadOption(static_cast<RoadOption>(cached_wp.road_option));
-      dense_topology.push_back(wp);
+      WaypointGraph::Node node;
+      node.waypoint = _world_map->GetWaypointXODR(cached_wp.road_id, cached_wp.lane_id, cached_wp.s);
+      if (node.waypoint == nullptr) {
+        log_error("Invalid InMemoryMap cache");
+        return false;
+      }
+      node.geodesic_grid_id = cached_wp.geodesic_grid_id;
+      node.is_junction = cached_wp.is_junction;
+      node.road_option = static_cast<RoadOption>(cached_wp.road_option);
+      nodes.push_back(std::move(node));
     }
 
     // connect waypoints
-    for (uint32_t i=0; i < dense_topology.size(); i++) {
-      auto wp = dense_topology.at(i);
-      auto cached_wp = cached_waypoints.at(i);
-
-      std::vector<SimpleWaypointPtr> next_waypoints;
+    for (uint32_t i=0; i < nodes.size(); i++) {
+      WaypointGraph::Node &node = nodes.at(i);
+      const CachedSimpleWaypoint &cached_wp = cached_waypoints.at(i);
+
+      bool linked = true;
+      auto index_of = [&](uint64_t id) {
+        auto it = id2index.find(id);
+        linked = linked && it != id2index.end();
+        return it != id2index.end() ? it->second : 0u;
+      };
       for (auto id : cached_wp.next_waypoints) {
-        next_waypoints.push_back(dense_topology.at(id2index.at(id)));
+        node.next.push_back(index_of(id));
       }
-      std::vector<SimpleWaypointPtr> previous_waypoints;
       for (auto id : cached_wp.previous_waypoints) {
-        previous_waypoints.push_back(dense_topology.at(id2index.at(id)));
+        node.previous.push_back(index_of(id));
       }
-      wp->SetNextWaypoint(next_waypoints);
-      wp->SetPreviousWaypoint(previous_waypoints);
       if (cached_wp.next_left_waypoint > 0) {
-        wp->SetLeftWaypoint(dense_topology.at(id2index.at(cached_wp.next_left_waypoint)));
+        node.left = index_of(cached_wp.next_left_waypoint);
       }
       if (cached_wp.next_right_waypoint > 0) {
-        wp->SetRightWaypoint(dense_topology.at(id2index.at(cached_wp.next_right_waypoint)));
+        node.right = index_of(cached_wp.next_right_waypoint);
+      }
+      if (!linked) {
+        log_error("Invalid InMemoryMap cache");
+        return false;
       }
     }
 
+    // The landmarks are not part of these caches, find them again.
+    ThreadPool pool;
+    const size_t threads = GetParallelThreads();
+    pool.AsyncRun(threads);
+    graph.Build(_world_map, nodes, SetUpLandmarks(pool, threads, nodes));
+
     // create spatial tree
-    SetUpSpatialTree();
+    SetUpSpatialTree(GetLocations(graph));
+
+    return true;
+  }
 
+  bool InMemoryMap::LoadFromFile(const std::string& path) {
+    try {
+      const bip::file_mapping file(path.c_str(), bip::read_only);
+      auto region = std::make_shared<bip::mapped_region>(file, bip::read_only);
+      // The graph keeps the mapping alive through the aliased pointer.
+      std::shared_ptr<const uint8_t> data(region, static_cast<const uint8_t *>(region->get_address()));
+      if (!graph.Load(_world_map, data, region->get_size())) {
+        return false;
+      }
+    } catch (const bip::interprocess_exception &) {
+      return false;
+    }
+    SetUpSpatialTree(GetLocations(graph));
     return true;
   }
 
   void InMemoryMap::SetUp() {
 
+    ThreadPool pool;
+    const size_t threads = GetParallelThreads();
+    pool.AsyncRun(threads);
+
     // 1. Building segment topology (i.e., defining set of segment predecessors and successors)
     assert(_world_map != nullptr && "No map reference found.");
     auto waypoint_topology = _world_map->GetTopology();
@@ -221,12 +295,12 @@ namespace traffic_manager {
       }
     }
 
-    // 2. Consuming the raw dense topology from cc::Map into SimpleWaypoints.
-    SegmentMap segment_map;
+    // 2. Consuming the raw dense topology from cc::Map into segments.
+    std::map<SegmentId, std::vector<WaypointPtr>> raw_segment_map;
     assert(_world_map != nullptr && "No map reference found.");
     auto raw_dense_topology = _world_map->GenerateWaypoints(MAP_RESOLUTION);
     for (auto &waypoint_ptr: raw_dense_topology) {
-      segment_map[GetSegmentId(waypoint_ptr)].emplace_back(std::make_shared<SimpleWaypoint>(waypoint_ptr));
+      raw_segment_map[GetSegmentId(waypoint_ptr)].emplace_back(waypoint_ptr);
     }
 
     // 3. Processing waypoints.
@@ -234,8 +308,8 @@ namespace traffic_manager {
       return cg::Math::DistanceSquared(l1, l2);
     };
     auto square = [](float input) {return std::pow(input, 2);};
-    auto compare_s = [](const SimpleWaypointPtr &swp1, const SimpleWaypointPtr &swp2) {
-      return (swp1->GetWaypoint()->GetDistance() < swp2->GetWaypoint()->GetDistance());
+    auto compare_s = [](const WaypointPtr &wp1, const WaypointPtr &wp2) {
+      return (wp1->GetDistance() < wp2->GetDistance());
     };
     auto wpt_angle = [](cg::Vector3D l1, cg::Vector3D l2) {
       return cg::Math::GetVectorAngle(l1, l2);
@@ -244,23 +318,24 @@ namespace traffic_manager {
       return x ^ ((x ^ y) & -(x < y));
     };
 
-    GeoGridId geodesic_grid_id_counter = -1;
-    for (auto &segment: segment_map) {
-      auto &segment_waypoints = segment.second;
-
-      // Generating geodesic grid ids.
-      ++geodesic_grid_id_counter;
+    // Segments are densified independently, in parallel.
+    std::vector<std::pair<SegmentId, std::vector<WaypointPtr>>> raw_segments(
+        std::make_move_iterator(raw_segment_map.begin()),
+        std::make_move_iterator(raw_segment_map.end()));
+    raw_segment_map.clear();
+    ParallelFor(pool, threads, raw_segments.size(), 1u, [&](const size_t segment_index) {
+      auto &segment_waypoints = raw_segments[segment_index].second;
 
       // Ordering waypoints according to road direction.
       std::sort(segment_waypoints.begin(), segment_waypoints.end(), compare_s);
-      auto lane_id = segment_waypoints.front()->GetWaypoint()->GetLaneId();
+      auto lane_id = segment_waypoints.front()->GetLaneId();
       if (lane_id > 0) {
         std::reverse(segment_waypoints.begin(), segment_waypoints.end());
       }
 
       // Adding more waypoints if the angle is too tight or if they are too distant.
       for (std::size_t i = 0; i < segment_waypoints.size() - 1; ++i) {
-          double distance = std::abs(segment_waypoints.at(i)->GetWaypoint()->GetDistance() - segment_waypoints.at(i+1)->GetWaypoint()->GetDistance());
+          double distance = std::abs(segment_waypoints.at(i)->GetDistance() - segment_waypoints.at(i+1)->GetDistance());
           double angle = wpt_angle(segment_waypoints.at(i)->GetTransform().GetForwardVector(), segment_waypoints.at(i+1)->GetTransform().GetForwardVector());
           int16_t angle_splits = static_cast<int16_t>(angle/MAX_WPT_RADIANS);
           int16_t distance_splits = static_cast<int16_t>((distance*distance)/MAX_WPT_DISTANCE);
@@ -268,11 +343,11 @@ namespace traffic_manager {
           if (max_splits >= 1) {
             // Compute how many waypoints do we need to generate.
             for (uint16_t j = 0; j < max_splits; ++j) {
-              auto next_waypoints = segment_waypoints.at(i)->GetWaypoint()->GetNext(distance/(max_splits+1));
+              auto next_waypoints = segment_waypoints.at(i)->GetNext(distance/(max_splits+1));
               if (next_waypoints.size() != 0) {
                 auto new_waypoint = next_waypoints.front();
                 i++;
-                segment_waypoints.insert(segment_waypoints.begin()+static_cast<int64_t>(i), std::make_shared<SimpleWaypoint>(new_waypoint));
+                segment_waypoints.insert(segment_waypoints.begin()+static_cast<int64_t>(i), new_waypoint);
               } else {
                 // Reached end of the road.
                 break;
@@ -280,156 +355,191 @@ namespace traffic_manager {
             }
           }
         }
+    });
+
+    GraphNodeList nodes;
+    SegmentMap segment_map;
+    GeoGridId geodesic_grid_id_counter = -1;
+    for (auto &raw_segment: raw_segments) {
+      auto &segment_waypoints = raw_segment.second;
+
+      // Generating geodesic grid ids.
+      ++geodesic_grid_id_counter;
+
+      // Adding the waypoints of the segment to the graph.
+      std::vector<WaypointIndex> &segment_indices = segment_map[raw_segment.first];
+      segment_indices.reserve(segment_waypoints.size());
+      for (auto &waypoint_ptr : segment_waypoints) {
+        segment_indices.push_back(static_cast<WaypointIndex>(nodes.size()));
+        WaypointGraph::Node node;
+        node.waypoint = waypoint_ptr;
+        nodes.push_back(std::move(node));
+      }
 
       // Placing intra-segment connections.
-      cg::Location grid_edge_location = segment_waypoints.front()->GetLocation();
-      for (std::size_t i = 0; i < segment_waypoints.size() - 1; ++i) {
-        SimpleWaypointPtr current_waypoint = segment_waypoints.at(i);
-        SimpleWaypointPtr next_waypoint = segment_waypoints.at(i+1);
+      cg::Location grid_edge_location = segment_waypoints.front()->GetTransform().location;
+      for (std::size_t i = 0; i < segment_indices.size() - 1; ++i) {
+        WaypointGraph::Node &current_node = nodes.at(segment_indices.at(i));
+        WaypointGraph::Node &next_node = nodes.at(segment_indices.at(i+1));
         // Assigning grid id.
-        if (distance_squared(grid_edge_location, current_waypoint->GetLocation()) >
+        const cg::Location current_location = current_node.waypoint->GetTransform().location;
+        if (distance_squared(grid_edge_location, current_location) >
         square(MAX_GEODESIC_GRID_LENGTH)) {
           ++geodesic_grid_id_counter;
-          grid_edge_location = current_waypoint->GetLocation();
+          grid_edge_location = current_location;
         }
-        current_waypoint->SetGeodesicGridId(geodesic_grid_id_counter);
+        current_node.geodesic_grid_id = geodesic_grid_id_counter;
 
-        current_waypoint->SetNextWaypoint({next_waypoint});
-        next_waypoint->SetPreviousWaypoint({current_waypoint});
+        current_node.next.push_back(segment_indices.at(i+1));
+        next_node.previous.push_back(segment_indices.at(i));
 
       }
-      segment_waypoints.back()->SetGeodesicGridId(geodesic_grid_id_counter);
+      nodes.at(segment_indices.back()).geodesic_grid_id = geodesic_grid_id_counter;
 
-      // Adding simple waypoints to processed dense topology.
-      for (auto swp: segment_waypoints) {
+      for (const WaypointIndex index : segment_indices) {
         // Checking whether the waypoint is in a real junction.
-        auto wpt = swp->GetWaypoint();
-        auto road_id = wpt->GetRoadId();
-        if (wpt->IsJunction() && !is_real_junction.count(road_id)) {
-          swp->SetIsJunction(false);
+        WaypointGraph::Node &node = nodes.at(index);
+        auto road_id = node.waypoint->GetRoadId();
+        if (node.waypoint->IsJunction() && !is_real_junction.count(road_id)) {
+          node.is_junction = false;
         } else {
-          swp->SetIsJunction(swp->GetWaypoint()->IsJunction());
+          node.is_junction = node.waypoint->IsJunction();
         }
-
-        dense_topology.push_back(swp);
       }
     }
 
-    SetUpSpatialTree();
+    std::vector<cg::Location> locations;
+    locations.reserve(nodes.size());
+    for (const auto &node : nodes) {
+      locations.push_back(node.waypoint->GetTransform().location);
+    }
+    SetUpSpatialTree(locations);
 
     // Placing inter-segment connections.
     for (auto &segment : segment_map) {
       SegmentId segment_id = segment.first;
-      auto &segment_waypoints = segment.second;
+      auto &segment_indices = segment.second;
 
       auto successors = GetSuccessors(segment_id, segment_topology, segment_map);
       auto predecessors = GetPredecessors(segment_id, segment_topology, segment_map);
 
-      segment_waypoints.front()->SetPreviousWaypoint(predecessors);
-      segment_waypoints.back()->SetNextWaypoint(successors);
+      auto &first_previous = nodes.at(segment_indices.front()).previous;
+      first_previous.insert(first_previous.end(), predecessors.begin(), predecessors.end());
+      auto &last_next = nodes.at(segment_indices.back()).next;
+      last_next.insert(last_next.end(), successors.begin(), successors.end());
     }
 
-    // Linking lane change connections.
-    for (auto &swp : dense_topology) {
-      if (!swp->CheckJunction()) {
-        FindAndLinkLaneChange(swp);
+    // Linking lane change connections. Each waypoint only writes its own
+    // links, so they are found in parallel.
+    ParallelFor(pool, threads, nodes.size(), 256u, [&](const size_t index) {
+      if (!nodes.at(index).is_junction) {
+        FindAndLinkLaneChange(static_cast<WaypointIndex>(index), nodes);
       }
-    }
+    });
 
     // Linking any unconnected segments.
-    for (auto &swp : dense_topology) {
-      if (swp->GetNextWaypoint().empty()) {
-        auto neighbour = swp->GetRightWaypoint();
-        if (!neighbour) {
-          neighbour = swp->GetLeftWaypoint();
+    for (WaypointIndex index = 0u; index < nodes.size(); ++index) {
+      WaypointGraph::Node &node = nodes.at(index);
+      if (node.next.empty()) {
+        WaypointIndex neighbour = node.right;
+        if (neighbour == INVALID_WAYPOINT_INDEX) {
+          neighbour = node.left;
         }
 
-        if (neighbour) {
-          swp->SetNextWaypoint(neighbour->GetNextWaypoint());
-          for (auto next_waypoint : neighbour->GetNextWaypoint()) {
-            next_waypoint->SetPreviousWaypoint({swp});
+        if (neighbour != INVALID_WAYPOINT_INDEX) {
+          const std::vector<WaypointIndex> neighbour_next = nodes.at(neighbour).next;
+          node.next.insert(node.next.end(), neighbour_next.begin(), neighbour_next.end());
+          for (const WaypointIndex next_index : neighbour_next) {
+            nodes.at(next_index).previous.push_back(index);
           }
         }
       }
     }
 
-    // Specifying a RoadOption for each SimpleWaypoint
-    SetUpRoadOption();
+    // Specifying a RoadOption for each waypoint.
+    SetUpRoadOption(pool, threads, nodes);
+
+    graph.Build(_world_map, nodes, SetUpLandmarks(pool, threads, nodes));
   }
 
-  void InMemoryMap::SetUpSpatialTree() {
-    for (auto &simple_waypoint: dense_topology) {
-      if (simple_waypoint != nullptr) {
-        const cg::Location loc = simple_waypoint->GetLocation();
-        Point3D point(loc.x, loc.y, loc.z);
-        rtree.insert(std::make_pair(point, simple_waypoint));
-      }
+  void InMemoryMap::SetUpSpatialTree(const std::vector<cg::Location> &locations) {
+    std::vector<SpatialTreeEntry> entries;
+    entries.reserve(locations.size());
+    for (WaypointIndex index = 0u; index < locations.size(); ++index) {
+      const cg::Location &loc = locations[index];
+      entries.emplace_back(Point3D(loc.x, loc.y, loc.z), index);
     }
+    // Bulk loading packs the nodes of the tree, which takes less memory and
+    // time than inserting the waypoints one by one.
+    rtree = Rtree(entries.begin(), entries.end());
   }
 
-  void InMemoryMap::SetUpRoadOption() {
-    for (auto &swp : dense_topology) {
-      std::vector<SimpleWaypointPtr> next_waypoints = swp->GetNextWaypoint();
+  void InMemoryMap::SetUpRoadOption(ThreadPool &pool, size_t threads, GraphNodeList &nodes) {
+    // To check if we are in an actual junction, and not on an highway, we try to see
+    // if there's a landmark nearby of type Traffic Light, Stop Sign or Yield Sign.
+    // Querying the landmarks is the expensive part, so it is done in parallel
+    // for all the waypoints entering a junction before assigning the options.
+    std::vector<uint8_t> found_landmarks(nodes.size(), 0u);
+    ParallelFor(pool, threads, nodes.size(), 256u, [&](const size_t index) {
+      const WaypointGraph::Node &node = nodes.at(index);
+      if (node.next.size() == 1 && !node.is_junction && nodes.at(node.next.front()).is_junction) {
+        for (auto &landmark : node.waypoint->GetAllLandmarksInDistance(15.0)) {
+          auto landmark_type = landmark->GetType();
+          if (landmark_type == "1000001" || landmark_type == "206" || landmark_type == "205") {
+            // We found a landmark.
+            found_landmarks[index] = 1u;
+            break;
+          }
+        }
+      }
+    });
+
+    for (size_t index = 0u; index < nodes.size(); ++index) {
+      WaypointGraph::Node &node = nodes.at(index);
+      const std::vector<WaypointIndex> &next_waypoints = node.next;
       std::size_t next_swp_size = next_waypoints.size();
 
       if (next_swp_size == 0) {
         // No next waypoint means that this is an end of the road.
-        swp->SetRoadOption(RoadOption::RoadEnd);
+        node.road_option = RoadOption::RoadEnd;
       }
 
-      else if (next_swp_size > 1 || (!swp->CheckJunction() && next_waypoints.front()->CheckJunction())) {
-        // To check if we are in an actual junction, and not on an highway, we try to see
-        // if there's a landmark nearby of type Traffic Light, Stop Sign or Yield Sign.
-
-        bool found_landmark= false;
-        if (next_swp_size <= 1) {
-
-          auto all_landmarks = swp->GetWaypoint()->GetAllLandmarksInDistance(15.0);
-
-          if (all_landmarks.empty()) {
-            // Landmark hasn't been found, this isn't a junction.
-            swp->SetRoadOption(RoadOption::LaneFollow);
-          } else {
-            for (auto &landmark : all_landmarks) {
-              auto landmark_type = landmark->GetType();
-              if (landmark_type == "1000001" || landmark_type == "206" || landmark_type == "205") {
-                // We found a landmark.
-                found_landmark= true;
-                break;
-              }
-            }
-            if (!found_landmark) {
-              swp->SetRoadOption(RoadOption::LaneFollow);
-            }
-          }
+      else if (next_swp_size > 1 || (!node.is_junction && nodes.at(next_waypoints.front()).is_junction)) {
+        const bool found_landmark = found_landmarks[index] != 0u;
+        if (next_swp_size <= 1 && !found_landmark) {
+          // Landmark hasn't been found, this isn't a junction.
+          node.road_option = RoadOption::LaneFollow;
         }
 
         // If we did find a landmark, or we are in the other case, find all waypoints
         // in the junction and assign the correct RoadOption.
         if (found_landmark || next_swp_size > 1) {
-          swp->SetRoadOption(RoadOption::LaneFollow);
-          for (auto &next_swp : next_waypoints) {
-            std::vector<SimpleWaypointPtr> traversed_waypoints;
-            SimpleWaypointPtr junction_end_waypoint;
+          node.road_option = RoadOption::LaneFollow;
+          for (const WaypointIndex next_index : next_waypoints) {
+            std::vector<WaypointIndex> traversed_waypoints;
+            WaypointIndex junction_end_waypoint;
 
             if (next_swp_size > 1) {
-              junction_end_waypoint = next_swp;
+              junction_end_waypoint = next_index;
             } else {
               junction_end_waypoint = next_waypoints.front();
             }
 
-            while (junction_end_waypoint->CheckJunction()){
+            while (nodes.at(junction_end_waypoint).is_junction){
               traversed_waypoints.push_back(junction_end_waypoint);
-              std::vector<SimpleWaypointPtr> temp = junction_end_waypoint->GetNextWaypoint();
+              const std::vector<WaypointIndex> &temp = nodes.at(junction_end_waypoint).next;
               if (temp.empty()) {
                 break;
               }
               junction_end_waypoint = temp.front();
             }
+            if (traversed_waypoints.empty()) {
+              continue;
+            }
 
             // Calculate the angle between the first and the last point of the junction.
-            int16_t current_angle = static_cast<int16_t>(traversed_waypoints.front()->GetTransform().rotation.yaw);
-            int16_t junction_end_angle = static_cast<int16_t>(traversed_waypoints.back()->GetTransform().rotation.yaw);
+            int16_t current_angle = static_cast<int16_t>(nodes.at(traversed_waypoints.front()).waypoint->GetTransform().rotation.yaw);
+            int16_t junction_end_angle = static_cast<int16_t>(nodes.at(traversed_waypoints.back()).waypoint->GetTransform().rotation.yaw);
             int16_t diff_angle = (junction_end_angle - current_angle) % 360;
             bool straight = (diff_angle < STRAIGHT_DEG && diff_angle > -STRAIGHT_DEG) ||
                   (diff_angle > 360-STRAIGHT_DEG && diff_angle <= 360) ||
@@ -437,9 +547,9 @@ namespace traffic_manager {
             bool right = (diff_angle >= STRAIGHT_DEG && diff_angle <= 180) ||
                 (diff_angle <= -180 && diff_angle >= -360+STRAIGHT_DEG);
 
-            auto assign_option = [](RoadOption ro, std::vector<SimpleWaypointPtr> traversed_waypoints) {
-              for (auto &twp : traversed_waypoints) {
-                  twp->SetRoadOption(ro);
+            auto assign_option = [&nodes](RoadOption ro, const std::vector<WaypointIndex> &traversed_waypoints) {
+              for (const WaypointIndex twp : traversed_waypoints) {
+                  nodes.at(twp).road_option = ro;
               }
             };
 
@@ -450,23 +560,94 @@ namespace traffic_manager {
           }
         }
       }
-      else if (next_swp_size == 1 && swp->GetRoadOption() == RoadOption::Void) {
-        swp->SetRoadOption(RoadOption::LaneFollow);
+      else if (next_swp_size == 1 && node.road_option == RoadOption::Void) {
+        node.road_option = RoadOption::LaneFollow;
       }
     }
   }
 
-  SimpleWaypointPtr InMemoryMap::GetWaypoint(const cg::Location loc) const {
+  std::vector<WaypointGraph::Landmark> InMemoryMap::SetUpLandmarks(
+      ThreadPool &pool,
+      size_t threads,
+      GraphNodeList &nodes) {
+    // Landmark as found from a waypoint, with the ids telling it apart from
+    // the same landmark found from other waypoints.
+    struct FoundLandmark {
+      std::string id;
+      uint64_t waypoint_id;
+      WaypointGraph::Landmark landmark;
+    };
+
+    // Each waypoint looks up the landmarks until its farthest successor,
+    // which is the expensive part and is done in parallel. The distance to a
+    // successor is a straight line, shorter than the lane when it curves, so
+    // the lookup goes one map resolution further.
+    std::vector<std::vector<FoundLandmark>> found_landmarks(nodes.size());
+    ParallelFor(pool, threads, nodes.size(), 256u, [&](const size_t index) {
+      const WaypointGraph::Node &node = nodes.at(index);
+      const cg::Location location = node.waypoint->GetTransform().location;
+      double distance = 0.0;
+      for (const WaypointIndex next_index : node.next) {
+        distance = std::max(distance, static_cast<double>(
+            location.Distance(nodes.at(next_index).waypoint->GetTransform().location)));
+      }
+      distance += MAP_RESOLUTION;
+      for (auto &landmark : node.waypoint->GetAllLandmarksInDistance(distance, false)) {
+        FoundLandmark found;
+        const std::string landmark_type = landmark->GetType();
+        if (landmark_type == "1000001") {
+          found.landmark.type = LandmarkType::TrafficLight;
+        } else if (landmark_type == "206") {
+          found.landmark.type = LandmarkType::Stop;
+        } else if (landmark_type == "205") {
+          found.landmark.type = LandmarkType::Yield;
+        } else if (landmark_type == "274") {
+          found.landmark.type = LandmarkType::SpeedLimit;
+          found.landmark.value = static_cast<float>(landmark->GetValue());
+        } else {
+          continue;
+        }
+        const WaypointPtr landmark_waypoint = landmark->GetWaypoint();
+        found.id = landmark->GetId();
+        found.waypoint_id = landmark_waypoint->GetId();
+        found.landmark.location = landmark_waypoint->GetTransform().location;
+        found_landmarks[index].push_back(std::move(found));
+      }
+    });
+
+    // Merging in waypoint order, so the indices don't depend on the scheduling.
+    std::vector<WaypointGraph::Landmark> landmarks;
+    std::map<std::pair<std::string, uint64_t>, uint32_t> landmark_indices;
+    for (size_t index = 0u; index < nodes.size(); ++index) {
+      std::vector<uint32_t> &node_landmarks = nodes.at(index).landmarks;
+      node_landmarks.clear();
+      for (FoundLandmark &found : found_landmarks[index]) {
+        const auto inserted = landmark_indices.emplace(
+            std::make_pair(std::move(found.id), found.waypoint_id),
+            static_cast<uint32_t>(landmarks.size()));
+        if (inserted.second) {
+          landmarks.push_back(found.landmark);
+        }
+        if (std::find(node_landmarks.begin(), node_landmarks.end(), inserted.first->second) == node_landmarks.end()) {
+          node_landmarks.push_back(inserted.first->second);
+        }
+      }
+    }
+    return landmarks;
+  }
+
+  WaypointIndex InMemoryMap::GetWaypointIndex(const cg::Location loc) const {
 
     Point3D query_point(loc.x, loc.y, loc.z);
     std::vector<SpatialTreeEntry> result_1;
 
     rtree.query(bgi::nearest(query_point, 1), std::back_inserter(result_1));
 
-    SpatialTreeEntry &closest_entry = result_1.front();
-    SimpleWaypointPtr &closest_point = closest_entry.second;
+    return result_1.front().second;
+  }
 
-    return closest_point;
+  SimpleWaypointPtr InMemoryMap::GetWaypoint(const cg::Location loc) const {
+    return graph.GetNode(GetWaypointIndex(loc));
   }
 
   NodeList InMemoryMap::GetWaypointsInDelta(const cg::Location loc, const uint16_t n_points, const float random_sample) const {
@@ -485,11 +666,11 @@ namespace traffic_manager {
     for (Rtree::const_query_iterator
         it = rtree.qbegin(bgi::within(upper_query_box)
         && !bgi::within(lower_query_box)
-        && bgi::satisfies([&](SpatialTreeEntry const& v) { return !v.second->CheckJunction();}));
+        && bgi::satisfies([&](SpatialTreeEntry const& v) { return !graph.IsJunction(v.second);}));
         it != rtree.qend();
         ++it) {
     x++;
-    result.push_back(it->second);
+    result.push_back(graph.GetNode(it->second));
     if (x >= n_points)
         break;
     }
@@ -498,68 +679,56 @@ namespace traffic_manager {
   }
 
   NodeList InMemoryMap::GetDenseTopology() const {
-    return dense_topology;
+    return graph.GetNodes();
   }
 
-  void InMemoryMap::FindAndLinkLaneChange(SimpleWaypointPtr reference_waypoint) {
+  const WaypointGraph &InMemoryMap::GetWaypointGraph() const {
+    return graph;
+  }
 
-    const WaypointPtr raw_waypoint = reference_waypoint->GetWaypoint();
+  void InMemoryMap::FindAndLinkLaneChange(const WaypointIndex reference_index, GraphNodeList &nodes) {
+
+    WaypointGraph::Node &reference_node = nodes.at(reference_index);
+    const WaypointPtr raw_waypoint = reference_node.waypoint;
     const crd::element::LaneMarking::LaneChange lane_change = raw_waypoint->GetLaneChange();
 
+    // Links the closest waypoint to a neighbouring lane if it lies on the
+    // expected side of the reference waypoint.
+    auto link_lane_change = [&](const WaypointPtr &neighbour_waypoint, const bool left) {
+      if (neighbour_waypoint != nullptr &&
+      neighbour_waypoint->GetType() == crd::Lane::LaneType::Driving &&
+      (neighbour_waypoint->GetLaneId() * raw_waypoint->GetLaneId() > 0)) {
+
+        const WaypointIndex closest_index = GetWaypointIndex(neighbour_waypoint->GetTransform().location);
+        const cg::Vector3D heading_vector = raw_waypoint->GetTransform().GetForwardVector();
+        const cg::Vector3D relative_vector = raw_waypoint->GetTransform().location
+                                             - nodes.at(closest_index).waypoint->GetTransform().location;
+        const float side = heading_vector.x * relative_vector.y - heading_vector.y * relative_vector.x;
+        if (left && side > 0.0f) {
+          reference_node.left = closest_index;
+        } else if (!left && side < 0.0f) {
+          reference_node.right = closest_index;
+        }
+      }
+    };
+
     /// Cheack for transits
     switch(lane_change)
     {
       /// Left transit way point present only
       case crd::element::LaneMarking::LaneChange::Left:
-      {
-        const WaypointPtr left_waypoint = raw_waypoint->GetLeft();
-        if (left_waypoint != nullptr &&
-        left_waypoint->GetType() == crd::Lane::LaneType::Driving &&
-        (left_waypoint->GetLaneId() * raw_waypoint->GetLaneId() > 0)) {
-
-          SimpleWaypointPtr closest_simple_waypoint = GetWaypoint(left_waypoint->GetTransform().location);
-          reference_waypoint->SetLeftWaypoint(closest_simple_waypoint);
-        }
-      }
+        link_lane_change(raw_waypoint->GetLeft(), true);
       break;
 
       /// Right transit way point present only
       case crd::element::LaneMarking::LaneChange::Right:
-      {
-	    const WaypointPtr right_waypoint = raw_waypoint->GetRight();
-	    if(right_waypoint != nullptr &&
-	    right_waypoint->GetType() == crd::Lane::LaneType::Driving &&
-	    (right_waypoint->GetLaneId() * raw_waypoint->GetLaneId() > 0)) {
-
-	      SimpleWaypointPtr closest_simple_waypoint = GetWaypoint(right_waypoint->GetTransform().location);
-	      reference_waypoint->SetRightWaypoint(closest_simple_waypoint);
-	    }
-      }
+        link_lane_change(raw_waypoint->GetRight(), false);
       break;
 
       /// Both left and right transit present
       case crd::element::LaneMarking::LaneChange::Both:
-      {
-        /// Right transit way point
-        const WaypointPtr right_waypoint = raw_waypoint->GetRight();
-        if (right_waypoint != nullptr &&
-        right_waypoint->GetType() == crd::Lane::LaneType::Driving &&
-        (right_waypoint->GetLaneId() * raw_waypoint->GetLaneId() > 0)) {
-
-          SimpleWaypointPtr closest_simple_waypointR = GetWaypoint(right_waypoint->GetTransform().location);
-          reference_waypoint->SetRightWaypoint(closest_simple_waypointR);
-        }
-
-        /// Left transit way point
-        const WaypointPtr left_waypoint = raw_waypoint->GetLeft();
-        if (left_waypoint != nullptr &&
-        left_waypoint->GetType() == crd::Lane::LaneType::Driving &&
-        (left_waypoint->GetLaneId() * raw_waypoint->GetLaneId() > 0)) {
-
-          SimpleWaypointPtr closest_simple_waypointL = GetWaypoint(left_waypoint->GetTransform().location);
-          reference_waypoint->SetLeftWaypoint(closest_simple_waypointL);
-        }
-      }
+        link_lane_change(raw_waypoint->GetRight(), false);
+        link_lane_change(raw_waypoint->GetLeft(), true);
       break;
 
       /// For no transit waypoint (left or right)
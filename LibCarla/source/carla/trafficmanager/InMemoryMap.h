@@ -25,8 +25,12 @@
 #include "carla/trafficmanager/RandomGenerator.h"
 #include "carla/trafficmanager/SimpleWaypoint.h"
 #include "carla/trafficmanager/CachedSimpleWaypoint.h"
+#include "carla/trafficmanager/WaypointGraph.h"
 
 namespace carla {
+
+  class ThreadPool;
+
 namespace traffic_manager {
 
 namespace cg = carla::geom;
@@ -36,18 +40,18 @@ namespace bg = boost::geometry;
 namespace bgi = boost::geometry::index;
 
   using WaypointPtr = carla::SharedPtr<cc::Waypoint>;
-  using SimpleWaypointPtr = std::shared_ptr<SimpleWaypoint>;
   using NodeList = std::vector<SimpleWaypointPtr>;
   using GeoGridId = crd::JuncId;
   using WorldMap = carla::SharedPtr<const cc::Map>;
 
   using Point3D = bg::model::point<float, 3, bg::cs::cartesian>;
   using Box = bg::model::box<Point3D>;
-  using SpatialTreeEntry = std::pair<Point3D, SimpleWaypointPtr>;
+  using SpatialTreeEntry = std::pair<Point3D, WaypointIndex>;
 
   using SegmentId = std::tuple<crd::RoadId, crd::LaneId, crd::SectionId>;
   using SegmentTopology = std::map<SegmentId, std::pair<std::vector<SegmentId>, std::vector<SegmentId>>>;
-  using SegmentMap = std::map<SegmentId, std::vector<SimpleWaypointPtr>>;
+  using SegmentMap = std::map<SegmentId, std::vector<WaypointIndex>>;
+  using GraphNodeList = std::vector<WaypointGraph::Node>;
   using Rtree = bgi::rtree<SpatialTreeEntry, bgi::rstar<16>>;
 
   /// This class builds a discretized local map-cache.
@@ -59,9 +63,9 @@ namespace bgi = boost::geometry::index;
 
     /// Object to hold the world map received by the constructor.
     WorldMap _world_map;
-    /// Structure to hold all custom waypoint objects after interpolation of
-    /// sparse topology.
-    NodeList dense_topology;
+    /// Structure to hold all the waypoints after interpolation of sparse
+    /// topology.
+    WaypointGraph graph;
     /// Spatial quadratic R-tree for indexing and querying waypoints.
     Rtree rtree;
 
@@ -75,6 +79,10 @@ namespace bgi = boost::geometry::index;
     //bool Load(const std::string& filename);
     bool Load(const std::vector<uint8_t>& content);
 
+    /// Memory-maps a cooked cache file and uses it in place. Returns false if
+    /// the file can't be mapped or is not in the current cache format.
+    bool LoadFromFile(const std::string& path);
+
     /// This method constructs the local map with a resolution of sampling_resolution.
     void SetUp();
 
@@ -87,6 +95,10 @@ namespace bgi = boost::geometry::index;
     /// This method returns the full list of discrete samples of the map in the local cache.
     NodeList GetDenseTopology() const;
 
+    /// This method returns the graph of discrete samples of the map, to
+    /// access them by index.
+    const WaypointGraph &GetWaypointGraph() const;
+
     std::string GetMapName();
 
     const cc::Map& GetMap() const;
@@ -94,24 +106,30 @@ namespace bgi = boost::geometry::index;
   private:
     void Save(const std::string& path);
 
-    void SetUpDenseTopology();
-    void SetUpSpatialTree();
-    void SetUpRoadOption();
+    /// Bulk loads the spatial tree with the waypoint at each location.
+    void SetUpSpatialTree(const std::vector<cg::Location> &locations);
+    /// Splits the landmark queries across the @a threads threads of @a pool.
+    void SetUpRoadOption(ThreadPool &pool, size_t threads, GraphNodeList &nodes);
+    /// Links every waypoint to the landmarks limiting the speed between it
+    /// and its successors, and returns the landmarks.
+    std::vector<WaypointGraph::Landmark> SetUpLandmarks(ThreadPool &pool, size_t threads, GraphNodeList &nodes);
+
+    /// This method returns the index of the closest waypoint to a given location.
+    WaypointIndex GetWaypointIndex(const cg::Location loc) const;
 
     /// This method is used to find and place lane change links.
-    void FindAndLinkLaneChange(SimpleWaypointPtr reference_waypoint);
+    void FindAndLinkLaneChange(const WaypointIndex reference_index, GraphNodeList &nodes);
 
-    NodeList GetSuccessors(const SegmentId segment_id,
-                          const SegmentTopology &segment_topology,
-                          const SegmentMap &segment_map);
-    NodeList GetPredecessors(const SegmentId segment_id,
-                            const SegmentTopology &segment_topology,
-                            const SegmentMap &segment_map);
+    std::vector<WaypointIndex> GetSuccessors(const SegmentId segment_id,
+                                             const SegmentTopology &segment_topology,
+                                             const SegmentMap &segment_map);
+    std::vector<WaypointIndex> GetPredecessors(const SegmentId segment_id,
+                                               const SegmentTopology &segment_topology,
+                                               const SegmentMap &segment_map);
 
     /// Computes the segment id of a given waypoint.
     /// The Id takes into account OpenDrive's road Id, lane Id and Section Id.
     SegmentId GetSegmentId(const WaypointPtr &wp) const;
-    SegmentId GetSegmentId(const SimpleWaypointPtr &swp) const;
   };
 
 } // namespace traffic_manager
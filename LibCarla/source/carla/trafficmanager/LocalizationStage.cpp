@@ -22,7 +22,7 @@ LocalizationStage::LocalizationStage(
   Parameters &parameters,
   std::vector<ActorId>& marked_for_removal,
   LocalizationFrame &output_array,
-  RandomGenerator &random_device)
+  RandomGeneratorMap &random_devices)
     : vehicle_id_list(vehicle_id_list),
     buffer_map(buffer_map),
     simulation_state(simulation_state),
@@ -31,7 +31,7 @@ LocalizationStage::LocalizationStage(
     parameters(parameters),
     marked_for_removal(marked_for_removal),
     output_array(output_array),
-    random_device(random_device){}
+    random_devices(random_devices){}
 
 void LocalizationStage::Update(const unsigned long index) {
 
@@ -111,18 +111,19 @@ void LocalizationStage::Update(const unsigned long index) {
   }
 
   // Assign a lane change.
-  const ChangeLaneInfo lane_change_info = parameters.GetForceLaneChange(actor_id);
+  const VehicleParameters &vehicle_parameters = parameters.GetSnapshot().at(index);
+  const ChangeLaneInfo lane_change_info = vehicle_parameters.force_lane_change;
   bool force_lane_change = lane_change_info.change_lane;
   bool lane_change_direction = lane_change_info.direction;
 
   // Apply parameters for keep right rule and random lane changes.
   if (!force_lane_change && vehicle_speed > MIN_LANE_CHANGE_SPEED){
-    const float perc_keep_right = parameters.GetKeepRightPercentage(actor_id);
-    const float perc_random_leftlanechange = parameters.GetRandomLeftLaneChangePercentage(actor_id);
-    const float perc_random_rightlanechange = parameters.GetRandomRightLaneChangePercentage(actor_id);
-    const bool is_keep_right = perc_keep_right > random_device.next();
-    const bool is_random_left_change = perc_random_leftlanechange >= random_device.next();
-    const bool is_random_right_change = perc_random_rightlanechange >= random_device.next();
+    const float perc_keep_right = vehicle_parameters.perc_keep_right;
+    const float perc_random_leftlanechange = vehicle_parameters.perc_random_left;
+    const float perc_random_rightlanechange = vehicle_parameters.perc_random_right;
+    const bool is_keep_right = perc_keep_right > random_devices.At(actor_id).next();
+    const bool is_random_left_change = perc_random_leftlanechange >= random_devices.At(actor_id).next();
+    const bool is_random_right_change = perc_random_rightlanechange >= random_devices.At(actor_id).next();
 
     // Determine which of the parameters we should apply.
     if (is_keep_right || is_random_right_change) {
@@ -135,7 +136,7 @@ void LocalizationStage::Update(const unsigned long index) {
         lane_change_direction = false;
       } else {
         // Both a left and right lane changes are forced. Choose between one of them.
-        lane_change_direction = FIFTYPERC > random_device.next();
+        lane_change_direction = FIFTYPERC > random_devices.At(actor_id).next();
       }
     }
   }
@@ -143,14 +144,15 @@ void LocalizationStage::Update(const unsigned long index) {
   const SimpleWaypointPtr front_waypoint = waypoint_buffer.front();
   const float lane_change_distance = SQUARE(std::max(10.0f * vehicle_speed, INTER_LANE_CHANGE_DISTANCE));
 
-  bool recently_not_executed_lane_change = last_lane_change_swpt.find(actor_id) == last_lane_change_swpt.end();
+  const SimpleWaypointPtr last_lane_change_point = GetLastLaneChangePoint(actor_id);
+  bool recently_not_executed_lane_change = last_lane_change_point == nullptr;
   bool done_with_previous_lane_change = true;
   if (!recently_not_executed_lane_change) {
-    float distance_frm_previous = cg::Math::DistanceSquared(last_lane_change_swpt.at(actor_id)->GetLocation(), vehicle_location);
+    float distance_frm_previous = cg::Math::DistanceSquared(last_lane_change_point->GetLocation(), vehicle_location);
     done_with_previous_lane_change = distance_frm_previous > lane_change_distance;
-    if (done_with_previous_lane_change) last_lane_change_swpt.erase(actor_id);
+    if (done_with_previous_lane_change) SetLastLaneChangePoint(actor_id, nullptr);
   }
-  bool auto_or_force_lane_change = parameters.GetAutoLaneChange(actor_id) || force_lane_change;
+  bool auto_or_force_lane_change = vehicle_parameters.auto_lane_change || force_lane_change;
   bool front_waypoint_not_junction = !front_waypoint->CheckJunction();
 
   if (auto_or_force_lane_change
@@ -161,11 +163,7 @@ void LocalizationStage::Update(const unsigned long index) {
                                                            force_lane_change, lane_change_direction);
 
     if (change_over_point != nullptr) {
-      if (last_lane_change_swpt.find(actor_id) != last_lane_change_swpt.end()) {
-        last_lane_change_swpt.at(actor_id) = change_over_point;
-      } else {
-        last_lane_change_swpt.insert({actor_id, change_over_point});
-      }
+      SetLastLaneChangePoint(actor_id, change_over_point);
       auto number_of_pops = waypoint_buffer.size();
       for (uint64_t j = 0u; j < number_of_pops; ++j) {
         PopWaypoint(actor_id, track_traffic, waypoint_buffer);
@@ -174,34 +172,34 @@ void LocalizationStage::Update(const unsigned long index) {
     }
   }
 
-  Path imported_path = parameters.GetCustomPath(actor_id);
-  Route imported_actions = parameters.GetImportedRoute(actor_id);
+  // The imported path and route are shared with the other vehicles
+  // following them, only the progress is copied.
+  ImportedPath imported_path = vehicle_parameters.imported_path;
+  ImportedRoute imported_route = vehicle_parameters.imported_route;
   // We are effectively importing a path.
-  if (!imported_path.empty()) {
-
-    ImportPath(imported_path, waypoint_buffer, actor_id, horizon_square);
-
-  } else if (!imported_actions.empty()) {
-
-    ImportRoute(imported_actions, waypoint_buffer, actor_id, horizon_square);
-
+  bool imported = false;
+  if (imported_path.path != nullptr) {
+    imported = ImportPath(imported_path, vehicle_parameters.upload_path, waypoint_buffer, actor_id, horizon_square);
+  }
+  if (!imported && imported_route.route != nullptr) {
+    imported = ImportRoute(imported_route, vehicle_parameters.upload_route, waypoint_buffer, actor_id, horizon_square);
   }
 
   // Populating the buffer through randomly chosen waypoints.
-  else {
+  if (!imported) {
     while (waypoint_buffer.back()->DistanceSquared(waypoint_buffer.front()) <= horizon_square) {
       SimpleWaypointPtr furthest_waypoint = waypoint_buffer.back();
       std::vector<SimpleWaypointPtr> next_waypoints = furthest_waypoint->GetNextWaypoint();
       uint64_t selection_index = 0u;
       // Pseudo-randomized path selection if found more than one choice.
       if (next_waypoints.size() > 1) {
-        double r_sample = random_device.next();
+        double r_sample = random_devices.At(actor_id).next();
         selection_index = static_cast<uint64_t>(r_sample*next_waypoints.size()*0.01);
       } else if (next_waypoints.size() == 0) {
         if (!parameters.GetOSMMode()) {
           std::cout << "This map has dead-end roads, please change the set_open_street_map parameter to true" << std::endl;
         }
-        marked_for_removal.push_back(actor_id);
+        MarkForRemoval(actor_id);
         break;
       }
       SimpleWaypointPtr next_wp_selection = next_waypoints.at(selection_index);
@@ -219,7 +217,9 @@ void LocalizationStage::Update(const unsigned long index) {
   output.is_at_junction_entrance = is_at_junction_entrance;
 
   if (is_at_junction_entrance) {
-    const SimpleWaypointPair &safe_space_end_points = vehicles_at_junction_entrance.at(actor_id);
+    std::unique_lock<std::mutex> state_lock(state_mutex);
+    const SimpleWaypointPair safe_space_end_points = vehicles_at_junction_entrance.at(actor_id);
+    state_lock.unlock();
     output.junction_end_point = safe_space_end_points.first;
     output.safe_point = safe_space_end_points.second;
   } else {
@@ -228,7 +228,7 @@ void LocalizationStage::Update(const unsigned long index) {
   }
 
   // Updating geodesic grid position for actor.
-  track_traffic.UpdateGridPosition(actor_id, waypoint_buffer);
+  track_traffic.UpdateGridPosition(actor_id);
 }
 
 void LocalizationStage::ExtendAndFindSafeSpace(const ActorId actor_id,
@@ -238,8 +238,12 @@ void LocalizationStage::ExtendAndFindSafeSpace(const ActorId actor_id,
   SimpleWaypointPtr junction_end_point = nullptr;
   SimpleWaypointPtr safe_point_after_junction = nullptr;
 
-  if (is_at_junction_entrance
-      && vehicles_at_junction_entrance.find(actor_id) == vehicles_at_junction_entrance.end()) {
+  std::unique_lock<std::mutex> state_lock(state_mutex);
+  const bool known_junction_entrance =
+      vehicles_at_junction_entrance.find(actor_id) != vehicles_at_junction_entrance.end();
+  state_lock.unlock();
+
+  if (is_at_junction_entrance && !known_junction_entrance) {
 
     bool entered_junction = false;
     bool past_junction = false;
@@ -310,23 +314,56 @@ void LocalizationStage::ExtendAndFindSafeSpace(const ActorId actor_id,
       safe_point_after_junction = nullptr;
     }
 
+    state_lock.lock();
     vehicles_at_junction_entrance.insert({actor_id, {junction_end_point, safe_point_after_junction}});
   }
-  else if (!is_at_junction_entrance
-           && vehicles_at_junction_entrance.find(actor_id) != vehicles_at_junction_entrance.end()) {
+  else if (!is_at_junction_entrance && known_junction_entrance) {
 
+    state_lock.lock();
     vehicles_at_junction_entrance.erase(actor_id);
   }
 }
 
+SimpleWaypointPtr LocalizationStage::GetLastLaneChangePoint(const ActorId actor_id) const {
+  std::lock_guard<std::mutex> lock(state_mutex);
+  auto it = last_lane_change_swpt.find(actor_id);
+  return it != last_lane_change_swpt.end() ? it->second : nullptr;
+}
+
+void LocalizationStage::SetLastLaneChangePoint(const ActorId actor_id, SimpleWaypointPtr point) {
+  std::lock_guard<std::mutex> lock(state_mutex);
+  if (point != nullptr) {
+    last_lane_change_swpt[actor_id] = std::move(point);
+  } else {
+    last_lane_change_swpt.erase(actor_id);
+  }
+}
+
+void LocalizationStage::MarkForRemoval(const ActorId actor_id) {
+  std::lock_guard<std::mutex> lock(state_mutex);
+  marked_for_removal.push_back(actor_id);
+}
+
+void LocalizationStage::PrepareCycle() {
+  for (const ActorId actor_id : vehicle_id_list) {
+    if (buffer_map.find(actor_id) == buffer_map.end()) {
+      buffer_map.insert({actor_id, Buffer()});
+    }
+  }
+}
+
 void LocalizationStage::RemoveActor(ActorId actor_id) {
+    std::lock_guard<std::mutex> lock(state_mutex);
     last_lane_change_swpt.erase(actor_id);
     vehicles_at_junction.erase(actor_id);
+    vehicles_at_junction_entrance.erase(actor_id);
 }
 
 void LocalizationStage::Reset() {
+  std::lock_guard<std::mutex> lock(state_mutex);
   last_lane_change_swpt.clear();
   vehicles_at_junction.clear();
+  vehicles_at_junction_entrance.clear();
 }
 
 SimpleWaypointPtr LocalizationStage::AssignLaneChange(const ActorId actor_id,
@@ -369,15 +406,13 @@ SimpleWaypointPtr LocalizationStage::AssignLaneChange(const ActorId actor_id,
         cg::Vector3D reference_to_other = other_location - current_waypoint->GetLocation();
         const cg::Vector3D other_heading = other_current_waypoint->GetForwardVector();
 
-        WaypointPtr current_raw_waypoint = current_waypoint->GetWaypoint();
-        WaypointPtr other_current_raw_waypoint = other_current_waypoint->GetWaypoint();
         // Check both vehicles are not in junction,
         // Check if the other vehicle is in front of the current vehicle,
         // Check if the two vehicles have acceptable angular deviation between their headings.
         if (!current_waypoint->CheckJunction()
             && !other_current_waypoint->CheckJunction()
-            && other_current_raw_waypoint->GetRoadId() == current_raw_waypoint->GetRoadId()
-            && other_current_raw_waypoint->GetLaneId() == current_raw_waypoint->GetLaneId()
+            && other_current_waypoint->GetRoadId() == current_waypoint->GetRoadId()
+            && other_current_waypoint->GetLaneId() == current_waypoint->GetLaneId()
             && cg::Math::Dot(reference_heading, reference_to_other) > 0.0f
             && cg::Math::Dot(reference_heading, other_heading) > MAXIMUM_LANE_OBSTACLE_CURVATURE) {
           float squared_distance = cg::Math::DistanceSquared(vehicle_location, other_location);
@@ -410,7 +445,7 @@ SimpleWaypointPtr LocalizationStage::AssignLaneChange(const ActorId actor_id,
       bool left_right = true;
       for (auto &candidate_lane_wp : other_neighbouring_lanes) {
         if (candidate_lane_wp != nullptr &&
-            track_traffic.GetPassingVehicles(candidate_lane_wp->GetId()).size() == 0) {
+            track_traffic.GetPassingVehicles(candidate_lane_wp).size() == 0) {
 
           if (left_right)
             distant_left_lane_free = true;
@@ -423,10 +458,10 @@ SimpleWaypointPtr LocalizationStage::AssignLaneChange(const ActorId actor_id,
       // Based on what lanes are free near the obstacle,
       // find the change over point with no vehicles passing through them.
       if (distant_right_lane_free && right_waypoint != nullptr
-          && track_traffic.GetPassingVehicles(right_waypoint->GetId()).size() == 0) {
+          && track_traffic.GetPassingVehicles(right_waypoint).size() == 0) {
         change_over_point = right_waypoint;
       } else if (distant_left_lane_free && left_waypoint != nullptr
-               && track_traffic.GetPassingVehicles(left_waypoint->GetId()).size() == 0) {
+               && track_traffic.GetPassingVehicles(left_waypoint).size() == 0) {
         change_over_point = left_waypoint;
       }
     } else if (force) {
@@ -450,9 +485,16 @@ SimpleWaypointPtr LocalizationStage::AssignLaneChange(const ActorId actor_id,
   return change_over_point;
 }
 
-void LocalizationStage::ImportPath(Path &imported_path, Buffer &waypoint_buffer, const ActorId actor_id, const float horizon_square) {
+bool LocalizationStage::ImportPath(ImportedPath &imported_path, const bool upload, Buffer &waypoint_buffer, const ActorId actor_id, const float horizon_square) {
+    // Drop a path with nothing left to import, such as an empty one.
+    if (imported_path.next >= imported_path.path->GetLocations().size()) {
+      parameters.RemoveUploadPath(actor_id, false);
+      parameters.UpdateCustomPathProgress(actor_id, imported_path);
+      return false;
+    }
+
     // Remove the waypoints already added to the path, except for the first.
-    if (parameters.GetUploadPath(actor_id)) {
+    if (upload) {
       auto number_of_pops = waypoint_buffer.size();
       for (uint64_t j = 0u; j < number_of_pops - 1; ++j) {
         PopWaypoint(actor_id, track_traffic, waypoint_buffer, false);
@@ -461,12 +503,13 @@ void LocalizationStage::ImportPath(Path &imported_path, Buffer &waypoint_buffer,
       parameters.RemoveUploadPath(actor_id, false);
     }
 
-    // Get the latest imported waypoint. and find its closest waypoint in TM's InMemoryMap.
-    cg::Location latest_imported = imported_path.front();
-    SimpleWaypointPtr imported = local_map->GetWaypoint(latest_imported);
+    // The closest waypoints in TM's InMemoryMap to the imported locations,
+    // resolved once for every vehicle following the path.
+    const std::vector<SimpleWaypointPtr> &path_waypoints = imported_path.path->GetWaypoints(*local_map);
+    SimpleWaypointPtr imported = path_waypoints.at(imported_path.next);
 
     // We need to generate a path compatible with TM's waypoints.
-    while (!imported_path.empty() && waypoint_buffer.back()->DistanceSquared(waypoint_buffer.front()) <= horizon_square) {
+    while (imported_path.next < path_waypoints.size() && waypoint_buffer.back()->DistanceSquared(waypoint_buffer.front()) <= horizon_square) {
       // Get the latest point we added to the list. If starting, this will be the one referred to the vehicle's location.
       SimpleWaypointPtr latest_waypoint = waypoint_buffer.back();
 
@@ -476,7 +519,7 @@ void LocalizationStage::ImportPath(Path &imported_path, Buffer &waypoint_buffer,
 
       // Choose correct path.
       if (next_waypoints.size() > 1) {
-        const float imported_road_id = imported->GetWaypoint()->GetRoadId();
+        const float imported_road_id = imported->GetRoadId();
         float min_distance = std::numeric_limits<float>::infinity();
         for (uint64_t k = 0u; k < next_waypoints.size(); ++k) {
           SimpleWaypointPtr junction_end_point = next_waypoints.at(k);
@@ -489,7 +532,7 @@ void LocalizationStage::ImportPath(Path &imported_path, Buffer &waypoint_buffer,
           while (next_waypoints.at(k)->DistanceSquared(junction_end_point) < 50.0f) {
             junction_end_point = junction_end_point->GetNextWaypoint().front();
           }
-          float jep_road_id = junction_end_point->GetWaypoint()->GetRoadId();
+          float jep_road_id = junction_end_point->GetRoadId();
           if (jep_road_id == imported_road_id) {
             selection_index = k;
             break;
@@ -504,38 +547,42 @@ void LocalizationStage::ImportPath(Path &imported_path, Buffer &waypoint_buffer,
         if (!parameters.GetOSMMode()) {
           std::cout << "This map has dead-end roads, please change the set_open_street_map parameter to true" << std::endl;
         }
-        marked_for_removal.push_back(actor_id);
+        MarkForRemoval(actor_id);
         break;
       }
       SimpleWaypointPtr next_wp_selection = next_waypoints.at(selection_index);
 
       // Remove the imported waypoint from the path if it's close to the last one.
       if (next_wp_selection->DistanceSquared(imported) < 30.0f) {
-        imported_path.erase(imported_path.begin());
+        ++imported_path.next;
         std::vector<SimpleWaypointPtr> possible_waypoints = next_wp_selection->GetNextWaypoint();
         if (std::find(possible_waypoints.begin(), possible_waypoints.end(), imported) != possible_waypoints.end()) {
           // If the lane is changing, only push the new waypoint
           PushWaypoint(actor_id, track_traffic, waypoint_buffer, next_wp_selection);
         }
         PushWaypoint(actor_id, track_traffic, waypoint_buffer, imported);
-        latest_imported = imported_path.front();
-        imported = local_map->GetWaypoint(latest_imported);
+        if (imported_path.next < path_waypoints.size()) {
+          imported = path_waypoints[imported_path.next];
+        }
       } else {
         PushWaypoint(actor_id, track_traffic, waypoint_buffer, next_wp_selection);
       }
     }
-    if (imported_path.empty()) {
-      // Once we are done, check if we can clear the structure.
-      parameters.RemoveUploadPath(actor_id, true);
-    } else {
-      // Otherwise, update the structure with the waypoints that we still need to import.
-      parameters.UpdateUploadPath(actor_id, imported_path);
-    }
+    // Clear the structure once we are done, otherwise keep track of the
+    // waypoints that we still need to import.
+    parameters.UpdateCustomPathProgress(actor_id, imported_path);
+    return true;
 }
 
-void LocalizationStage::ImportRoute(Route &imported_actions, Buffer &waypoint_buffer, const ActorId actor_id, const float horizon_square) {
+bool LocalizationStage::ImportRoute(ImportedRoute &imported_route, const bool upload, Buffer &waypoint_buffer, const ActorId actor_id, const float horizon_square) {
+    // Drop a route with nothing left to import, such as an empty one.
+    if (imported_route.next >= imported_route.route->size()) {
+      parameters.RemoveImportedRoute(actor_id, false);
+      parameters.UpdateImportedRouteProgress(actor_id, imported_route);
+      return false;
+    }
 
-    if (parameters.GetUploadRoute(actor_id)) {
+    if (upload) {
       auto number_of_pops = waypoint_buffer.size();
       for (uint64_t j = 0u; j < number_of_pops - 1; ++j) {
         PopWaypoint(actor_id, track_traffic, waypoint_buffer, false);
@@ -544,8 +591,9 @@ void LocalizationStage::ImportRoute(Route &imported_actions, Buffer &waypoint_bu
       parameters.RemoveImportedRoute(actor_id, false);
     }
 
-    RoadOption next_road_option = static_cast<RoadOption>(imported_actions.front());
-    while (!imported_actions.empty() && waypoint_buffer.back()->DistanceSquared(waypoint_buffer.front()) <= horizon_square) {
+    const Route &imported_actions = *imported_route.route;
+    RoadOption next_road_option = static_cast<RoadOption>(imported_actions.at(imported_route.next));
+    while (imported_route.next < imported_actions.size() && waypoint_buffer.back()->DistanceSquared(waypoint_buffer.front()) <= horizon_square) {
       // Get the latest point we added to the list. If starting, this will be the one referred to the vehicle's location.
       SimpleWaypointPtr latest_waypoint = waypoint_buffer.back();
       RoadOption latest_road_option = latest_waypoint->GetRoadOption();
@@ -567,7 +615,7 @@ void LocalizationStage::ImportRoute(Route &imported_actions, Buffer &waypoint_bu
         if (!parameters.GetOSMMode()) {
           std::cout << "This map has dead-end roads, please change the set_open_street_map parameter to true" << std::endl;
         }
-        marked_for_removal.push_back(actor_id);
+        MarkForRemoval(actor_id);
         break;
       }
 
@@ -576,93 +624,109 @@ void LocalizationStage::ImportRoute(Route &imported_actions, Buffer &waypoint_bu
 
       // If we are switching to a new RoadOption, it means the current one is already fully imported.
       if (latest_road_option != next_wp_selection->GetRoadOption() && next_road_option == next_wp_selection->GetRoadOption()) {
-        imported_actions.erase(imported_actions.begin());
-        next_road_option = static_cast<RoadOption>(imported_actions.front());
+        ++imported_route.next;
+        if (imported_route.next < imported_actions.size()) {
+          next_road_option = static_cast<RoadOption>(imported_actions[imported_route.next]);
+        }
       }
     }
-    if (imported_actions.empty()) {
-      // Once we are done, check if we can clear the structure.
-      parameters.RemoveImportedRoute(actor_id, true);
-    } else {
-      // Otherwise, update the structure with the waypoints that we still need to import.
-      parameters.UpdateImportedRoute(actor_id, imported_actions);
-    }
+    // Clear the structure once we are done, otherwise keep track of the
+    // road options that we still need to import.
+    parameters.UpdateImportedRouteProgress(actor_id, imported_route);
+    return true;
 }
 
 Action LocalizationStage::ComputeNextAction(const ActorId& actor_id) {
-  auto waypoint_buffer = buffer_map.at(actor_id);
-  auto next_action = std::make_pair(RoadOption::LaneFollow, waypoint_buffer.back()->GetWaypoint());
+  // The actions are chosen on the graph, only the returned waypoints are
+  // created from the map.
+  const Buffer &waypoint_buffer = buffer_map.at(actor_id);
+  RoadOption next_road_option = RoadOption::LaneFollow;
+  SimpleWaypointPtr next_waypoint = waypoint_buffer.back();
+  const SimpleWaypointPtr last_lane_change_point = GetLastLaneChangePoint(actor_id);
   bool is_lane_change = false;
-  if (last_lane_change_swpt.find(actor_id) != last_lane_change_swpt.end()) {
+  if (last_lane_change_point != nullptr) {
     // A lane change is happening.
     is_lane_change = true;
     const cg::Vector3D heading_vector = simulation_state.GetHeading(actor_id);
-    const cg::Vector3D relative_vector = simulation_state.GetLocation(actor_id) - last_lane_change_swpt.at(actor_id)->GetLocation();
+    const cg::Vector3D relative_vector = simulation_state.GetLocation(actor_id) - last_lane_change_point->GetLocation();
     bool left_heading = (heading_vector.x * relative_vector.y - heading_vector.y * relative_vector.x) > 0.0f;
-    if (left_heading) next_action = std::make_pair(RoadOption::ChangeLaneLeft, last_lane_change_swpt.at(actor_id)->GetWaypoint());
-    else next_action = std::make_pair(RoadOption::ChangeLaneRight, last_lane_change_swpt.at(actor_id)->GetWaypoint());
+    next_road_option = left_heading ? RoadOption::ChangeLaneLeft : RoadOption::ChangeLaneRight;
+    next_waypoint = last_lane_change_point;
   }
-  for (auto &swpt : waypoint_buffer) {
+  for (const SimpleWaypointPtr swpt : waypoint_buffer) {
     RoadOption road_opt = swpt->GetRoadOption();
     if (road_opt != RoadOption::LaneFollow) {
       if (!is_lane_change) {
         // No lane change in sight, we can assume this will be the next action.
-        return std::make_pair(road_opt, swpt->GetWaypoint());
+        next_road_option = road_opt;
+        next_waypoint = swpt;
       } else {
         // A lane change will happen as well as another action, we need to figure out which one will happen first.
-        cg::Location lane_change = last_lane_change_swpt.at(actor_id)->GetLocation();
+        cg::Location lane_change = last_lane_change_point->GetLocation();
         cg::Location actual_location = simulation_state.GetLocation(actor_id);
         auto distance_lane_change = cg::Math::DistanceSquared(actual_location, lane_change);
         auto distance_other_action = cg::Math::DistanceSquared(actual_location, swpt->GetLocation());
-        if (distance_lane_change < distance_other_action) return next_action;
-        else return std::make_pair(road_opt, swpt->GetWaypoint());
+        if (distance_lane_change >= distance_other_action) {
+          next_road_option = road_opt;
+          next_waypoint = swpt;
+        }
       }
+      break;
     }
   }
-  return next_action;
+  return std::make_pair(next_road_option, next_waypoint->GetWaypoint());
 }
 
 ActionBuffer LocalizationStage::ComputeActionBuffer(const ActorId& actor_id) {
 
-  auto waypoint_buffer = buffer_map.at(actor_id);
-  ActionBuffer action_buffer;
-  Action lane_change;
+  // The actions are chosen on the graph, only the returned waypoints are
+  // created from the map.
+  using GraphAction = std::pair<RoadOption, SimpleWaypointPtr>;
+  const Buffer &waypoint_buffer = buffer_map.at(actor_id);
+  std::vector<GraphAction> graph_actions;
+  GraphAction lane_change;
   bool is_lane_change = false;
   SimpleWaypointPtr buffer_front = waypoint_buffer.front();
   RoadOption last_road_opt = buffer_front->GetRoadOption();
-  action_buffer.push_back(std::make_pair(last_road_opt, buffer_front->GetWaypoint()));
-  if (last_lane_change_swpt.find(actor_id) != last_lane_change_swpt.end()) {
+  graph_actions.push_back(std::make_pair(last_road_opt, buffer_front));
+  const SimpleWaypointPtr last_lane_change_point = GetLastLaneChangePoint(actor_id);
+  if (last_lane_change_point != nullptr) {
     // A lane change is happening.
     is_lane_change = true;
     const cg::Vector3D heading_vector = simulation_state.GetHeading(actor_id);
-    const cg::Vector3D relative_vector = simulation_state.GetLocation(actor_id) - last_lane_change_swpt.at(actor_id)->GetLocation();
+    const cg::Vector3D relative_vector = simulation_state.GetLocation(actor_id) - last_lane_change_point->GetLocation();
     bool left_heading = (heading_vector.x * relative_vector.y - heading_vector.y * relative_vector.x) > 0.0f;
-    if (left_heading) lane_change = std::make_pair(RoadOption::ChangeLaneLeft, last_lane_change_swpt.at(actor_id)->GetWaypoint());
-    else lane_change = std::make_pair(RoadOption::ChangeLaneRight, last_lane_change_swpt.at(actor_id)->GetWaypoint());
+    if (left_heading) lane_change = std::make_pair(RoadOption::ChangeLaneLeft, last_lane_change_point);
+    else lane_change = std::make_pair(RoadOption::ChangeLaneRight, last_lane_change_point);
   }
-  for (auto &wpt : waypoint_buffer) {
+  for (const SimpleWaypointPtr wpt : waypoint_buffer) {
     RoadOption current_road_opt = wpt->GetRoadOption();
     if (current_road_opt != last_road_opt) {
-      action_buffer.push_back(std::make_pair(current_road_opt, wpt->GetWaypoint()));
+      graph_actions.push_back(std::make_pair(current_road_opt, wpt));
       last_road_opt = current_road_opt;
     }
   }
   if (is_lane_change) {
     // Insert the lane change action in the appropriate part of the action buffer.
-    auto distance_lane_change = cg::Math::DistanceSquared(waypoint_buffer.front()->GetLocation(), lane_change.second->GetTransform().location);
-    for (uint16_t i = 0; i < action_buffer.size(); ++i) {
-      auto distance_action = cg::Math::DistanceSquared(waypoint_buffer.front()->GetLocation(), waypoint_buffer.at(i)->GetLocation());
+    auto distance_lane_change = cg::Math::DistanceSquared(buffer_front->GetLocation(), lane_change.second->GetLocation());
+    for (uint16_t i = 0; i < graph_actions.size(); ++i) {
+      auto distance_action = cg::Math::DistanceSquared(buffer_front->GetLocation(), waypoint_buffer.at(i)->GetLocation());
       // If the waypoint related to the next action is further away from the one of the lane change, insert lane change action here.
       // If we reached the end of the buffer, place the action at the end.
-      if (i == action_buffer.size()-1) {
-        action_buffer.push_back(lane_change);
+      if (i == graph_actions.size()-1) {
+        graph_actions.push_back(lane_change);
         break;
       } else if (distance_action > distance_lane_change) {
-        action_buffer.insert(action_buffer.begin()+i, lane_change);
+        graph_actions.insert(graph_actions.begin()+i, lane_change);
         break;
       }
     }
   }
+
+  ActionBuffer action_buffer;
+  for (const GraphAction &action : graph_actions) {
+    action_buffer.push_back(std::make_pair(action.first, action.second->GetWaypoint()));
+  }
   return action_buffer;
 }
 
@@ -2,6 +2,7 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
 
 #include "carla/trafficmanager/DataStructures.h"
 #include "carla/trafficmanager/InMemoryMap.h"
@@ -44,7 +45,17 @@ private:
   ActorIdSet vehicles_at_junction;
   using SimpleWaypointPair = std::pair<SimpleWaypointPtr, SimpleWaypointPtr>;
   std::unordered_map<ActorId, SimpleWaypointPair> vehicles_at_junction_entrance;
-  RandomGenerator &random_device;
+  /// Guards the state above and marked_for_removal, so that vehicles far
+  /// from each other can be updated concurrently.
+  mutable std::mutex state_mutex;
+  RandomGeneratorMap &random_devices;
+
+  /// Point where the ongoing lane change of the vehicle ends, nullptr if
+  /// there is none.
+  SimpleWaypointPtr GetLastLaneChangePoint(const ActorId actor_id) const;
+  void SetLastLaneChangePoint(const ActorId actor_id, SimpleWaypointPtr point);
+
+  void MarkForRemoval(const ActorId actor_id);
 
   SimpleWaypointPtr AssignLaneChange(const ActorId actor_id,
                                      const cg::Location vehicle_location,
@@ -55,12 +66,20 @@ private:
                               const bool is_at_junction_entrance,
                               Buffer &waypoint_buffer);
 
-  void ImportPath(Path &imported_path,
+  /// Extends the buffer along the imported path, emptying it first if
+  /// @a upload is set. Returns false, dropping the path, if there is nothing
+  /// left to import.
+  bool ImportPath(ImportedPath &imported_path,
+                  const bool upload,
                   Buffer &waypoint_buffer,
                   const ActorId actor_id,
                   const float horizon_square);
 
-  void ImportRoute(Route &imported_actions,
+  /// Extends the buffer along the imported route, emptying it first if
+  /// @a upload is set. Returns false, dropping the route, if there is nothing
+  /// left to import.
+  bool ImportRoute(ImportedRoute &imported_route,
+                  const bool upload,
                   Buffer &waypoint_buffer,
                   const ActorId actor_id,
                   const float horizon_square);
@@ -74,7 +93,12 @@ public:
                     Parameters &parameters,
                     std::vector<ActorId>& marked_for_removal,
                     LocalizationFrame &output_array,
-                    RandomGenerator &random_device);
+                    RandomGeneratorMap &random_devices);
+
+  /// Creates the waypoint buffers of new vehicles. Must be called before
+  /// updating vehicles concurrently, as Update() modifies @a buffer_map
+  /// otherwise.
+  void PrepareCycle();
 
   void Update(const unsigned long index) override;
 
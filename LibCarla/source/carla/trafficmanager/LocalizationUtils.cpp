@@ -38,22 +38,20 @@ float DeviationDotProduct(const cg::Location &reference_location,
 void PushWaypoint(ActorId actor_id, TrackTraffic &track_traffic,
                   Buffer &buffer, SimpleWaypointPtr &waypoint) {
 
-  const uint64_t waypoint_id = waypoint->GetId();
   buffer.push_back(waypoint);
-  track_traffic.UpdatePassingVehicle(waypoint_id, actor_id);
+  track_traffic.UpdatePassingVehicle(waypoint, actor_id);
 }
 
 void PopWaypoint(ActorId actor_id, TrackTraffic &track_traffic,
                  Buffer &buffer, bool front_or_back) {
 
   SimpleWaypointPtr removed_waypoint = front_or_back ? buffer.front() : buffer.back();
-  const uint64_t removed_waypoint_id = removed_waypoint->GetId();
   if (front_or_back) {
     buffer.pop_front();
   } else {
     buffer.pop_back();
   }
-  track_traffic.RemovePassingVehicle(removed_waypoint_id, actor_id);
+  track_traffic.RemovePassingVehicle(removed_waypoint, actor_id);
 }
 
 TargetWPInfo GetTargetWaypoint(const Buffer &waypoint_buffer, const float &target_point_distance) {
@@ -4,6 +4,7 @@
 // This work is licensed under the terms of the MIT license.
 // For a copy, see <https://opensource.org/licenses/MIT>.
 
+#include <cmath>
 #include <limits>
 
 #include "carla/client/TrafficSign.h"
@@ -41,7 +42,7 @@ MotionPlanStage::MotionPlanStage(
   const TLFrame &tl_frame,
   const cc::World &world,
   ControlFrame &output_array,
-  RandomGenerator &random_device,
+  RandomGeneratorMap &random_devices,
   const LocalMapPtr &local_map)
     : vehicle_id_list(vehicle_id_list),
     simulation_state(simulation_state),
@@ -57,11 +58,75 @@ MotionPlanStage::MotionPlanStage(
     tl_frame(tl_frame),
     world(world),
     output_array(output_array),
-    random_device(random_device),
+    random_devices(random_devices),
     local_map(local_map) {}
 
+void MotionPlanStage::UpdateWorldInfo() {
+  UpdateWorldInfo(world.GetSnapshot().GetTimestamp());
+}
+
+void MotionPlanStage::UpdateWorldInfo(const cc::Timestamp &timestamp) {
+  current_timestamp = timestamp;
+  hybrid_kinematics.Reset(vehicle_id_list.size());
+}
+
+void MotionPlanStage::HybridKinematics::Reset(const size_t size) {
+  mode.assign(size, HybridMode::None);
+  location_x.resize(size);
+  location_y.resize(size);
+  location_z.resize(size);
+  target_x.resize(size);
+  target_y.resize(size);
+  target_z.resize(size);
+  heading_x.resize(size);
+  heading_y.resize(size);
+  heading_z.resize(size);
+  displacement.resize(size);
+  rotation.resize(size);
+}
+
+void MotionPlanStage::HybridKinematics::Set(const unsigned long index,
+                                            const HybridMode new_mode,
+                                            const cg::Location &location,
+                                            const cg::Rotation &new_rotation,
+                                            const cg::Location &target,
+                                            const cg::Vector3D &heading,
+                                            const float new_displacement) {
+  mode[index] = new_mode;
+  location_x[index] = location.x;
+  location_y[index] = location.y;
+  location_z[index] = location.z;
+  target_x[index] = target.x;
+  target_y[index] = target.y;
+  target_z[index] = target.z;
+  heading_x[index] = heading.x;
+  heading_y[index] = heading.y;
+  heading_z[index] = heading.z;
+  displacement[index] = new_displacement;
+  rotation[index] = new_rotation;
+}
+
+bool MotionPlanStage::RespawnsDormantVehicle(const unsigned long index) const {
+  const ActorId actor_id = vehicle_id_list.at(index);
+  const bool is_hero_alive = track_traffic.GetHeroLocation() != cg::Location(0, 0, 0);
+  return simulation_state.IsDormant(actor_id) && parameters.GetRespawnDormantVehicles() && is_hero_alive;
+}
+
+StateEntry &MotionPlanStage::GetPIDState(const ActorId actor_id) {
+  std::lock_guard<std::mutex> lock(state_mutex);
+  // References to the entries of the map are not invalidated by the
+  // insertions of other vehicles.
+  return pid_state_map.insert({actor_id, StateEntry{current_timestamp, 0.0f, 0.0f, 0.0f}}).first->second;
+}
+
+cc::Timestamp MotionPlanStage::GetTeleportationInstance(const ActorId actor_id) {
+  std::lock_guard<std::mutex> lock(state_mutex);
+  return teleportation_instance.insert({actor_id, current_timestamp}).first->second;
+}
+
 void MotionPlanStage::Update(const unsigned long index) {
   const ActorId actor_id = vehicle_id_list.at(index);
+  const VehicleParameters &vehicle_parameters = parameters.GetSnapshot().at(index);
   const cg::Location vehicle_location = simulation_state.GetLocation(actor_id);
   const cg::Vector3D vehicle_velocity = simulation_state.GetVelocity(actor_id);
   const cg::Rotation vehicle_rotation = simulation_state.GetRotation(actor_id);
@@ -73,7 +138,6 @@ void MotionPlanStage::Update(const unsigned long index) {
   const LocalizationData &localization = localization_frame.at(index);
   const CollisionHazardData &collision_hazard = collision_frame.at(index);
   const bool &tl_hazard = tl_frame.at(index);
-  current_timestamp = world.GetSnapshot().GetTimestamp();
   StateEntry current_state;
 
   // Instanciating teleportation transform as current vehicle transform.
@@ -81,29 +145,23 @@ void MotionPlanStage::Update(const unsigned long index) {
 
   // Get information about the hero location from the actor_id state.
   cg::Location hero_location = track_traffic.GetHeroLocation();
-  bool is_hero_alive = hero_location != cg::Location(0, 0, 0);
 
-  if (simulation_state.IsDormant(actor_id) && parameters.GetRespawnDormantVehicles() && is_hero_alive) {
+  if (RespawnsDormantVehicle(index)) {
     // Flushing controller state for vehicle.
     current_state = {current_timestamp,
                     0.0f, 0.0f,
                     0.0f};
 
-    // Add entry to teleportation duration clock table if not present.
-    if (teleportation_instance.find(actor_id) == teleportation_instance.end()) {
-      teleportation_instance.insert({actor_id, current_timestamp});
-    }
-
     // Get lower and upper bound for teleporting vehicle.
     float lower_bound = parameters.GetLowerBoundaryRespawnDormantVehicles();
     float upper_bound = parameters.GetUpperBoundaryRespawnDormantVehicles();
     float dilate_factor = (upper_bound-lower_bound)/100.0f;
 
     // Measuring time elapsed since last teleportation for the vehicle.
-    double elapsed_time = current_timestamp.elapsed_seconds - teleportation_instance.at(actor_id).elapsed_seconds;
+    double elapsed_time = current_timestamp.elapsed_seconds - GetTeleportationInstance(actor_id).elapsed_seconds;
 
     if (parameters.GetSynchronousMode() || elapsed_time > HYBRID_MODE_DT) {
-      float random_sample = (static_cast<float>(random_device.next())*dilate_factor) + lower_bound;
+      float random_sample = (static_cast<float>(random_devices.At(actor_id).next())*dilate_factor) + lower_bound;
       NodeList teleport_waypoint_list = local_map->GetWaypointsInDelta(hero_location, ATTEMPTS_TO_TELEPORT, random_sample);
       if (!teleport_waypoint_list.empty()) {
         for (auto &teleport_waypoint : teleport_waypoint_list) {
@@ -117,7 +175,8 @@ void MotionPlanStage::Update(const unsigned long index) {
         }
       }
     }
-    output_array.at(index) = carla::rpc::Command::ApplyTransform(actor_id, teleportation_transform);
+    hybrid_kinematics.Set(index, HybridMode::Respawned,
+                          teleportation_transform.location, teleportation_transform.rotation);
 
     // Update the simulation state with the new transform of the vehicle after teleporting it.
     KinematicState kinematic_state{teleportation_transform.location,
@@ -131,10 +190,10 @@ void MotionPlanStage::Update(const unsigned long index) {
   else {
 
     // Target velocity for vehicle.
-    float max_target_velocity = parameters.GetVehicleTargetVelocity(actor_id, vehicle_speed_limit) / 3.6f;
+    float max_target_velocity = vehicle_parameters.GetTargetVelocity(vehicle_speed_limit) / 3.6f;
 
     // Algorithm to reduce speed near landmarks
-    float max_landmark_target_velocity = GetLandmarkTargetVelocity(*(waypoint_buffer.at(0)), vehicle_location, actor_id, max_target_velocity);
+    float max_landmark_target_velocity = GetLandmarkTargetVelocity(*(waypoint_buffer.at(0)), vehicle_location, vehicle_parameters, max_target_velocity);
 
     // Algorithm to reduce speed near turns
     float max_turn_target_velocity = GetTurnTargetVelocity(waypoint_buffer, max_target_velocity);
@@ -160,7 +219,7 @@ void MotionPlanStage::Update(const unsigned long index) {
       const SimpleWaypointPtr &target_waypoint = GetTargetWaypoint(waypoint_buffer, target_point_distance).first;
       cg::Location target_location = target_waypoint->GetLocation();
 
-      float offset = parameters.GetLaneOffset(actor_id);
+      float offset = vehicle_parameters.lane_offset;
       auto right_vector = target_waypoint->GetTransform().GetRightVector();
       auto offset_location = cg::Location(cg::Vector3D(offset*right_vector.x, offset*right_vector.y, 0.0f));
       target_location = target_location + offset_location;
@@ -173,15 +232,10 @@ void MotionPlanStage::Update(const unsigned long index) {
       }
       const float angular_deviation = dot_product;
       const float velocity_deviation = (dynamic_target_velocity - vehicle_speed) / dynamic_target_velocity;
-      // If previous state for vehicle not found, initialize state entry.
-      if (pid_state_map.find(actor_id) == pid_state_map.end()) {
-        const auto initial_state = StateEntry{current_timestamp, 0.0f, 0.0f, 0.0f};
-        pid_state_map.insert({actor_id, initial_state});
-      }
-
-      // Retrieving the previous state.
+      // Retrieving the previous state, initialized if not found.
+      StateEntry &state = GetPIDState(actor_id);
       traffic_manager::StateEntry previous_state;
-      previous_state = pid_state_map.at(actor_id);
+      previous_state = state;
 
       // Select PID parameters.
       std::vector<float> longitudinal_parameters;
@@ -218,7 +272,6 @@ void MotionPlanStage::Update(const unsigned long index) {
 
       // Updating PID state.
       current_state.steer = actuation_signal.steer;
-      StateEntry &state = pid_state_map.at(actor_id);
       state = current_state;
     }
     // For physics-less vehicles, determine position and orientation for teleportation.
@@ -228,45 +281,91 @@ void MotionPlanStage::Update(const unsigned long index) {
                       0.0f, 0.0f,
                       0.0f};
 
-      // Add entry to teleportation duration clock table if not present.
-      if (teleportation_instance.find(actor_id) == teleportation_instance.end()) {
-        teleportation_instance.insert({actor_id, current_timestamp});
-      }
-
-      // Measuring time elapsed since last teleportation for the vehicle.
-      double elapsed_time = current_timestamp.elapsed_seconds - teleportation_instance.at(actor_id).elapsed_seconds;
+      // Teleport only once every dt in asynchronous mode.
+      const double elapsed_time = current_timestamp.elapsed_seconds - GetTeleportationInstance(actor_id).elapsed_seconds;
+      const bool teleport = parameters.GetSynchronousMode() || elapsed_time > HYBRID_MODE_DT;
 
-      // Find a location ahead of the vehicle for teleportation to achieve intended velocity.
-      if (!emergency_stop && (parameters.GetSynchronousMode() || elapsed_time > HYBRID_MODE_DT)) {
+      // Find a location ahead of the vehicle for teleportation to achieve intended velocity,
+      // the displacement along the path is integrated with the rest of these vehicles.
+      if (!emergency_stop && teleport) {
 
         // Target displacement magnitude to achieve target velocity.
         const float target_displacement = dynamic_target_velocity * HYBRID_MODE_DT_FL;
-        SimpleWaypointPtr teleport_target = waypoint_buffer.front();
-        cg::Transform target_base_transform = teleport_target->GetTransform();
-        cg::Location target_base_location = target_base_transform.location;
-        cg::Vector3D target_heading = target_base_transform.GetForwardVector();
-        cg::Vector3D correct_heading = (target_base_location - vehicle_location).MakeSafeUnitVector(EPSILON);
-
-        if (vehicle_location.Distance(target_base_location) < target_displacement) {
-          cg::Location teleportation_location = vehicle_location + cg::Location(target_heading.MakeSafeUnitVector(EPSILON) * target_displacement);
-          teleportation_transform = cg::Transform(teleportation_location, target_base_transform.rotation);
-        }
-        else {
-          cg::Location teleportation_location = vehicle_location + cg::Location(correct_heading * target_displacement);
-          teleportation_transform = cg::Transform(teleportation_location, target_base_transform.rotation);
-        }
+        const cg::Transform target_base_transform = waypoint_buffer.front()->GetTransform();
+        hybrid_kinematics.Set(index, HybridMode::Integrated,
+                              vehicle_location, target_base_transform.rotation,
+                              target_base_transform.location, target_base_transform.GetForwardVector(),
+                              target_displacement);
       // In case of an emergency stop, stay in the same location.
-      // Also, teleport only once every dt in asynchronous mode.
       } else {
-        teleportation_transform = cg::Transform(vehicle_location, simulation_state.GetRotation(actor_id));
+        hybrid_kinematics.Set(index, HybridMode::Integrated,
+                              vehicle_location, vehicle_rotation, vehicle_location);
       }
-      // Constructing the actuation signal.
-      output_array.at(index) = carla::rpc::Command::ApplyTransform(actor_id, teleportation_transform);
-      simulation_state.UpdateKinematicHybridEndLocation(actor_id, teleportation_transform.location);
     }
   }
 }
 
+void MotionPlanStage::IntegrateHybridVehicles() {
+  HybridKinematics &hybrid = hybrid_kinematics;
+  const size_t size = hybrid.mode.size();
+
+  // Each vehicle moves by its displacement towards its target waypoint, or
+  // along the heading of the waypoint if it would overshoot it. Loops over
+  // plain arrays without branches, so that they get vectorized. Vehicles
+  // that do not move have no displacement.
+  const float *target_x = hybrid.target_x.data();
+  const float *target_y = hybrid.target_y.data();
+  const float *target_z = hybrid.target_z.data();
+  const float *heading_x = hybrid.heading_x.data();
+  const float *heading_y = hybrid.heading_y.data();
+  const float *heading_z = hybrid.heading_z.data();
+  const float *displacement = hybrid.displacement.data();
+  float *location_x = hybrid.location_x.data();
+  float *location_y = hybrid.location_y.data();
+  float *location_z = hybrid.location_z.data();
+  for (size_t i = 0u; i < size; ++i) {
+    const float to_target_x = target_x[i] - location_x[i];
+    const float to_target_y = target_y[i] - location_y[i];
+    const float to_target_z = target_z[i] - location_z[i];
+    const float distance = std::sqrt(to_target_x * to_target_x + to_target_y * to_target_y + to_target_z * to_target_z);
+    const float heading_length = std::sqrt(heading_x[i] * heading_x[i] + heading_y[i] * heading_y[i] + heading_z[i] * heading_z[i]);
+    // Same as cg::Vector3D::MakeSafeUnitVector.
+    const float inverse_distance = distance > EPSILON ? 1.0f / distance : 1.0f;
+    const float inverse_heading_length = heading_length > EPSILON ? 1.0f / heading_length : 1.0f;
+    const bool overshoots = distance < displacement[i];
+    const float direction_x = overshoots ? heading_x[i] * inverse_heading_length : to_target_x * inverse_distance;
+    const float direction_y = overshoots ? heading_y[i] * inverse_heading_length : to_target_y * inverse_distance;
+    const float direction_z = overshoots ? heading_z[i] * inverse_heading_length : to_target_z * inverse_distance;
+    location_x[i] = location_x[i] + direction_x * displacement[i];
+    location_y[i] = location_y[i] + direction_y * displacement[i];
+    location_z[i] = location_z[i] + direction_z * displacement[i];
+  }
+
+  // Commands of the rest of the vehicles keep their order.
+  carla::rpc::Command::ApplyTransforms transforms;
+  size_t kept = 0u;
+  for (size_t i = 0u; i < size; ++i) {
+    if (hybrid.mode[i] == HybridMode::None) {
+      if (kept != i) {
+        output_array[kept] = std::move(output_array[i]);
+      }
+      ++kept;
+      continue;
+    }
+    const ActorId actor_id = vehicle_id_list[i];
+    const cg::Location location(location_x[i], location_y[i], location_z[i]);
+    transforms.actors.push_back(actor_id);
+    transforms.transforms.emplace_back(location, hybrid.rotation[i]);
+    if (hybrid.mode[i] == HybridMode::Integrated) {
+      simulation_state.UpdateKinematicHybridEndLocation(actor_id, location);
+    }
+  }
+  output_array.resize(kept);
+  if (!transforms.actors.empty()) {
+    output_array.push_back(std::move(transforms));
+  }
+}
+
 bool MotionPlanStage::SafeAfterJunction(const LocalizationData &localization,
                                         const bool tl_hazard,
                                         const bool collision_emergency_stop) {
@@ -280,8 +379,8 @@ bool MotionPlanStage::SafeAfterJunction(const LocalizationData &localization,
       && junction_end_point != nullptr && safe_point != nullptr
       && junction_end_point->DistanceSquared(safe_point) > SQUARE(MIN_SAFE_INTERVAL_LENGTH)) {
 
-    ActorIdSet passing_safe_point = track_traffic.GetPassingVehicles(safe_point->GetId());
-    ActorIdSet passing_junction_end_point = track_traffic.GetPassingVehicles(junction_end_point->GetId());
+    ActorIdSet passing_safe_point = track_traffic.GetPassingVehicles(safe_point);
+    ActorIdSet passing_junction_end_point = track_traffic.GetPassingVehicles(junction_end_point);
     cg::Location mid_point = (junction_end_point->GetLocation() + safe_point->GetLocation())/2.0f;
 
     // Only check for vehicles that have the safe point in their passing waypoint, but not
@@ -360,38 +459,42 @@ std::pair<bool, float> MotionPlanStage::CollisionHandling(const CollisionHazardD
 
 float MotionPlanStage::GetLandmarkTargetVelocity(const SimpleWaypoint& waypoint,
                                                  const cg::Location vehicle_location,
-                                                 const ActorId actor_id,
+                                                 const VehicleParameters &vehicle_parameters,
                                                  float max_target_velocity) {
 
     auto const max_distance = LANDMARK_DETECTION_TIME * max_target_velocity;
 
     float landmark_target_velocity = std::numeric_limits<float>::max();
 
-    auto all_landmarks = waypoint.GetWaypoint()->GetAllLandmarksInDistance(max_distance, false);
-
-    for (auto &landmark: all_landmarks) {
+    // The landmarks ahead are resolved when building the graph, following
+    // its links is enough to find them.
+    const WaypointGraph &graph = waypoint.GetGraph();
+    for (const uint32_t landmark_index : graph.GetLandmarksInDistance(waypoint.GetIndex(), max_distance)) {
 
-      auto landmark_location = landmark->GetWaypoint()->GetTransform().location;
-      auto landmark_type = landmark->GetType();
-      auto distance = landmark_location.Distance(vehicle_location);
+      const WaypointGraph::Landmark &landmark = graph.GetLandmark(landmark_index);
+      auto distance = landmark.location.Distance(vehicle_location);
 
       if (distance > max_distance) {
         continue;
       }
 
       float minimum_velocity = max_target_velocity;
-      if (landmark_type == "1000001") {  // Traffic light
-        minimum_velocity = TL_TARGET_VELOCITY;
-      } else if (landmark_type == "206") {  // Stop
-        minimum_velocity = STOP_TARGET_VELOCITY;
-      } else if (landmark_type == "205") {  // Yield
-        minimum_velocity = YIELD_TARGET_VELOCITY;
-      } else if (landmark_type == "274") {  // Speed limit
-        float value = static_cast<float>(landmark->GetValue()) / 3.6f;
-        value = parameters.GetVehicleTargetVelocity(actor_id, value);
-        minimum_velocity = (value < max_target_velocity) ? value : max_target_velocity;
-      } else {
-        continue;
+      switch (landmark.type) {
+        case LandmarkType::TrafficLight:
+          minimum_velocity = TL_TARGET_VELOCITY;
+          break;
+        case LandmarkType::Stop:
+          minimum_velocity = STOP_TARGET_VELOCITY;
+          break;
+        case LandmarkType::Yield:
+          minimum_velocity = YIELD_TARGET_VELOCITY;
+          break;
+        case LandmarkType::SpeedLimit: {
+          float value = landmark.value / 3.6f;
+          value = vehicle_parameters.GetTargetVelocity(value);
+          minimum_velocity = (value < max_target_velocity) ? value : max_target_velocity;
+          break;
+        }
       }
 
       float v = std::max(((max_target_velocity - minimum_velocity) / max_distance) * distance + minimum_velocity, minimum_velocity);
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <mutex>
+
 #include "carla/trafficmanager/DataStructures.h"
 #include "carla/trafficmanager/InMemoryMap.h"
 #include "carla/trafficmanager/LocalizationUtils.h"
@@ -40,11 +42,45 @@ private:
   // Structure to keep track of duration between teleportation
   // in hybrid physics mode.
   std::unordered_map<ActorId, cc::Timestamp> teleportation_instance;
+  // Mutex guarding insertions into the two structures above when vehicles
+  // are updated concurrently.
+  std::mutex state_mutex;
   ControlFrame &output_array;
   cc::Timestamp current_timestamp;
-  RandomGenerator &random_device;
+  // Teleportations of the vehicles without physics in the current cycle, as
+  // a structure of arrays indexed like vehicle_id_list. Update() fills the
+  // slots of these vehicles, and IntegrateHybridVehicles() moves all of them
+  // at once.
+  enum class HybridMode : uint8_t {
+    None,
+    // Advanced by the given displacement towards the target waypoint.
+    Integrated,
+    // Teleported to a given transform around the hero vehicle.
+    Respawned
+  };
+  struct HybridKinematics {
+    std::vector<HybridMode> mode;
+    std::vector<float> location_x, location_y, location_z;
+    std::vector<float> target_x, target_y, target_z;
+    std::vector<float> heading_x, heading_y, heading_z;
+    std::vector<float> displacement;
+    std::vector<cg::Rotation> rotation;
+
+    void Reset(const size_t size);
+    void Set(const unsigned long index, const HybridMode mode,
+             const cg::Location &location, const cg::Rotation &rotation,
+             const cg::Location &target = cg::Location(),
+             const cg::Vector3D &heading = cg::Vector3D(),
+             const float displacement = 0.0f);
+  } hybrid_kinematics;
+  RandomGeneratorMap &random_devices;
   const LocalMapPtr &local_map;
 
+  // Methods to retrieve the controller state and the time of the first
+  // teleportation of a vehicle, initializing them if not present.
+  StateEntry &GetPIDState(const ActorId actor_id);
+  cc::Timestamp GetTeleportationInstance(const ActorId actor_id);
+
   std::pair<bool, float> CollisionHandling(const CollisionHazardData &collision_hazard,
                                            const bool tl_hazard,
                                            const cg::Vector3D ego_velocity,
@@ -57,7 +93,7 @@ private:
 
   float GetLandmarkTargetVelocity(const SimpleWaypoint& waypoint,
                                   const cg::Location vehicle_location,
-                                  const ActorId actor_id,
+                                  const VehicleParameters &vehicle_parameters,
                                   float max_target_velocity);
 
   float GetTurnTargetVelocity(const Buffer &waypoint_buffer,
@@ -82,11 +118,29 @@ public:
                   const TLFrame &tl_frame,
                   const cc::World &world,
                   ControlFrame &output_array,
-                  RandomGenerator &random_device,
+                  RandomGeneratorMap &random_devices,
                   const LocalMapPtr &local_map);
 
+  // Method to update the timestamp used by the current update cycle, and
+  // to set up the state of the cycle for the current vehicle list.
+  void UpdateWorldInfo();
+
+  // Same as above, with a timestamp that does not come from the world, as
+  // when replaying recorded frames offline.
+  void UpdateWorldInfo(const cc::Timestamp &timestamp);
+
+  // Method to check if the vehicle is a dormant vehicle to be respawned around
+  // the hero vehicle. Respawning takes free geodesic grids from TrackTraffic,
+  // so these vehicles have to be updated sequentially and after the rest.
+  bool RespawnsDormantVehicle(const unsigned long index) const;
+
   void Update(const unsigned long index);
 
+  // Method to compute the transforms of every vehicle without physics, once
+  // all vehicles have been updated. Their commands are taken out of the
+  // output array and replaced by a single ApplyTransforms at its end.
+  void IntegrateHybridVehicles();
+
   void RemoveActor(const ActorId actor_id);
 
   void Reset();
@@ -6,6 +6,7 @@
 
 #include "carla/trafficmanager/Parameters.h"
 #include "carla/trafficmanager/Constants.h"
+#include "carla/Logging.h"
 
 namespace carla {
 namespace traffic_manager {
@@ -18,6 +19,17 @@ Parameters::Parameters() {
 
 Parameters::~Parameters() {}
 
+VehicleSettings &Parameters::EditSettings(const ActorId actor_id) {
+  ++settings_version;
+  return pending_settings[actor_id];
+}
+
+VehicleSettings Parameters::GetSettings(const ActorId &actor_id) const {
+  std::lock_guard<std::mutex> lock(settings_mutex);
+  const auto it = pending_settings.find(actor_id);
+  return it != pending_settings.end() ? it->second : VehicleSettings();
+}
+
 //////////////////////////////////// SETTERS //////////////////////////////////
 
 void Parameters::SetHybridPhysicsMode(const bool mode_switch) {
@@ -40,107 +52,165 @@ void Parameters::SetBoundariesRespawnDormantVehicles(const float lower_bound, co
   respawn_upper_bound = max_upper_bound < upper_bound ? max_upper_bound : upper_bound;
 }
 
-void Parameters::SetPercentageSpeedDifference(const ActorPtr &actor, const float percentage) {
+void Parameters::ApplyVehicleSetting(const ActorId actor_id, const VehicleSetting setting, const float value) {
 
-  float new_percentage = std::min(100.0f, percentage);
-  percentage_difference_from_speed_limit.AddEntry({actor->GetId(), new_percentage});
-  if (exact_desired_speed.Contains(actor->GetId())) {
-    exact_desired_speed.RemoveEntry(actor->GetId());
+  switch (setting) {
+    case VehicleSetting::PercentageSpeedDifference: {
+      VehicleSettings &vehicle_settings = EditSettings(actor_id);
+      vehicle_settings.has_percentage_speed_difference = true;
+      vehicle_settings.percentage_speed_difference = std::min(100.0f, value);
+      vehicle_settings.has_exact_desired_speed = false;
+      break;
+    }
+    case VehicleSetting::LaneOffset: {
+      VehicleSettings &vehicle_settings = EditSettings(actor_id);
+      vehicle_settings.has_lane_offset = true;
+      vehicle_settings.lane_offset = value;
+      break;
+    }
+    case VehicleSetting::DesiredSpeed: {
+      VehicleSettings &vehicle_settings = EditSettings(actor_id);
+      vehicle_settings.has_exact_desired_speed = true;
+      vehicle_settings.exact_desired_speed = std::max(0.0f, value);
+      vehicle_settings.has_percentage_speed_difference = false;
+      break;
+    }
+    case VehicleSetting::DistanceToLeadingVehicle: {
+      VehicleSettings &vehicle_settings = EditSettings(actor_id);
+      vehicle_settings.has_distance_to_leading_vehicle = true;
+      vehicle_settings.distance_to_leading_vehicle = std::max(0.0f, value);
+      break;
+    }
+    case VehicleSetting::AutoLaneChange:
+      EditSettings(actor_id).auto_lane_change = value != 0.0f;
+      break;
+    case VehicleSetting::ForceLaneChange:
+      force_lane_change[actor_id] = {true, value != 0.0f};
+      break;
+    case VehicleSetting::PercentageRunningLight:
+      EditSettings(actor_id).perc_run_traffic_light = cg::Math::Clamp(value, 0.0f, 100.0f);
+      break;
+    case VehicleSetting::PercentageRunningSign:
+      EditSettings(actor_id).perc_run_traffic_sign = cg::Math::Clamp(value, 0.0f, 100.0f);
+      break;
+    case VehicleSetting::PercentageIgnoreVehicles:
+      EditSettings(actor_id).perc_ignore_vehicles = cg::Math::Clamp(value, 0.0f, 100.0f);
+      break;
+    case VehicleSetting::PercentageIgnoreWalkers:
+      EditSettings(actor_id).perc_ignore_walkers = cg::Math::Clamp(value, 0.0f, 100.0f);
+      break;
+    case VehicleSetting::KeepRightPercentage:
+      EditSettings(actor_id).perc_keep_right = value;
+      break;
+    case VehicleSetting::RandomLeftLaneChangePercentage:
+      EditSettings(actor_id).perc_random_left = value;
+      break;
+    case VehicleSetting::RandomRightLaneChangePercentage:
+      EditSettings(actor_id).perc_random_right = value;
+      break;
+    case VehicleSetting::UpdateVehicleLights:
+      EditSettings(actor_id).update_vehicle_lights = value != 0.0f;
+      break;
+    default:
+      break;
+  }
+}
+
+void Parameters::ApplyVehicleSettings(const VehicleSettingsBatch &batch) {
+
+  if (!batch.IsValid()) {
+    log_warning("Traffic Manager: ignoring malformed batch of", batch.Size(), "vehicle settings");
+    return;
+  }
+  std::lock_guard<std::mutex> lock(settings_mutex);
+  for (size_t i = 0u; i < batch.Size(); ++i) {
+    ApplyVehicleSetting(batch.actors[i], static_cast<VehicleSetting>(batch.settings[i]), batch.values[i]);
   }
 }
 
+void Parameters::SetPercentageSpeedDifference(const ActorPtr &actor, const float percentage) {
+  std::lock_guard<std::mutex> lock(settings_mutex);
+  ApplyVehicleSetting(actor->GetId(), VehicleSetting::PercentageSpeedDifference, percentage);
+}
+
 void Parameters::SetLaneOffset(const ActorPtr &actor, const float offset) {
-  const auto entry = std::make_pair(actor->GetId(), offset);
-  lane_offset.AddEntry(entry);
+  std::lock_guard<std::mutex> lock(settings_mutex);
+  ApplyVehicleSetting(actor->GetId(), VehicleSetting::LaneOffset, offset);
 }
 
 void Parameters::SetDesiredSpeed(const ActorPtr &actor, const float value) {
-
-  float new_value = std::max(0.0f, value);
-  exact_desired_speed.AddEntry({actor->GetId(), new_value});
-  if (percentage_difference_from_speed_limit.Contains(actor->GetId())) {
-    percentage_difference_from_speed_limit.RemoveEntry(actor->GetId());
-  }
+  std::lock_guard<std::mutex> lock(settings_mutex);
+  ApplyVehicleSetting(actor->GetId(), VehicleSetting::DesiredSpeed, value);
 }
 
 void Parameters::SetGlobalPercentageSpeedDifference(const float percentage) {
   float new_percentage = std::min(100.0f, percentage);
-  global_percentage_difference_from_limit = new_percentage;
+  global_percentage_difference_from_limit.store(new_percentage);
+  ++settings_version;
 }
 
 void Parameters::SetGlobalLaneOffset(const float offset) {
-  global_lane_offset = offset;
+  global_lane_offset.store(offset);
+  ++settings_version;
 }
 
 void Parameters::SetCollisionDetection(const ActorPtr &reference_actor, const ActorPtr &other_actor, const bool detect_collision) {
   const ActorId reference_id = reference_actor->GetId();
   const ActorId other_id = other_actor->GetId();
 
-  if (detect_collision) {
-    if (ignore_collision.Contains(reference_id)) {
-      std::shared_ptr<AtomicActorSet> actor_set = ignore_collision.GetValue(reference_id);
-      if (actor_set->Contains(other_id)) {
-        actor_set->Remove({other_id});
-      }
-    }
-  } else {
-    if (ignore_collision.Contains(reference_id)) {
-      std::shared_ptr<AtomicActorSet> actor_set = ignore_collision.GetValue(reference_id);
-      if (!actor_set->Contains(other_id)) {
-        actor_set->Insert({other_actor});
-      }
+  std::lock_guard<std::mutex> lock(settings_mutex);
+  const auto it = pending_settings.find(reference_id);
+  const bool is_ignored = it != pending_settings.end()
+      && it->second.ignored_actors != nullptr
+      && it->second.ignored_actors->count(other_id) > 0u;
+  if (detect_collision == is_ignored) {
+    // The set may be shared with a published version, so modify a copy.
+    VehicleSettings &vehicle_settings = EditSettings(reference_id);
+    auto actor_set = vehicle_settings.ignored_actors != nullptr ?
+        std::make_shared<IgnoredActorSet>(*vehicle_settings.ignored_actors) :
+        std::make_shared<IgnoredActorSet>();
+    if (detect_collision) {
+      actor_set->erase(other_id);
     } else {
-      std::shared_ptr<AtomicActorSet> actor_set = std::make_shared<AtomicActorSet>();
-      actor_set->Insert({other_actor});
-      auto entry = std::make_pair(reference_id, actor_set);
-      ignore_collision.AddEntry(entry);
+      actor_set->insert(other_id);
     }
+    vehicle_settings.ignored_actors = std::move(actor_set);
   }
 }
 
 void Parameters::SetForceLaneChange(const ActorPtr &actor, const bool direction) {
-
-  const ChangeLaneInfo lane_change_info = {true, direction};
-  const auto entry = std::make_pair(actor->GetId(), lane_change_info);
-  force_lane_change.AddEntry(entry);
+  std::lock_guard<std::mutex> lock(settings_mutex);
+  ApplyVehicleSetting(actor->GetId(), VehicleSetting::ForceLaneChange, direction ? 1.0f : 0.0f);
 }
 
 void Parameters::SetKeepRightPercentage(const ActorPtr &actor, const float percentage) {
-
-  const auto entry = std::make_pair(actor->GetId(), percentage);
-  perc_keep_right.AddEntry(entry);
+  std::lock_guard<std::mutex> lock(settings_mutex);
+  ApplyVehicleSetting(actor->GetId(), VehicleSetting::KeepRightPercentage, percentage);
 }
 
 void Parameters::SetRandomLeftLaneChangePercentage(const ActorPtr &actor, const float percentage) {
-
-  const auto entry = std::make_pair(actor->GetId(), percentage);
-  perc_random_left.AddEntry(entry);
+  std::lock_guard<std::mutex> lock(settings_mutex);
+  ApplyVehicleSetting(actor->GetId(), VehicleSetting::RandomLeftLaneChangePercentage, percentage);
 }
 
 void Parameters::SetRandomRightLaneChangePercentage(const ActorPtr &actor, const float percentage) {
-
-  const auto entry = std::make_pair(actor->GetId(), percentage);
-  perc_random_right.AddEntry(entry);
-
+  std::lock_guard<std::mutex> lock(settings_mutex);
+  ApplyVehicleSetting(actor->GetId(), VehicleSetting::RandomRightLaneChangePercentage, percentage);
 }
 
 void Parameters::SetUpdateVehicleLights(const ActorPtr &actor, const bool do_update) {
-
-  const auto entry = std::make_pair(actor->GetId(), do_update);
-  auto_update_vehicle_lights.AddEntry(entry);
+  std::lock_guard<std::mutex> lock(settings_mutex);
+  ApplyVehicleSetting(actor->GetId(), VehicleSetting::UpdateVehicleLights, do_update ? 1.0f : 0.0f);
 }
 
 void Parameters::SetAutoLaneChange(const ActorPtr &actor, const bool enable) {
-
-  const auto entry = std::make_pair(actor->GetId(), enable);
-  auto_lane_change.AddEntry(entry);
+  std::lock_guard<std::mutex> lock(settings_mutex);
+  ApplyVehicleSetting(actor->GetId(), VehicleSetting::AutoLaneChange, enable ? 1.0f : 0.0f);
 }
 
 void Parameters::SetDistanceToLeadingVehicle(const ActorPtr &actor, const float distance) {
-
-  float new_distance = std::max(0.0f, distance);
-  const auto entry = std::make_pair(actor->GetId(), new_distance);
-  distance_to_leading_vehicle.AddEntry(entry);
+  std::lock_guard<std::mutex> lock(settings_mutex);
+  ApplyVehicleSetting(actor->GetId(), VehicleSetting::DistanceToLeadingVehicle, distance);
 }
 
 void Parameters::SetSynchronousMode(const bool mode_switch) {
@@ -154,34 +224,27 @@ void Parameters::SetSynchronousModeTimeOutInMiliSecond(const double time) {
 void Parameters::SetGlobalDistanceToLeadingVehicle(const float dist) {
 
   distance_margin.store(dist);
+  ++settings_version;
 }
 
 void Parameters::SetPercentageRunningLight(const ActorPtr &actor, const float perc) {
-
-  float new_perc = cg::Math::Clamp(perc, 0.0f, 100.0f);
-  const auto entry = std::make_pair(actor->GetId(), new_perc);
-  perc_run_traffic_light.AddEntry(entry);
+  std::lock_guard<std::mutex> lock(settings_mutex);
+  ApplyVehicleSetting(actor->GetId(), VehicleSetting::PercentageRunningLight, perc);
 }
 
 void Parameters::SetPercentageRunningSign(const ActorPtr &actor, const float perc) {
-
-  float new_perc = cg::Math::Clamp(perc, 0.0f, 100.0f);
-  const auto entry = std::make_pair(actor->GetId(), new_perc);
-  perc_run_traffic_sign.AddEntry(entry);
+  std::lock_guard<std::mutex> lock(settings_mutex);
+  ApplyVehicleSetting(actor->GetId(), VehicleSetting::PercentageRunningSign, perc);
 }
 
 void Parameters::SetPercentageIgnoreVehicles(const ActorPtr &actor, const float perc) {
-
-  float new_perc = cg::Math::Clamp(perc, 0.0f, 100.0f);
-  const auto entry = std::make_pair(actor->GetId(), new_perc);
-  perc_ignore_vehicles.AddEntry(entry);
+  std::lock_guard<std::mutex> lock(settings_mutex);
+  ApplyVehicleSetting(actor->GetId(), VehicleSetting::PercentageIgnoreVehicles, perc);
 }
 
 void Parameters::SetPercentageIgnoreWalkers(const ActorPtr &actor, const float perc) {
-
-  float new_perc = cg::Math::Clamp(perc,0.0f,100.0f);
-  const auto entry = std::make_pair(actor->GetId(), new_perc);
-  perc_ignore_walkers.AddEntry(entry);
+  std::lock_guard<std::mutex> lock(settings_mutex);
+  ApplyVehicleSetting(actor->GetId(), VehicleSetting::PercentageIgnoreWalkers, perc);
 }
 
 void Parameters::SetHybridPhysicsRadius(const float radius) {
@@ -193,46 +256,179 @@ void Parameters::SetOSMMode(const bool mode_switch) {
   osm_mode.store(mode_switch);
 }
 
+void Parameters::SetShardedMode(const bool mode_switch) {
+  sharded_mode.store(mode_switch);
+}
+
 void Parameters::SetCustomPath(const ActorPtr &actor, const Path path, const bool empty_buffer) {
-  const auto entry = std::make_pair(actor->GetId(), path);
-  custom_path.AddEntry(entry);
-  const auto entry2 = std::make_pair(actor->GetId(), empty_buffer);
-  upload_path.AddEntry(entry2);
+  RouteStore::SharedPathPtr shared_path = route_store.AddPath(path);
+  std::lock_guard<std::mutex> lock(path_mutex);
+  custom_path[actor->GetId()] = ImportedPath{std::move(shared_path), 0u};
+  upload_path[actor->GetId()] = empty_buffer;
+  ++settings_version;
 }
 
 void Parameters::RemoveUploadPath(const ActorId &actor_id, const bool remove_path) {
+  std::lock_guard<std::mutex> lock(path_mutex);
   if (!remove_path) {
-    upload_path.RemoveEntry(actor_id);
+    upload_path.erase(actor_id);
   } else {
-    custom_path.RemoveEntry(actor_id);
+    custom_path.erase(actor_id);
   }
+  ++settings_version;
 }
 
 void Parameters::UpdateUploadPath(const ActorId &actor_id, const Path path) {
-  custom_path.RemoveEntry(actor_id);
-  const auto entry = std::make_pair(actor_id, path);
-  custom_path.AddEntry(entry);
+  RouteStore::SharedPathPtr shared_path = route_store.AddPath(path);
+  std::lock_guard<std::mutex> lock(path_mutex);
+  custom_path[actor_id] = ImportedPath{std::move(shared_path), 0u};
+  ++settings_version;
 }
 
 void Parameters::SetImportedRoute(const ActorPtr &actor, const Route route, const bool empty_buffer) {
-  const auto entry = std::make_pair(actor->GetId(), route);
-  custom_route.AddEntry(entry);
-  const auto entry2 = std::make_pair(actor->GetId(), empty_buffer);
-  upload_route.AddEntry(entry2);
+  RouteStore::SharedRoutePtr shared_route = route_store.AddRoute(route);
+  std::lock_guard<std::mutex> lock(path_mutex);
+  custom_route[actor->GetId()] = ImportedRoute{std::move(shared_route), 0u};
+  upload_route[actor->GetId()] = empty_buffer;
+  ++settings_version;
 }
 
 void Parameters::RemoveImportedRoute(const ActorId &actor_id, const bool remove_path) {
+  std::lock_guard<std::mutex> lock(path_mutex);
   if (!remove_path) {
-    upload_route.RemoveEntry(actor_id);
+    upload_route.erase(actor_id);
   } else {
-    custom_route.RemoveEntry(actor_id);
+    custom_route.erase(actor_id);
   }
+  ++settings_version;
 }
 
 void Parameters::UpdateImportedRoute(const ActorId &actor_id, const Route route) {
-  custom_route.RemoveEntry(actor_id);
-  const auto entry = std::make_pair(actor_id, route);
-  custom_route.AddEntry(entry);
+  RouteStore::SharedRoutePtr shared_route = route_store.AddRoute(route);
+  std::lock_guard<std::mutex> lock(path_mutex);
+  custom_route[actor_id] = ImportedRoute{std::move(shared_route), 0u};
+  ++settings_version;
+}
+
+void Parameters::UpdateCustomPathProgress(const ActorId &actor_id, const ImportedPath &imported_path) {
+  std::lock_guard<std::mutex> lock(path_mutex);
+  auto it = custom_path.find(actor_id);
+  if (it == custom_path.end() || it->second.path != imported_path.path) {
+    return;
+  }
+  if (imported_path.next >= imported_path.path->GetLocations().size()) {
+    custom_path.erase(it);
+    ++settings_version;
+  } else {
+    it->second.next = imported_path.next;
+  }
+}
+
+void Parameters::UpdateImportedRouteProgress(const ActorId &actor_id, const ImportedRoute &imported_route) {
+  std::lock_guard<std::mutex> lock(path_mutex);
+  auto it = custom_route.find(actor_id);
+  if (it == custom_route.end() || it->second.route != imported_route.route) {
+    return;
+  }
+  if (imported_route.next >= imported_route.route->size()) {
+    custom_route.erase(it);
+    ++settings_version;
+  } else {
+    it->second.next = imported_route.next;
+  }
+}
+
+void Parameters::ClearResolvedPaths() {
+  route_store.ClearResolvedPaths();
+}
+
+//////////////////////////////////// SNAPSHOT /////////////////////////////////
+
+void Parameters::TakeSnapshot(const std::vector<ActorId> &vehicle_id_list) {
+
+  // Force lane change commands only last for the cycle that consumed them.
+  for (const unsigned long index : snapshot_lane_changes) {
+    snapshot.at(index).force_lane_change = ChangeLaneInfo();
+  }
+  snapshot_lane_changes.clear();
+
+  std::lock_guard<std::mutex> lock(settings_mutex);
+  std::lock_guard<std::mutex> path_lock(path_mutex);
+  const uint64_t version = settings_version.load();
+  if (version != snapshot_version || vehicle_id_list != snapshot_vehicles) {
+    const float global_percentage = global_percentage_difference_from_limit.load();
+    const float global_offset = global_lane_offset.load();
+    const float global_distance = distance_margin.load();
+
+    snapshot.assign(vehicle_id_list.size(), VehicleParameters());
+    snapshot_imports.clear();
+    for (unsigned long i = 0u; i < vehicle_id_list.size(); ++i) {
+      const ActorId actor_id = vehicle_id_list.at(i);
+      VehicleParameters &vehicle_parameters = snapshot.at(i);
+      vehicle_parameters.speed_value = global_percentage;
+      vehicle_parameters.lane_offset = global_offset;
+      vehicle_parameters.distance_to_leading_vehicle = global_distance;
+      if (custom_path.count(actor_id) > 0u || custom_route.count(actor_id) > 0u) {
+        snapshot_imports.push_back(i);
+      }
+
+      const auto it = pending_settings.find(actor_id);
+      if (it == pending_settings.end()) {
+        continue;
+      }
+      const VehicleSettings &vehicle_settings = it->second;
+      if (vehicle_settings.has_percentage_speed_difference) {
+        vehicle_parameters.speed_value = vehicle_settings.percentage_speed_difference;
+      } else if (vehicle_settings.has_exact_desired_speed) {
+        vehicle_parameters.exact_speed = true;
+        vehicle_parameters.speed_value = vehicle_settings.exact_desired_speed;
+      }
+      if (vehicle_settings.has_lane_offset) {
+        vehicle_parameters.lane_offset = vehicle_settings.lane_offset;
+      }
+      if (vehicle_settings.has_distance_to_leading_vehicle) {
+        vehicle_parameters.distance_to_leading_vehicle = vehicle_settings.distance_to_leading_vehicle;
+      }
+      vehicle_parameters.auto_lane_change = vehicle_settings.auto_lane_change;
+      vehicle_parameters.perc_run_traffic_light = vehicle_settings.perc_run_traffic_light;
+      vehicle_parameters.perc_run_traffic_sign = vehicle_settings.perc_run_traffic_sign;
+      vehicle_parameters.perc_ignore_walkers = vehicle_settings.perc_ignore_walkers;
+      vehicle_parameters.perc_ignore_vehicles = vehicle_settings.perc_ignore_vehicles;
+      vehicle_parameters.perc_keep_right = vehicle_settings.perc_keep_right;
+      vehicle_parameters.perc_random_left = vehicle_settings.perc_random_left;
+      vehicle_parameters.perc_random_right = vehicle_settings.perc_random_right;
+      vehicle_parameters.update_vehicle_lights = vehicle_settings.update_vehicle_lights;
+      vehicle_parameters.ignored_actors = vehicle_settings.ignored_actors;
+    }
+    snapshot_version = version;
+    snapshot_vehicles = vehicle_id_list;
+  }
+
+  // The progress along the imported paths and routes changes every cycle
+  // without changing the settings.
+  for (const unsigned long index : snapshot_imports) {
+    const ActorId actor_id = vehicle_id_list.at(index);
+    VehicleParameters &vehicle_parameters = snapshot.at(index);
+    const auto path = custom_path.find(actor_id);
+    vehicle_parameters.imported_path = path != custom_path.end() ? path->second : ImportedPath();
+    const auto route = custom_route.find(actor_id);
+    vehicle_parameters.imported_route = route != custom_route.end() ? route->second : ImportedRoute();
+    const auto upload = upload_path.find(actor_id);
+    vehicle_parameters.upload_path = upload != upload_path.end() && upload->second;
+    const auto upload_imported_route = upload_route.find(actor_id);
+    vehicle_parameters.upload_route = upload_imported_route != upload_route.end() && upload_imported_route->second;
+  }
+
+  if (!force_lane_change.empty()) {
+    for (unsigned long i = 0u; i < vehicle_id_list.size(); ++i) {
+      const auto it = force_lane_change.find(vehicle_id_list.at(i));
+      if (it != force_lane_change.end()) {
+        snapshot.at(i).force_lane_change = it->second;
+        snapshot_lane_changes.push_back(i);
+        force_lane_change.erase(it);
+      }
+    }
+  }
 }
 
 //////////////////////////////////// GETTERS //////////////////////////////////
@@ -252,160 +448,86 @@ double Parameters::GetSynchronousModeTimeOutInMiliSecond() const {
 
 float Parameters::GetVehicleTargetVelocity(const ActorId &actor_id, const float speed_limit) const {
 
-  float percentage_difference = global_percentage_difference_from_limit;
+  const VehicleSettings vehicle_settings = GetSettings(actor_id);
+  float percentage_difference = global_percentage_difference_from_limit.load();
 
-  if (percentage_difference_from_speed_limit.Contains(actor_id)) {
-    percentage_difference = percentage_difference_from_speed_limit.GetValue(actor_id);
-  } else if (exact_desired_speed.Contains(actor_id)) {
-    return exact_desired_speed.GetValue(actor_id);
+  if (vehicle_settings.has_percentage_speed_difference) {
+    percentage_difference = vehicle_settings.percentage_speed_difference;
+  } else if (vehicle_settings.has_exact_desired_speed) {
+    return vehicle_settings.exact_desired_speed;
   }
 
   return speed_limit * (1.0f - percentage_difference / 100.0f);
 }
 
 float Parameters::GetLaneOffset(const ActorId &actor_id) const {
-  float offset = global_lane_offset;
-
-  if (lane_offset.Contains(actor_id)) {
-    offset = lane_offset.GetValue(actor_id);
-  }
-
-  return offset;
+  const VehicleSettings vehicle_settings = GetSettings(actor_id);
+  return vehicle_settings.has_lane_offset ? vehicle_settings.lane_offset : global_lane_offset.load();
 }
 
 bool Parameters::GetCollisionDetection(const ActorId &reference_actor_id, const ActorId &other_actor_id) const {
 
-  bool avoid_collision = true;
-
-  if (ignore_collision.Contains(reference_actor_id) &&
-    ignore_collision.GetValue(reference_actor_id)->Contains(other_actor_id)) {
-    avoid_collision = false;
-  }
-
-  return avoid_collision;
+  const VehicleSettings vehicle_settings = GetSettings(reference_actor_id);
+  return vehicle_settings.ignored_actors == nullptr
+      || vehicle_settings.ignored_actors->count(other_actor_id) == 0u;
 }
 
 ChangeLaneInfo Parameters::GetForceLaneChange(const ActorId &actor_id) {
 
   ChangeLaneInfo change_lane_info {false, false};
 
-  if (force_lane_change.Contains(actor_id)) {
-    change_lane_info = force_lane_change.GetValue(actor_id);
+  std::lock_guard<std::mutex> lock(settings_mutex);
+  const auto it = force_lane_change.find(actor_id);
+  if (it != force_lane_change.end()) {
+    change_lane_info = it->second;
+    force_lane_change.erase(it);
   }
 
-  force_lane_change.RemoveEntry(actor_id);
-
   return change_lane_info;
 }
 
-float Parameters::GetKeepRightPercentage(const ActorId &actor_id) {
-
-  float percentage = -1.0f;
-
-  if (perc_keep_right.Contains(actor_id)) {
-    percentage = perc_keep_right.GetValue(actor_id);
-  }
-
-  return percentage;
+float Parameters::GetKeepRightPercentage(const ActorId &actor_id) const {
+  return GetSettings(actor_id).perc_keep_right;
 }
 
-float Parameters::GetRandomLeftLaneChangePercentage(const ActorId &actor_id) {
-
-  float percentage = -1.0f;
-
-  if (perc_random_left.Contains(actor_id)) {
-    percentage = perc_random_left.GetValue(actor_id);
-  }
-
-  return percentage;
+float Parameters::GetRandomLeftLaneChangePercentage(const ActorId &actor_id) const {
+  return GetSettings(actor_id).perc_random_left;
 }
 
-float Parameters::GetRandomRightLaneChangePercentage(const ActorId &actor_id) {
-
-  float percentage = -1.0f;
-
-  if (perc_random_right.Contains(actor_id)) {
-    percentage = perc_random_right.GetValue(actor_id);
-  }
-
-  return percentage;
+float Parameters::GetRandomRightLaneChangePercentage(const ActorId &actor_id) const {
+  return GetSettings(actor_id).perc_random_right;
 }
 
 bool Parameters::GetAutoLaneChange(const ActorId &actor_id) const {
-
-  bool auto_lane_change_policy = true;
-
-  if (auto_lane_change.Contains(actor_id)) {
-    auto_lane_change_policy = auto_lane_change.GetValue(actor_id);
-  }
-
-  return auto_lane_change_policy;
+  return GetSettings(actor_id).auto_lane_change;
 }
 
 float Parameters::GetDistanceToLeadingVehicle(const ActorId &actor_id) const {
 
-  float specific_distance_margin = 0.0f;
-  if (distance_to_leading_vehicle.Contains(actor_id)) {
-    specific_distance_margin = distance_to_leading_vehicle.GetValue(actor_id);
-  } else {
-    specific_distance_margin = distance_margin;
-  }
-
-  return specific_distance_margin;
+  const VehicleSettings vehicle_settings = GetSettings(actor_id);
+  return vehicle_settings.has_distance_to_leading_vehicle ?
+      vehicle_settings.distance_to_leading_vehicle :
+      distance_margin.load();
 }
 
 float Parameters::GetPercentageRunningLight(const ActorId &actor_id) const {
-
-  float percentage = 0.0f;
-
-  if (perc_run_traffic_light.Contains(actor_id)) {
-    percentage = perc_run_traffic_light.GetValue(actor_id);
-  }
-
-  return percentage;
+  return GetSettings(actor_id).perc_run_traffic_light;
 }
 
 float Parameters::GetPercentageRunningSign(const ActorId &actor_id) const {
-
-  float percentage = 0.0f;
-
-  if (perc_run_traffic_sign.Contains(actor_id)) {
-    percentage = perc_run_traffic_sign.GetValue(actor_id);
-  }
-
-  return percentage;
+  return GetSettings(actor_id).perc_run_traffic_sign;
 }
 
 float Parameters::GetPercentageIgnoreWalkers(const ActorId &actor_id) const {
-
-  float percentage = 0.0f;
-
-  if (perc_ignore_walkers.Contains(actor_id)) {
-    percentage = perc_ignore_walkers.GetValue(actor_id);
-  }
-
-  return percentage;
+  return GetSettings(actor_id).perc_ignore_walkers;
 }
 
 bool Parameters::GetUpdateVehicleLights(const ActorId &actor_id) const {
-  bool do_update = false;
-
-  if (auto_update_vehicle_lights.Contains(actor_id)) {
-    do_update = auto_update_vehicle_lights.GetValue(actor_id);
-  }
-
-  return do_update;
+  return GetSettings(actor_id).update_vehicle_lights;
 }
 
 float Parameters::GetPercentageIgnoreVehicles(const ActorId &actor_id) const {
-
-  float percentage = 0.0f;
-
-  if (perc_ignore_vehicles.Contains(actor_id)) {
-    percentage = perc_ignore_vehicles.GetValue(actor_id);
-  }
-
-  return percentage;
+  return GetSettings(actor_id).perc_ignore_vehicles;
 }
 
 bool Parameters::GetHybridPhysicsMode() const {
@@ -434,51 +556,38 @@ bool Parameters::GetOSMMode() const {
   return osm_mode.load();
 }
 
-bool Parameters::GetUploadPath(const ActorId &actor_id) const {
-
-  bool custom_path_bool = false;
-
-  if (upload_path.Contains(actor_id)) {
-    custom_path_bool = upload_path.GetValue(actor_id);
-  }
+bool Parameters::GetShardedMode() const {
 
-  return custom_path_bool;
+  return sharded_mode.load();
 }
 
-Path Parameters::GetCustomPath(const ActorId &actor_id) const {
+bool Parameters::GetUploadPath(const ActorId &actor_id) const {
 
-  Path custom_path_import;
+  std::lock_guard<std::mutex> lock(path_mutex);
+  const auto it = upload_path.find(actor_id);
+  return it != upload_path.end() && it->second;
+}
 
-  if (custom_path.Contains(actor_id)) {
-    custom_path_import = custom_path.GetValue(actor_id);
-  }
+ImportedPath Parameters::GetCustomPath(const ActorId &actor_id) const {
 
-  return custom_path_import;
+  std::lock_guard<std::mutex> lock(path_mutex);
+  const auto it = custom_path.find(actor_id);
+  return it != custom_path.end() ? it->second : ImportedPath();
 }
 
-
 bool Parameters::GetUploadRoute(const ActorId &actor_id) const {
 
-  bool custom_route_bool = false;
-
-  if (upload_route.Contains(actor_id)) {
-    custom_route_bool = upload_route.GetValue(actor_id);
-  }
-
-  return custom_route_bool;
+  std::lock_guard<std::mutex> lock(path_mutex);
+  const auto it = upload_route.find(actor_id);
+  return it != upload_route.end() && it->second;
 }
 
-Route Parameters::GetImportedRoute(const ActorId &actor_id) const {
+ImportedRoute Parameters::GetImportedRoute(const ActorId &actor_id) const {
 
-  Route custom_route_import;
-
-  if (custom_route.Contains(actor_id)) {
-    custom_route_import = custom_route.GetValue(actor_id);
-  }
-
-  return custom_route_import;
+  std::lock_guard<std::mutex> lock(path_mutex);
+  const auto it = custom_route.find(actor_id);
+  return it != custom_route.end() ? it->second : ImportedRoute();
 }
 
-
 } // namespace traffic_manager
 } // namespace carla
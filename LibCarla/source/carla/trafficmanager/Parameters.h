@@ -8,16 +8,19 @@
 
 #include <atomic>
 #include <chrono>
+#include <memory>
+#include <mutex>
 #include <random>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "carla/client/Actor.h"
 #include "carla/client/Vehicle.h"
 #include "carla/Memory.h"
 #include "carla/rpc/ActorId.h"
-
-#include "carla/trafficmanager/AtomicActorSet.h"
-#include "carla/trafficmanager/AtomicMap.h"
+#include "carla/trafficmanager/RouteStore.h"
+#include "carla/trafficmanager/VehicleSettingsBatch.h"
 
 namespace carla {
 namespace traffic_manager {
@@ -26,51 +29,125 @@ namespace cc = carla::client;
 namespace cg = carla::geom;
 using ActorPtr = carla::SharedPtr<cc::Actor>;
 using ActorId = carla::ActorId;
-using Path = std::vector<cg::Location>;
-using Route = std::vector<uint8_t>;
+
+/// Path imported for a vehicle, shared with the vehicles following the same
+/// one, and the position in it of the next location to import.
+struct ImportedPath {
+  RouteStore::SharedPathPtr path;
+  size_t next = 0u;
+};
+
+/// Route imported for a vehicle, shared with the vehicles following the same
+/// one, and the position in it of the next road option to import.
+struct ImportedRoute {
+  RouteStore::SharedRoutePtr route;
+  size_t next = 0u;
+};
 
 struct ChangeLaneInfo {
   bool change_lane = false;
   bool direction = false;
 };
 
+using IgnoredActorSet = std::unordered_set<ActorId>;
+
+/// Values set through the API for a single vehicle. Values not set fall back
+/// to the global ones when a snapshot is taken.
+struct VehicleSettings {
+  /// The target velocity is either a % difference from the speed limit or an
+  /// exact value, whichever was set last.
+  bool has_percentage_speed_difference = false;
+  float percentage_speed_difference = 0.0f;
+  bool has_exact_desired_speed = false;
+  float exact_desired_speed = 0.0f;
+  bool has_lane_offset = false;
+  float lane_offset = 0.0f;
+  bool has_distance_to_leading_vehicle = false;
+  float distance_to_leading_vehicle = 0.0f;
+  bool auto_lane_change = true;
+  float perc_run_traffic_light = 0.0f;
+  float perc_run_traffic_sign = 0.0f;
+  float perc_ignore_walkers = 0.0f;
+  float perc_ignore_vehicles = 0.0f;
+  float perc_keep_right = -1.0f;
+  float perc_random_left = -1.0f;
+  float perc_random_right = -1.0f;
+  bool update_vehicle_lights = false;
+  /// Actors ignored during collision detection. Shared between versions of
+  /// the table and replaced, never modified, once published.
+  std::shared_ptr<const IgnoredActorSet> ignored_actors;
+};
+
+/// Parameters of a vehicle for the current cycle, resolved against the
+/// global ones.
+struct VehicleParameters {
+  /// If true, speed_value is the target velocity, otherwise it is a %
+  /// difference from the speed limit.
+  bool exact_speed = false;
+  float speed_value = 0.0f;
+  float lane_offset = 0.0f;
+  float distance_to_leading_vehicle = 0.0f;
+  ChangeLaneInfo force_lane_change;
+  bool auto_lane_change = true;
+  float perc_run_traffic_light = 0.0f;
+  float perc_run_traffic_sign = 0.0f;
+  float perc_ignore_walkers = 0.0f;
+  float perc_ignore_vehicles = 0.0f;
+  float perc_keep_right = -1.0f;
+  float perc_random_left = -1.0f;
+  float perc_random_right = -1.0f;
+  bool update_vehicle_lights = false;
+  /// Path and route imported for the vehicle, if any, with their progress
+  /// at the start of the cycle.
+  ImportedPath imported_path;
+  ImportedRoute imported_route;
+  /// Whether the waypoint buffer has to be emptied before importing the path
+  /// or the route.
+  bool upload_path = false;
+  bool upload_route = false;
+  std::shared_ptr<const IgnoredActorSet> ignored_actors;
+
+  /// Target velocity for the given speed limit.
+  float GetTargetVelocity(const float speed_limit) const {
+    return exact_speed ? speed_value : speed_limit * (1.0f - speed_value / 100.0f);
+  }
+
+  /// Whether collisions against the given actor have to be avoided.
+  bool GetCollisionDetection(const ActorId other_actor_id) const {
+    return ignored_actors == nullptr || ignored_actors->count(other_actor_id) == 0u;
+  }
+};
+
+/// Parameters of every registered vehicle for the current cycle, in the
+/// order of the vehicle id list.
+using ParameterSnapshot = std::vector<VehicleParameters>;
+
 class Parameters {
 
 private:
-  /// Target velocity map for individual vehicles, based on a % diffrerence from speed limit.
-  AtomicMap<ActorId, float> percentage_difference_from_speed_limit;
-  /// Lane offset map for individual vehicles.
-  AtomicMap<ActorId, float> lane_offset;
-  /// Target velocity map for individual vehicles, based on a desired velocity.
-  AtomicMap<ActorId, float> exact_desired_speed;
+  using SettingsTable = std::unordered_map<ActorId, VehicleSettings>;
+
+  /// Per-vehicle settings modified by the setters, resolved into the
+  /// snapshot at the start of the next cycle.
+  SettingsTable pending_settings;
+  /// Pending force lane change commands, consumed by the next cycle.
+  std::unordered_map<ActorId, ChangeLaneInfo> force_lane_change;
+  mutable std::mutex settings_mutex;
+  /// Incremented by every setter that changes the snapshot.
+  std::atomic<uint64_t> settings_version{0u};
+  /// State of the last snapshot, to skip resolving it again when neither
+  /// the settings nor the vehicles changed.
+  uint64_t snapshot_version = 0u;
+  std::vector<ActorId> snapshot_vehicles;
+  std::vector<unsigned long> snapshot_lane_changes;
+  /// Indices in the snapshot of the vehicles importing a path or a route,
+  /// whose progress is refreshed every cycle.
+  std::vector<unsigned long> snapshot_imports;
+  ParameterSnapshot snapshot;
   /// Global target velocity limit % difference.
-  float global_percentage_difference_from_limit = 0;
+  std::atomic<float> global_percentage_difference_from_limit{0.0f};
   /// Global lane offset
-  float global_lane_offset = 0;
-  /// Map containing a set of actors to be ignored during collision detection.
-  AtomicMap<ActorId, std::shared_ptr<AtomicActorSet>> ignore_collision;
-  /// Map containing distance to leading vehicle command.
-  AtomicMap<ActorId, float> distance_to_leading_vehicle;
-  /// Map containing force lane change commands.
-  AtomicMap<ActorId, ChangeLaneInfo> force_lane_change;
-  /// Map containing auto lane change commands.
-  AtomicMap<ActorId, bool> auto_lane_change;
-  /// Map containing % of running a traffic light.
-  AtomicMap<ActorId, float> perc_run_traffic_light;
-  /// Map containing % of running a traffic sign.
-  AtomicMap<ActorId, float> perc_run_traffic_sign;
-  /// Map containing % of ignoring walkers.
-  AtomicMap<ActorId, float> perc_ignore_walkers;
-  /// Map containing % of ignoring vehicles.
-  AtomicMap<ActorId, float> perc_ignore_vehicles;
-  /// Map containing % of keep right rule.
-  AtomicMap<ActorId, float> perc_keep_right;
-  /// Map containing % of random left lane change.
-  AtomicMap<ActorId, float> perc_random_left;
-  /// Map containing % of random right lane change.
-  AtomicMap<ActorId, float> perc_random_right;
-  /// Map containing the automatic vehicle lights update flag
-  AtomicMap<ActorId, bool> auto_update_vehicle_lights;
+  std::atomic<float> global_lane_offset{0.0f};
   /// Synchronous mode switch.
   std::atomic<bool> synchronous_mode{false};
   /// Distance margin
@@ -91,14 +168,31 @@ private:
   std::atomic<float> hybrid_physics_radius {70.0};
   /// Parameter specifying Open Street Map mode.
   std::atomic<bool> osm_mode {true};
+  /// Parameter specifying if vehicles are localized in spatial shards.
+  std::atomic<bool> sharded_mode {false};
   /// Parameter specifying if importing a custom path.
-  AtomicMap<ActorId, bool> upload_path;
+  std::unordered_map<ActorId, bool> upload_path;
   /// Structure to hold all custom paths.
-  AtomicMap<ActorId, Path> custom_path;
+  std::unordered_map<ActorId, ImportedPath> custom_path;
   /// Parameter specifying if importing a custom route.
-  AtomicMap<ActorId, bool> upload_route;
+  std::unordered_map<ActorId, bool> upload_route;
   /// Structure to hold all custom routes.
-  AtomicMap<ActorId, Route> custom_route;
+  std::unordered_map<ActorId, ImportedRoute> custom_route;
+  /// Mutex guarding the custom paths and routes.
+  mutable std::mutex path_mutex;
+  /// Paths and routes shared by the vehicles following them.
+  RouteStore route_store;
+
+  /// Returns the settings of a vehicle in the pending table, creating them if
+  /// needed. Must be called with settings_mutex locked.
+  VehicleSettings &EditSettings(const ActorId actor_id);
+
+  /// Returns the latest settings of a vehicle, or the defaults.
+  VehicleSettings GetSettings(const ActorId &actor_id) const;
+
+  /// Updates a setting of a vehicle in the pending table. Must be called
+  /// with settings_mutex locked.
+  void ApplyVehicleSetting(const ActorId actor_id, const VehicleSetting setting, const float value);
 
 public:
   Parameters();
@@ -106,6 +200,10 @@ public:
 
   ////////////////////////////////// SETTERS /////////////////////////////////////
 
+  /// Applies all the updates of @a batch at once, so they are published
+  /// together at the start of the next cycle. Malformed batches are ignored.
+  void ApplyVehicleSettings(const VehicleSettingsBatch &batch);
+
   /// Set a vehicle's % decrease in velocity with respect to the speed limit.
   /// If less than 0, it's a % increase.
   void SetPercentageSpeedDifference(const ActorPtr &actor, const float percentage);
@@ -184,6 +282,9 @@ public:
   /// Method to set Open Street Map mode.
   void SetOSMMode(const bool mode_switch);
 
+  /// Method to set sharded mode.
+  void SetShardedMode(const bool mode_switch);
+
   /// Method to set if we are automatically respawning vehicles.
   void SetRespawnDormantVehicles(const bool mode_switch);
 
@@ -211,8 +312,37 @@ public:
   /// Method to update an already set route.
   void UpdateImportedRoute(const ActorId &actor_id, const Route route);
 
+  /// Records how far the vehicle has imported its path, removing the path
+  /// once it is fully imported. Ignored if the path was replaced meanwhile.
+  void UpdateCustomPathProgress(const ActorId &actor_id, const ImportedPath &imported_path);
+
+  /// Records how far the vehicle has imported its route, removing the route
+  /// once it is fully imported. Ignored if the route was replaced meanwhile.
+  void UpdateImportedRouteProgress(const ActorId &actor_id, const ImportedRoute &imported_route);
+
+  /// Forgets the waypoints the imported paths were resolved to, to be called
+  /// when the local map changes.
+  void ClearResolvedPaths();
+
+  ///////////////////////////////// SNAPSHOT ////////////////////////////////////
+
+  /// Publishes the pending settings and resolves the parameters of the given
+  /// vehicles for the next cycle. Consumes their force lane change commands.
+  /// Must not be called while the stages are running.
+  void TakeSnapshot(const std::vector<ActorId> &vehicle_id_list);
+
+  /// Parameters of the registered vehicles for the current cycle, indexed as
+  /// the vehicle id list used to take the snapshot.
+  const ParameterSnapshot &GetSnapshot() const {
+    return snapshot;
+  }
+
   ///////////////////////////////// GETTERS /////////////////////////////////////
 
+  /// The per-vehicle getters below return the latest value set, even if the
+  /// current cycle still runs with the previous one. The stages read the
+  /// snapshot instead, which only changes at the start of a cycle.
+
   /// Method to retrieve hybrid physics radius.
   float GetHybridPhysicsRadius() const;
 
@@ -229,13 +359,13 @@ public:
   ChangeLaneInfo GetForceLaneChange(const ActorId &actor_id);
 
   /// Method to query percentage probability of keep right rule for a vehicle.
-  float GetKeepRightPercentage(const ActorId &actor_id);
+  float GetKeepRightPercentage(const ActorId &actor_id) const;
 
   /// Method to query percentage probability of a random right lane change for a vehicle.
-  float GetRandomLeftLaneChangePercentage(const ActorId &actor_id);
+  float GetRandomLeftLaneChangePercentage(const ActorId &actor_id) const;
 
   /// Method to query percentage probability of a random left lane change for a vehicle.
-  float GetRandomRightLaneChangePercentage(const ActorId &actor_id);
+  float GetRandomRightLaneChangePercentage(const ActorId &actor_id) const;
 
   /// Method to query auto lane change rule for a vehicle.
   bool GetAutoLaneChange(const ActorId &actor_id) const;
@@ -279,17 +409,20 @@ public:
   /// Method to get Open Street Map mode.
   bool GetOSMMode() const;
 
+  /// Method to get sharded mode.
+  bool GetShardedMode() const;
+
   /// Method to get if we are uploading a path.
   bool GetUploadPath(const ActorId &actor_id) const;
 
   /// Method to get a custom path.
-  Path GetCustomPath(const ActorId &actor_id) const;
+  ImportedPath GetCustomPath(const ActorId &actor_id) const;
 
   /// Method to get if we are uploading a route.
   bool GetUploadRoute(const ActorId &actor_id) const;
 
   /// Method to get a custom route.
-  Route GetImportedRoute(const ActorId &actor_id) const;
+  ImportedRoute GetImportedRoute(const ActorId &actor_id) const;
 
   /// Synchronous mode time out variable.
   std::chrono::duration<double, std::milli> synchronous_time_out;
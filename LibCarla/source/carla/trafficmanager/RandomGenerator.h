@@ -1,4 +1,3 @@
-
 #pragma once
 
 #include <random>
@@ -12,11 +11,65 @@ namespace traffic_manager {
 class RandomGenerator {
 public:
     RandomGenerator(const uint64_t seed): mt(std::mt19937(seed)), dist(0.0, 100.0) {}
+    RandomGenerator(std::seed_seq &seed): mt(std::mt19937(seed)), dist(0.0, 100.0) {}
     double next() { return dist(mt); }
 private:
     std::mt19937 mt;
     std::uniform_real_distribution<double> dist;
 };
 
+/// Holds one random generator per registered vehicle, seeded from the traffic
+/// manager seed and the id of the vehicle. Samples drawn by a vehicle do not
+/// depend on the order in which vehicles are updated, so stages can update
+/// them concurrently and still be deterministic for a given seed.
+///
+/// Generators are added and removed by the ALSM while the stages are not
+/// running; the stages only look them up.
+class RandomGeneratorMap {
+public:
+    RandomGeneratorMap(const uint64_t seed): seed(seed) {}
+
+    /// Create the generator of @a actor_id if it does not have one yet.
+    void Add(const ActorId actor_id) {
+        if (generators.find(actor_id) == generators.end()) {
+            generators.emplace(actor_id, MakeGenerator(actor_id));
+        }
+    }
+
+    void Remove(const ActorId actor_id) {
+        generators.erase(actor_id);
+    }
+
+    /// Generator of @a actor_id, which must have been added. Never modifies
+    /// the map, so it can be called concurrently as long as each vehicle is
+    /// only sampled by one thread at a time.
+    RandomGenerator &At(const ActorId actor_id) {
+        return generators.at(actor_id);
+    }
+
+    /// Re-seed the generators of all the vehicles.
+    void Reset(const uint64_t new_seed) {
+        seed = new_seed;
+        for (auto &entry : generators) {
+            entry.second = MakeGenerator(entry.first);
+        }
+    }
+
+    void Clear() {
+        generators.clear();
+    }
+
+private:
+    RandomGenerator MakeGenerator(const ActorId actor_id) const {
+        std::seed_seq sequence{static_cast<uint32_t>(seed),
+                               static_cast<uint32_t>(seed >> 32u),
+                               static_cast<uint32_t>(actor_id)};
+        return RandomGenerator(sequence);
+    }
+
+    uint64_t seed;
+    std::unordered_map<ActorId, RandomGenerator> generators;
+};
+
 } // namespace traffic_manager
 } // namespace carla
@@ -0,0 +1,259 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#include "carla/trafficmanager/ReplayHarness.h"
+
+#include "carla/trafficmanager/Constants.h"
+
+#include <algorithm>
+#include <exception>
+#include <future>
+
+namespace carla {
+namespace traffic_manager {
+
+using namespace constants::PID;
+
+ReplayHarness::ReplayHarness(SharedPtr<cc::Map> map, ReplayRecording in_recording, const uint64_t seed)
+  : recording(std::move(in_recording)),
+    world(cc::detail::EpisodeProxy{}),
+    local_map(std::make_shared<InMemoryMap>(map)),
+    random_devices(seed),
+    longitudinal_parameters(LONGITUDIAL_PARAM),
+    longitudinal_highway_parameters(LONGITUDIAL_HIGHWAY_PARAM),
+    lateral_parameters(LATERAL_PARAM),
+    lateral_highway_parameters(LATERAL_HIGHWAY_PARAM),
+    localization_stage(vehicle_id_list,
+                       buffer_map,
+                       simulation_state,
+                       track_traffic,
+                       local_map,
+                       parameters,
+                       marked_for_removal,
+                       localization_frame,
+                       random_devices),
+    collision_stage(vehicle_id_list,
+                    simulation_state,
+                    buffer_map,
+                    track_traffic,
+                    parameters,
+                    collision_frame,
+                    random_devices),
+    motion_plan_stage(vehicle_id_list,
+                      simulation_state,
+                      parameters,
+                      buffer_map,
+                      track_traffic,
+                      longitudinal_parameters,
+                      longitudinal_highway_parameters,
+                      lateral_parameters,
+                      lateral_highway_parameters,
+                      localization_frame,
+                      collision_frame,
+                      tl_frame,
+                      world,
+                      control_frame,
+                      random_devices,
+                      local_map) {
+
+  local_map->SetUp();
+  track_traffic.SetUp(local_map->GetWaypointGraph());
+  parameters.SetSynchronousMode(true);
+}
+
+void ReplayHarness::SetLocalizationShards(const unsigned long in_max_shards) {
+  max_shards = std::max(in_max_shards, 1ul);
+  shard_threads.reset();
+  if (max_shards > 1u) {
+    shard_threads = std::make_unique<ThreadPool>();
+    shard_threads->AsyncRun(max_shards - 1u);
+  }
+}
+
+bool ReplayHarness::Step() {
+
+  if (next_frame >= recording.frames.size()) {
+    return false;
+  }
+  const ReplayFrame &frame = recording.frames[next_frame];
+  ++next_frame;
+
+  const StageProfiler::Clock::time_point cycle_begin = StageProfiler::Clock::now();
+  UpdateActors(frame);
+  StageProfiler::Clock::time_point stage_begin = stage_profiler.Record(ProfiledStage::ALSM, cycle_begin);
+
+  const unsigned long number_of_vehicles = vehicle_id_list.size();
+  localization_frame.clear();
+  localization_frame.resize(number_of_vehicles);
+  collision_frame.clear();
+  collision_frame.resize(number_of_vehicles);
+  tl_frame.clear();
+  tl_frame.resize(number_of_vehicles);
+  control_frame.clear();
+  control_frame.resize(number_of_vehicles);
+  marked_for_removal.clear();
+
+  parameters.TakeSnapshot(vehicle_id_list);
+  stage_begin = StageProfiler::Clock::now();
+
+  if (max_shards > 1u) {
+    ShardedLocalization();
+  } else {
+    for (unsigned long index = 0u; index < number_of_vehicles; ++index) {
+      localization_stage.Update(index);
+    }
+  }
+  stage_begin = stage_profiler.Record(ProfiledStage::Localization, stage_begin);
+  collision_stage.PrepareCycle();
+  for (unsigned long index = 0u; index < number_of_vehicles; ++index) {
+    collision_stage.UpdateGeodesicBoundary(index);
+  }
+  for (unsigned long index = 0u; index < number_of_vehicles; ++index) {
+    collision_stage.Update(index);
+  }
+  collision_stage.ClearCycleCache();
+  stage_begin = stage_profiler.Record(ProfiledStage::Collision, stage_begin);
+  motion_plan_stage.UpdateWorldInfo(
+      cc::Timestamp(frame.frame, frame.elapsed_seconds, frame.delta_seconds, 0.0));
+  for (unsigned long index = 0u; index < number_of_vehicles; ++index) {
+    if (!motion_plan_stage.RespawnsDormantVehicle(index)) {
+      motion_plan_stage.Update(index);
+    }
+  }
+  for (unsigned long index = 0u; index < number_of_vehicles; ++index) {
+    if (motion_plan_stage.RespawnsDormantVehicle(index)) {
+      motion_plan_stage.Update(index);
+    }
+  }
+  motion_plan_stage.IntegrateHybridVehicles();
+  stage_profiler.Record(ProfiledStage::MotionPlan, stage_begin);
+
+  stage_profiler.Record(ProfiledStage::Cycle, cycle_begin);
+  stage_profiler.RecordVehicles(number_of_vehicles);
+  return true;
+}
+
+void ReplayHarness::ShardedLocalization() {
+  localization_stage.PrepareCycle();
+  vehicle_shards.Update(vehicle_id_list, simulation_state, buffer_map, max_shards);
+  vehicle_shards.Run(
+      [this](const unsigned long number_of_tasks, const std::function<void(const unsigned long)> &task) {
+        std::vector<std::future<void>> futures;
+        for (unsigned long index = 1u; index < number_of_tasks; ++index) {
+          futures.emplace_back(shard_threads->Post([&task, index]() {
+            task(index);
+          }));
+        }
+        std::exception_ptr exception;
+        try {
+          task(0u);
+        } catch (...) {
+          exception = std::current_exception();
+        }
+        // The tasks reference the task function, wait for all of them.
+        for (auto &future : futures) {
+          try {
+            future.get();
+          } catch (...) {
+            if (!exception) {
+              exception = std::current_exception();
+            }
+          }
+        }
+        if (exception) {
+          std::rethrow_exception(exception);
+        }
+      },
+      [this](const unsigned long index) {
+        localization_stage.Update(index);
+      });
+}
+
+void ReplayHarness::UpdateActors(const ReplayFrame &frame) {
+
+  // Actors missing from the frame were destroyed.
+  std::unordered_set<ActorId> frame_actors;
+  for (const ReplayActorState &state : frame.actors) {
+    if (recording.FindActor(state.id) != nullptr) {
+      frame_actors.insert(state.id);
+    }
+  }
+  for (auto it = active_actors.begin(); it != active_actors.end();) {
+    if (frame_actors.find(*it) == frame_actors.end()) {
+      RemoveActor(*it, recording.FindActor(*it)->registered);
+      it = active_actors.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  vehicle_id_list.clear();
+  cg::Location hero_location;
+  for (const ReplayActorState &state : frame.actors) {
+    const ReplayActor *actor = recording.FindActor(state.id);
+    if (actor == nullptr) {
+      continue;
+    }
+    const ActorType actor_type = static_cast<ActorType>(actor->actor_type);
+    KinematicState kinematic_state{state.transform.location, state.transform.rotation,
+                                   state.velocity, state.speed_limit,
+                                   true, state.is_dormant, cg::Location()};
+    TrafficLightState tl_state{state.tl_state, state.at_traffic_light};
+
+    if (simulation_state.ContainsActor(state.id)) {
+      simulation_state.UpdateKinematicState(state.id, kinematic_state);
+      simulation_state.UpdateTrafficLightState(state.id, tl_state);
+    } else {
+      StaticAttributes attributes{actor_type, actor->extent.x, actor->extent.y, actor->extent.z};
+      simulation_state.AddActor(state.id, kinematic_state, attributes, tl_state);
+      active_actors.insert(state.id);
+    }
+
+    if (actor->registered) {
+      random_devices.Add(state.id);
+      vehicle_id_list.push_back(state.id);
+    } else {
+      UpdateUnregisteredGridPosition(state, *actor);
+    }
+    if (actor->is_hero && hero_location == cg::Location()) {
+      hero_location = state.transform.location;
+    }
+  }
+  track_traffic.SetHeroLocation(hero_location);
+  std::sort(vehicle_id_list.begin(), vehicle_id_list.end());
+}
+
+void ReplayHarness::RemoveActor(const ActorId actor_id, const bool registered) {
+  if (registered) {
+    buffer_map.erase(actor_id);
+    localization_stage.RemoveActor(actor_id);
+    collision_stage.RemoveActor(actor_id);
+    motion_plan_stage.RemoveActor(actor_id);
+    random_devices.Remove(actor_id);
+  }
+  track_traffic.DeleteActor(actor_id);
+  simulation_state.RemoveActor(actor_id);
+}
+
+void ReplayHarness::UpdateUnregisteredGridPosition(const ReplayActorState &state, const ReplayActor &actor) {
+  const cg::Location location = state.transform.location;
+  std::vector<SimpleWaypointPtr> nearest_waypoints;
+  if (actor.actor_type == static_cast<uint8_t>(ActorType::Vehicle)) {
+    const cg::Vector3D heading_vector = state.transform.GetForwardVector();
+    const std::vector<cg::Location> corners = {location + cg::Location(actor.extent.x * heading_vector),
+                                               location,
+                                               location + cg::Location(-actor.extent.x * heading_vector)};
+    for (const cg::Location &vertex : corners) {
+      nearest_waypoints.push_back(local_map->GetWaypoint(vertex));
+    }
+  } else if (actor.actor_type == static_cast<uint8_t>(ActorType::Pedestrian)) {
+    nearest_waypoints.push_back(local_map->GetWaypoint(location));
+  }
+  track_traffic.UpdateUnregisteredGridPosition(state.id, nearest_waypoints);
+}
+
+} // namespace traffic_manager
+} // namespace carla
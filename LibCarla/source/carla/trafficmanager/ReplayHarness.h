@@ -0,0 +1,135 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "carla/ThreadPool.h"
+#include "carla/client/Map.h"
+#include "carla/client/World.h"
+#include "carla/trafficmanager/CollisionStage.h"
+#include "carla/trafficmanager/DataStructures.h"
+#include "carla/trafficmanager/InMemoryMap.h"
+#include "carla/trafficmanager/LocalizationStage.h"
+#include "carla/trafficmanager/MotionPlanStage.h"
+#include "carla/trafficmanager/Parameters.h"
+#include "carla/trafficmanager/RandomGenerator.h"
+#include "carla/trafficmanager/ReplayRecording.h"
+#include "carla/trafficmanager/SimulationState.h"
+#include "carla/trafficmanager/StageProfiler.h"
+#include "carla/trafficmanager/TrackTraffic.h"
+#include "carla/trafficmanager/VehicleShards.h"
+
+namespace carla {
+namespace traffic_manager {
+
+  /// Runs the localization, collision and motion planner stages of the
+  /// Traffic Manager over a ReplayRecording, without a simulator, to measure
+  /// them and check their output is deterministic.
+  ///
+  /// The harness takes the place of the ALSM and feeds the recorded state of
+  /// the actors to the stages. The commands it produces are not applied, so
+  /// every cycle sees the recorded state, whatever the previous commands
+  /// were. The stages run sequentially, except for the localization in
+  /// sharded mode, and the traffic light stage is left out as it needs a
+  /// live world, so no vehicle stops for a traffic light.
+  class ReplayHarness {
+  public:
+
+    /// Builds the local map of @a map. Replays with the same @a seed produce
+    /// the same commands.
+    ReplayHarness(SharedPtr<client::Map> map, ReplayRecording recording, uint64_t seed = 0u);
+
+    /// Parameters used by the stages. The harness runs in synchronous mode.
+    Parameters &GetParameters() {
+      return parameters;
+    }
+
+    /// Localizes the vehicles split in up to @a max_shards strips that run
+    /// concurrently, as the sharded mode of the Traffic Manager does. With 1,
+    /// the default, they are localized one after the other.
+    void SetLocalizationShards(unsigned long max_shards);
+
+    /// Strips of the vehicles localized in the last cycle in sharded mode.
+    const VehicleShards &GetVehicleShards() const {
+      return vehicle_shards;
+    }
+
+    /// Runs a cycle with the next frame of the recording. Returns false when
+    /// there are no frames left.
+    bool Step();
+
+    /// Index of the next frame to replay.
+    size_t GetFrameIndex() const {
+      return next_frame;
+    }
+
+    /// Vehicles driven in the last cycle, sorted by id.
+    const std::vector<ActorId> &GetVehicleIds() const {
+      return vehicle_id_list;
+    }
+
+    /// Commands produced in the last cycle, in the order of GetVehicleIds().
+    const ControlFrame &GetCommands() const {
+      return control_frame;
+    }
+
+    TrafficManagerTimings GetTimings() const {
+      return stage_profiler.GetTimings();
+    }
+
+  private:
+
+    /// Does the work of the ALSM with the actors of @a frame.
+    void UpdateActors(const ReplayFrame &frame);
+
+    void RemoveActor(ActorId actor_id, bool registered);
+
+    void ShardedLocalization();
+
+    void UpdateUnregisteredGridPosition(const ReplayActorState &state, const ReplayActor &actor);
+
+    const ReplayRecording recording;
+    size_t next_frame = 0u;
+    /// Unused by the replayed stages, which only need a world to be built.
+    const client::World world;
+    LocalMapPtr local_map;
+
+    Parameters parameters;
+    SimulationState simulation_state;
+    TrackTraffic track_traffic;
+    BufferMap buffer_map;
+    RandomGeneratorMap random_devices;
+    std::unordered_set<ActorId> active_actors;
+    std::vector<ActorId> vehicle_id_list;
+    std::vector<ActorId> marked_for_removal;
+    LocalizationFrame localization_frame;
+    CollisionFrame collision_frame;
+    TLFrame tl_frame;
+    ControlFrame control_frame;
+    const std::vector<float> longitudinal_parameters;
+    const std::vector<float> longitudinal_highway_parameters;
+    const std::vector<float> lateral_parameters;
+    const std::vector<float> lateral_highway_parameters;
+
+    LocalizationStage localization_stage;
+    CollisionStage collision_stage;
+    MotionPlanStage motion_plan_stage;
+
+    StageProfiler stage_profiler;
+
+    unsigned long max_shards = 1u;
+    VehicleShards vehicle_shards;
+    /// Threads running all the strips but the first one.
+    std::unique_ptr<ThreadPool> shard_threads;
+  };
+
+} // namespace traffic_manager
+} // namespace carla
@@ -0,0 +1,117 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#include "carla/trafficmanager/ReplayRecording.h"
+
+#include "boost/pointer_cast.hpp"
+#include "carla/Exception.h"
+#include "carla/client/ActorList.h"
+#include "carla/client/Map.h"
+#include "carla/client/Vehicle.h"
+#include "carla/client/Walker.h"
+#include "carla/trafficmanager/SimulationState.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace carla {
+namespace traffic_manager {
+
+void ReplayRecording::Capture(const cc::World &world, const cc::WorldSnapshot &snapshot) {
+
+  if (map_name.empty()) {
+    map_name = world.GetMap()->GetName();
+  }
+
+  // Query the attributes of the actors seen for the first time.
+  std::vector<ActorId> new_actor_ids;
+  for (const auto &actor_snapshot : snapshot) {
+    if (FindActor(actor_snapshot.id) == nullptr) {
+      new_actor_ids.push_back(actor_snapshot.id);
+    }
+  }
+  if (!new_actor_ids.empty()) {
+    for (const auto &actor : *world.GetActors(new_actor_ids)) {
+      const std::string &type_id = actor->GetTypeId();
+      ReplayActor replay_actor;
+      replay_actor.id = actor->GetId();
+      if (type_id.front() == 'v') {
+        replay_actor.actor_type = static_cast<uint8_t>(ActorType::Vehicle);
+        for (auto &&attribute : actor->GetAttributes()) {
+          if (attribute.GetId() == "role_name" && attribute.GetValue() == "hero") {
+            replay_actor.is_hero = true;
+          }
+        }
+        replay_actor.registered = !replay_actor.is_hero;
+        replay_actor.extent = boost::static_pointer_cast<cc::Vehicle>(actor)->GetBoundingBox().extent;
+      } else if (type_id.front() == 'w') {
+        replay_actor.actor_type = static_cast<uint8_t>(ActorType::Pedestrian);
+        replay_actor.extent = boost::static_pointer_cast<cc::Walker>(actor)->GetBoundingBox().extent;
+      } else {
+        replay_actor.actor_type = static_cast<uint8_t>(ActorType::Any);
+      }
+      actors.push_back(replay_actor);
+    }
+    std::sort(actors.begin(), actors.end(), [](const ReplayActor &lhs, const ReplayActor &rhs) {
+      return lhs.id < rhs.id;
+    });
+  }
+
+  const cc::Timestamp &timestamp = snapshot.GetTimestamp();
+  ReplayFrame replay_frame;
+  replay_frame.frame = timestamp.frame;
+  replay_frame.elapsed_seconds = timestamp.elapsed_seconds;
+  replay_frame.delta_seconds = timestamp.delta_seconds;
+  for (const auto &actor_snapshot : snapshot) {
+    const ReplayActor *replay_actor = FindActor(actor_snapshot.id);
+    if (replay_actor == nullptr || replay_actor->actor_type == static_cast<uint8_t>(ActorType::Any)) {
+      continue;
+    }
+    ReplayActorState state;
+    state.id = actor_snapshot.id;
+    state.transform = actor_snapshot.transform;
+    state.velocity = actor_snapshot.velocity;
+    state.is_dormant = actor_snapshot.actor_state == rpc::ActorState::Dormant;
+    if (replay_actor->actor_type == static_cast<uint8_t>(ActorType::Vehicle)) {
+      const auto &vehicle_data = actor_snapshot.state.vehicle_data;
+      state.speed_limit = vehicle_data.speed_limit;
+      state.tl_state = vehicle_data.traffic_light_state;
+      state.at_traffic_light = vehicle_data.has_traffic_light;
+    }
+    replay_frame.actors.push_back(state);
+  }
+  frames.push_back(std::move(replay_frame));
+}
+
+void ReplayRecording::Save(const std::string &path) const {
+  const carla::Buffer buffer = MsgPack::Pack(*this);
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char *>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+  if (!out.good()) {
+    throw_exception(std::runtime_error("unable to write replay recording " + path));
+  }
+}
+
+ReplayRecording ReplayRecording::Load(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in.good()) {
+    throw_exception(std::runtime_error("unable to open replay recording " + path));
+  }
+  const std::vector<unsigned char> content{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+  return MsgPack::UnPack<ReplayRecording>(content.data(), content.size());
+}
+
+const ReplayActor *ReplayRecording::FindActor(const rpc::ActorId id) const {
+  auto it = std::lower_bound(actors.begin(), actors.end(), id, [](const ReplayActor &actor, const rpc::ActorId value) {
+    return actor.id < value;
+  });
+  return (it != actors.end() && it->id == id) ? &*it : nullptr;
+}
+
+} // namespace traffic_manager
+} // namespace carla
@@ -0,0 +1,88 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "carla/MsgPack.h"
+#include "carla/client/World.h"
+#include "carla/client/WorldSnapshot.h"
+#include "carla/geom/Transform.h"
+#include "carla/geom/Vector3D.h"
+#include "carla/rpc/ActorId.h"
+#include "carla/rpc/TrafficLightState.h"
+
+namespace carla {
+namespace traffic_manager {
+
+  /// Static description of an actor seen during a recording.
+  struct ReplayActor {
+    rpc::ActorId id = 0u;
+    /// An ActorType value.
+    uint8_t actor_type = 0u;
+    /// Whether the vehicle is driven by the Traffic Manager when replaying.
+    bool registered = false;
+    /// Whether the vehicle has the "hero" role name.
+    bool is_hero = false;
+    geom::Vector3D extent;
+
+    MSGPACK_DEFINE_ARRAY(id, actor_type, registered, is_hero, extent);
+  };
+
+  /// State of an actor in a recorded frame.
+  struct ReplayActorState {
+    rpc::ActorId id = 0u;
+    geom::Transform transform;
+    geom::Vector3D velocity;
+    float speed_limit = -1.0f;
+    rpc::TrafficLightState tl_state = rpc::TrafficLightState::Unknown;
+    bool at_traffic_light = false;
+    bool is_dormant = false;
+
+    MSGPACK_DEFINE_ARRAY(id, transform, velocity, speed_limit, tl_state, at_traffic_light, is_dormant);
+  };
+
+  struct ReplayFrame {
+    uint64_t frame = 0u;
+    double elapsed_seconds = 0.0;
+    double delta_seconds = 0.0;
+    std::vector<ReplayActorState> actors;
+
+    MSGPACK_DEFINE_ARRAY(frame, elapsed_seconds, delta_seconds, actors);
+  };
+
+  /// Sequence of episode states that the ReplayHarness feeds to the stages of
+  /// the Traffic Manager. It only holds what the ALSM would read from the
+  /// simulator, so it can be replayed without one.
+  class ReplayRecording {
+  public:
+
+    /// Appends the state of the vehicles and walkers in @a snapshot. Actors
+    /// seen for the first time are queried to @a world. Every vehicle is
+    /// registered except those with the "hero" role name.
+    void Capture(const client::World &world, const client::WorldSnapshot &snapshot);
+
+    /// Throws on failure.
+    void Save(const std::string &path) const;
+
+    /// Throws on failure.
+    static ReplayRecording Load(const std::string &path);
+
+    const ReplayActor *FindActor(rpc::ActorId id) const;
+
+    std::string map_name;
+    /// Sorted by id.
+    std::vector<ReplayActor> actors;
+    std::vector<ReplayFrame> frames;
+
+    MSGPACK_DEFINE_ARRAY(map_name, actors, frames);
+  };
+
+} // namespace traffic_manager
+} // namespace carla
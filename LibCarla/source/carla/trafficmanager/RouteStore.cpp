@@ -0,0 +1,139 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#include <algorithm>
+
+#include <boost/container_hash/hash.hpp>
+
+#include "carla/trafficmanager/InMemoryMap.h"
+
+#include "carla/trafficmanager/RouteStore.h"
+
+namespace carla {
+namespace traffic_manager {
+
+namespace {
+
+  size_t HashPath(const Path &path) {
+    size_t seed = path.size();
+    for (const cg::Location &location : path) {
+      boost::hash_combine(seed, location.x);
+      boost::hash_combine(seed, location.y);
+      boost::hash_combine(seed, location.z);
+    }
+    return seed;
+  }
+
+  const Path &GetContent(const SharedPath &path) {
+    return path.GetLocations();
+  }
+
+  const Route &GetContent(const Route &route) {
+    return route;
+  }
+
+  /// Minimum size of a table before its expired entries are swept.
+  static constexpr size_t MIN_SWEEP_SIZE = 64u;
+
+  /// Returns the entry of @a table holding @a content, removing on the way
+  /// the entries with the same hash no vehicle references anymore.
+  template <typename T, typename C>
+  std::shared_ptr<T> FindEntry(RouteStore::Table<T> &table,
+                               const size_t hash,
+                               const C &content) {
+    auto range = table.entries.equal_range(hash);
+    for (auto it = range.first; it != range.second;) {
+      std::shared_ptr<T> entry = it->second.lock();
+      if (entry == nullptr) {
+        it = table.entries.erase(it);
+      } else if (GetContent(*entry) == content) {
+        return entry;
+      } else {
+        ++it;
+      }
+    }
+    return nullptr;
+  }
+
+  /// Adds @a entry to @a table, sweeping the expired entries if the table
+  /// doubled its size since the last sweep.
+  template <typename T>
+  void InsertEntry(RouteStore::Table<T> &table, const size_t hash, const std::shared_ptr<T> &entry) {
+    table.entries.emplace(hash, entry);
+    if (table.entries.size() > std::max(table.sweep_size, MIN_SWEEP_SIZE)) {
+      for (auto it = table.entries.begin(); it != table.entries.end();) {
+        if (it->second.expired()) {
+          it = table.entries.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      table.sweep_size = 2u * table.entries.size();
+    }
+  }
+
+} // namespace
+
+const std::vector<SimpleWaypointPtr> &SharedPath::GetWaypoints(const InMemoryMap &local_map) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!resolved) {
+    waypoints.reserve(locations.size());
+    for (const cg::Location &location : locations) {
+      waypoints.push_back(local_map.GetWaypoint(location));
+    }
+    resolved = true;
+  }
+  return waypoints;
+}
+
+void SharedPath::ClearWaypoints() {
+  std::lock_guard<std::mutex> lock(mutex);
+  waypoints.clear();
+  resolved = false;
+}
+
+RouteStore::SharedPathPtr RouteStore::AddPath(const Path &path) {
+  const size_t hash = HashPath(path);
+  std::lock_guard<std::mutex> lock(mutex);
+  SharedPathPtr entry = FindEntry(paths, hash, path);
+  if (entry == nullptr) {
+    entry = std::make_shared<SharedPath>(path);
+    InsertEntry(paths, hash, entry);
+  }
+  return entry;
+}
+
+RouteStore::SharedRoutePtr RouteStore::AddRoute(const Route &route) {
+  const size_t hash = boost::hash_range(route.begin(), route.end());
+  std::lock_guard<std::mutex> lock(mutex);
+  SharedRoutePtr entry = FindEntry(routes, hash, route);
+  if (entry == nullptr) {
+    entry = std::make_shared<const Route>(route);
+    InsertEntry(routes, hash, entry);
+  }
+  return entry;
+}
+
+void RouteStore::ClearResolvedPaths() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto &entry : paths.entries) {
+    SharedPathPtr path = entry.second.lock();
+    if (path != nullptr) {
+      path->ClearWaypoints();
+    }
+  }
+}
+
+void RouteStore::Clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  paths.entries.clear();
+  paths.sweep_size = 0u;
+  routes.entries.clear();
+  routes.sweep_size = 0u;
+}
+
+} // namespace traffic_manager
+} // namespace carla
@@ -0,0 +1,89 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "carla/geom/Location.h"
+
+#include "carla/trafficmanager/SimpleWaypoint.h"
+
+namespace carla {
+namespace traffic_manager {
+
+namespace cg = carla::geom;
+using Path = std::vector<cg::Location>;
+using Route = std::vector<uint8_t>;
+
+class InMemoryMap;
+
+/// A path imported for one or more vehicles. Its locations are resolved to
+/// waypoints of the local map once, by the first vehicle following it.
+class SharedPath {
+public:
+  explicit SharedPath(Path path)
+    : locations(std::move(path)) {}
+
+  const Path &GetLocations() const {
+    return locations;
+  }
+
+  /// Closest waypoint of @a local_map to each location of the path.
+  const std::vector<SimpleWaypointPtr> &GetWaypoints(const InMemoryMap &local_map);
+
+  /// Forgets the waypoints, which belong to a local map no longer in use.
+  void ClearWaypoints();
+
+private:
+  const Path locations;
+  std::mutex mutex;
+  bool resolved = false;
+  std::vector<SimpleWaypointPtr> waypoints;
+};
+
+/// Paths and routes imported for the vehicles, shared by every vehicle
+/// following the same one. Entries are found by their content and live as
+/// long as a vehicle references them, so a fleet following a few lines
+/// stores and resolves each of them once.
+class RouteStore {
+public:
+  using SharedPathPtr = std::shared_ptr<SharedPath>;
+  using SharedRoutePtr = std::shared_ptr<const Route>;
+
+  /// Entry holding @a path, created if no vehicle follows it yet.
+  SharedPathPtr AddPath(const Path &path);
+
+  /// Entry holding @a route, created if no vehicle follows it yet.
+  SharedRoutePtr AddRoute(const Route &route);
+
+  /// Forgets the waypoints of every path, to be called when the local map
+  /// changes.
+  void ClearResolvedPaths();
+
+  void Clear();
+
+  /// Entries keyed by the hash of their content. A lookup only visits the
+  /// entries with the same hash, and the entries no vehicle references
+  /// anymore are swept once the table doubles its size since the last sweep.
+  template <typename T>
+  struct Table {
+    std::unordered_multimap<size_t, std::weak_ptr<T>> entries;
+    size_t sweep_size = 0u;
+  };
+
+private:
+  std::mutex mutex;
+  Table<SharedPath> paths;
+  Table<const Route> routes;
+};
+
+} // namespace traffic_manager
+} // namespace carla
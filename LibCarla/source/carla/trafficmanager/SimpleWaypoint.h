@@ -6,7 +6,8 @@
 
 #pragma once
 
-#include <memory.h>
+#include <cstddef>
+#include <type_traits>
 
 #include "carla/client/Waypoint.h"
 #include "carla/geom/Location.h"
@@ -15,6 +16,8 @@
 #include "carla/Memory.h"
 #include "carla/road/RoadTypes.h"
 
+#include "carla/trafficmanager/WaypointGraph.h"
+
 namespace carla {
 namespace traffic_manager {
 
@@ -22,51 +25,44 @@ namespace traffic_manager {
   namespace cg = carla::geom;
   using WaypointPtr = carla::SharedPtr<cc::Waypoint>;
   using GeoGridId = carla::road::JuncId;
-  enum class RoadOption : uint8_t {
-    Void = 0,
-    Left = 1,
-    Right = 2,
-    Straight = 3,
-    LaneFollow = 4,
-    ChangeLaneLeft = 5,
-    ChangeLaneRight = 6,
-    RoadEnd = 7
-  };
 
-  /// This is a simple wrapper class on Carla's waypoint object.
-  /// The class is used to represent discrete samples of the world map.
+  /// This class represents a discrete sample of the world map. It is a handle
+  /// to a waypoint of a WaypointGraph, where its attributes and links are
+  /// stored, and is only valid while the graph is.
   class SimpleWaypoint {
 
-    using SimpleWaypointPtr = std::shared_ptr<SimpleWaypoint>;
-
   private:
 
-    /// Pointer to Carla's waypoint object around which this class wraps around.
-    WaypointPtr waypoint;
-    /// List of pointers to next connecting waypoints.
-    std::vector<SimpleWaypointPtr> next_waypoints;
-    /// List of pointers to previous connecting waypoints.
-    std::vector<SimpleWaypointPtr> previous_waypoints;
-    /// Pointer to left lane change waypoint.
-    SimpleWaypointPtr next_left_waypoint;
-    /// Pointer to right lane change waypoint.
-    SimpleWaypointPtr next_right_waypoint;
-    /// RoadOption for the actual waypoint.
-    RoadOption road_option = RoadOption::Void;
-    /// Integer placing the waypoint into a geodesic grid.
-    GeoGridId geodesic_grid_id = 0;
-    // Boolean to hold if the waypoint belongs to a junction
-    bool _is_junction = false;
+    friend class SimpleWaypointPtr;
+
+    /// Graph holding the waypoint.
+    const WaypointGraph *graph = nullptr;
+    /// Position of the waypoint in the graph.
+    WaypointIndex index = INVALID_WAYPOINT_INDEX;
 
   public:
 
-    SimpleWaypoint(WaypointPtr _waypoint);
-    ~SimpleWaypoint();
+    SimpleWaypoint() = default;
+    SimpleWaypoint(const WaypointGraph &graph, WaypointIndex index);
+
+    /// Returns the graph holding the waypoint.
+    const WaypointGraph &GetGraph() const {
+      return *graph;
+    }
+
+    /// Returns the position of the waypoint in its graph.
+    WaypointIndex GetIndex() const {
+      return index;
+    }
 
     /// Returns the location object for this waypoint.
-    cg::Location GetLocation() const;
+    cg::Location GetLocation() const {
+      return graph->GetLocation(index);
+    }
 
-    /// Returns a carla::shared_ptr to carla::waypoint.
+    /// Returns a carla::shared_ptr to a carla::waypoint, created from the map
+    /// on every call. Meant for the results returned to the user, the stages
+    /// use the attributes stored in the graph.
     WaypointPtr GetWaypoint() const;
 
     /// Returns the list of next waypoints.
@@ -76,35 +72,44 @@ namespace traffic_manager {
     std::vector<SimpleWaypointPtr> GetPreviousWaypoint() const;
 
     /// Returns the vector along the waypoint's direction.
-    cg::Vector3D GetForwardVector() const;
+    cg::Vector3D GetForwardVector() const {
+      return graph->GetForwardVector(index);
+    }
 
     /// Returns the unique id for the waypoint.
-    uint64_t GetId() const;
-
-    /// This method is used to set the next waypoints.
-    uint64_t SetNextWaypoint(const std::vector<SimpleWaypointPtr> &next_waypoints);
-
-    /// This method is used to set the previous waypoints.
-    uint64_t SetPreviousWaypoint(const std::vector<SimpleWaypointPtr> &next_waypoints);
-
-    /// This method is used to set the closest left waypoint for a lane change.
-    void SetLeftWaypoint(SimpleWaypointPtr &waypoint);
-
-    /// This method is used to set the closest right waypoint for a lane change.
-    void SetRightWaypoint(SimpleWaypointPtr &waypoint);
+    uint64_t GetId() const {
+      return graph->GetId(index);
+    }
+
+    /// Accessors to the OpenDRIVE position of the waypoint.
+    carla::road::RoadId GetRoadId() const {
+      return graph->GetRoadId(index);
+    }
+    carla::road::SectionId GetSectionId() const {
+      return graph->GetSectionId(index);
+    }
+    carla::road::LaneId GetLaneId() const {
+      return graph->GetLaneId(index);
+    }
+    double GetDistance() const {
+      return graph->GetDistance(index);
+    }
 
     /// This method is used to get the closest left waypoint for a lane change.
-    SimpleWaypointPtr GetLeftWaypoint();
+    SimpleWaypointPtr GetLeftWaypoint() const;
 
     /// This method is used to get the closest right waypoint for a lane change.
-    SimpleWaypointPtr GetRightWaypoint();
+    SimpleWaypointPtr GetRightWaypoint() const;
 
-    /// Accessor methods for geodesic grid id.
-    void SetGeodesicGridId(GeoGridId _geodesic_grid_id);
-    GeoGridId GetGeodesicGridId();
+    /// Accessor method for geodesic grid id.
+    GeoGridId GetGeodesicGridId() const {
+      return graph->GetGeodesicGridId(index);
+    }
 
     /// Method to retreive junction id of the waypoint.
-    GeoGridId GetJunctionId() const;
+    GeoGridId GetJunctionId() const {
+      return graph->GetJunctionId(index);
+    }
 
     /// Calculates the distance from the object's waypoint to the passed
     /// location.
@@ -120,21 +125,79 @@ namespace traffic_manager {
     float DistanceSquared(const SimpleWaypointPtr &other) const;
 
     /// Returns true if the object's waypoint belongs to an intersection.
-    bool CheckJunction() const;
-
-    /// This method is used to set whether the waypoint belongs to a junction.
-    void SetIsJunction(bool value);
+    bool CheckJunction() const {
+      return graph->IsJunction(index);
+    }
 
     /// Returns true if the object's waypoint belongs to an intersection (Doesn't use OpenDrive).
-    bool CheckIntersection() const;
+    bool CheckIntersection() const {
+      return graph->GetNumberOfSuccessors(index) > 1u;
+    }
 
     /// Return transform object for the current waypoint.
-    cg::Transform GetTransform() const;
+    cg::Transform GetTransform() const {
+      return graph->GetTransform(index);
+    }
+
+    // Accessor method for road option.
+    RoadOption GetRoadOption() const {
+      return graph->GetRoadOption(index);
+    }
+  };
+
+  /// Handle to a waypoint of a WaypointGraph, used as a pointer to its
+  /// SimpleWaypoint. It only holds the graph and the index of the waypoint,
+  /// so copying it is as cheap as copying two words and never touches a
+  /// reference counter. A default constructed handle is null.
+  class SimpleWaypointPtr {
+  public:
 
-    // Accessor methods for road option.
-    void SetRoadOption(RoadOption _road_option);
-    RoadOption GetRoadOption();
+    SimpleWaypointPtr() = default;
+
+    SimpleWaypointPtr(std::nullptr_t) {}
+
+    SimpleWaypointPtr(const WaypointGraph &graph, WaypointIndex index)
+      : _waypoint(graph, index) {}
+
+    const SimpleWaypoint *operator->() const {
+      return &_waypoint;
+    }
+
+    const SimpleWaypoint &operator*() const {
+      return _waypoint;
+    }
+
+    explicit operator bool() const {
+      return _waypoint.graph != nullptr;
+    }
+
+    bool operator==(const SimpleWaypointPtr &rhs) const {
+      return _waypoint.graph == rhs._waypoint.graph && _waypoint.index == rhs._waypoint.index;
+    }
+
+    bool operator!=(const SimpleWaypointPtr &rhs) const {
+      return !(*this == rhs);
+    }
+
+    bool operator==(std::nullptr_t) const {
+      return _waypoint.graph == nullptr;
+    }
+
+    bool operator!=(std::nullptr_t) const {
+      return _waypoint.graph != nullptr;
+    }
+
+  private:
+
+    SimpleWaypoint _waypoint;
   };
 
+  static_assert(std::is_trivially_copyable<SimpleWaypointPtr>::value,
+      "SimpleWaypointPtr must be trivially copyable.");
+
+  inline SimpleWaypointPtr WaypointGraph::GetNode(const WaypointIndex index) const {
+    return SimpleWaypointPtr(*this, index);
+  }
+
 } // namespace traffic_manager
 } // namespace carla
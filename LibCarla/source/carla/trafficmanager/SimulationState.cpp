@@ -27,6 +27,10 @@ void SimulationState::RemoveActor(ActorId actor_id) {
   tl_state_map.erase(actor_id);
 }
 
+const std::unordered_set<ActorId> &SimulationState::GetActorIds() const {
+  return actor_set;
+}
+
 void SimulationState::Reset() {
   actor_set.clear();
   kinematic_state_map.clear();
@@ -67,6 +67,9 @@ public :
   // Method to remove an actor from simulation state.
   void RemoveActor(ActorId actor_id);
 
+  // Method to retrieve the ids of all the actors in the simulation state.
+  const std::unordered_set<ActorId> &GetActorIds() const;
+
   // Method to flush all states and actors.
   void Reset();
 
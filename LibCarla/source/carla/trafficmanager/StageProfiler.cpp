@@ -0,0 +1,153 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#include "carla/trafficmanager/StageProfiler.h"
+
+#include <algorithm>
+
+namespace carla {
+namespace traffic_manager {
+
+  static const char *GetStageName(const ProfiledStage stage) {
+    switch (stage) {
+      case ProfiledStage::ALSM:         return "alsm";
+      case ProfiledStage::Localization: return "localization";
+      case ProfiledStage::Collision:    return "collision";
+      case ProfiledStage::TrafficLight: return "traffic_light";
+      case ProfiledStage::MotionPlan:   return "motion_plan";
+      case ProfiledStage::VehicleLight: return "vehicle_light";
+      case ProfiledStage::ApplyBatch:   return "apply_batch";
+      case ProfiledStage::Cycle:        return "cycle";
+      default:                          return "unknown";
+    }
+  }
+
+  // ===========================================================================
+  // -- StageProfiler::Histogram -----------------------------------------------
+  // ===========================================================================
+
+  constexpr uint64_t StageProfiler::Histogram::EXACT_RANGE;
+
+  size_t StageProfiler::Histogram::GetBucket(const uint64_t microseconds) {
+    if (microseconds < EXACT_RANGE) {
+      return static_cast<size_t>(microseconds);
+    }
+    unsigned exponent = 0u;
+    for (uint64_t value = microseconds; value > 1u; value >>= 1u) {
+      ++exponent;
+    }
+    if (exponent >= MAX_EXPONENT) {
+      return NUMBER_OF_BUCKETS - 1u;
+    }
+    const uint64_t sub_bucket = (microseconds >> (exponent - SUB_BUCKET_BITS)) & ((1u << SUB_BUCKET_BITS) - 1u);
+    return static_cast<size_t>(
+        EXACT_RANGE + (exponent - SUB_BUCKET_BITS - 1u) * (1u << SUB_BUCKET_BITS) + sub_bucket);
+  }
+
+  double StageProfiler::Histogram::GetBucketValue(const size_t bucket) {
+    if (bucket < EXACT_RANGE) {
+      return static_cast<double>(bucket);
+    }
+    const size_t offset = bucket - EXACT_RANGE;
+    const unsigned exponent = static_cast<unsigned>(offset >> SUB_BUCKET_BITS) + SUB_BUCKET_BITS + 1u;
+    const uint64_t sub_bucket = offset & ((1u << SUB_BUCKET_BITS) - 1u);
+    const uint64_t width = uint64_t(1u) << (exponent - SUB_BUCKET_BITS);
+    const uint64_t lower = (uint64_t(1u) << exponent) + sub_bucket * width;
+    return static_cast<double>(lower) + 0.5 * static_cast<double>(width);
+  }
+
+  void StageProfiler::Histogram::Add(const uint64_t microseconds) {
+    ++buckets[GetBucket(microseconds)];
+    ++count;
+    sum += microseconds;
+    max = std::max(max, microseconds);
+  }
+
+  double StageProfiler::Histogram::Percentile(const double fraction) const {
+    const uint64_t rank = std::max<uint64_t>(1u, static_cast<uint64_t>(fraction * static_cast<double>(count) + 0.5));
+    uint64_t accumulated = 0u;
+    for (size_t bucket = 0u; bucket < NUMBER_OF_BUCKETS; ++bucket) {
+      accumulated += buckets[bucket];
+      if (accumulated >= rank) {
+        return std::min(GetBucketValue(bucket), static_cast<double>(max));
+      }
+    }
+    return static_cast<double>(max);
+  }
+
+  StageTimings StageProfiler::Histogram::GetTimings(std::string name) const {
+    constexpr double MILLISECONDS = 1e-3;
+    StageTimings timings;
+    timings.name = std::move(name);
+    timings.count = count;
+    if (count > 0u) {
+      timings.mean = MILLISECONDS * static_cast<double>(sum) / static_cast<double>(count);
+      timings.p50 = MILLISECONDS * Percentile(0.50);
+      timings.p90 = MILLISECONDS * Percentile(0.90);
+      timings.p99 = MILLISECONDS * Percentile(0.99);
+      timings.max = MILLISECONDS * static_cast<double>(max);
+    }
+    return timings;
+  }
+
+  void StageProfiler::Histogram::Clear() {
+    buckets.fill(0u);
+    count = 0u;
+    sum = 0u;
+    max = 0u;
+  }
+
+  // ===========================================================================
+  // -- StageProfiler ----------------------------------------------------------
+  // ===========================================================================
+
+  void StageProfiler::Record(const ProfiledStage stage, const Clock::duration duration) {
+    const auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    std::lock_guard<std::mutex> lock(mutex);
+    histograms[static_cast<size_t>(stage)].Add(static_cast<uint64_t>(std::max<decltype(microseconds)>(0, microseconds)));
+  }
+
+  StageProfiler::Clock::time_point StageProfiler::Record(const ProfiledStage stage, const Clock::time_point begin) {
+    const Clock::time_point end = Clock::now();
+    Record(stage, end - begin);
+    return end;
+  }
+
+  void StageProfiler::RecordVehicles(const uint64_t number_of_vehicles) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++cycles;
+    last_vehicles = number_of_vehicles;
+    total_vehicles += number_of_vehicles;
+    max_vehicles = std::max(max_vehicles, number_of_vehicles);
+  }
+
+  TrafficManagerTimings StageProfiler::GetTimings() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    TrafficManagerTimings timings;
+    timings.cycles = cycles;
+    timings.vehicles = last_vehicles;
+    timings.mean_vehicles = cycles > 0u ? static_cast<double>(total_vehicles) / static_cast<double>(cycles) : 0.0;
+    timings.max_vehicles = max_vehicles;
+    timings.stages.reserve(histograms.size());
+    for (size_t i = 0u; i < histograms.size(); ++i) {
+      timings.stages.emplace_back(histograms[i].GetTimings(GetStageName(static_cast<ProfiledStage>(i))));
+    }
+    return timings;
+  }
+
+  void StageProfiler::Reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &histogram : histograms) {
+      histogram.Clear();
+    }
+    cycles = 0u;
+    last_vehicles = 0u;
+    total_vehicles = 0u;
+    max_vehicles = 0u;
+  }
+
+} // namespace traffic_manager
+} // namespace carla
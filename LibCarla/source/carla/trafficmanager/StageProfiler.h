@@ -0,0 +1,130 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "carla/MsgPack.h"
+
+namespace carla {
+namespace traffic_manager {
+
+  /// Parts of the Traffic Manager cycle timed by the StageProfiler.
+  enum class ProfiledStage : uint8_t {
+    ALSM,
+    Localization,
+    Collision,
+    TrafficLight,
+    MotionPlan,
+    VehicleLight,
+    /// Round trip of the batch of commands sent to the simulator.
+    ApplyBatch,
+    /// Whole cycle, from the update of the actors to the batch round trip.
+    Cycle,
+    SIZE
+  };
+
+  /// Timing statistics of a part of the Traffic Manager cycle. Durations are
+  /// in milliseconds.
+  struct StageTimings {
+    std::string name;
+    /// Number of cycles measured.
+    uint64_t count = 0u;
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p90 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+
+    MSGPACK_DEFINE_ARRAY(name, count, mean, p50, p90, p99, max);
+  };
+
+  /// Timing statistics of the Traffic Manager since they were last reset.
+  struct TrafficManagerTimings {
+    /// Number of cycles measured.
+    uint64_t cycles = 0u;
+    /// Number of registered vehicles in the last cycle.
+    uint64_t vehicles = 0u;
+    double mean_vehicles = 0.0;
+    uint64_t max_vehicles = 0u;
+    /// One entry for each ProfiledStage, in the same order.
+    std::vector<StageTimings> stages;
+
+    MSGPACK_DEFINE_ARRAY(cycles, vehicles, mean_vehicles, max_vehicles, stages);
+  };
+
+  /// Accumulates the duration of each part of the Traffic Manager cycle in
+  /// histograms, from which percentiles are estimated with a relative error
+  /// of at most 1/32. Recording and querying can happen from different threads.
+  class StageProfiler {
+  public:
+
+    using Clock = std::chrono::steady_clock;
+
+    /// Adds a measure of @a stage.
+    void Record(ProfiledStage stage, Clock::duration duration);
+
+    /// Same as above, measured from @a begin until now. Returns now.
+    Clock::time_point Record(ProfiledStage stage, Clock::time_point begin);
+
+    /// Adds the number of vehicles updated in a cycle.
+    void RecordVehicles(uint64_t number_of_vehicles);
+
+    TrafficManagerTimings GetTimings() const;
+
+    void Reset();
+
+  private:
+
+    /// Log-linear histogram of durations in microseconds: exact below 32 us,
+    /// then 16 buckets for each power of two.
+    class Histogram {
+    public:
+
+      void Add(uint64_t microseconds);
+
+      StageTimings GetTimings(std::string name) const;
+
+      void Clear();
+
+    private:
+
+      static constexpr unsigned SUB_BUCKET_BITS = 4u;
+      static constexpr uint64_t EXACT_RANGE = 2u << SUB_BUCKET_BITS;
+      static constexpr unsigned MAX_EXPONENT = 40u;
+      /// The last bucket holds every duration of 2^MAX_EXPONENT us or more.
+      static constexpr size_t NUMBER_OF_BUCKETS =
+          EXACT_RANGE + (MAX_EXPONENT - SUB_BUCKET_BITS - 1u) * (1u << SUB_BUCKET_BITS) + 1u;
+
+      static size_t GetBucket(uint64_t microseconds);
+
+      /// Middle of the range of values of @a bucket, in microseconds.
+      static double GetBucketValue(size_t bucket);
+
+      double Percentile(double fraction) const;
+
+      std::array<uint64_t, NUMBER_OF_BUCKETS> buckets{};
+      uint64_t count = 0u;
+      uint64_t sum = 0u;
+      uint64_t max = 0u;
+    };
+
+    mutable std::mutex mutex;
+    std::array<Histogram, static_cast<size_t>(ProfiledStage::SIZE)> histograms;
+    uint64_t cycles = 0u;
+    uint64_t last_vehicles = 0u;
+    uint64_t total_vehicles = 0u;
+    uint64_t max_vehicles = 0u;
+  };
+
+} // namespace traffic_manager
+} // namespace carla
@@ -1,4 +1,8 @@
 
+#include <algorithm>
+
+#include "carla/Debug.h"
+
 #include "carla/trafficmanager/Constants.h"
 
 #include "carla/trafficmanager/TrackTraffic.h"
@@ -11,82 +15,197 @@ using constants::TrackTraffic::INV_BUFFER_STEP_THROUGH;
 
 TrackTraffic::TrackTraffic() {}
 
-void TrackTraffic::UpdateUnregisteredGridPosition(const ActorId actor_id,
-                                                  const std::vector<SimpleWaypointPtr> waypoints) {
+TrackTraffic::Partition &TrackTraffic::GetPartition(const uint64_t key) {
+    // Fibonacci hashing, consecutive waypoint, actor and grid ids end up in
+    // different partitions.
+    return partitions[(key * 0x9E3779B97F4A7C15ull) >> (64u - NUMBER_OF_PARTITIONS_LOG2)];
+}
 
-    DeleteActor(actor_id);
+const TrackTraffic::Partition &TrackTraffic::GetPartition(const uint64_t key) const {
+    return partitions[(key * 0x9E3779B97F4A7C15ull) >> (64u - NUMBER_OF_PARTITIONS_LOG2)];
+}
 
-    std::unordered_set<GeoGridId> current_grids;
-    // Step through waypoints and update grid list for actor and actor list for grids.
-    for (auto &waypoint : waypoints) {
-        UpdatePassingVehicle(waypoint->GetId(), actor_id);
+void TrackTraffic::SetUp(const WaypointGraph &waypoint_graph) {
+    Clear();
 
-        GeoGridId ggid = waypoint->GetGeodesicGridId();
-        current_grids.insert(ggid);
+    GeoGridId number_of_grids = 0;
+    for (WaypointIndex index = 0u; index < waypoint_graph.Size(); ++index) {
+        number_of_grids = std::max(number_of_grids, waypoint_graph.GetGeodesicGridId(index) + 1);
+    }
+    graph = &waypoint_graph;
+    waypoint_overlap_tracker.assign(waypoint_graph.Size(), Occupants());
+    grid_to_actors.assign(static_cast<size_t>(number_of_grids), Occupants());
+}
 
-        if (grid_to_actors.find(ggid) != grid_to_actors.end()) {
-            ActorIdSet &actor_ids = grid_to_actors.at(ggid);
-            if (actor_ids.find(actor_id) == actor_ids.end()) {
-                actor_ids.insert(actor_id);
-            }
-        } else {
-            grid_to_actors.insert({ggid, {actor_id}});
-        }
+void TrackTraffic::AddOccupant(Occupants &occupants, const uint64_t key, const ActorId actor_id) {
+    Partition &partition = GetPartition(key);
+    std::lock_guard<std::mutex> lock(partition.mutex);
+    occupants.push_back(actor_id);
+}
+
+void TrackTraffic::RemoveOccupant(Occupants &occupants, const uint64_t key, const ActorId actor_id) {
+    Partition &partition = GetPartition(key);
+    std::lock_guard<std::mutex> lock(partition.mutex);
+    auto it = std::find(occupants.begin(), occupants.end(), actor_id);
+    if (it != occupants.end()) {
+        *it = occupants.back();
+        occupants.pop_back();
     }
+}
 
-    actor_to_grids.insert({actor_id, current_grids});
+void TrackTraffic::AddPassingVehicle(const WaypointIndex index, const ActorId actor_id) {
+    DEBUG_ASSERT(index < waypoint_overlap_tracker.size());
+    AddOccupant(waypoint_overlap_tracker[index], index, actor_id);
+
+    // Count the waypoints of the path in each grid, the actor is registered
+    // in the grid on its next grid update.
+    const GeoGridId grid_id = graph->GetGeodesicGridId(index);
+    Partition &partition = GetPartition(actor_id);
+    std::lock_guard<std::mutex> lock(partition.mutex);
+    ActorOccupancy &occupancy = partition.actors[actor_id];
+    occupancy.waypoints.push_back(index);
+    auto it = std::find_if(occupancy.path_grids.begin(), occupancy.path_grids.end(),
+                           [grid_id](const std::pair<GeoGridId, uint32_t> &entry) {
+                               return entry.first == grid_id;
+                           });
+    if (it != occupancy.path_grids.end()) {
+        ++it->second;
+    } else {
+        occupancy.path_grids.emplace_back(grid_id, 1u);
+    }
 }
 
-void TrackTraffic::UpdateGridPosition(const ActorId actor_id, const Buffer &buffer) {
-    if (!buffer.empty()) {
+void TrackTraffic::RemovePassingVehicle(const WaypointIndex index, const ActorId actor_id) {
+    {
+        Partition &partition = GetPartition(actor_id);
+        std::lock_guard<std::mutex> lock(partition.mutex);
+        auto actor_it = partition.actors.find(actor_id);
+        if (actor_it == partition.actors.end()) {
+            return;
+        }
+        ActorOccupancy &occupancy = actor_it->second;
+        // Waypoints mostly leave from the front of the path.
+        auto it = std::find(occupancy.waypoints.begin(), occupancy.waypoints.end(), index);
+        if (it == occupancy.waypoints.end()) {
+            return;
+        }
+        occupancy.waypoints.erase(it);
+
+        const GeoGridId grid_id = graph->GetGeodesicGridId(index);
+        auto grid_it = std::find_if(occupancy.path_grids.begin(), occupancy.path_grids.end(),
+                                    [grid_id](const std::pair<GeoGridId, uint32_t> &entry) {
+                                        return entry.first == grid_id;
+                                    });
+        if (grid_it != occupancy.path_grids.end() && --grid_it->second == 0u) {
+            *grid_it = occupancy.path_grids.back();
+            occupancy.path_grids.pop_back();
+        }
+    }
+
+    RemoveOccupant(waypoint_overlap_tracker[index], index, actor_id);
+}
 
-        // Clear current actor from all grids containing itself.
-        if (actor_to_grids.find(actor_id) != actor_to_grids.end()) {
-            std::unordered_set<GeoGridId> &current_grids = actor_to_grids.at(actor_id);
-            for (auto &grid_id : current_grids) {
-                if (grid_to_actors.find(grid_id) != grid_to_actors.end()) {
-                    ActorIdSet &actor_ids = grid_to_actors.at(grid_id);
-                    actor_ids.erase(actor_id);
-                }
-            }
+void TrackTraffic::UpdateUnregisteredGridPosition(const ActorId actor_id,
+                                                  const std::vector<SimpleWaypointPtr> &waypoints) {
+
+    std::vector<WaypointIndex> current_waypoints;
+    {
+        Partition &partition = GetPartition(actor_id);
+        std::lock_guard<std::mutex> lock(partition.mutex);
+        auto it = partition.actors.find(actor_id);
+        if (it != partition.actors.end()) {
+            current_waypoints = it->second.waypoints;
+        }
+    }
 
-            actor_to_grids.erase(actor_id);
+    // Only the waypoints the actor left or reached are updated.
+    std::vector<WaypointIndex> new_waypoints;
+    new_waypoints.reserve(waypoints.size());
+    for (auto &waypoint : waypoints) {
+        new_waypoints.push_back(waypoint->GetIndex());
+    }
+    for (const WaypointIndex index : current_waypoints) {
+        auto it = std::find(new_waypoints.begin(), new_waypoints.end(), index);
+        if (it != new_waypoints.end()) {
+            *it = new_waypoints.back();
+            new_waypoints.pop_back();
+        } else {
+            RemovePassingVehicle(index, actor_id);
         }
+    }
+    for (const WaypointIndex index : new_waypoints) {
+        AddPassingVehicle(index, actor_id);
+    }
 
-        // Step through buffer and update grid list for actor and actor list for grids.
-        std::unordered_set<GeoGridId> current_grids;
-        uint64_t buffer_size = buffer.size();
-        for (uint64_t i = 0u; i <= buffer_size - 1u; ++i) {
-            auto waypoint = buffer.at(i);
-            GeoGridId ggid = waypoint->GetGeodesicGridId();
-            current_grids.insert(ggid);
-            // Add grid entry if not present.
-            if (grid_to_actors.find(ggid) == grid_to_actors.end()) {
-                grid_to_actors.insert({ggid, {}});
-            }
+    UpdateGridPosition(actor_id);
+}
 
-            ActorIdSet &actor_ids = grid_to_actors.at(ggid);
-            if (actor_ids.find(actor_id) == actor_ids.end()) {
-                actor_ids.insert(actor_id);
+void TrackTraffic::UpdateGridPosition(const ActorId actor_id) {
+    std::vector<GeoGridId> entering_grids;
+    std::vector<GeoGridId> leaving_grids;
+    {
+        Partition &partition = GetPartition(actor_id);
+        std::lock_guard<std::mutex> lock(partition.mutex);
+        auto it = partition.actors.find(actor_id);
+        if (it == partition.actors.end()) {
+            return;
+        }
+        ActorOccupancy &occupancy = it->second;
+        for (const GeoGridId grid_id : occupancy.grids) {
+            if (std::none_of(occupancy.path_grids.begin(), occupancy.path_grids.end(),
+                             [grid_id](const std::pair<GeoGridId, uint32_t> &entry) {
+                                 return entry.first == grid_id;
+                             })) {
+                leaving_grids.push_back(grid_id);
             }
         }
+        for (const auto &entry : occupancy.path_grids) {
+            if (std::find(occupancy.grids.begin(), occupancy.grids.end(), entry.first) == occupancy.grids.end()) {
+                entering_grids.push_back(entry.first);
+            }
+        }
+        if (entering_grids.empty() && leaving_grids.empty()) {
+            return;
+        }
+        occupancy.grids.clear();
+        for (const auto &entry : occupancy.path_grids) {
+            occupancy.grids.push_back(entry.first);
+        }
+    }
 
-        actor_to_grids.insert({actor_id, current_grids});
+    for (const GeoGridId grid_id : leaving_grids) {
+        RemoveOccupant(grid_to_actors[static_cast<size_t>(grid_id)], static_cast<uint64_t>(grid_id), actor_id);
+    }
+    for (const GeoGridId grid_id : entering_grids) {
+        AddOccupant(grid_to_actors[static_cast<size_t>(grid_id)], static_cast<uint64_t>(grid_id), actor_id);
     }
 }
 
 
 bool TrackTraffic::IsGeoGridFree(const GeoGridId geogrid_id) const {
-    if (grid_to_actors.find(geogrid_id) != grid_to_actors.end()) {
-        return grid_to_actors.at(geogrid_id).empty();
-    }
-    return true;
+    DEBUG_ASSERT(static_cast<size_t>(geogrid_id) < grid_to_actors.size());
+    const Partition &partition = GetPartition(static_cast<uint64_t>(geogrid_id));
+    std::lock_guard<std::mutex> lock(partition.mutex);
+    return grid_to_actors[static_cast<size_t>(geogrid_id)].empty();
 }
 
 void TrackTraffic::AddTakenGrid(const GeoGridId geogrid_id, const ActorId actor_id) {
-    if (grid_to_actors.find(geogrid_id) == grid_to_actors.end()) {
-        grid_to_actors.insert({geogrid_id, {actor_id}});
+    DEBUG_ASSERT(static_cast<size_t>(geogrid_id) < grid_to_actors.size());
+    {
+        Partition &partition = GetPartition(static_cast<uint64_t>(geogrid_id));
+        std::lock_guard<std::mutex> lock(partition.mutex);
+        Occupants &occupants = grid_to_actors[static_cast<size_t>(geogrid_id)];
+        if (!occupants.empty()) {
+            return;
+        }
+        occupants.push_back(actor_id);
     }
+
+    // The grid is released when it is not in the path of the actor on its
+    // next grid update.
+    Partition &partition = GetPartition(actor_id);
+    std::lock_guard<std::mutex> lock(partition.mutex);
+    partition.actors[actor_id].grids.push_back(geogrid_id);
 }
 
 
@@ -101,93 +220,101 @@ cg::Location TrackTraffic::GetHeroLocation() const {
 ActorIdSet TrackTraffic::GetOverlappingVehicles(ActorId actor_id) const {
     ActorIdSet actor_id_set;
 
-    if (actor_to_grids.find(actor_id) != actor_to_grids.end()) {
-        const std::unordered_set<GeoGridId> &grid_ids = actor_to_grids.at(actor_id);
-        for (auto &grid_id : grid_ids) {
-            if (grid_to_actors.find(grid_id) != grid_to_actors.end()) {
-                const ActorIdSet &actor_ids = grid_to_actors.at(grid_id);
-                actor_id_set.insert(actor_ids.begin(), actor_ids.end());
-            }
+    std::vector<GeoGridId> grid_ids;
+    {
+        const Partition &partition = GetPartition(actor_id);
+        std::lock_guard<std::mutex> lock(partition.mutex);
+        auto it = partition.actors.find(actor_id);
+        if (it == partition.actors.end()) {
+            return actor_id_set;
         }
+        grid_ids = it->second.grids;
+    }
+
+    for (const GeoGridId grid_id : grid_ids) {
+        const Partition &partition = GetPartition(static_cast<uint64_t>(grid_id));
+        std::lock_guard<std::mutex> lock(partition.mutex);
+        const Occupants &occupants = grid_to_actors[static_cast<size_t>(grid_id)];
+        actor_id_set.insert(occupants.begin(), occupants.end());
     }
 
     return actor_id_set;
 }
 
-void TrackTraffic::DeleteActor(ActorId actor_id) {
-    if (actor_to_grids.find(actor_id) != actor_to_grids.end()) {
-        std::unordered_set<GeoGridId> &grid_ids = actor_to_grids.at(actor_id);
-        for (auto &grid_id : grid_ids) {
-            if (grid_to_actors.find(grid_id) != grid_to_actors.end()) {
-                ActorIdSet &actor_ids = grid_to_actors.at(grid_id);
-                actor_ids.erase(actor_id);
-                }
-            }
-        actor_to_grids.erase(actor_id);
-    }
-
-    if (waypoint_occupied.find(actor_id) != waypoint_occupied.end()) {
-        WaypointIdSet waypoint_id_set = waypoint_occupied.at(actor_id);
-        for (const uint64_t &waypoint_id : waypoint_id_set) {
-            RemovePassingVehicle(waypoint_id, actor_id);
-        }
+std::vector<GeoGridId> TrackTraffic::GetGrids(ActorId actor_id) const {
+    const Partition &partition = GetPartition(actor_id);
+    std::lock_guard<std::mutex> lock(partition.mutex);
+    auto it = partition.actors.find(actor_id);
+    if (it == partition.actors.end()) {
+        return {};
     }
+    return it->second.grids;
 }
 
-void TrackTraffic::UpdatePassingVehicle(uint64_t waypoint_id, ActorId actor_id) {
-    if (waypoint_overlap_tracker.find(waypoint_id) != waypoint_overlap_tracker.end()) {
-        ActorIdSet &actor_id_set = waypoint_overlap_tracker.at(waypoint_id);
-        if (actor_id_set.find(actor_id) == actor_id_set.end()) {
-            actor_id_set.insert(actor_id);
-        }
-    } else {
-        waypoint_overlap_tracker.insert({waypoint_id, {actor_id}});
+bool TrackTraffic::IsInAnyGrid(ActorId actor_id, const std::vector<GeoGridId> &grid_ids) const {
+    const Partition &partition = GetPartition(actor_id);
+    std::lock_guard<std::mutex> lock(partition.mutex);
+    auto it = partition.actors.find(actor_id);
+    if (it == partition.actors.end()) {
+        return false;
     }
-
-    if (waypoint_occupied.find(actor_id) != waypoint_occupied.end()) {
-        WaypointIdSet &waypoint_id_set = waypoint_occupied.at(actor_id);
-        if (waypoint_id_set.find(waypoint_id) == waypoint_id_set.end()) {
-            waypoint_id_set.insert(waypoint_id);
+    for (const GeoGridId grid_id : it->second.grids) {
+        if (std::find(grid_ids.begin(), grid_ids.end(), grid_id) != grid_ids.end()) {
+            return true;
         }
-    } else {
-        waypoint_occupied.insert({actor_id, {waypoint_id}});
     }
+    return false;
 }
 
-void TrackTraffic::RemovePassingVehicle(uint64_t waypoint_id, ActorId actor_id) {
-    if (waypoint_overlap_tracker.find(waypoint_id) != waypoint_overlap_tracker.end()) {
-        ActorIdSet &actor_id_set = waypoint_overlap_tracker.at(waypoint_id);
-        actor_id_set.erase(actor_id);
-
-        if (actor_id_set.size() == 0) {
-            waypoint_overlap_tracker.erase(waypoint_id);
+void TrackTraffic::DeleteActor(ActorId actor_id) {
+    ActorOccupancy occupancy;
+    {
+        Partition &partition = GetPartition(actor_id);
+        std::lock_guard<std::mutex> lock(partition.mutex);
+        auto it = partition.actors.find(actor_id);
+        if (it == partition.actors.end()) {
+            return;
         }
+        occupancy = std::move(it->second);
+        partition.actors.erase(it);
     }
 
-    if (waypoint_occupied.find(actor_id) != waypoint_occupied.end()) {
-        WaypointIdSet &waypoint_id_set = waypoint_occupied.at(actor_id);
-        waypoint_id_set.erase(waypoint_id);
-
-        if (waypoint_id_set.size() == 0) {
-            waypoint_occupied.erase(actor_id);
-        }
+    for (const WaypointIndex index : occupancy.waypoints) {
+        RemoveOccupant(waypoint_overlap_tracker[index], index, actor_id);
+    }
+    for (const GeoGridId grid_id : occupancy.grids) {
+        RemoveOccupant(grid_to_actors[static_cast<size_t>(grid_id)], static_cast<uint64_t>(grid_id), actor_id);
     }
 }
 
-ActorIdSet TrackTraffic::GetPassingVehicles(uint64_t waypoint_id) const {
+void TrackTraffic::UpdatePassingVehicle(const SimpleWaypointPtr &waypoint, ActorId actor_id) {
+    AddPassingVehicle(waypoint->GetIndex(), actor_id);
+}
 
-    if (waypoint_overlap_tracker.find(waypoint_id) != waypoint_overlap_tracker.end()) {
-        return waypoint_overlap_tracker.at(waypoint_id);
-    } else {
-        return ActorIdSet();
-    }
+void TrackTraffic::RemovePassingVehicle(const SimpleWaypointPtr &waypoint, ActorId actor_id) {
+    RemovePassingVehicle(waypoint->GetIndex(), actor_id);
+}
+
+ActorIdSet TrackTraffic::GetPassingVehicles(const SimpleWaypointPtr &waypoint) const {
+    const WaypointIndex index = waypoint->GetIndex();
+    DEBUG_ASSERT(index < waypoint_overlap_tracker.size());
+    const Partition &partition = GetPartition(index);
+    std::lock_guard<std::mutex> lock(partition.mutex);
+    const Occupants &occupants = waypoint_overlap_tracker[index];
+    return ActorIdSet(occupants.begin(), occupants.end());
 }
 
 void TrackTraffic::Clear() {
-    waypoint_overlap_tracker.clear();
-    waypoint_occupied.clear();
-    actor_to_grids.clear();
-    grid_to_actors.clear();
+    for (Partition &partition : partitions) {
+        std::lock_guard<std::mutex> lock(partition.mutex);
+        partition.actors.clear();
+    }
+    for (Occupants &occupants : waypoint_overlap_tracker) {
+        occupants.clear();
+    }
+    for (Occupants &occupants : grid_to_actors) {
+        occupants.clear();
+    }
 }
 
 } // namespace traffic_manager
@@ -1,55 +1,107 @@
 
 #pragma once
 
+#include <array>
+#include <mutex>
+#include <utility>
+#include <vector>
+
 #include "carla/road/RoadTypes.h"
 #include "carla/rpc/ActorId.h"
 
 #include "carla/trafficmanager/SimpleWaypoint.h"
+#include "carla/trafficmanager/WaypointBuffer.h"
 
 namespace carla {
 namespace traffic_manager {
 
 using ActorId = carla::ActorId;
 using ActorIdSet = std::unordered_set<ActorId>;
-using SimpleWaypointPtr = std::shared_ptr<SimpleWaypoint>;
-using Buffer = std::deque<SimpleWaypointPtr>;
+using Buffer = WaypointBuffer;
 using GeoGridId = carla::road::JuncId;
 
 // This class is used to track the waypoint occupancy of all the actors.
+// Occupancy is stored in dense arrays indexed by the waypoints of the
+// WaypointGraph and by the geodesic grid ids, and is updated incrementally
+// as waypoints enter and leave the path of an actor. The arrays are guarded
+// by a set of locks chosen by key, so that vehicles touching different
+// waypoints and grids can be updated concurrently. No method holds more
+// than one lock at a time.
 class TrackTraffic {
 
 private:
-    /// Structure to keep track of overlapping waypoints between vehicles.
-    using WaypointOverlap = std::unordered_map<uint64_t, ActorIdSet>;
-    WaypointOverlap waypoint_overlap_tracker;
-
-    /// Structure to keep track of waypoints occupied by vehicles;
-    using WaypointIdSet = std::unordered_set<uint64_t>;
-    using WaypointOccupancyMap = std::unordered_map<ActorId, WaypointIdSet>;
-    WaypointOccupancyMap waypoint_occupied;
-
-    /// Geodesic grids occupied by actors's paths.
-    std::unordered_map<ActorId, std::unordered_set<GeoGridId>> actor_to_grids;
-    /// Actors currently passing through grids.
-    std::unordered_map<GeoGridId, ActorIdSet> grid_to_actors;
+    /// Actors in a waypoint or a geodesic grid, usually none or a few.
+    using Occupants = std::vector<ActorId>;
+
+    /// Occupancy of an actor.
+    struct ActorOccupancy {
+        /// Waypoints occupied by the actor, once per occurrence in its path.
+        std::vector<WaypointIndex> waypoints;
+        /// Geodesic grids of those waypoints, with the number of them in each.
+        std::vector<std::pair<GeoGridId, uint32_t>> path_grids;
+        /// Geodesic grids the actor is currently registered in.
+        std::vector<GeoGridId> grids;
+    };
+
+    struct Partition {
+        mutable std::mutex mutex;
+        /// Occupancy of the actors of this partition.
+        std::unordered_map<ActorId, ActorOccupancy> actors;
+    };
+
+    static constexpr unsigned NUMBER_OF_PARTITIONS_LOG2 = 6u;
+    std::array<Partition, 1u << NUMBER_OF_PARTITIONS_LOG2> partitions;
+    /// Actors passing through each waypoint, once per occurrence in their path.
+    std::vector<Occupants> waypoint_overlap_tracker;
+    /// Actors currently registered in each geodesic grid.
+    std::vector<Occupants> grid_to_actors;
+    /// Graph of the tracked waypoints.
+    const WaypointGraph *graph = nullptr;
     /// Current hero location.
     cg::Location hero_location = cg::Location(0,0,0);
 
+    /// Partition whose lock guards a waypoint, actor or grid id, and that
+    /// holds the data of an actor.
+    Partition &GetPartition(const uint64_t key);
+    const Partition &GetPartition(const uint64_t key) const;
+
+    /// Adds an actor to the occupants of a waypoint or grid.
+    void AddOccupant(Occupants &occupants, const uint64_t key, const ActorId actor_id);
+    /// Removes an occurrence of an actor from the occupants of a waypoint or grid.
+    void RemoveOccupant(Occupants &occupants, const uint64_t key, const ActorId actor_id);
+
+    void AddPassingVehicle(const WaypointIndex index, const ActorId actor_id);
+    void RemovePassingVehicle(const WaypointIndex index, const ActorId actor_id);
+
 
 public:
     TrackTraffic();
 
-    /// Methods to update, remove and retrieve vehicles passing through a waypoint.
-    void UpdatePassingVehicle(uint64_t waypoint_id, ActorId actor_id);
-    void RemovePassingVehicle(uint64_t waypoint_id, ActorId actor_id);
-    ActorIdSet GetPassingVehicles(uint64_t waypoint_id) const;
+    /// Sizes the occupancy arrays for the waypoints and geodesic grids of
+    /// @a graph, which every tracked waypoint must belong to. Clears all
+    /// tracked data.
+    void SetUp(const WaypointGraph &graph);
 
-    void UpdateGridPosition(const ActorId actor_id, const Buffer &buffer);
+    /// Methods to update, remove and retrieve vehicles passing through a waypoint.
+    void UpdatePassingVehicle(const SimpleWaypointPtr &waypoint, ActorId actor_id);
+    void RemovePassingVehicle(const SimpleWaypointPtr &waypoint, ActorId actor_id);
+    ActorIdSet GetPassingVehicles(const SimpleWaypointPtr &waypoint) const;
+
+    /// Registers the actor in the geodesic grids of the waypoints it passes
+    /// through. Only the grids that entered or left its path since the last
+    /// call are updated.
+    void UpdateGridPosition(const ActorId actor_id);
     void UpdateUnregisteredGridPosition(const ActorId actor_id,
-                                        const std::vector<SimpleWaypointPtr> waypoints);
+                                        const std::vector<SimpleWaypointPtr> &waypoints);
 
     ActorIdSet GetOverlappingVehicles(ActorId actor_id) const;
+    /// Geodesic grids the actor is registered in.
+    std::vector<GeoGridId> GetGrids(ActorId actor_id) const;
+    /// Returns true if the actor is registered in any of @a grid_ids, that is,
+    /// if it is one of the overlapping vehicles of an actor in those grids.
+    bool IsInAnyGrid(ActorId actor_id, const std::vector<GeoGridId> &grid_ids) const;
     bool IsGeoGridFree(const GeoGridId geogrid_id) const;
+    /// Marks a free grid as taken by the actor until its next grid update.
     void AddTakenGrid(const GeoGridId geogrid_id, const ActorId actor_id);
 
     void SetHeroLocation(const cg::Location location);
@@ -1,4 +1,6 @@
 
+#include "carla/client/ActorList.h"
+#include "carla/client/TrafficLight.h"
 #include "carla/trafficmanager/Constants.h"
 #include "carla/trafficmanager/LocalizationUtils.h"
 
@@ -8,10 +10,13 @@ namespace carla {
 namespace traffic_manager {
 
 using constants::TrafficLight::EXIT_JUNCTION_THRESHOLD;
+using constants::TrafficLight::MAX_APPROACH_DISTANCE;
 using constants::TrafficLight::MINIMUM_STOP_TIME;
 using constants::WaypointSelection::JUNCTION_LOOK_AHEAD;
 using constants::MotionPlan::EPSILON_RELATIVE_SPEED;
 
+constexpr uint32_t TrafficLightStage::NO_TRAFFIC_LIGHT;
+
 TrafficLightStage::TrafficLightStage(
   const std::vector<ActorId> &vehicle_id_list,
   const SimulationState &simulation_state,
@@ -19,14 +24,93 @@ TrafficLightStage::TrafficLightStage(
   const Parameters &parameters,
   const cc::World &world,
   TLFrame &output_array,
-  RandomGenerator &random_device)
+  RandomGeneratorMap &random_devices)
   : vehicle_id_list(vehicle_id_list),
     simulation_state(simulation_state),
     buffer_map(buffer_map),
     parameters(parameters),
     world(world),
     output_array(output_array),
-    random_device(random_device) {}
+    random_devices(random_devices) {}
+
+void TrafficLightStage::SetUp(const InMemoryMap &local_map) {
+  std::vector<TrafficLightLanes> traffic_lights;
+  std::vector<TLS> states;
+  const auto actors = world.GetActors()->Filter("traffic.traffic_light");
+  for (const auto &actor : *actors) {
+    const auto traffic_light = boost::static_pointer_cast<cc::TrafficLight>(actor);
+    TrafficLightLanes lanes{traffic_light->GetId(), {}};
+    for (const auto &affected_waypoint : traffic_light->GetAffectedLaneWaypoints()) {
+      lanes.affected_locations.push_back(affected_waypoint->GetTransform().location);
+    }
+    traffic_lights.push_back(std::move(lanes));
+    states.push_back(traffic_light->GetState());
+  }
+  SetUp(local_map, traffic_lights);
+  traffic_light_states = std::move(states);
+}
+
+void TrafficLightStage::SetUp(const InMemoryMap &local_map, const std::vector<TrafficLightLanes> &traffic_lights) {
+  const WaypointGraph &graph = local_map.GetWaypointGraph();
+  traffic_light_ids.clear();
+  traffic_light_states.assign(traffic_lights.size(), TLS::Off);
+  waypoint_traffic_light.assign(graph.Size(), NO_TRAFFIC_LIGHT);
+
+  // Waypoints to visit, and whether the junction was reached on the way.
+  std::vector<std::pair<WaypointIndex, bool>> pending;
+  for (const TrafficLightLanes &traffic_light : traffic_lights) {
+    const uint32_t light_index = static_cast<uint32_t>(traffic_light_ids.size());
+    traffic_light_ids.push_back(traffic_light.id);
+
+    for (const cg::Location &light_location : traffic_light.affected_locations) {
+      const SimpleWaypointPtr start = local_map.GetWaypoint(light_location);
+      if (start == nullptr) {
+        continue;
+      }
+      // Follow the lane up to the junction, then the junction lanes until
+      // they leave it.
+      pending.assign(1u, {start->GetIndex(), false});
+      while (!pending.empty()) {
+        const WaypointIndex waypoint_index = pending.back().first;
+        const bool in_junction = pending.back().second || graph.IsJunction(waypoint_index);
+        pending.pop_back();
+        if (waypoint_traffic_light.at(waypoint_index) != NO_TRAFFIC_LIGHT ||
+            (in_junction && !graph.IsJunction(waypoint_index)) ||
+            (!in_junction && cg::Math::DistanceSquared(light_location, graph.GetLocation(waypoint_index)) >
+                             SQUARE(MAX_APPROACH_DISTANCE))) {
+          continue;
+        }
+        waypoint_traffic_light.at(waypoint_index) = light_index;
+        for (auto it = graph.SuccessorsBegin(waypoint_index); it != graph.SuccessorsEnd(waypoint_index); ++it) {
+          pending.emplace_back(*it, in_junction);
+        }
+      }
+    }
+  }
+}
+
+void TrafficLightStage::UpdateWorldInfo() {
+  const cc::WorldSnapshot snapshot = world.GetSnapshot();
+  current_timestamp = snapshot.GetTimestamp();
+  for (size_t i = 0u; i < traffic_light_ids.size(); ++i) {
+    const auto actor_snapshot = snapshot.Find(traffic_light_ids[i]);
+    traffic_light_states[i] = actor_snapshot ? actor_snapshot->state.traffic_light_data.state : TLS::Off;
+  }
+}
+
+void TrafficLightStage::UpdateWorldInfo(const cc::Timestamp &timestamp, const std::vector<TLS> &states) {
+  current_timestamp = timestamp;
+  traffic_light_states = states;
+}
+
+bool TrafficLightStage::IsSignalisedApproach(const SimpleWaypointPtr &waypoint) const {
+  const WaypointIndex waypoint_index = waypoint->GetIndex();
+  if (waypoint_index >= waypoint_traffic_light.size()) {
+    return false;
+  }
+  const uint32_t light_index = waypoint_traffic_light[waypoint_index];
+  return light_index != NO_TRAFFIC_LIGHT && traffic_light_states[light_index] != TLS::Off;
+}
 
 void TrafficLightStage::Update(const unsigned long index) {
   bool traffic_light_hazard = false;
@@ -38,19 +122,22 @@ void TrafficLightStage::Update(const unsigned long index) {
     if (vehicle_last_junction.find(ego_actor_id) != vehicle_last_junction.end()) {
       current_junction_id = vehicle_last_junction.at(ego_actor_id);
     }
-    auto affected_junction_id = GetAffectedJunctionId(ego_actor_id);
-
-    current_timestamp = world.GetSnapshot().GetTimestamp();
+    const Buffer &waypoint_buffer = buffer_map.at(ego_actor_id);
+    const SimpleWaypointPtr look_ahead_point = GetTargetWaypoint(waypoint_buffer, JUNCTION_LOOK_AHEAD).first;
+    auto affected_junction_id = GetAffectedJunctionId(ego_actor_id, look_ahead_point);
 
     const TrafficLightState tl_state = simulation_state.GetTLS(ego_actor_id);
     const TLS traffic_light_state = tl_state.tl_state;
     const bool is_at_traffic_light = tl_state.at_traffic_light;
+    // Junctions approached through a working traffic light are not handled
+    // as non signalized, even before the vehicle reaches the light.
+    const bool is_signalised_approach = IsSignalisedApproach(look_ahead_point);
 
     // We determine to stop if the vehicle found a traffic light in yellow / red.
     if (is_at_traffic_light &&
         traffic_light_state != TLS::Green &&
         traffic_light_state != TLS::Off &&
-        parameters.GetPercentageRunningLight(ego_actor_id) <= random_device.next()) {
+        parameters.GetSnapshot().at(index).perc_run_traffic_light <= random_devices.At(ego_actor_id).next()) {
       // Remove actor from non-signalized junction if it is affected by a traffic light.
       if (current_junction_id != -1) {
         RemoveActor(ego_actor_id);
@@ -61,7 +148,7 @@ void TrafficLightStage::Update(const unsigned long index) {
     // Don't use the next condition as bounding boxes might switch to green
     else if (current_junction_id != -1)
     {
-      if ( affected_junction_id == -1 || affected_junction_id != current_junction_id ) {
+      if ( affected_junction_id == -1 || affected_junction_id != current_junction_id || is_signalised_approach ) {
         RemoveActor(ego_actor_id);
       }
       else {
@@ -70,8 +157,9 @@ void TrafficLightStage::Update(const unsigned long index) {
     }
     else if (affected_junction_id != -1 &&
             !is_at_traffic_light &&
+            !is_signalised_approach &&
             traffic_light_state != TLS::Green &&
-            parameters.GetPercentageRunningSign(ego_actor_id) <= random_device.next()) {
+            parameters.GetSnapshot().at(index).perc_run_traffic_sign <= random_devices.At(ego_actor_id).next()) {
 
       AddActorToNonSignalisedJunction(ego_actor_id, affected_junction_id);
       traffic_light_hazard = true;
@@ -129,10 +217,9 @@ bool TrafficLightStage::HandleNonSignalisedJunction(const ActorId ego_actor_id,
   return traffic_light_hazard;
 }
 
-JunctionID TrafficLightStage::GetAffectedJunctionId(const ActorId ego_actor_id) {
-    const Buffer &waypoint_buffer = buffer_map.at(ego_actor_id);
-    const SimpleWaypointPtr look_ahead_point = GetTargetWaypoint(waypoint_buffer, JUNCTION_LOOK_AHEAD).first;
-    const auto front_point = waypoint_buffer.front();
+JunctionID TrafficLightStage::GetAffectedJunctionId(const ActorId ego_actor_id,
+                                                   const SimpleWaypointPtr &look_ahead_point) {
+    const auto front_point = buffer_map.at(ego_actor_id).front();
 
     auto look_ahead_junction_id = look_ahead_point->GetJunctionId();
     auto front_junction_id = front_point->GetJunctionId();
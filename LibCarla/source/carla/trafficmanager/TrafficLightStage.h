@@ -1,7 +1,11 @@
 
 #pragma once
 
+#include <cstdint>
+#include <limits>
+
 #include "carla/trafficmanager/DataStructures.h"
+#include "carla/trafficmanager/InMemoryMap.h"
 #include "carla/trafficmanager/Parameters.h"
 #include "carla/trafficmanager/RandomGenerator.h"
 #include "carla/trafficmanager/SimulationState.h"
@@ -29,9 +33,27 @@ private:
   /// Map containing the timestamp at which the actor first stopped at a stop sign.
   std::unordered_map<ActorId, cc::Timestamp> vehicle_stop_time;
   TLFrame &output_array;
-  RandomGenerator &random_device;
+  RandomGeneratorMap &random_devices;
   cc::Timestamp current_timestamp;
 
+  /// Variables used to know which junction approaches are signalized
+
+  static constexpr uint32_t NO_TRAFFIC_LIGHT = std::numeric_limits<uint32_t>::max();
+  /// Traffic lights of the world.
+  std::vector<ActorId> traffic_light_ids;
+  /// State of each traffic light in the current cycle.
+  std::vector<TLS> traffic_light_states;
+  /// Index in traffic_light_ids of the light controlling each waypoint of the
+  /// local map, or NO_TRAFFIC_LIGHT. The waypoints of an approach lane, from
+  /// the light to the junction, and those of the junction lanes following it
+  /// are controlled by the light.
+  std::vector<uint32_t> waypoint_traffic_light;
+
+  /// Whether @a waypoint is on the approach to a junction controlled by a
+  /// working traffic light. Whether to stop at the light is still decided by
+  /// the state the simulator reports for the vehicle.
+  bool IsSignalisedApproach(const SimpleWaypointPtr &waypoint) const;
+
   /// This controls all vehicle's interactions at non signalized junctions. Priorities are done by order of arrival
   /// and no two vehicle will enter the junction at the same time. Only once it is exiting can the next one enter.
   /// Additionally, all vehicles will always brake at the stop sign for a set amount of time.
@@ -42,7 +64,7 @@ private:
   void AddActorToNonSignalisedJunction(const ActorId ego_actor_id, const JunctionID junction_id);
 
   /// Get current affected junction id for the vehicle
-  JunctionID GetAffectedJunctionId(const ActorId ego_actor_id);
+  JunctionID GetAffectedJunctionId(const ActorId ego_actor_id, const SimpleWaypointPtr &look_ahead_point);
 
 public:
   TrafficLightStage(const std::vector<ActorId> &vehicle_id_list,
@@ -51,7 +73,28 @@ public:
                     const Parameters &parameters,
                     const cc::World &world,
                     TLFrame &output_array,
-                    RandomGenerator &random_device);
+                    RandomGeneratorMap &random_devices);
+
+  /// A traffic light and the location of the waypoints of the lanes it
+  /// affects.
+  struct TrafficLightLanes {
+    ActorId id;
+    std::vector<cg::Location> affected_locations;
+  };
+
+  /// Links the waypoints of @a local_map to the traffic lights of the world
+  /// controlling them. To be called whenever the local map changes.
+  void SetUp(const InMemoryMap &local_map);
+
+  /// Links the waypoints of @a local_map to @a traffic_lights.
+  void SetUp(const InMemoryMap &local_map, const std::vector<TrafficLightLanes> &traffic_lights);
+
+  /// Reads the timestamp and the state of the traffic lights, once per cycle.
+  void UpdateWorldInfo();
+
+  /// Sets the timestamp and the state of the traffic lights, in the order
+  /// they were given to SetUp.
+  void UpdateWorldInfo(const cc::Timestamp &timestamp, const std::vector<TLS> &states);
 
   void Update(const unsigned long index) override;
 
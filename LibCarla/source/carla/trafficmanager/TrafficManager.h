@@ -65,6 +65,14 @@ public:
     }
   }
 
+  /// Method to set sharded mode.
+  void SetShardedMode(const bool mode_switch) {
+    TrafficManagerBase* tm_ptr = GetTM(_port);
+    if (tm_ptr != nullptr) {
+      tm_ptr->SetShardedMode(mode_switch);
+    }
+  }
+
   /// Method to set our own imported path.
   void SetCustomPath(const ActorPtr &actor, const Path path, const bool empty_buffer) {
     TrafficManagerBase* tm_ptr = GetTM(_port);
@@ -194,6 +202,15 @@ public:
     }
   }
 
+  /// Apply many vehicle settings at once. They take effect together at the
+  /// start of the next cycle.
+  void ApplyVehicleSettings(const VehicleSettingsBatch &batch) {
+    TrafficManagerBase* tm_ptr = GetTM(_port);
+    if(tm_ptr != nullptr){
+      tm_ptr->ApplyVehicleSettings(batch);
+    }
+  }
+
   /// Set a global % decrease in velocity with respect to the speed limit.
   /// If less than 0, it's a % increase.
   void SetGlobalPercentageSpeedDifference(float const percentage){
@@ -375,6 +392,24 @@ public:
     return action_buffer;
   }
 
+  /// Method to get the timing statistics of each stage since the last reset.
+  TrafficManagerTimings GetTimings() {
+    TrafficManagerTimings timings;
+    TrafficManagerBase* tm_ptr = GetTM(_port);
+    if (tm_ptr != nullptr) {
+      timings = tm_ptr->GetTimings();
+    }
+    return timings;
+  }
+
+  /// Method to reset the timing statistics.
+  void ResetTimings() {
+    TrafficManagerBase* tm_ptr = GetTM(_port);
+    if (tm_ptr != nullptr) {
+      tm_ptr->ResetTimings();
+    }
+  }
+
 private:
 
   void CreateTrafficManagerServer(
@@ -9,6 +9,8 @@
 #include <memory>
 #include "carla/client/Actor.h"
 #include "carla/trafficmanager/SimpleWaypoint.h"
+#include "carla/trafficmanager/StageProfiler.h"
+#include "carla/trafficmanager/VehicleSettingsBatch.h"
 
 namespace carla {
 namespace traffic_manager {
@@ -61,6 +63,10 @@ public:
   /// Set a vehicle's exact desired velocity.
   virtual void SetDesiredSpeed(const ActorPtr &actor, const float value) = 0;
 
+  /// Apply many vehicle settings at once. They take effect together at the
+  /// start of the next cycle.
+  virtual void ApplyVehicleSettings(const VehicleSettingsBatch &batch) = 0;
+
   /// Set a global % decrease in velocity with respect to the speed limit.
   /// If less than 0, it's a % increase.
   virtual void SetGlobalPercentageSpeedDifference(float const percentage) = 0;
@@ -134,6 +140,10 @@ public:
   /// Method to set Open Street Map mode.
   virtual void SetOSMMode(const bool mode_switch) = 0;
 
+  /// Method to set sharded mode, where vehicles far from each other are
+  /// localized concurrently.
+  virtual void SetShardedMode(const bool mode_switch) = 0;
+
   /// Method to set our own imported path.
   virtual void SetCustomPath(const ActorPtr &actor, const Path path, const bool empty_buffer) = 0;
 
@@ -167,6 +177,12 @@ public:
   /// Method to get the vehicle's action buffer.
   virtual ActionBuffer GetActionBuffer(const ActorId &actor_id) = 0;
 
+  /// Method to get the timing statistics of each stage since the last reset.
+  virtual TrafficManagerTimings GetTimings() = 0;
+
+  /// Method to reset the timing statistics.
+  virtual void ResetTimings() = 0;
+
   virtual void ShutDown() = 0;
 
 protected:
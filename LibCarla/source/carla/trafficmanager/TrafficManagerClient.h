@@ -7,6 +7,7 @@
 #pragma once
 
 #include "carla/trafficmanager/Constants.h"
+#include "carla/trafficmanager/VehicleSettingsBatch.h"
 #include "carla/rpc/Actor.h"
 
 #include <rpc/client.h>
@@ -94,6 +95,12 @@ public:
     _client->call("set_desired_speed", std::move(_actor), value);
   }
 
+  /// Apply many vehicle settings at once.
+  void ApplyVehicleSettings(const VehicleSettingsBatch &batch) {
+    DEBUG_ASSERT(_client != nullptr);
+    _client->call("apply_vehicle_settings", batch);
+  }
+
   /// Method to set a global % decrease in velocity with respect to the speed limit.
   /// If less than 0, it's a % increase.
   void SetGlobalPercentageSpeedDifference(const float percentage) {
@@ -237,6 +244,12 @@ public:
     _client->call("set_osm_mode", mode_switch);
   }
 
+  /// Method to set sharded mode.
+  void SetShardedMode(const bool mode_switch) {
+    DEBUG_ASSERT(_client != nullptr);
+    _client->call("set_sharded_mode", mode_switch);
+  }
+
   /// Method to set our own imported path.
   void SetCustomPath(const carla::rpc::Actor &actor, const Path path, const bool empty_buffer) {
     DEBUG_ASSERT(_client != nullptr);
@@ -305,6 +318,18 @@ public:
     return ActionBuffer();
   }
 
+  /// Method to get the timing statistics of each stage since the last reset.
+  TrafficManagerTimings GetTimings() {
+    DEBUG_ASSERT(_client != nullptr);
+    return _client->call("get_timings").as<TrafficManagerTimings>();
+  }
+
+  /// Method to reset the timing statistics.
+  void ResetTimings() {
+    DEBUG_ASSERT(_client != nullptr);
+    _client->call("reset_timings");
+  }
+
   void ShutDown() {
     DEBUG_ASSERT(_client != nullptr);
     _client->call("shut_down");
@@ -5,9 +5,12 @@
 // For a copy, see <https://opensource.org/licenses/MIT>.
 
 #include <algorithm>
+#include <exception>
+#include <future>
 
 #include "carla/Logging.h"
 
+#include "carla/client/FileTransfer.h"
 #include "carla/client/detail/Simulator.h"
 
 #include "carla/trafficmanager/TrafficManagerLocal.h"
@@ -16,6 +19,7 @@ namespace carla {
 namespace traffic_manager {
 
 using namespace constants::FrameMemory;
+using namespace constants::StageExecution;
 
 TrafficManagerLocal::TrafficManagerLocal(
   std::vector<float> longitudinal_PID_parameters,
@@ -34,23 +38,23 @@ TrafficManagerLocal::TrafficManagerLocal(
     episode_proxy(episode_proxy),
     world(cc::World(episode_proxy)),
 
-    localization_stage(LocalizationStage(vehicle_id_list,
-                                         buffer_map,
-                                         simulation_state,
-                                         track_traffic,
-                                         local_map,
-                                         parameters,
-                                         marked_for_removal,
-                                         localization_frame,
-                                         random_device)),
-
-    collision_stage(CollisionStage(vehicle_id_list,
-                                   simulation_state,
-                                   buffer_map,
-                                   track_traffic,
-                                   parameters,
-                                   collision_frame,
-                                   random_device)),
+    localization_stage(vehicle_id_list,
+                       buffer_map,
+                       simulation_state,
+                       track_traffic,
+                       local_map,
+                       parameters,
+                       marked_for_removal,
+                       localization_frame,
+                       random_devices),
+
+    collision_stage(vehicle_id_list,
+                    simulation_state,
+                    buffer_map,
+                    track_traffic,
+                    parameters,
+                    collision_frame,
+                    random_devices),
 
     traffic_light_stage(TrafficLightStage(vehicle_id_list,
                                           simulation_state,
@@ -58,24 +62,24 @@ TrafficManagerLocal::TrafficManagerLocal(
                                           parameters,
                                           world,
                                           tl_frame,
-                                          random_device)),
-
-    motion_plan_stage(MotionPlanStage(vehicle_id_list,
-                                      simulation_state,
-                                      parameters,
-                                      buffer_map,
-                                      track_traffic,
-                                      longitudinal_PID_parameters,
-                                      longitudinal_highway_PID_parameters,
-                                      lateral_PID_parameters,
-                                      lateral_highway_PID_parameters,
-                                      localization_frame,
-                                      collision_frame,
-                                      tl_frame,
-                                      world,
-                                      control_frame,
-                                      random_device,
-                                      local_map)),
+                                          random_devices)),
+
+    motion_plan_stage(vehicle_id_list,
+                      simulation_state,
+                      parameters,
+                      buffer_map,
+                      track_traffic,
+                      longitudinal_PID_parameters,
+                      longitudinal_highway_PID_parameters,
+                      lateral_PID_parameters,
+                      lateral_highway_PID_parameters,
+                      localization_frame,
+                      collision_frame,
+                      tl_frame,
+                      world,
+                      control_frame,
+                      random_devices,
+                      local_map),
 
     vehicle_light_stage(VehicleLightStage(vehicle_id_list,
                                           buffer_map,
@@ -95,7 +99,8 @@ TrafficManagerLocal::TrafficManagerLocal(
               collision_stage,
               traffic_light_stage,
               motion_plan_stage,
-              vehicle_light_stage)),
+              vehicle_light_stage,
+              random_devices)),
 
     server(TrafficManagerServer(RPCportTM, static_cast<carla::traffic_manager::TrafficManagerBase *>(this))) {
 
@@ -103,6 +108,13 @@ TrafficManagerLocal::TrafficManagerLocal(
 
   registered_vehicles_state = -1;
 
+  // The thread running the traffic manager takes part in the stages too.
+  const unsigned long hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+  number_of_stage_workers = std::min(hardware_threads, MAX_STAGE_WORKERS) - 1u;
+  if (number_of_stage_workers > 0u) {
+    stage_thread_pool.AsyncRun(number_of_stage_workers);
+  }
+
   SetupLocalMap();
 
   Start();
@@ -117,19 +129,28 @@ void TrafficManagerLocal::SetupLocalMap() {
   const carla::SharedPtr<const cc::Map> world_map = world.GetMap();
   local_map = std::make_shared<InMemoryMap>(world_map);
 
+  bool cache_loaded = false;
   auto files = episode_proxy.Lock()->GetRequiredFiles("TM");
   if (!files.empty()) {
-    auto content = episode_proxy.Lock()->GetCacheFile(files[0], true);
-    if (content.size() != 0) {
-      local_map->Load(content);
-    } else {
-      log_warning("No InMemoryMap cache found. Setting up local map. This may take a while...");
-      local_map->SetUp();
+    // Caches in the current format are mapped and used in place, older ones
+    // are read and parsed.
+    cache_loaded = local_map->LoadFromFile(cc::FileTransfer::GetFilePath(files[0]));
+    if (!cache_loaded) {
+      auto content = episode_proxy.Lock()->GetCacheFile(files[0], true);
+      cache_loaded = content.size() != 0 && local_map->Load(content);
     }
-  } else {
+  }
+  if (!cache_loaded) {
     log_warning("No InMemoryMap cache found. Setting up local map. This may take a while...");
     local_map->SetUp();
   }
+
+  // The occupancy of the waypoints and geodesic grids is indexed by them,
+  // the imported paths are resolved to them and the traffic lights are
+  // linked to them.
+  track_traffic.SetUp(local_map->GetWaypointGraph());
+  parameters.ClearResolvedPaths();
+  traffic_light_stage.SetUp(*local_map);
 }
 
 void TrafficManagerLocal::Start() {
@@ -179,9 +200,11 @@ void TrafficManagerLocal::Run() {
       last_frame = timestamp.frame;
     }
 
+    const StageProfiler::Clock::time_point cycle_begin = StageProfiler::Clock::now();
     std::unique_lock<std::mutex> registration_lock(registration_mutex);
     // Updating simulation state, actor life cycle and performing necessary cleanup.
     alsm.Update();
+    StageProfiler::Clock::time_point stage_begin = stage_profiler.Record(ProfiledStage::ALSM, cycle_begin);
 
     // Re-allocating inter-stage communication frames based on changed number of registered vehicles.
     int current_registered_vehicles_state = registered_vehicles.GetState();
@@ -211,43 +234,161 @@ void TrafficManagerLocal::Run() {
     tl_frame.clear();
     tl_frame.resize(number_of_vehicles);
     control_frame.clear();
-    // Reserve two frames for each vehicle: one for the ApplyVehicleControl command,
-    // and one for the optional SetVehicleLightState command
-    control_frame.reserve(2 * number_of_vehicles);
+    // Reserve one frame for each vehicle's ApplyVehicleControl command, plus
+    // the bulk ApplyTransforms and SetVehicleLightStates commands
+    control_frame.reserve(number_of_vehicles + 2u);
     // Resize to accomodate at least all ApplyVehicleControl commands,
     // that will be inserted by the motion_plan_stage stage.
     control_frame.resize(number_of_vehicles);
 
+    // Resolve the parameters of every vehicle once for the whole cycle.
+    parameters.TakeSnapshot(vehicle_id_list);
+    stage_begin = StageProfiler::Clock::now();
+
     // Run core operation stages.
+    // Localization modifies the waypoint buffers and the tracked traffic of
+    // every vehicle, so it runs sequentially unless vehicles are split into
+    // shards that do not interact. Afterwards both are read only for the
+    // rest of the cycle and stages working on a vehicle at a time run on the
+    // stage workers.
+    if (parameters.GetShardedMode()) {
+      ShardedLocalization();
+    } else {
+      for (unsigned long index = 0u; index < vehicle_id_list.size(); ++index) {
+        localization_stage.Update(index);
+      }
+    }
+    stage_begin = stage_profiler.Record(ProfiledStage::Localization, stage_begin);
+    collision_stage.PrepareCycle();
+    ParallelUpdate([this](const unsigned long index) {
+      collision_stage.UpdateGeodesicBoundary(index);
+    });
+    ParallelUpdate([this](const unsigned long index) {
+      collision_stage.Update(index);
+    });
+    collision_stage.ClearCycleCache();
+    stage_begin = stage_profiler.Record(ProfiledStage::Collision, stage_begin);
+    // Junction priorities depend on the order of arrival of the vehicles.
+    traffic_light_stage.UpdateWorldInfo();
     for (unsigned long index = 0u; index < vehicle_id_list.size(); ++index) {
-      localization_stage.Update(index);
+      traffic_light_stage.Update(index);
     }
+    stage_begin = stage_profiler.Record(ProfiledStage::TrafficLight, stage_begin);
+    motion_plan_stage.UpdateWorldInfo();
+    ParallelUpdate([this](const unsigned long index) {
+      if (!motion_plan_stage.RespawnsDormantVehicle(index)) {
+        motion_plan_stage.Update(index);
+      }
+    });
     for (unsigned long index = 0u; index < vehicle_id_list.size(); ++index) {
-      collision_stage.Update(index);
+      if (motion_plan_stage.RespawnsDormantVehicle(index)) {
+        motion_plan_stage.Update(index);
+      }
     }
-    collision_stage.ClearCycleCache();
+    // Vehicles without physics are moved together by a single command.
+    motion_plan_stage.IntegrateHybridVehicles();
+    stage_begin = stage_profiler.Record(ProfiledStage::MotionPlan, stage_begin);
+    // Light state commands are appended to the control frame.
     vehicle_light_stage.UpdateWorldInfo();
     for (unsigned long index = 0u; index < vehicle_id_list.size(); ++index) {
-      traffic_light_stage.Update(index);
-      motion_plan_stage.Update(index);
       vehicle_light_stage.Update(index);
     }
+    vehicle_light_stage.ApplyLightStates();
+    stage_begin = stage_profiler.Record(ProfiledStage::VehicleLight, stage_begin);
 
     registration_lock.unlock();
 
     // Sending the current cycle's batch command to the simulator.
     if (synchronous_mode) {
       episode_proxy.Lock()->ApplyBatchSync(control_frame, false);
+      stage_profiler.Record(ProfiledStage::ApplyBatch, stage_begin);
       step_end.store(true);
       step_end_trigger.notify_one();
     } else {
       if (control_frame.size() > 0){
         episode_proxy.Lock()->ApplyBatchSync(control_frame, false);
+        stage_profiler.Record(ProfiledStage::ApplyBatch, stage_begin);
       }
     }
+    stage_profiler.Record(ProfiledStage::Cycle, cycle_begin);
+    stage_profiler.RecordVehicles(number_of_vehicles);
   }
 }
 
+void TrafficManagerLocal::ParallelUpdate(const std::function<void(const unsigned long)> &update) {
+  const unsigned long number_of_vehicles = vehicle_id_list.size();
+  const unsigned long number_of_tasks = std::min(number_of_stage_workers + 1u,
+                                                 number_of_vehicles / MIN_VEHICLES_PER_WORKER);
+  if (number_of_tasks <= 1u) {
+    for (unsigned long index = 0u; index < number_of_vehicles; ++index) {
+      update(index);
+    }
+    return;
+  }
+
+  // Contiguous ranges of vehicles.
+  const unsigned long task_size = (number_of_vehicles + number_of_tasks - 1u) / number_of_tasks;
+  RunTasks(number_of_tasks, [&update, task_size, number_of_vehicles](const unsigned long task) {
+    const unsigned long end = std::min((task + 1u) * task_size, number_of_vehicles);
+    for (unsigned long index = task * task_size; index < end; ++index) {
+      update(index);
+    }
+  });
+}
+
+void TrafficManagerLocal::RunTasks(const unsigned long number_of_tasks,
+                                   const std::function<void(const unsigned long)> &task) {
+  std::vector<std::future<void>> futures;
+  futures.reserve(number_of_tasks);
+  for (unsigned long index = 1u; index < number_of_tasks; ++index) {
+    futures.emplace_back(stage_thread_pool.Post([&task, index]() {
+      task(index);
+    }));
+  }
+
+  std::exception_ptr exception;
+  try {
+    if (number_of_tasks > 0u) {
+      task(0u);
+    }
+  } catch (...) {
+    exception = std::current_exception();
+  }
+  // Barrier, the tasks reference the task function so all of them must
+  // finish before returning, even if one of them failed.
+  for (auto &future : futures) {
+    try {
+      future.get();
+    } catch (...) {
+      if (!exception) {
+        exception = std::current_exception();
+      }
+    }
+  }
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+}
+
+void TrafficManagerLocal::ShardedLocalization() {
+  // Buffers of new vehicles are created beforehand, shards only modify the
+  // buffers of their own vehicles.
+  localization_stage.PrepareCycle();
+  vehicle_shards.Update(vehicle_id_list, simulation_state, buffer_map, number_of_stage_workers + 1u);
+
+  const size_t first_removal = marked_for_removal.size();
+  vehicle_shards.Run(
+      [this](const unsigned long number_of_tasks, const std::function<void(const unsigned long)> &task) {
+        RunTasks(number_of_tasks, task);
+      },
+      [this](const unsigned long index) {
+        localization_stage.Update(index);
+      });
+  // Strips mark vehicles for removal concurrently. Sorting them by id, the
+  // order of the vehicle list, gives the list of a sequential update.
+  std::sort(marked_for_removal.begin() + static_cast<std::ptrdiff_t>(first_removal), marked_for_removal.end());
+}
+
 bool TrafficManagerLocal::SynchronousTick() {
   if (parameters.GetSynchronousMode()) {
     step_begin.store(true);
@@ -275,6 +416,7 @@ void TrafficManagerLocal::Stop() {
   }
 
   vehicle_id_list.clear();
+  random_devices.Clear();
   registered_vehicles.Clear();
   registered_vehicles_state = -1;
   track_traffic.Clear();
@@ -346,6 +488,10 @@ void TrafficManagerLocal::SetDesiredSpeed(const ActorPtr &actor, const float val
   parameters.SetDesiredSpeed(actor, value);
 }
 
+void TrafficManagerLocal::ApplyVehicleSettings(const VehicleSettingsBatch &batch) {
+  parameters.ApplyVehicleSettings(batch);
+}
+
 /// Method to set the automatic management of the vehicle lights
 void TrafficManagerLocal::SetUpdateVehicleLights(const ActorPtr &actor, const bool do_update) {
   parameters.SetUpdateVehicleLights(actor, do_update);
@@ -411,6 +557,10 @@ void TrafficManagerLocal::SetOSMMode(const bool mode_switch) {
   parameters.SetOSMMode(mode_switch);
 }
 
+void TrafficManagerLocal::SetShardedMode(const bool mode_switch) {
+  parameters.SetShardedMode(mode_switch);
+}
+
 void TrafficManagerLocal::SetCustomPath(const ActorPtr &actor, const Path path, const bool empty_buffer) {
   parameters.SetCustomPath(actor, path, empty_buffer);
 }
@@ -455,6 +605,14 @@ ActionBuffer TrafficManagerLocal::GetActionBuffer(const ActorId &actor_id) {
   return localization_stage.ComputeActionBuffer(actor_id);
 }
 
+TrafficManagerTimings TrafficManagerLocal::GetTimings() {
+  return stage_profiler.GetTimings();
+}
+
+void TrafficManagerLocal::ResetTimings() {
+  stage_profiler.Reset();
+}
+
 bool TrafficManagerLocal::CheckAllFrozen(TLGroup tl_to_freeze) {
   for (auto &elem : tl_to_freeze) {
     if (!elem->IsFrozen() || elem->GetState() != TLS::Red) {
@@ -486,8 +644,11 @@ std::vector<ActorId> TrafficManagerLocal::GetRegisteredVehiclesIDs() {
 }
 
 void TrafficManagerLocal::SetRandomDeviceSeed(const uint64_t _seed) {
-  seed = _seed;
-  random_device = RandomGenerator(seed);
+  {
+    std::lock_guard<std::mutex> registration_lock(registration_mutex);
+    seed = _seed;
+    random_devices.Reset(seed);
+  }
   world.ResetAllTrafficLights();
 }
 
@@ -8,6 +8,7 @@
 
 #include <atomic>
 #include <chrono>
+#include <functional>
 #include <mutex>
 #include <thread>
 #include <vector>
@@ -16,6 +17,7 @@
 #include "carla/client/TrafficLight.h"
 #include "carla/client/World.h"
 #include "carla/Memory.h"
+#include "carla/ThreadPool.h"
 #include "carla/rpc/Command.h"
 
 #include "carla/trafficmanager/AtomicActorSet.h"
@@ -26,6 +28,7 @@
 #include "carla/trafficmanager/TrackTraffic.h"
 #include "carla/trafficmanager/TrafficManagerBase.h"
 #include "carla/trafficmanager/TrafficManagerServer.h"
+#include "carla/trafficmanager/VehicleShards.h"
 
 #include "carla/trafficmanager/ALSM.h"
 #include "carla/trafficmanager/LocalizationStage.h"
@@ -109,17 +112,40 @@ private:
   std::condition_variable step_end_trigger;
   /// Single worker thread for sequential execution of sub-components.
   std::unique_ptr<std::thread> worker_thread;
+  /// Pool of threads updating vehicles concurrently within a stage.
+  ThreadPool stage_thread_pool;
+  /// Number of threads in the stage thread pool.
+  unsigned long number_of_stage_workers {0u};
   /// Randomization seed.
   uint64_t seed {static_cast<uint64_t>(time(NULL))};
   /// Structure holding random devices per vehicle.
-  RandomGenerator random_device = RandomGenerator(seed);
+  RandomGeneratorMap random_devices = RandomGeneratorMap(seed);
   std::vector<ActorId> marked_for_removal;
   /// Mutex to prevent vehicle registration during frame array re-allocation.
   std::mutex registration_mutex;
+  /// Timing statistics of the stages.
+  StageProfiler stage_profiler;
+  /// Spatial partition of the vehicles used in sharded mode.
+  VehicleShards vehicle_shards;
 
   /// Method to check if all traffic lights are frozen in a group.
   bool CheckAllFrozen(TLGroup tl_to_freeze);
 
+  /// Method to call @a update for the index of every registered vehicle,
+  /// splitting them among the stage workers and the calling thread. Returns
+  /// once all of them have been updated.
+  void ParallelUpdate(const std::function<void(const unsigned long)> &update);
+
+  /// Method to run @a task for every index below @a number_of_tasks, the
+  /// first one on the calling thread and the rest on the stage workers.
+  /// Returns once all of them have finished.
+  void RunTasks(const unsigned long number_of_tasks,
+                const std::function<void(const unsigned long)> &task);
+
+  /// Method to localize the vehicles of every shard concurrently, and then
+  /// the ones in the border zone between shards.
+  void ShardedLocalization();
+
 public:
   /// Private constructor for singleton lifecycle management.
   TrafficManagerLocal(std::vector<float> longitudinal_PID_parameters,
@@ -164,6 +190,10 @@ public:
   /// Set a vehicle's exact desired velocity.
   void SetDesiredSpeed(const ActorPtr &actor, const float value);
 
+  /// Apply many vehicle settings at once. They take effect together at the
+  /// start of the next cycle.
+  void ApplyVehicleSettings(const VehicleSettingsBatch &batch);
+
   /// Method to set a global % decrease in velocity with respect to the speed limit.
   /// If less than 0, it's a % increase.
   void SetGlobalPercentageSpeedDifference(float const percentage);
@@ -245,6 +275,9 @@ public:
   /// Method to set Open Street Map mode.
   void SetOSMMode(const bool mode_switch);
 
+  /// Method to set sharded mode.
+  void SetShardedMode(const bool mode_switch);
+
   /// Method to set our own imported path.
   void SetCustomPath(const ActorPtr &actor, const Path path, const bool empty_buffer);
 
@@ -278,6 +311,12 @@ public:
   /// Method to get the vehicle's action buffer.
   ActionBuffer GetActionBuffer(const ActorId &actor_id);
 
+  /// Method to get the timing statistics of each stage since the last reset.
+  TrafficManagerTimings GetTimings();
+
+  /// Method to reset the timing statistics.
+  void ResetTimings();
+
   void ShutDown() {};
 };
 
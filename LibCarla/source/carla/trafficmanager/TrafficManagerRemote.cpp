@@ -117,6 +117,10 @@ void TrafficManagerRemote::SetDesiredSpeed(const ActorPtr &_actor, const float v
   client.SetDesiredSpeed(actor, value);
 }
 
+void TrafficManagerRemote::ApplyVehicleSettings(const VehicleSettingsBatch &batch) {
+  client.ApplyVehicleSettings(batch);
+}
+
 void TrafficManagerRemote::SetGlobalPercentageSpeedDifference(const float percentage) {
   client.SetGlobalPercentageSpeedDifference(percentage);
 }
@@ -221,6 +225,10 @@ void TrafficManagerRemote::SetOSMMode(const bool mode_switch) {
   client.SetOSMMode(mode_switch);
 }
 
+void TrafficManagerRemote::SetShardedMode(const bool mode_switch) {
+  client.SetShardedMode(mode_switch);
+}
+
 void TrafficManagerRemote::SetCustomPath(const ActorPtr &_actor, const Path path, const bool empty_buffer) {
   carla::rpc::Actor actor(_actor->Serialize());
 
@@ -281,6 +289,14 @@ ActionBuffer TrafficManagerRemote::GetActionBuffer(const ActorId &actor_id) {
   return client.GetActionBuffer(actor_id);
 }
 
+TrafficManagerTimings TrafficManagerRemote::GetTimings() {
+  return client.GetTimings();
+}
+
+void TrafficManagerRemote::ResetTimings() {
+  client.ResetTimings();
+}
+
 bool TrafficManagerRemote::SynchronousTick() {
   return false;
 }
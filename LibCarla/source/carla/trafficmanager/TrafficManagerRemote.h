@@ -64,6 +64,10 @@ public:
   /// Set a vehicle's exact desired velocity.
   void SetDesiredSpeed(const ActorPtr &actor, const float value);
 
+  /// Apply many vehicle settings at once, with a single call to the server.
+  /// They take effect together at the start of the next cycle.
+  void ApplyVehicleSettings(const VehicleSettingsBatch &batch);
+
   /// Method to set a global % decrease in velocity with respect to the speed limit.
   /// If less than 0, it's a % increase.
   void SetGlobalPercentageSpeedDifference(float const percentage);
@@ -128,6 +132,9 @@ public:
   /// Method to set Open Street Map mode.
   void SetOSMMode(const bool mode_switch);
 
+  /// Method to set sharded mode.
+  void SetShardedMode(const bool mode_switch);
+
   /// Method to set our own imported path.
   void SetCustomPath(const ActorPtr &actor, const Path path, const bool empty_buffer);
 
@@ -163,6 +170,12 @@ public:
   /// Method to get the vehicle's action buffer.
   ActionBuffer GetActionBuffer(const ActorId &actor_id);
 
+  /// Method to get the timing statistics of each stage since the last reset.
+  TrafficManagerTimings GetTimings();
+
+  /// Method to reset the timing statistics.
+  void ResetTimings();
+
   /// Method to provide synchronous tick
   bool SynchronousTick();
 
@@ -105,6 +105,11 @@ public:
         tm->SetDesiredSpeed(carla::client::detail::ActorVariant(actor).Get(tm->GetEpisodeProxy()), value);
       });
 
+      /// Apply many vehicle settings at once.
+      server->bind("apply_vehicle_settings", [=](const VehicleSettingsBatch &batch) {
+        tm->ApplyVehicleSettings(batch);
+      });
+
       /// Method to set the automatic management of the vehicle lights
       server->bind("update_vehicle_lights", [=](carla::rpc::Actor actor, const bool do_update) {
         tm->SetUpdateVehicleLights(carla::client::detail::ActorVariant(actor).Get(tm->GetEpisodeProxy()), do_update);
@@ -203,6 +208,11 @@ public:
         tm->SetOSMMode(mode_switch);
       });
 
+      /// Method to set sharded mode.
+      server->bind("set_sharded_mode", [=](const bool mode_switch) {
+        tm->SetShardedMode(mode_switch);
+      });
+
       /// Method to set our own imported path.
       server->bind("set_path", [=](carla::rpc::Actor actor, const Path path, const bool empty_buffer) {
         tm->SetCustomPath(carla::client::detail::ActorVariant(actor).Get(tm->GetEpisodeProxy()), path, empty_buffer);
@@ -253,6 +263,16 @@ public:
         tm->GetActionBuffer(actor_id);
       });
 
+      /// Method to get the timing statistics of each stage.
+      server->bind("get_timings", [=]() -> TrafficManagerTimings {
+        return tm->GetTimings();
+      });
+
+      /// Method to reset the timing statistics.
+      server->bind("reset_timings", [=]() {
+        tm->ResetTimings();
+      });
+
       server->bind("shut_down", [=]() {
         tm->Release();
       });
@@ -22,19 +22,70 @@ VehicleLightStage::VehicleLightStage(
     control_frame(control_frame) {}
 
 void VehicleLightStage::UpdateWorldInfo() {
-  // Get the global weather and all the vehicle light states at once
-  all_light_states = world.GetVehiclesLightStates();
-  weather = world.GetWeather();
+  // The weather and the light states of the vehicles are read from the
+  // simulator only when flagged dirty: at start, after a reset, and
+  // periodically to catch changes made by other clients. The light states
+  // are also read when a vehicle with automatic lights has no known state,
+  // which happens when it is registered or its automatic lights are enabled
+  // again. Otherwise the light states sent by this stage are the current ones.
+  const double elapsed_seconds = world.GetSnapshot().GetTimestamp().elapsed_seconds;
+  if (elapsed_seconds - world_info_timestamp > WORLD_INFO_REFRESH_PERIOD ||
+      elapsed_seconds < world_info_timestamp) {
+    world_info_dirty = true;
+  }
+  if (world_info_dirty) {
+    weather = world.GetWeather();
+    world_info_dirty = false;
+    world_info_timestamp = elapsed_seconds;
+  }
+
+  if (elapsed_seconds - light_states_timestamp > LIGHT_STATES_REFRESH_PERIOD ||
+      elapsed_seconds < light_states_timestamp) {
+    light_states_dirty = true;
+  }
+  const auto &vehicle_parameters = parameters.GetSnapshot();
+  for (unsigned long index = 0u; !light_states_dirty && index < vehicle_id_list.size(); ++index) {
+    if (vehicle_parameters.at(index).update_vehicle_lights &&
+        light_states.find(vehicle_id_list.at(index)) == light_states.end()) {
+      light_states_dirty = true;
+    }
+  }
+  if (light_states_dirty) {
+    light_states.clear();
+    for (auto &&vls : world.GetVehiclesLightStates()) {
+      light_states.emplace(vls.first, vls.second);
+    }
+    light_states_dirty = false;
+    light_states_timestamp = elapsed_seconds;
+  }
+
+  // Vehicles braking hard, to avoid blinking for throttle control.
+  braking_vehicles.clear();
+  for (const carla::rpc::Command &command : control_frame) {
+    if (auto *ctrl = boost::variant2::get_if<carla::rpc::Command::ApplyVehicleControl>(&command.command)) {
+      if (ctrl->control.brake > 0.5f) {
+        braking_vehicles.insert(ctrl->actor);
+      }
+    }
+  }
 }
 
 void VehicleLightStage::Update(const unsigned long index) {
   ActorId actor_id = vehicle_id_list.at(index);
 
-  if (!parameters.GetUpdateVehicleLights(actor_id))
+  if (!parameters.GetSnapshot().at(index).update_vehicle_lights) {
+    // Its lights may be changed by others until automatic updates are
+    // enabled again, then they are read from the simulator.
+    light_states.erase(actor_id);
     return; // this vehicle is not set to have automatic lights update
+  }
 
-  rpc::VehicleLightState::flag_type light_states = uint32_t(-1);
-  bool brake_lights = false;
+  rpc::VehicleLightState::flag_type current_light_states = uint32_t(-1);
+  auto light_states_it = light_states.find(actor_id);
+  if (light_states_it != light_states.end()) {
+    current_light_states = light_states_it->second;
+  }
+  const bool brake_lights = braking_vehicles.count(actor_id) > 0u;
   bool left_turn_indicator = false;
   bool right_turn_indicator = false;
   bool position = false;
@@ -42,14 +93,6 @@ void VehicleLightStage::Update(const unsigned long index) {
   bool high_beam = false;
   bool fog_lights = false;
 
-  // search the current light state of the vehicle
-  for (auto&& vls : all_light_states) {
-    if (vls.first == actor_id) {
-      light_states = vls.second;
-      break;
-    }
-  }
-
   // Determine if the vehicle is truning left or right by checking the close waypoints
 
   const Buffer& waypoint_buffer = buffer_map.at(actor_id);
@@ -67,17 +110,6 @@ void VehicleLightStage::Update(const unsigned long index) {
     }
   }
 
-  // Determine brake light state
-  for (size_t cc = 0; cc < control_frame.size(); cc++) {
-    if (auto* maybe_ctrl = boost::variant2::get_if<carla::rpc::Command::ApplyVehicleControl>(&control_frame[cc].command)) {
-      carla::rpc::Command::ApplyVehicleControl& ctrl = *maybe_ctrl;
-      if (ctrl.actor == actor_id) {
-        brake_lights = (ctrl.control.brake > 0.5); // hard braking, avoid blinking for throttle control
-        break;
-      }
-    }
-  }
-
   // Determine position, fog and beams
 
   // Turn on beams & positions from sunset to dawn
@@ -105,7 +137,7 @@ void VehicleLightStage::Update(const unsigned long index) {
   }
 
   // Determine the new vehicle light state
-  rpc::VehicleLightState::flag_type new_light_states = light_states;
+  rpc::VehicleLightState::flag_type new_light_states = current_light_states;
   if (brake_lights)
     new_light_states |= rpc::VehicleLightState::flag_type(rpc::VehicleLightState::LightState::Brake);
   else
@@ -142,14 +174,32 @@ void VehicleLightStage::Update(const unsigned long index) {
     new_light_states &= ~rpc::VehicleLightState::flag_type(rpc::VehicleLightState::LightState::Fog);
 
   // Update the vehicle light state if it has changed
-  if (new_light_states != light_states)
-    control_frame.push_back(carla::rpc::Command::SetVehicleLightState(actor_id, new_light_states));
+  if (new_light_states != current_light_states) {
+    changed_light_states.actors.push_back(actor_id);
+    changed_light_states.light_states.push_back(new_light_states);
+    light_states[actor_id] = new_light_states;
+  }
+}
+
+void VehicleLightStage::ApplyLightStates() {
+  if (!changed_light_states.actors.empty()) {
+    control_frame.push_back(changed_light_states);
+    changed_light_states.actors.clear();
+    changed_light_states.light_states.clear();
+  }
 }
 
-void VehicleLightStage::RemoveActor(const ActorId) {
+void VehicleLightStage::RemoveActor(const ActorId actor_id) {
+  light_states.erase(actor_id);
 }
 
 void VehicleLightStage::Reset() {
+  light_states.clear();
+  braking_vehicles.clear();
+  changed_light_states.actors.clear();
+  changed_light_states.light_states.clear();
+  world_info_dirty = true;
+  light_states_dirty = true;
 }
 
 } // namespace traffic_manager
@@ -1,6 +1,9 @@
 
 #pragma once
 
+#include <unordered_map>
+#include <unordered_set>
+
 #include "carla/trafficmanager/DataStructures.h"
 #include "carla/trafficmanager/Parameters.h"
 #include "carla/trafficmanager/RandomGenerator.h"
@@ -19,10 +22,23 @@ private:
   const Parameters &parameters;
   const cc::World &world;
   ControlFrame& control_frame;
-  /// All vehicle light states
-  rpc::VehicleLightStateList all_light_states;
+  /// Light state last sent for each vehicle, or read from the simulator if
+  /// none was sent since.
+  std::unordered_map<ActorId, rpc::VehicleLightState::flag_type> light_states;
+  /// Whether the light states have to be read again from the simulator.
+  bool light_states_dirty = true;
+  /// Simulation time at which they were last read.
+  double light_states_timestamp = 0.0;
+  /// Vehicles braking hard in the current cycle.
+  std::unordered_set<ActorId> braking_vehicles;
+  /// Light states changed in the current cycle.
+  carla::rpc::Command::SetVehicleLightStates changed_light_states;
   /// Current weather parameters
   rpc::WeatherParameters weather;
+  /// Whether the weather has to be read again from the simulator.
+  bool world_info_dirty = true;
+  /// Simulation time at which they were last read.
+  double world_info_timestamp = 0.0;
 
 public:
   VehicleLightStage(const std::vector<ActorId> &vehicle_id_list,
@@ -35,6 +51,10 @@ public:
 
   void Update(const unsigned long index) override;
 
+  /// Appends the light states changed in this cycle to the control frame,
+  /// as a single command.
+  void ApplyLightStates();
+
   void RemoveActor(const ActorId actor_id) override;
 
   void Reset() override;
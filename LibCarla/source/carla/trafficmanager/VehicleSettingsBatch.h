@@ -0,0 +1,89 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "carla/MsgPack.h"
+#include "carla/rpc/ActorId.h"
+
+namespace carla {
+namespace traffic_manager {
+
+  /// Per-vehicle settings of the Traffic Manager that take a single value.
+  /// Boolean settings are true for any value other than zero.
+  enum class VehicleSetting : uint8_t {
+    PercentageSpeedDifference,
+    LaneOffset,
+    DesiredSpeed,
+    DistanceToLeadingVehicle,
+    AutoLaneChange,
+    /// Changes to the right lane if true, to the left one otherwise.
+    ForceLaneChange,
+    PercentageRunningLight,
+    PercentageRunningSign,
+    PercentageIgnoreVehicles,
+    PercentageIgnoreWalkers,
+    KeepRightPercentage,
+    RandomLeftLaneChangePercentage,
+    RandomRightLaneChangePercentage,
+    UpdateVehicleLights,
+    SIZE
+  };
+
+  /// Updates of vehicle settings sent together, so a client configures many
+  /// vehicles with a single call. Entries are stored as three parallel
+  /// arrays, and applied in order: a later entry for the same vehicle and
+  /// setting overrides an earlier one.
+  class VehicleSettingsBatch {
+  public:
+
+    void Add(const rpc::ActorId actor_id, const VehicleSetting setting, const float value) {
+      actors.push_back(actor_id);
+      settings.push_back(static_cast<uint8_t>(setting));
+      values.push_back(value);
+    }
+
+    void Reserve(const size_t size) {
+      actors.reserve(size);
+      settings.reserve(size);
+      values.reserve(size);
+    }
+
+    void Clear() {
+      actors.clear();
+      settings.clear();
+      values.clear();
+    }
+
+    size_t Size() const {
+      return actors.size();
+    }
+
+    /// Whether the arrays have the same size and every setting is known.
+    bool IsValid() const {
+      if (settings.size() != actors.size() || values.size() != actors.size()) {
+        return false;
+      }
+      for (const uint8_t setting : settings) {
+        if (setting >= static_cast<uint8_t>(VehicleSetting::SIZE)) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    std::vector<rpc::ActorId> actors;
+    std::vector<uint8_t> settings;
+    std::vector<float> values;
+
+    MSGPACK_DEFINE_ARRAY(actors, settings, values);
+  };
+
+} // namespace traffic_manager
+} // namespace carla
@@ -0,0 +1,205 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <limits>
+#include <mutex>
+
+#include "carla/trafficmanager/Constants.h"
+
+#include "carla/trafficmanager/VehicleShards.h"
+
+namespace carla {
+namespace traffic_manager {
+
+using namespace constants::Sharding;
+using namespace constants::PathBufferUpdate;
+using constants::LaneChange::MAX_WPT_DISTANCE;
+using constants::Map::MAX_GEODESIC_GRID_LENGTH;
+using constants::SpeedThreshold::HIGHWAY_SPEED;
+
+void VehicleShards::Update(const std::vector<ActorId> &vehicle_id_list,
+                           const SimulationState &simulation_state,
+                           const BufferMap &buffer_map,
+                           const unsigned long max_shards) {
+
+  const unsigned long number_of_vehicles = vehicle_id_list.size();
+  border.clear();
+  border_strips.clear();
+  strip_ends.clear();
+
+  // Bounding box of the vehicles.
+  float min_x = std::numeric_limits<float>::infinity();
+  float min_y = min_x;
+  float max_x = -min_x;
+  float max_y = -min_x;
+  for (const ActorId actor_id : vehicle_id_list) {
+    const cg::Location location = simulation_state.GetLocation(actor_id);
+    min_x = std::min(min_x, location.x);
+    min_y = std::min(min_y, location.y);
+    max_x = std::max(max_x, location.x);
+    max_y = std::max(max_y, location.y);
+  }
+  const bool along_x = max_x - min_x >= max_y - min_y;
+  const float span = number_of_vehicles > 0u ? std::max(max_x - min_x, max_y - min_y) : 0.0f;
+
+  unsigned long number_of_shards = std::min(max_shards, number_of_vehicles / MIN_VEHICLES_PER_SHARD);
+  number_of_shards = std::min(number_of_shards, static_cast<unsigned long>(span / MIN_SHARD_WIDTH));
+  number_of_shards = std::max(number_of_shards, 1ul);
+  shards.resize(number_of_shards);
+  for (auto &shard : shards) {
+    shard.clear();
+  }
+
+  if (number_of_shards == 1u) {
+    auto &shard = shards.front();
+    shard.reserve(number_of_vehicles);
+    for (unsigned long index = 0u; index < number_of_vehicles; ++index) {
+      shard.push_back(index);
+    }
+    return;
+  }
+
+  auto coordinate = [along_x](const cg::Location &location) {
+    return along_x ? location.x : location.y;
+  };
+
+  sorted_vehicles.clear();
+  reach.clear();
+  for (unsigned long index = 0u; index < number_of_vehicles; ++index) {
+    const ActorId actor_id = vehicle_id_list[index];
+    const float position = coordinate(simulation_state.GetLocation(actor_id));
+    sorted_vehicles.emplace_back(position, index);
+
+    // Waypoints in the buffer stay tracked until they are passed.
+    float reach_begin = position;
+    float reach_end = position;
+    auto buffer_it = buffer_map.find(actor_id);
+    if (buffer_it != buffer_map.end()) {
+      for (const SimpleWaypointPtr &waypoint : buffer_it->second) {
+        const float waypoint_position = coordinate(waypoint->GetLocation());
+        reach_begin = std::min(reach_begin, waypoint_position);
+        reach_end = std::max(reach_end, waypoint_position);
+      }
+    }
+
+    // New waypoints lie within the horizon of the start of the buffer,
+    // which may move to the end of a lane change or be extended past a
+    // junction. Other vehicles are found through the geodesic grids.
+    const float speed = simulation_state.GetVelocity(actor_id).Length();
+    const float horizon_length = std::max(speed * (speed > HIGHWAY_SPEED ? HIGH_SPEED_HORIZON_RATE : HORIZON_RATE),
+                                          MINIMUM_HORIZON_LENGTH);
+    const float margin = MAX_START_DISTANCE + MAX_WPT_DISTANCE + horizon_length
+                         + JUNCTION_EXTENSION_MARGIN + MAX_GEODESIC_GRID_LENGTH;
+    reach.emplace_back(std::min(reach_begin, position - margin) - MAX_GEODESIC_GRID_LENGTH,
+                       std::max(reach_end, position + margin) + MAX_GEODESIC_GRID_LENGTH);
+  }
+  std::sort(sorted_vehicles.begin(), sorted_vehicles.end());
+
+  // Strips with the same number of vehicles, split half way between the
+  // last vehicle of a strip and the first one of the next.
+  float strip_begin = -std::numeric_limits<float>::infinity();
+  for (unsigned long shard = 0u; shard < number_of_shards; ++shard) {
+    const unsigned long first = shard * number_of_vehicles / number_of_shards;
+    const unsigned long last = (shard + 1u) * number_of_vehicles / number_of_shards;
+    const float strip_end = last < number_of_vehicles
+        ? 0.5f * (sorted_vehicles[last - 1u].first + sorted_vehicles[last].first)
+        : std::numeric_limits<float>::infinity();
+    strip_ends.push_back(strip_end);
+
+    for (unsigned long rank = first; rank < last; ++rank) {
+      const unsigned long index = sorted_vehicles[rank].second;
+      if (reach[index].first > strip_begin && reach[index].second < strip_end) {
+        shards[shard].push_back(index);
+      } else {
+        border.push_back(index);
+      }
+    }
+    strip_begin = strip_end;
+  }
+
+  // Keep the order of the vehicle list within each group.
+  for (auto &shard : shards) {
+    std::sort(shard.begin(), shard.end());
+  }
+  std::sort(border.begin(), border.end());
+
+  // A reach overlaps the strips ending after its start and starting before
+  // its end.
+  border_strips.reserve(border.size());
+  for (const unsigned long index : border) {
+    const auto first = std::upper_bound(strip_ends.begin(), strip_ends.end(), reach[index].first);
+    const auto last = std::lower_bound(strip_ends.begin(), strip_ends.end(), reach[index].second);
+    border_strips.emplace_back(static_cast<unsigned long>(first - strip_ends.begin()),
+                               std::min(static_cast<unsigned long>(last - strip_ends.begin()),
+                                        number_of_shards - 1u));
+  }
+}
+
+void VehicleShards::Run(const TaskRunner &run_tasks,
+                        const std::function<void(const unsigned long)> &update) const {
+
+  if (shards.size() == 1u) {
+    for (const unsigned long index : shards.front()) {
+      update(index);
+    }
+    return;
+  }
+
+  // A border vehicle is updated by the last strip getting to it, while the
+  // others wait. Two vehicles with overlapping reach share a strip, where
+  // they are met in the order of the vehicle list.
+  std::mutex mutex;
+  std::condition_variable border_done;
+  std::vector<unsigned long> strips_left(border.size());
+  std::vector<bool> updated(border.size(), false);
+  bool failed = false;
+  for (unsigned long k = 0u; k < border.size(); ++k) {
+    strips_left[k] = border_strips[k].second - border_strips[k].first + 1u;
+  }
+
+  run_tasks(shards.size(), [&](const unsigned long shard) {
+    try {
+      auto next = shards[shard].begin();
+      const auto end = shards[shard].end();
+      for (unsigned long k = 0u; k < border.size(); ++k) {
+        if (shard < border_strips[k].first || shard > border_strips[k].second) {
+          continue;
+        }
+        for (; next != end && *next < border[k]; ++next) {
+          update(*next);
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        if (--strips_left[k] == 0u) {
+          lock.unlock();
+          update(border[k]);
+          lock.lock();
+          updated[k] = true;
+          border_done.notify_all();
+        } else {
+          border_done.wait(lock, [&]() { return updated[k] || failed; });
+          if (failed) {
+            return;
+          }
+        }
+      }
+      for (; next != end; ++next) {
+        update(*next);
+      }
+    } catch (...) {
+      // Do not leave the other strips waiting for this one.
+      std::lock_guard<std::mutex> lock(mutex);
+      failed = true;
+      border_done.notify_all();
+      throw;
+    }
+  });
+}
+
+} // namespace traffic_manager
+} // namespace carla
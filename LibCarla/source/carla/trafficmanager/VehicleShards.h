@@ -0,0 +1,85 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#pragma once
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "carla/trafficmanager/DataStructures.h"
+#include "carla/trafficmanager/SimulationState.h"
+
+namespace carla {
+namespace traffic_manager {
+
+/// Splits the registered vehicles into strips of the map, so that the
+/// localization of vehicles in different strips can run concurrently.
+///
+/// The strips run across the longest side of the area covered by the
+/// vehicles and hold the same number of vehicles each. The reach of a
+/// vehicle in a cycle spans its current waypoint buffer plus the path it may
+/// add to it. Vehicles whose reach crosses the edge of their strip make up
+/// the border zone: they may share waypoints or geodesic grids with vehicles
+/// of the strips their reach overlaps.
+///
+/// Run() updates the strips concurrently, and each border vehicle once the
+/// strips it overlaps got to it. Vehicles whose reach overlaps are thus
+/// updated in the order of the vehicle list, giving the same result as
+/// updating every vehicle sequentially.
+class VehicleShards {
+public:
+  /// Runs the task function with every index from 0 to the number of tasks,
+  /// concurrently, returning once all of them are done.
+  using TaskRunner = std::function<void(const unsigned long,
+                                        const std::function<void(const unsigned long)> &)>;
+
+  /// Partitions the vehicles in @a vehicle_id_list into up to @a max_shards
+  /// strips. With too few vehicles, or a too small area, all of them end up
+  /// in a single shard.
+  void Update(const std::vector<ActorId> &vehicle_id_list,
+              const SimulationState &simulation_state,
+              const BufferMap &buffer_map,
+              const unsigned long max_shards);
+
+  /// Indices in the vehicle list of the vehicles inside each strip, in
+  /// increasing order.
+  const std::vector<std::vector<unsigned long>> &GetShards() const {
+    return shards;
+  }
+
+  /// Indices in the vehicle list of the vehicles in the border zone, in
+  /// increasing order.
+  const std::vector<unsigned long> &GetBorder() const {
+    return border;
+  }
+
+  /// First and last strip overlapped by the reach of each vehicle of the
+  /// border zone, in the order of GetBorder().
+  const std::vector<std::pair<unsigned long, unsigned long>> &GetBorderStrips() const {
+    return border_strips;
+  }
+
+  /// Calls @a update with the index of every vehicle. Each strip is a task of
+  /// @a run_tasks, which must run all of them at the same time, as they wait
+  /// for each other at the border vehicles they share.
+  void Run(const TaskRunner &run_tasks,
+           const std::function<void(const unsigned long)> &update) const;
+
+private:
+  std::vector<std::vector<unsigned long>> shards;
+  std::vector<unsigned long> border;
+  std::vector<std::pair<unsigned long, unsigned long>> border_strips;
+  /// End of each strip along the splitting axis, and start of the next one.
+  std::vector<float> strip_ends;
+  /// Position of each vehicle along the splitting axis with its index.
+  std::vector<std::pair<float, unsigned long>> sorted_vehicles;
+  /// Interval along the splitting axis reachable by each vehicle.
+  std::vector<std::pair<float, float>> reach;
+};
+
+} // namespace traffic_manager
+} // namespace carla
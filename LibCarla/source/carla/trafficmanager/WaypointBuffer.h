@@ -0,0 +1,165 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#pragma once
+
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+#include "carla/Exception.h"
+
+#include "carla/trafficmanager/Constants.h"
+#include "carla/trafficmanager/SimpleWaypoint.h"
+#include "carla/trafficmanager/WaypointGraph.h"
+
+namespace carla {
+namespace traffic_manager {
+
+  using constants::PathBufferUpdate::WAYPOINT_BUFFER_CAPACITY;
+
+  /// Path of a vehicle, stored as a ring buffer of indices into the
+  /// WaypointGraph of its waypoints. It offers the subset of the std::deque
+  /// interface used by the stages; the elements are returned as handles to
+  /// the graph, built from the index on every read.
+  ///
+  /// The capacity is fixed and a power of two, and only grows (doubling) in
+  /// the rare case a horizon does not fit.
+  class WaypointBuffer {
+  public:
+
+    class const_iterator {
+    public:
+
+      using iterator_category = std::input_iterator_tag;
+      using value_type = SimpleWaypointPtr;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const SimpleWaypointPtr *;
+      using reference = SimpleWaypointPtr;
+
+      const_iterator(const WaypointBuffer &buffer, size_t position)
+        : _buffer(&buffer),
+          _position(position) {}
+
+      reference operator*() const {
+        return (*_buffer)[_position];
+      }
+
+      const_iterator &operator++() {
+        ++_position;
+        return *this;
+      }
+
+      const_iterator operator++(int) {
+        const_iterator current = *this;
+        ++_position;
+        return current;
+      }
+
+      bool operator==(const const_iterator &rhs) const {
+        return _position == rhs._position;
+      }
+
+      bool operator!=(const const_iterator &rhs) const {
+        return _position != rhs._position;
+      }
+
+    private:
+
+      const WaypointBuffer *_buffer;
+      size_t _position;
+    };
+
+    WaypointBuffer()
+      : _indices(WAYPOINT_BUFFER_CAPACITY) {}
+
+    bool empty() const {
+      return _size == 0u;
+    }
+
+    size_t size() const {
+      return _size;
+    }
+
+    size_t capacity() const {
+      return _indices.size();
+    }
+
+    SimpleWaypointPtr operator[](size_t position) const {
+      return _graph->GetNode(_indices[Slot(position)]);
+    }
+
+    SimpleWaypointPtr at(size_t position) const {
+      if (position >= _size) {
+        carla::throw_exception(std::out_of_range("WaypointBuffer::at: position out of range"));
+      }
+      return (*this)[position];
+    }
+
+    SimpleWaypointPtr front() const {
+      return (*this)[0u];
+    }
+
+    SimpleWaypointPtr back() const {
+      return (*this)[_size - 1u];
+    }
+
+    const_iterator begin() const {
+      return const_iterator(*this, 0u);
+    }
+
+    const_iterator end() const {
+      return const_iterator(*this, _size);
+    }
+
+    /// The waypoint must belong to the same graph as the ones already in the
+    /// buffer.
+    void push_back(const SimpleWaypointPtr &waypoint) {
+      if (_size == _indices.size()) {
+        Grow();
+      }
+      _graph = &waypoint->GetGraph();
+      _indices[Slot(_size)] = waypoint->GetIndex();
+      ++_size;
+    }
+
+    void pop_front() {
+      _head = Slot(1u);
+      --_size;
+    }
+
+    void pop_back() {
+      --_size;
+    }
+
+    void clear() {
+      _head = 0u;
+      _size = 0u;
+    }
+
+  private:
+
+    size_t Slot(size_t position) const {
+      return (_head + position) & (_indices.size() - 1u);
+    }
+
+    void Grow() {
+      std::vector<WaypointIndex> indices(2u * _indices.size());
+      for (size_t i = 0u; i < _size; ++i) {
+        indices[i] = _indices[Slot(i)];
+      }
+      _indices.swap(indices);
+      _head = 0u;
+    }
+
+    const WaypointGraph *_graph = nullptr;
+    std::vector<WaypointIndex> _indices;
+    size_t _head = 0u;
+    size_t _size = 0u;
+  };
+
+} // namespace traffic_manager
+} // namespace carla
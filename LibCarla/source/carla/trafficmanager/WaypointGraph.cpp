@@ -0,0 +1,391 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "carla/client/Map.h"
+
+#include "carla/trafficmanager/SimpleWaypoint.h"
+#include "carla/trafficmanager/WaypointGraph.h"
+
+namespace carla {
+namespace traffic_manager {
+
+  static const char GRAPH_MAGIC[8] = {'C', 'A', 'R', 'L', 'A', 'T', 'M', 'G'};
+  static const uint32_t GRAPH_VERSION = 2u;
+
+  static_assert(sizeof(cg::Transform) == 6u * sizeof(float), "Unexpected padding in cg::Transform.");
+  static_assert(sizeof(cg::Vector3D) == 3u * sizeof(float), "Unexpected padding in cg::Vector3D.");
+  static_assert(sizeof(RoadOption) == 1u, "Unexpected size of RoadOption.");
+  static_assert(sizeof(WaypointGraph::Landmark) == 5u * sizeof(float), "Unexpected padding in WaypointGraph::Landmark.");
+
+  struct WaypointGraph::Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t number_of_waypoints;
+    uint32_t number_of_successors;
+    uint32_t number_of_predecessors;
+    uint32_t number_of_landmarks;
+    uint32_t number_of_landmark_links;
+  };
+
+  /// Byte offsets of the arrays in the buffer, placed one after the other
+  /// after the header and aligned to 8 bytes.
+  struct WaypointGraph::Layout {
+    size_t transforms;
+    size_t forward_vectors;
+    size_t ids;
+    size_t road_ids;
+    size_t section_ids;
+    size_t lane_ids;
+    size_t distances;
+    size_t geodesic_grid_ids;
+    size_t junction_ids;
+    size_t is_junction;
+    size_t road_options;
+    size_t successor_offsets;
+    size_t successors;
+    size_t predecessor_offsets;
+    size_t predecessors;
+    size_t left_indices;
+    size_t right_indices;
+    size_t landmark_offsets;
+    size_t landmark_links;
+    size_t landmarks;
+    size_t size = sizeof(Header);
+
+    explicit Layout(const Header &header) {
+      const size_t n = header.number_of_waypoints;
+      transforms = Place<cg::Transform>(n);
+      forward_vectors = Place<cg::Vector3D>(n);
+      ids = Place<uint64_t>(n);
+      road_ids = Place<carla::road::RoadId>(n);
+      section_ids = Place<carla::road::SectionId>(n);
+      lane_ids = Place<carla::road::LaneId>(n);
+      distances = Place<double>(n);
+      geodesic_grid_ids = Place<GeoGridId>(n);
+      junction_ids = Place<GeoGridId>(n);
+      is_junction = Place<uint8_t>(n);
+      road_options = Place<RoadOption>(n);
+      successor_offsets = Place<WaypointIndex>(n + 1u);
+      successors = Place<WaypointIndex>(header.number_of_successors);
+      predecessor_offsets = Place<WaypointIndex>(n + 1u);
+      predecessors = Place<WaypointIndex>(header.number_of_predecessors);
+      left_indices = Place<WaypointIndex>(n);
+      right_indices = Place<WaypointIndex>(n);
+      landmark_offsets = Place<uint32_t>(n + 1u);
+      landmark_links = Place<uint32_t>(header.number_of_landmark_links);
+      landmarks = Place<Landmark>(header.number_of_landmarks);
+    }
+
+  private:
+
+    template <typename T>
+    size_t Place(size_t count) {
+      const size_t offset = (size + 7u) & ~size_t(7u);
+      size = offset + count * sizeof(T);
+      return offset;
+    }
+  };
+
+  template <typename T>
+  static T *ArrayAt(uint8_t *data, size_t offset) {
+    return reinterpret_cast<T *>(data + offset);
+  }
+
+  template <typename T>
+  static const T *ArrayAt(const uint8_t *data, size_t offset) {
+    return reinterpret_cast<const T *>(data + offset);
+  }
+
+  void WaypointGraph::Build(
+      carla::SharedPtr<const cc::Map> world_map,
+      const std::vector<Node> &nodes,
+      const std::vector<Landmark> &landmarks_in) {
+    Clear();
+
+    Header header;
+    std::memcpy(header.magic, GRAPH_MAGIC, sizeof(GRAPH_MAGIC));
+    header.version = GRAPH_VERSION;
+    header.number_of_waypoints = static_cast<uint32_t>(nodes.size());
+    header.number_of_successors = 0u;
+    header.number_of_predecessors = 0u;
+    header.number_of_landmarks = static_cast<uint32_t>(landmarks_in.size());
+    header.number_of_landmark_links = 0u;
+    for (const Node &node : nodes) {
+      header.number_of_successors += static_cast<uint32_t>(node.next.size());
+      header.number_of_predecessors += static_cast<uint32_t>(node.previous.size());
+      header.number_of_landmark_links += static_cast<uint32_t>(node.landmarks.size());
+    }
+    const Layout layout(header);
+
+    // Zero initialized so the padding between arrays is deterministic.
+    std::shared_ptr<uint8_t> data(new uint8_t[layout.size](), std::default_delete<uint8_t[]>());
+    uint8_t *buffer = data.get();
+    std::memcpy(buffer, &header, sizeof(Header));
+
+    auto out_transforms = ArrayAt<cg::Transform>(buffer, layout.transforms);
+    auto out_forward_vectors = ArrayAt<cg::Vector3D>(buffer, layout.forward_vectors);
+    auto out_ids = ArrayAt<uint64_t>(buffer, layout.ids);
+    auto out_road_ids = ArrayAt<carla::road::RoadId>(buffer, layout.road_ids);
+    auto out_section_ids = ArrayAt<carla::road::SectionId>(buffer, layout.section_ids);
+    auto out_lane_ids = ArrayAt<carla::road::LaneId>(buffer, layout.lane_ids);
+    auto out_distances = ArrayAt<double>(buffer, layout.distances);
+    auto out_geodesic_grid_ids = ArrayAt<GeoGridId>(buffer, layout.geodesic_grid_ids);
+    auto out_junction_ids = ArrayAt<GeoGridId>(buffer, layout.junction_ids);
+    auto out_is_junction = ArrayAt<uint8_t>(buffer, layout.is_junction);
+    auto out_road_options = ArrayAt<RoadOption>(buffer, layout.road_options);
+    auto out_successor_offsets = ArrayAt<WaypointIndex>(buffer, layout.successor_offsets);
+    auto out_successors = ArrayAt<WaypointIndex>(buffer, layout.successors);
+    auto out_predecessor_offsets = ArrayAt<WaypointIndex>(buffer, layout.predecessor_offsets);
+    auto out_predecessors = ArrayAt<WaypointIndex>(buffer, layout.predecessors);
+    auto out_left_indices = ArrayAt<WaypointIndex>(buffer, layout.left_indices);
+    auto out_right_indices = ArrayAt<WaypointIndex>(buffer, layout.right_indices);
+    auto out_landmark_offsets = ArrayAt<uint32_t>(buffer, layout.landmark_offsets);
+    auto out_landmark_links = ArrayAt<uint32_t>(buffer, layout.landmark_links);
+    auto out_landmarks = ArrayAt<Landmark>(buffer, layout.landmarks);
+
+    WaypointIndex number_of_successors = 0u;
+    WaypointIndex number_of_predecessors = 0u;
+    uint32_t number_of_landmark_links = 0u;
+    for (size_t i = 0u; i < nodes.size(); ++i) {
+      const Node &node = nodes[i];
+      const WaypointPtr &waypoint = node.waypoint;
+      const cg::Transform &transform = waypoint->GetTransform();
+      out_transforms[i] = transform;
+      out_forward_vectors[i] = transform.rotation.GetForwardVector();
+      out_ids[i] = waypoint->GetId();
+      out_road_ids[i] = waypoint->GetRoadId();
+      out_section_ids[i] = waypoint->GetSectionId();
+      out_lane_ids[i] = waypoint->GetLaneId();
+      out_distances[i] = waypoint->GetDistance();
+      // Waypoints inside a junction are placed in the grid of the junction.
+      out_geodesic_grid_ids[i] = waypoint->IsJunction() ? waypoint->GetJunctionId() : node.geodesic_grid_id;
+      out_junction_ids[i] = waypoint->GetJunctionId();
+      out_is_junction[i] = node.is_junction ? 1u : 0u;
+      out_road_options[i] = node.road_option;
+      out_left_indices[i] = node.left;
+      out_right_indices[i] = node.right;
+
+      out_successor_offsets[i] = number_of_successors;
+      std::copy(node.next.begin(), node.next.end(), out_successors + number_of_successors);
+      number_of_successors += static_cast<WaypointIndex>(node.next.size());
+      out_predecessor_offsets[i] = number_of_predecessors;
+      std::copy(node.previous.begin(), node.previous.end(), out_predecessors + number_of_predecessors);
+      number_of_predecessors += static_cast<WaypointIndex>(node.previous.size());
+      out_landmark_offsets[i] = number_of_landmark_links;
+      std::copy(node.landmarks.begin(), node.landmarks.end(), out_landmark_links + number_of_landmark_links);
+      number_of_landmark_links += static_cast<uint32_t>(node.landmarks.size());
+    }
+    out_successor_offsets[nodes.size()] = number_of_successors;
+    out_predecessor_offsets[nodes.size()] = number_of_predecessors;
+    out_landmark_offsets[nodes.size()] = number_of_landmark_links;
+    std::copy(landmarks_in.begin(), landmarks_in.end(), out_landmarks);
+
+    _world_map = world_map;
+    _data = data;
+    _data_size = layout.size;
+    _size = header.number_of_waypoints;
+    SetUpArrays(buffer, layout);
+  }
+
+  bool WaypointGraph::IsGraphData(const uint8_t *data, size_t size) {
+    if (!HasGraphMagic(data, size)) {
+      return false;
+    }
+    Header header;
+    std::memcpy(&header, data, sizeof(Header));
+    return header.version == GRAPH_VERSION;
+  }
+
+  bool WaypointGraph::HasGraphMagic(const uint8_t *data, size_t size) {
+    if (data == nullptr || size < sizeof(Header)) {
+      return false;
+    }
+    return std::memcmp(data, GRAPH_MAGIC, sizeof(GRAPH_MAGIC)) == 0;
+  }
+
+  bool WaypointGraph::Load(
+      carla::SharedPtr<const cc::Map> world_map,
+      std::shared_ptr<const uint8_t> data,
+      size_t size) {
+    Clear();
+    if (!IsGraphData(data.get(), size) ||
+        reinterpret_cast<uintptr_t>(data.get()) % alignof(double) != 0u) {
+      return false;
+    }
+    Header header;
+    std::memcpy(&header, data.get(), sizeof(Header));
+    const Layout layout(header);
+    if (layout.size != size) {
+      return false;
+    }
+
+    _world_map = world_map;
+    _data = data;
+    _data_size = size;
+    _size = header.number_of_waypoints;
+    SetUpArrays(data.get(), layout);
+    if (!IsValid()) {
+      Clear();
+      return false;
+    }
+    return true;
+  }
+
+  void WaypointGraph::Write(std::ostream &out) const {
+    out.write(reinterpret_cast<const char *>(_data.get()), static_cast<std::streamsize>(_data_size));
+  }
+
+  void WaypointGraph::SetUpArrays(const uint8_t *data, const Layout &layout) {
+    transforms = ArrayAt<cg::Transform>(data, layout.transforms);
+    forward_vectors = ArrayAt<cg::Vector3D>(data, layout.forward_vectors);
+    ids = ArrayAt<uint64_t>(data, layout.ids);
+    road_ids = ArrayAt<carla::road::RoadId>(data, layout.road_ids);
+    section_ids = ArrayAt<carla::road::SectionId>(data, layout.section_ids);
+    lane_ids = ArrayAt<carla::road::LaneId>(data, layout.lane_ids);
+    distances = ArrayAt<double>(data, layout.distances);
+    geodesic_grid_ids = ArrayAt<GeoGridId>(data, layout.geodesic_grid_ids);
+    junction_ids = ArrayAt<GeoGridId>(data, layout.junction_ids);
+    is_junction = ArrayAt<uint8_t>(data, layout.is_junction);
+    road_options = ArrayAt<RoadOption>(data, layout.road_options);
+    successor_offsets = ArrayAt<WaypointIndex>(data, layout.successor_offsets);
+    successors = ArrayAt<WaypointIndex>(data, layout.successors);
+    predecessor_offsets = ArrayAt<WaypointIndex>(data, layout.predecessor_offsets);
+    predecessors = ArrayAt<WaypointIndex>(data, layout.predecessors);
+    left_indices = ArrayAt<WaypointIndex>(data, layout.left_indices);
+    right_indices = ArrayAt<WaypointIndex>(data, layout.right_indices);
+    landmark_offsets = ArrayAt<uint32_t>(data, layout.landmark_offsets);
+    landmark_links = ArrayAt<uint32_t>(data, layout.landmark_links);
+    landmarks = ArrayAt<Landmark>(data, layout.landmarks);
+  }
+
+  bool WaypointGraph::IsValid() const {
+    Header header;
+    std::memcpy(&header, _data.get(), sizeof(Header));
+    if (successor_offsets[0] != 0u || successor_offsets[_size] != header.number_of_successors ||
+        predecessor_offsets[0] != 0u || predecessor_offsets[_size] != header.number_of_predecessors ||
+        landmark_offsets[0] != 0u || landmark_offsets[_size] != header.number_of_landmark_links) {
+      return false;
+    }
+    for (WaypointIndex i = 0u; i < _size; ++i) {
+      if (successor_offsets[i] > successor_offsets[i + 1u] ||
+          predecessor_offsets[i] > predecessor_offsets[i + 1u] ||
+          landmark_offsets[i] > landmark_offsets[i + 1u] ||
+          (left_indices[i] >= _size && left_indices[i] != INVALID_WAYPOINT_INDEX) ||
+          (right_indices[i] >= _size && right_indices[i] != INVALID_WAYPOINT_INDEX) ||
+          road_options[i] > RoadOption::RoadEnd) {
+        return false;
+      }
+    }
+    auto is_index = [this](const WaypointIndex index) { return index < _size; };
+    auto is_landmark_index = [&header](const uint32_t index) { return index < header.number_of_landmarks; };
+    auto is_landmark = [](const Landmark &landmark) { return landmark.type <= LandmarkType::SpeedLimit; };
+    return std::all_of(successors, successors + header.number_of_successors, is_index) &&
+        std::all_of(predecessors, predecessors + header.number_of_predecessors, is_index) &&
+        std::all_of(landmark_links, landmark_links + header.number_of_landmark_links, is_landmark_index) &&
+        std::all_of(landmarks, landmarks + header.number_of_landmarks, is_landmark);
+  }
+
+  void WaypointGraph::Clear() {
+    _world_map.reset();
+    _data.reset();
+    _data_size = 0u;
+    _size = 0u;
+    transforms = nullptr;
+    forward_vectors = nullptr;
+    ids = nullptr;
+    road_ids = nullptr;
+    section_ids = nullptr;
+    lane_ids = nullptr;
+    distances = nullptr;
+    geodesic_grid_ids = nullptr;
+    junction_ids = nullptr;
+    is_junction = nullptr;
+    road_options = nullptr;
+    successor_offsets = nullptr;
+    successors = nullptr;
+    predecessor_offsets = nullptr;
+    predecessors = nullptr;
+    left_indices = nullptr;
+    right_indices = nullptr;
+    landmark_offsets = nullptr;
+    landmark_links = nullptr;
+    landmarks = nullptr;
+  }
+
+  size_t WaypointGraph::GetMemoryUsage() const {
+    return sizeof(WaypointGraph) + _data_size;
+  }
+
+  std::vector<SimpleWaypointPtr> WaypointGraph::GetNodes() const {
+    std::vector<SimpleWaypointPtr> nodes;
+    nodes.reserve(_size);
+    for (WaypointIndex i = 0u; i < _size; ++i) {
+      nodes.push_back(GetNode(i));
+    }
+    return nodes;
+  }
+
+  /// Shortest distance each waypoint was reached with by a call to
+  /// GetLandmarksInDistance, valid only where the stamp is the one of the
+  /// call. Kept per thread, so a call does not clear the arrays nor allocate
+  /// once they have grown to the size of the graph.
+  struct VisitedWaypoints {
+    std::vector<uint32_t> stamps;
+    std::vector<float> distances;
+    uint32_t stamp = 0u;
+  };
+
+  std::vector<uint32_t> WaypointGraph::GetLandmarksInDistance(
+      const WaypointIndex index,
+      const float distance) const {
+    std::vector<uint32_t> result;
+    static thread_local VisitedWaypoints visited;
+    if (visited.stamps.size() < _size) {
+      visited.stamps.resize(_size, 0u);
+      visited.distances.resize(_size);
+    }
+    if (++visited.stamp == 0u) {
+      std::fill(visited.stamps.begin(), visited.stamps.end(), 0u);
+      visited.stamp = 1u;
+    }
+    // Waypoints to visit, with the distance travelled to reach them.
+    std::vector<std::pair<WaypointIndex, float>> pending{{index, 0.0f}};
+    while (!pending.empty()) {
+      const auto current = pending.back();
+      pending.pop_back();
+      if (visited.stamps[current.first] == visited.stamp &&
+          visited.distances[current.first] <= current.second) {
+        continue;
+      }
+      visited.stamps[current.first] = visited.stamp;
+      visited.distances[current.first] = current.second;
+
+      // The landmarks of a waypoint lie between it and its successors.
+      for (auto it = LandmarksBegin(current.first); it != LandmarksEnd(current.first); ++it) {
+        if (std::find(result.begin(), result.end(), *it) == result.end()) {
+          result.push_back(*it);
+        }
+      }
+      for (auto it = SuccessorsBegin(current.first); it != SuccessorsEnd(current.first); ++it) {
+        const float travelled = current.second + GetLocation(current.first).Distance(GetLocation(*it));
+        if (travelled <= distance) {
+          pending.emplace_back(*it, travelled);
+        }
+      }
+    }
+    return result;
+  }
+
+  WaypointPtr WaypointGraph::MakeWaypoint(const WaypointIndex index) const {
+    return _world_map->GetWaypointXODR(road_ids[index], lane_ids[index], static_cast<float>(distances[index]));
+  }
+
+} // namespace traffic_manager
+} // namespace carla
@@ -0,0 +1,285 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "carla/client/Waypoint.h"
+#include "carla/geom/Location.h"
+#include "carla/geom/Transform.h"
+#include "carla/geom/Vector3D.h"
+#include "carla/Memory.h"
+#include "carla/NonCopyable.h"
+#include "carla/road/RoadTypes.h"
+
+namespace carla {
+namespace client {
+  class Map;
+} // namespace client
+
+namespace traffic_manager {
+
+  namespace cc = carla::client;
+  namespace cg = carla::geom;
+  using WaypointPtr = carla::SharedPtr<cc::Waypoint>;
+  using GeoGridId = carla::road::JuncId;
+
+  enum class RoadOption : uint8_t {
+    Void = 0,
+    Left = 1,
+    Right = 2,
+    Straight = 3,
+    LaneFollow = 4,
+    ChangeLaneLeft = 5,
+    ChangeLaneRight = 6,
+    RoadEnd = 7
+  };
+
+  /// Position of a waypoint in the WaypointGraph.
+  using WaypointIndex = uint32_t;
+  static const WaypointIndex INVALID_WAYPOINT_INDEX = std::numeric_limits<WaypointIndex>::max();
+
+  /// Kinds of landmark limiting the speed of the vehicles, the only ones
+  /// kept in the graph.
+  enum class LandmarkType : uint8_t {
+    TrafficLight = 0,
+    Stop = 1,
+    Yield = 2,
+    SpeedLimit = 3
+  };
+
+  class SimpleWaypointPtr;
+
+  /// Compact representation of the discrete samples of the world map. The
+  /// attributes of every waypoint are stored in contiguous arrays, and the
+  /// links between waypoints as 32-bit indices into them. The carla waypoint
+  /// of a sample is not kept but recreated from the map when requested, so
+  /// everything the stages read every tick, including the landmarks ahead of
+  /// each waypoint, is resolved when the graph is built.
+  ///
+  /// All the arrays live in a single buffer, which is also the format of the
+  /// cooked cache: a cache file can be memory-mapped and used in place.
+  ///
+  /// The waypoints are handed out as SimpleWaypointPtr, a handle made of the
+  /// graph and the index of the waypoint.
+  class WaypointGraph : private NonCopyable {
+  public:
+
+    /// Landmark limiting the speed, with the location of its waypoint and
+    /// its value (km/h for speed limits).
+    struct Landmark {
+      cg::Location location;
+      float value = 0.0f;
+      LandmarkType type = LandmarkType::TrafficLight;
+      uint8_t padding[3] = {0u, 0u, 0u};
+    };
+
+    /// Description of a waypoint used to build the graph, with its links as
+    /// indices into the list of descriptions, and the landmarks found between
+    /// it and its successors as indices into the list of landmarks.
+    struct Node {
+      WaypointPtr waypoint;
+      std::vector<WaypointIndex> next;
+      std::vector<WaypointIndex> previous;
+      WaypointIndex left = INVALID_WAYPOINT_INDEX;
+      WaypointIndex right = INVALID_WAYPOINT_INDEX;
+      GeoGridId geodesic_grid_id = 0;
+      RoadOption road_option = RoadOption::Void;
+      bool is_junction = false;
+      std::vector<uint32_t> landmarks;
+    };
+
+    WaypointGraph() = default;
+
+    /// Replace the content of the graph with @a nodes and the @a landmarks
+    /// they refer to. The handles of any previous content are invalidated.
+    void Build(
+        carla::SharedPtr<const cc::Map> world_map,
+        const std::vector<Node> &nodes,
+        const std::vector<Landmark> &landmarks);
+
+    /// Replace the content of the graph with the @a size bytes at @a data, as
+    /// written by Write. The data is used in place and kept alive by the
+    /// graph. Returns false, leaving the graph empty, if the data is not a
+    /// valid graph.
+    bool Load(
+        carla::SharedPtr<const cc::Map> world_map,
+        std::shared_ptr<const uint8_t> data,
+        size_t size);
+
+    /// Returns true if @a data starts like a buffer written by Write, of the
+    /// current version.
+    static bool IsGraphData(const uint8_t *data, size_t size);
+
+    /// Returns true if @a data starts like a buffer written by Write, of any
+    /// version.
+    static bool HasGraphMagic(const uint8_t *data, size_t size);
+
+    void Write(std::ostream &out) const;
+
+    void Clear();
+
+    size_t Size() const {
+      return _size;
+    }
+
+    /// Approximate number of bytes used by the graph.
+    size_t GetMemoryUsage() const;
+
+    /// Handle to a waypoint, defined in SimpleWaypoint.h.
+    SimpleWaypointPtr GetNode(const WaypointIndex index) const;
+
+    /// Handles to all the waypoints, in index order.
+    std::vector<SimpleWaypointPtr> GetNodes() const;
+
+    const cg::Transform &GetTransform(const WaypointIndex index) const {
+      return transforms[index];
+    }
+
+    const cg::Location &GetLocation(const WaypointIndex index) const {
+      return transforms[index].location;
+    }
+
+    const cg::Vector3D &GetForwardVector(const WaypointIndex index) const {
+      return forward_vectors[index];
+    }
+
+    uint64_t GetId(const WaypointIndex index) const {
+      return ids[index];
+    }
+
+    carla::road::RoadId GetRoadId(const WaypointIndex index) const {
+      return road_ids[index];
+    }
+
+    carla::road::SectionId GetSectionId(const WaypointIndex index) const {
+      return section_ids[index];
+    }
+
+    carla::road::LaneId GetLaneId(const WaypointIndex index) const {
+      return lane_ids[index];
+    }
+
+    double GetDistance(const WaypointIndex index) const {
+      return distances[index];
+    }
+
+    GeoGridId GetGeodesicGridId(const WaypointIndex index) const {
+      return geodesic_grid_ids[index];
+    }
+
+    GeoGridId GetJunctionId(const WaypointIndex index) const {
+      return junction_ids[index];
+    }
+
+    bool IsJunction(const WaypointIndex index) const {
+      return is_junction[index] != 0u;
+    }
+
+    RoadOption GetRoadOption(const WaypointIndex index) const {
+      return road_options[index];
+    }
+
+    /// Indices of the successors of a waypoint, as [begin, end) pointers.
+    const WaypointIndex *SuccessorsBegin(const WaypointIndex index) const {
+      return successors + successor_offsets[index];
+    }
+
+    const WaypointIndex *SuccessorsEnd(const WaypointIndex index) const {
+      return successors + successor_offsets[index + 1u];
+    }
+
+    size_t GetNumberOfSuccessors(const WaypointIndex index) const {
+      return successor_offsets[index + 1u] - successor_offsets[index];
+    }
+
+    const WaypointIndex *PredecessorsBegin(const WaypointIndex index) const {
+      return predecessors + predecessor_offsets[index];
+    }
+
+    const WaypointIndex *PredecessorsEnd(const WaypointIndex index) const {
+      return predecessors + predecessor_offsets[index + 1u];
+    }
+
+    WaypointIndex GetLeft(const WaypointIndex index) const {
+      return left_indices[index];
+    }
+
+    WaypointIndex GetRight(const WaypointIndex index) const {
+      return right_indices[index];
+    }
+
+    /// Indices of the landmarks between a waypoint and its successors, as
+    /// [begin, end) pointers.
+    const uint32_t *LandmarksBegin(const WaypointIndex index) const {
+      return landmark_links + landmark_offsets[index];
+    }
+
+    const uint32_t *LandmarksEnd(const WaypointIndex index) const {
+      return landmark_links + landmark_offsets[index + 1u];
+    }
+
+    const Landmark &GetLandmark(const uint32_t landmark_index) const {
+      return landmarks[landmark_index];
+    }
+
+    /// Indices of the landmarks ahead of a waypoint, following all its
+    /// successors up to @a distance meters away. Each landmark is listed once.
+    std::vector<uint32_t> GetLandmarksInDistance(const WaypointIndex index, const float distance) const;
+
+    /// Recreates the carla waypoint of a sample from the map.
+    WaypointPtr MakeWaypoint(const WaypointIndex index) const;
+
+  private:
+
+    struct Header;
+    struct Layout;
+
+    /// Points the arrays to their place in @a data.
+    void SetUpArrays(const uint8_t *data, const Layout &layout);
+
+    bool IsValid() const;
+
+    carla::SharedPtr<const cc::Map> _world_map;
+
+    /// Buffer holding the header and all the arrays.
+    std::shared_ptr<const uint8_t> _data;
+    size_t _data_size = 0u;
+    WaypointIndex _size = 0u;
+
+    const cg::Transform *transforms = nullptr;
+    const cg::Vector3D *forward_vectors = nullptr;
+    const uint64_t *ids = nullptr;
+    const carla::road::RoadId *road_ids = nullptr;
+    const carla::road::SectionId *section_ids = nullptr;
+    const carla::road::LaneId *lane_ids = nullptr;
+    const double *distances = nullptr;
+    const GeoGridId *geodesic_grid_ids = nullptr;
+    const GeoGridId *junction_ids = nullptr;
+    const uint8_t *is_junction = nullptr;
+    const RoadOption *road_options = nullptr;
+
+    /// Links in compressed sparse row layout: the successors of waypoint i
+    /// are successors[successor_offsets[i]] to successors[successor_offsets[i + 1] - 1].
+    const WaypointIndex *successor_offsets = nullptr;
+    const WaypointIndex *successors = nullptr;
+    const WaypointIndex *predecessor_offsets = nullptr;
+    const WaypointIndex *predecessors = nullptr;
+    const WaypointIndex *left_indices = nullptr;
+    const WaypointIndex *right_indices = nullptr;
+    /// Landmarks, linked to the waypoints in the same layout as the successors.
+    const uint32_t *landmark_offsets = nullptr;
+    const uint32_t *landmark_links = nullptr;
+    const Landmark *landmarks = nullptr;
+  };
+
+} // namespace traffic_manager
+} // namespace carla
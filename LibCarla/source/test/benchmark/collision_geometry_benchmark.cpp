@@ -0,0 +1,208 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+// Benchmark of the polygon distances of the collision stage.
+//
+//   collision_geometry_benchmark [--pairs <n>] [--runs <n>] [--seed <n>]
+//
+// Computes the distances between the bounding boxes and path boundaries of
+// random pairs of actors with boost.geometry, as the collision stage used to,
+// and with the flat polygons of CollisionGeometry, and prints the time spent
+// by each. Fails if the mean difference between both is above 2 mm.
+
+#include <carla/StopWatch.h>
+#include <carla/geom/Location.h>
+#include <carla/trafficmanager/CollisionGeometry.h>
+
+#include <boost/geometry.hpp>
+#include <boost/geometry/geometries/point_xy.hpp>
+#include <boost/geometry/geometries/polygon.hpp>
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bg = boost::geometry;
+
+using carla::geom::Location;
+using carla::traffic_manager::CollisionPolygon;
+using LocationVector = std::vector<Location>;
+using BoostPolygon = bg::model::polygon<bg::model::d2::point_xy<double>>;
+
+static BoostPolygon MakeBoostPolygon(const LocationVector &boundary) {
+  using Point2D = bg::model::point<double, 2, bg::cs::cartesian>;
+  BoostPolygon polygon;
+  for (const Location &location : boundary) {
+    bg::append(polygon.outer(), Point2D(location.x, location.y));
+  }
+  bg::append(polygon.outer(), Point2D(boundary.front().x, boundary.front().y));
+  return polygon;
+}
+
+// Corners of a bounding box in the same order as CollisionStage::GetBoundary.
+static LocationVector MakeBoundingBox(
+    const Location &location,
+    float yaw,
+    float half_length,
+    float half_width) {
+  const Location x_boundary(std::cos(yaw) * half_length, std::sin(yaw) * half_length, 0.0f);
+  const Location y_boundary(-std::sin(yaw) * half_width, std::cos(yaw) * half_width, 0.0f);
+  return {
+      location + x_boundary - y_boundary,
+      location - x_boundary - y_boundary,
+      location - x_boundary + y_boundary,
+      location + x_boundary + y_boundary};
+}
+
+// Path boundary following an arc ahead of the vehicle, built the same way as
+// CollisionStage::ComputeGeodesicBoundary.
+static LocationVector MakeGeodesicBoundary(
+    const Location &location,
+    float yaw,
+    float half_length,
+    float half_width,
+    float curvature,
+    float path_length) {
+  constexpr float step = 2.0f;
+  LocationVector left_boundary;
+  LocationVector right_boundary;
+  Location point = location + Location(std::cos(yaw) * half_length, std::sin(yaw) * half_length, 0.0f);
+  float heading = yaw;
+  for (float travelled = 0.0f; travelled <= path_length; travelled += step) {
+    const Location perpendicular(-std::sin(heading) * half_width, std::cos(heading) * half_width, 0.0f);
+    left_boundary.push_back(point + perpendicular);
+    right_boundary.push_back(point - perpendicular);
+    point += Location(std::cos(heading) * step, std::sin(heading) * step, 0.0f);
+    heading += curvature * step;
+  }
+  LocationVector boundary(right_boundary.rbegin(), right_boundary.rend());
+  const LocationVector bbox = MakeBoundingBox(location, yaw, half_length, half_width);
+  boundary.insert(boundary.end(), bbox.begin(), bbox.end());
+  boundary.insert(boundary.end(), left_boundary.begin(), left_boundary.end());
+  return boundary;
+}
+
+struct Actor {
+  LocationVector bbox;
+  LocationVector geodesic;
+};
+
+class ActorGenerator {
+public:
+
+  explicit ActorGenerator(unsigned seed) : _engine(seed) {}
+
+  // Two actors close to each other, far from the origin as in large maps.
+  std::pair<Actor, Actor> MakePair() {
+    const Location origin(Uniform(-2000.0f, 2000.0f), Uniform(-2000.0f, 2000.0f), 0.0f);
+    Actor first = MakeActor(origin, 15.0f);
+    Actor second = MakeActor(origin, 15.0f);
+    return {std::move(first), std::move(second)};
+  }
+
+private:
+
+  float Uniform(float min, float max) {
+    return std::uniform_real_distribution<float>(min, max)(_engine);
+  }
+
+  Actor MakeActor(const Location &origin, float radius) {
+    const Location location = origin + Location(Uniform(-radius, radius), Uniform(-radius, radius), 0.0f);
+    const float yaw = Uniform(-static_cast<float>(M_PI), static_cast<float>(M_PI));
+    const float half_length = Uniform(0.3f, 3.0f);
+    const float half_width = Uniform(0.3f, 1.2f);
+    const float curvature = Uniform(-0.08f, 0.08f);
+    const float path_length = Uniform(2.0f, 40.0f);
+    return {
+        MakeBoundingBox(location, yaw, half_length, half_width),
+        MakeGeodesicBoundary(location, yaw, half_length, half_width, curvature, path_length)};
+  }
+
+  std::mt19937 _engine;
+};
+
+static int Usage() {
+  std::cerr << "usage: collision_geometry_benchmark [--pairs <n>] [--runs <n>] [--seed <n>]\n";
+  return 1;
+}
+
+int main(int argc, char *argv[]) {
+  size_t number_of_pairs = 1000u;
+  size_t number_of_runs = 10u;
+  unsigned seed = 0u;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 >= argc) {
+      return Usage();
+    }
+    const auto value = std::strtoul(argv[i + 1], nullptr, 10);
+    if (std::strcmp(argv[i], "--pairs") == 0) {
+      number_of_pairs = value;
+    } else if (std::strcmp(argv[i], "--runs") == 0) {
+      number_of_runs = value;
+    } else if (std::strcmp(argv[i], "--seed") == 0) {
+      seed = static_cast<unsigned>(value);
+    } else {
+      return Usage();
+    }
+    ++i;
+  }
+
+  ActorGenerator generator(seed);
+  std::vector<std::pair<Actor, Actor>> pairs;
+  for (size_t i = 0u; i < number_of_pairs; ++i) {
+    pairs.emplace_back(generator.MakePair());
+  }
+
+  // The four comparisons computed by the collision stage for a pair of actors.
+  std::vector<std::pair<const LocationVector *, const LocationVector *>> comparisons;
+  for (const auto &pair : pairs) {
+    comparisons.emplace_back(&pair.first.bbox, &pair.second.geodesic);
+    comparisons.emplace_back(&pair.second.bbox, &pair.first.geodesic);
+    comparisons.emplace_back(&pair.first.geodesic, &pair.second.geodesic);
+    comparisons.emplace_back(&pair.first.bbox, &pair.second.bbox);
+  }
+
+  // Both paths include building the polygons from the boundaries, as the
+  // collision stage does for every pair.
+  double boost_sum = 0.0;
+  carla::StopWatch boost_timer;
+  for (size_t run = 0u; run < number_of_runs; ++run) {
+    for (const auto &comparison : comparisons) {
+      boost_sum += bg::distance(
+          MakeBoostPolygon(*comparison.first),
+          MakeBoostPolygon(*comparison.second));
+    }
+  }
+  boost_timer.Stop();
+
+  double flat_sum = 0.0;
+  carla::StopWatch flat_timer;
+  for (size_t run = 0u; run < number_of_runs; ++run) {
+    for (const auto &comparison : comparisons) {
+      flat_sum += CollisionPolygon(*comparison.first).Distance(CollisionPolygon(*comparison.second));
+    }
+  }
+  flat_timer.Stop();
+
+  const size_t number_of_distances = number_of_runs * comparisons.size();
+  std::cout << "polygon distance x" << number_of_distances
+            << ": boost.geometry " << boost_timer.GetElapsedTime<std::chrono::microseconds>() << "us"
+            << ", flat arrays " << flat_timer.GetElapsedTime<std::chrono::microseconds>() << "us"
+            << std::endl;
+
+  const double mean_error = number_of_distances == 0u ? 0.0 :
+      std::abs(flat_sum - boost_sum) / static_cast<double>(number_of_distances);
+  if (mean_error >= 0.002) {
+    std::cerr << "mean difference with boost.geometry too large: " << mean_error << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,211 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+// Offline benchmark of the stages of the Traffic Manager.
+//
+//   tm_replay_benchmark record <host> <port> <frames> <recording> [<xodr>]
+//
+// Captures the state of the actors of a running simulation for the given
+// number of ticks, and optionally saves the OpenDRIVE of its map.
+//
+//   tm_replay_benchmark replay <xodr> <recording> [--seed <n>] [--repeat <n>] [--commands <path>]
+//
+// Replays the recording through the localization, collision and motion
+// planner stages at full speed, and prints the time spent in each of them
+// along with a checksum of the commands produced. Two builds that produce
+// the same checksum for the same recording and seed behave the same.
+
+#include <carla/Buffer.h>
+#include <carla/MsgPack.h>
+#include <carla/client/Client.h>
+#include <carla/client/Map.h>
+#include <carla/client/World.h>
+#include <carla/rpc/Command.h>
+#include <carla/trafficmanager/ReplayHarness.h>
+#include <carla/trafficmanager/ReplayRecording.h>
+
+#include <boost/make_shared.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+
+namespace cc = carla::client;
+namespace ctm = carla::traffic_manager;
+
+using Clock = std::chrono::steady_clock;
+
+static int Usage() {
+  std::cerr << "usage:\n"
+            << "  tm_replay_benchmark record <host> <port> <frames> <recording> [<xodr>]\n"
+            << "  tm_replay_benchmark replay <xodr> <recording> [--seed <n>] [--repeat <n>] [--commands <path>]\n";
+  return 1;
+}
+
+static std::string ReadFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in.good()) {
+    throw std::runtime_error("unable to open " + path);
+  }
+  return std::string{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+}
+
+static uint64_t Fnv1a(const unsigned char *data, const size_t size, uint64_t hash) {
+  for (size_t i = 0u; i < size; ++i) {
+    hash ^= data[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+namespace {
+
+  struct CommandWriter {
+    std::ostream &out;
+
+    void operator()(const carla::rpc::Command::ApplyVehicleControl &command) const {
+      const auto &control = command.control;
+      out << command.actor << " control " << control.throttle << ' ' << control.steer << ' '
+          << control.brake << ' ' << control.hand_brake << ' ' << control.reverse << '\n';
+    }
+
+    void operator()(const carla::rpc::Command::ApplyTransform &command) const {
+      WriteTransform(command.actor, command.transform);
+    }
+
+    void operator()(const carla::rpc::Command::ApplyTransforms &command) const {
+      for (size_t i = 0u; i < command.actors.size(); ++i) {
+        WriteTransform(command.actors[i], command.transforms[i]);
+      }
+    }
+
+    void WriteTransform(const carla::ActorId actor, const carla::geom::Transform &transform) const {
+      out << actor << " transform " << transform.location.x << ' ' << transform.location.y << ' '
+          << transform.location.z << ' ' << transform.rotation.yaw << '\n';
+    }
+
+    template <typename T>
+    void operator()(const T &) const {
+      out << "other\n";
+    }
+  };
+
+} // namespace
+
+static int Record(const std::string &host, const uint16_t port, const size_t frames,
+                  const std::string &recording_path, const std::string &xodr_path) {
+  cc::Client client(host, port);
+  client.SetTimeout(std::chrono::seconds(10));
+  cc::World world = client.GetWorld();
+
+  ctm::ReplayRecording recording;
+  for (size_t i = 0u; i < frames; ++i) {
+    recording.Capture(world, world.WaitForTick(std::chrono::seconds(10)));
+  }
+  recording.Save(recording_path);
+  if (!xodr_path.empty()) {
+    std::ofstream out(xodr_path, std::ios::binary | std::ios::trunc);
+    out << world.GetMap()->GetOpenDrive();
+  }
+  std::cout << "recorded " << recording.frames.size() << " frames, "
+            << recording.actors.size() << " actors of " << recording.map_name << '\n';
+  return 0;
+}
+
+static int Replay(const std::string &xodr_path, const std::string &recording_path,
+                  const uint64_t seed, const size_t repeat, const std::string &commands_path) {
+  ctm::ReplayRecording recording = ctm::ReplayRecording::Load(recording_path);
+  auto map = boost::make_shared<cc::Map>(recording.map_name, ReadFile(xodr_path));
+
+  std::ofstream commands_file;
+  if (!commands_path.empty()) {
+    commands_file.open(commands_path, std::ios::trunc);
+  }
+
+  for (size_t run = 0u; run < repeat; ++run) {
+    const Clock::time_point setup_begin = Clock::now();
+    ctm::ReplayHarness harness(map, recording, seed);
+    const Clock::time_point replay_begin = Clock::now();
+
+    uint64_t checksum = 14695981039346656037ull;
+    while (harness.Step()) {
+      const carla::Buffer buffer = carla::MsgPack::Pack(harness.GetCommands());
+      checksum = Fnv1a(buffer.data(), buffer.size(), checksum);
+      if (run == 0u && commands_file.is_open()) {
+        commands_file << "frame " << harness.GetFrameIndex() - 1u << '\n';
+        CommandWriter writer{commands_file};
+        for (const auto &command : harness.GetCommands()) {
+          boost::variant2::visit(writer, command.command);
+        }
+      }
+    }
+    const Clock::time_point replay_end = Clock::now();
+
+    const ctm::TrafficManagerTimings timings = harness.GetTimings();
+    std::printf("run %zu: %llu frames, %.1f vehicles per frame, setup %.3f s, replay %.3f s\n",
+        run,
+        static_cast<unsigned long long>(timings.cycles),
+        timings.mean_vehicles,
+        std::chrono::duration<double>(replay_begin - setup_begin).count(),
+        std::chrono::duration<double>(replay_end - replay_begin).count());
+    std::printf("%-14s %10s %10s %10s %10s %10s %14s\n",
+        "stage", "mean ms", "p50 ms", "p90 ms", "p99 ms", "max ms", "us per vehicle");
+    for (const auto &stage : timings.stages) {
+      if (stage.count == 0u) {
+        continue;
+      }
+      const double per_vehicle = timings.mean_vehicles > 0.0 ? 1e3 * stage.mean / timings.mean_vehicles : 0.0;
+      std::printf("%-14s %10.3f %10.3f %10.3f %10.3f %10.3f %14.2f\n",
+          stage.name.c_str(), stage.mean, stage.p50, stage.p90, stage.p99, stage.max, per_vehicle);
+    }
+    std::printf("commands checksum %016llx\n", static_cast<unsigned long long>(checksum));
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  try {
+    const std::string mode = argc > 1 ? argv[1] : "";
+    if (mode == "record" && (argc == 6 || argc == 7)) {
+      return Record(argv[2],
+                    static_cast<uint16_t>(std::stoul(argv[3])),
+                    std::stoul(argv[4]),
+                    argv[5],
+                    argc == 7 ? argv[6] : "");
+    }
+    if (mode == "replay" && argc >= 4) {
+      uint64_t seed = 0u;
+      size_t repeat = 1u;
+      std::string commands_path;
+      for (int i = 4; i < argc; i += 2) {
+        const std::string option = argv[i];
+        if (i + 1 >= argc) {
+          return Usage();
+        } else if (option == "--seed") {
+          seed = std::stoull(argv[i + 1]);
+        } else if (option == "--repeat") {
+          repeat = std::stoul(argv[i + 1]);
+        } else if (option == "--commands") {
+          commands_path = argv[i + 1];
+        } else {
+          return Usage();
+        }
+      }
+      return Replay(argv[2], argv[3], seed, repeat, commands_path);
+    }
+    return Usage();
+  } catch (const std::exception &e) {
+    std::cerr << "error: " << e.what() << '\n';
+    return 1;
+  }
+}
@@ -0,0 +1,156 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#include "test.h"
+#include "Random.h"
+
+#include <carla/trafficmanager/CollisionGeometry.h>
+
+#include <boost/geometry.hpp>
+#include <boost/geometry/geometries/point_xy.hpp>
+#include <boost/geometry/geometries/polygon.hpp>
+
+#include <cmath>
+#include <vector>
+
+namespace bg = boost::geometry;
+
+using carla::geom::Location;
+using carla::traffic_manager::CollisionPolygon;
+using LocationVector = std::vector<Location>;
+using BoostPolygon = bg::model::polygon<bg::model::d2::point_xy<double>>;
+
+// Polygon built as the collision stage used to before the flat kernels.
+static BoostPolygon make_boost_polygon(const LocationVector &boundary) {
+  using Point2D = bg::model::point<double, 2, bg::cs::cartesian>;
+  BoostPolygon polygon;
+  for (const Location &location : boundary) {
+    bg::append(polygon.outer(), Point2D(location.x, location.y));
+  }
+  bg::append(polygon.outer(), Point2D(boundary.front().x, boundary.front().y));
+  return polygon;
+}
+
+// Corners of a bounding box in the same order as CollisionStage::GetBoundary.
+static LocationVector make_bounding_box(
+    const Location &location,
+    float yaw,
+    float half_length,
+    float half_width) {
+  const Location x_boundary(std::cos(yaw) * half_length, std::sin(yaw) * half_length, 0.0f);
+  const Location y_boundary(-std::sin(yaw) * half_width, std::cos(yaw) * half_width, 0.0f);
+  return {
+      location + x_boundary - y_boundary,
+      location - x_boundary - y_boundary,
+      location - x_boundary + y_boundary,
+      location + x_boundary + y_boundary};
+}
+
+// Path boundary following an arc ahead of the vehicle, built the same way as
+// CollisionStage::ComputeGeodesicBoundary.
+static LocationVector make_geodesic_boundary(
+    const Location &location,
+    float yaw,
+    float half_length,
+    float half_width,
+    float curvature,
+    float path_length) {
+  constexpr float step = 2.0f;
+  LocationVector left_boundary;
+  LocationVector right_boundary;
+  Location point = location + Location(std::cos(yaw) * half_length, std::sin(yaw) * half_length, 0.0f);
+  float heading = yaw;
+  for (float travelled = 0.0f; travelled <= path_length; travelled += step) {
+    const Location perpendicular(-std::sin(heading) * half_width, std::cos(heading) * half_width, 0.0f);
+    left_boundary.push_back(point + perpendicular);
+    right_boundary.push_back(point - perpendicular);
+    point += Location(std::cos(heading) * step, std::sin(heading) * step, 0.0f);
+    heading += curvature * step;
+  }
+  LocationVector boundary(right_boundary.rbegin(), right_boundary.rend());
+  const LocationVector bbox = make_bounding_box(location, yaw, half_length, half_width);
+  boundary.insert(boundary.end(), bbox.begin(), bbox.end());
+  boundary.insert(boundary.end(), left_boundary.begin(), left_boundary.end());
+  return boundary;
+}
+
+struct Actor {
+  LocationVector bbox;
+  LocationVector geodesic;
+};
+
+static Actor make_random_actor(const Location &origin, float radius) {
+  const Location location = origin + Location(
+      static_cast<float>(util::Random::Uniform(-radius, radius)),
+      static_cast<float>(util::Random::Uniform(-radius, radius)),
+      0.0f);
+  const float yaw = static_cast<float>(util::Random::Uniform(-M_PI, M_PI));
+  const float half_length = static_cast<float>(util::Random::Uniform(0.3, 3.0));
+  const float half_width = static_cast<float>(util::Random::Uniform(0.3, 1.2));
+  const float curvature = static_cast<float>(util::Random::Uniform(-0.08, 0.08));
+  const float path_length = static_cast<float>(util::Random::Uniform(2.0, 40.0));
+  return {
+      make_bounding_box(location, yaw, half_length, half_width),
+      make_geodesic_boundary(location, yaw, half_length, half_width, curvature, path_length)};
+}
+
+// The four comparisons computed by the collision stage for a pair of actors.
+static std::vector<std::pair<const LocationVector *, const LocationVector *>> make_comparisons(
+    const std::vector<std::pair<Actor, Actor>> &pairs) {
+  std::vector<std::pair<const LocationVector *, const LocationVector *>> comparisons;
+  for (const auto &pair : pairs) {
+    comparisons.emplace_back(&pair.first.bbox, &pair.second.geodesic);
+    comparisons.emplace_back(&pair.second.bbox, &pair.first.geodesic);
+    comparisons.emplace_back(&pair.first.geodesic, &pair.second.geodesic);
+    comparisons.emplace_back(&pair.first.bbox, &pair.second.bbox);
+  }
+  return comparisons;
+}
+
+static std::vector<std::pair<Actor, Actor>> make_random_pairs(size_t count) {
+  std::vector<std::pair<Actor, Actor>> pairs;
+  for (auto i = 0u; i < count; ++i) {
+    // Far from the origin, as in large maps, to exercise float precision.
+    const Location origin(
+        static_cast<float>(util::Random::Uniform(-2000.0, 2000.0)),
+        static_cast<float>(util::Random::Uniform(-2000.0, 2000.0)),
+        0.0f);
+    pairs.emplace_back(make_random_actor(origin, 15.0f), make_random_actor(origin, 15.0f));
+  }
+  return pairs;
+}
+
+TEST(collision_geometry, distance_matches_boost) {
+  constexpr double error = 0.002;
+  const auto pairs = make_random_pairs(2000u);
+  size_t overlapping = 0u;
+  for (const auto &comparison : make_comparisons(pairs)) {
+    const double expected = bg::distance(
+        make_boost_polygon(*comparison.first),
+        make_boost_polygon(*comparison.second));
+    const CollisionPolygon first(*comparison.first);
+    const CollisionPolygon second(*comparison.second);
+    ASSERT_NEAR(first.Distance(second), expected, error);
+    ASSERT_NEAR(second.Distance(first), expected, error);
+    ASSERT_LE(first.BoundingBoxDistance(second), expected + error);
+    if (expected == 0.0) {
+      ++overlapping;
+    }
+  }
+  // Make sure both overlapping and disjoint polygons were compared.
+  ASSERT_GT(overlapping, 0u);
+  ASSERT_LT(overlapping, 4u * pairs.size());
+}
+
+TEST(collision_geometry, contained_polygon) {
+  const LocationVector outer = make_bounding_box({10.0f, 10.0f, 0.0f}, 0.3f, 5.0f, 5.0f);
+  const LocationVector inner = make_bounding_box({10.5f, 10.0f, 0.0f}, 1.0f, 1.0f, 0.5f);
+  const LocationVector path = make_geodesic_boundary({10.0f, 10.0f, 0.0f}, 0.0f, 0.5f, 0.5f, 0.0f, 2.0f);
+  ASSERT_EQ(CollisionPolygon(outer).Distance(CollisionPolygon(inner)), 0.0f);
+  ASSERT_EQ(CollisionPolygon(inner).Distance(CollisionPolygon(outer)), 0.0f);
+  ASSERT_EQ(CollisionPolygon(outer).Distance(CollisionPolygon(path)), 0.0f);
+  ASSERT_EQ(CollisionPolygon(path).Distance(CollisionPolygon(outer)), 0.0f);
+}
@@ -0,0 +1,197 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#include "test.h"
+#include "OpenDrive.h"
+#include "Random.h"
+
+#include <carla/client/Landmark.h>
+#include <carla/client/Map.h>
+#include <carla/client/Waypoint.h>
+#include <carla/trafficmanager/CachedSimpleWaypoint.h>
+#include <carla/trafficmanager/InMemoryMap.h>
+#include <carla/trafficmanager/SimpleWaypoint.h>
+#include <carla/trafficmanager/WaypointGraph.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using carla::traffic_manager::InMemoryMap;
+using carla::traffic_manager::SimpleWaypointPtr;
+using carla::traffic_manager::WaypointGraph;
+using carla::traffic_manager::WaypointIndex;
+
+static void check_same_graph(const WaypointGraph &expected, const WaypointGraph &graph) {
+  ASSERT_EQ(expected.Size(), graph.Size());
+  for (WaypointIndex i = 0u; i < expected.Size(); ++i) {
+    ASSERT_EQ(expected.GetId(i), graph.GetId(i));
+    ASSERT_EQ(expected.GetLocation(i), graph.GetLocation(i));
+    ASSERT_EQ(expected.GetGeodesicGridId(i), graph.GetGeodesicGridId(i));
+    ASSERT_EQ(expected.IsJunction(i), graph.IsJunction(i));
+    ASSERT_EQ(expected.GetRoadOption(i), graph.GetRoadOption(i));
+    ASSERT_EQ(expected.GetLeft(i), graph.GetLeft(i));
+    ASSERT_EQ(expected.GetRight(i), graph.GetRight(i));
+    ASSERT_TRUE(std::equal(
+        expected.SuccessorsBegin(i), expected.SuccessorsEnd(i),
+        graph.SuccessorsBegin(i), graph.SuccessorsEnd(i)));
+    ASSERT_TRUE(std::equal(
+        expected.PredecessorsBegin(i), expected.PredecessorsEnd(i),
+        graph.PredecessorsBegin(i), graph.PredecessorsEnd(i)));
+    ASSERT_TRUE(std::equal(
+        expected.LandmarksBegin(i), expected.LandmarksEnd(i),
+        graph.LandmarksBegin(i), graph.LandmarksEnd(i)));
+    for (auto it = expected.LandmarksBegin(i); it != expected.LandmarksEnd(i); ++it) {
+      ASSERT_EQ(expected.GetLandmark(*it).location, graph.GetLandmark(*it).location);
+      ASSERT_EQ(expected.GetLandmark(*it).type, graph.GetLandmark(*it).type);
+      ASSERT_EQ(expected.GetLandmark(*it).value, graph.GetLandmark(*it).value);
+    }
+  }
+}
+
+TEST(traffic_manager, in_memory_map_cache) {
+  for (const auto &file : util::OpenDrive::GetAvailableFiles()) {
+    carla::logging::log("Parsing", file);
+    auto map = boost::make_shared<carla::client::Map>(file, util::OpenDrive::Load(file));
+    InMemoryMap local_map(map);
+    local_map.SetUp();
+
+    const std::string path =
+        (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+    InMemoryMap::Cook(map, path);
+
+    InMemoryMap mapped_map(map);
+    ASSERT_TRUE(mapped_map.LoadFromFile(path));
+    check_same_graph(local_map.GetWaypointGraph(), mapped_map.GetWaypointGraph());
+
+    std::ifstream in(path, std::ios::binary);
+    std::vector<uint8_t> content{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    in.close();
+    boost::filesystem::remove(path);
+
+    InMemoryMap read_map(map);
+    ASSERT_TRUE(read_map.Load(content));
+    check_same_graph(local_map.GetWaypointGraph(), read_map.GetWaypointGraph());
+
+    for (auto i = 0u; i < 100u; ++i) {
+      const auto location = util::Random::Location(-200.0f, 200.0f);
+      ASSERT_EQ(local_map.GetWaypoint(location)->GetIndex(), mapped_map.GetWaypoint(location)->GetIndex());
+    }
+
+    // A truncated cache must be rejected rather than used.
+    content.resize(content.size() / 2u);
+    InMemoryMap truncated_map(map);
+    ASSERT_FALSE(truncated_map.Load(content));
+  }
+}
+
+TEST(traffic_manager, in_memory_map_cache_versions) {
+  const auto files = util::OpenDrive::GetAvailableFiles();
+  ASSERT_FALSE(files.empty());
+  const auto &file = files.front();
+  auto map = boost::make_shared<carla::client::Map>(file, util::OpenDrive::Load(file));
+  InMemoryMap local_map(map);
+  local_map.SetUp();
+  const WaypointGraph &graph = local_map.GetWaypointGraph();
+
+  const std::string path =
+      (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+  auto read_file = [&]() {
+    std::ifstream in(path, std::ios::binary);
+    std::vector<uint8_t> content{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    in.close();
+    boost::filesystem::remove(path);
+    return content;
+  };
+
+  // A graph of another version must be built again, not parsed as a cache
+  // cooked before the graph format.
+  InMemoryMap::Cook(map, path);
+  std::vector<uint8_t> content = read_file();
+  uint32_t version;
+  std::memcpy(&version, content.data() + 8u, sizeof(version));
+  ++version;
+  std::memcpy(content.data() + 8u, &version, sizeof(version));
+  InMemoryMap other_version_map(map);
+  ASSERT_FALSE(other_version_map.Load(content));
+
+  // Caches cooked before the graph format are still read.
+  std::ofstream out(path, std::ios::binary);
+  const uint32_t total = static_cast<uint32_t>(graph.Size());
+  out.write(reinterpret_cast<const char *>(&total), sizeof(total));
+  for (WaypointIndex i = 0u; i < graph.Size(); ++i) {
+    carla::traffic_manager::CachedSimpleWaypoint(graph.GetNode(i)).Write(out);
+  }
+  out.close();
+  content = read_file();
+  InMemoryMap legacy_map(map);
+  ASSERT_TRUE(legacy_map.Load(content));
+  ASSERT_EQ(legacy_map.GetWaypointGraph().Size(), graph.Size());
+
+  // But never past their end, nor with more waypoints than they can hold.
+  std::vector<uint8_t> truncated(content.begin(), content.begin() + content.size() / 2u);
+  InMemoryMap truncated_map(map);
+  ASSERT_FALSE(truncated_map.Load(truncated));
+  const uint32_t too_many = total + 1u;
+  std::memcpy(content.data(), &too_many, sizeof(too_many));
+  content.resize(content.size() - 1u);
+  InMemoryMap too_many_map(map);
+  ASSERT_FALSE(too_many_map.Load(content));
+}
+
+TEST(traffic_manager, in_memory_map_handles) {
+  static_assert(std::is_trivially_copyable<SimpleWaypointPtr>::value, "");
+  for (const auto &file : util::OpenDrive::GetAvailableFiles()) {
+    auto map = boost::make_shared<carla::client::Map>(file, util::OpenDrive::Load(file));
+    InMemoryMap local_map(map);
+    local_map.SetUp();
+    const WaypointGraph &graph = local_map.GetWaypointGraph();
+    const auto nodes = local_map.GetDenseTopology();
+    ASSERT_EQ(nodes.size(), graph.Size());
+    for (WaypointIndex i = 0u; i < graph.Size(); ++i) {
+      const SimpleWaypointPtr copy = nodes[i];
+      ASSERT_TRUE(copy);
+      ASSERT_EQ(copy, graph.GetNode(i));
+      ASSERT_EQ(copy->GetIndex(), i);
+      ASSERT_EQ(copy->GetId(), graph.GetId(i));
+    }
+    ASSERT_FALSE(SimpleWaypointPtr());
+    ASSERT_EQ(SimpleWaypointPtr(), nullptr);
+  }
+}
+
+TEST(traffic_manager, in_memory_map_landmarks) {
+  constexpr float distance = 30.0f;
+  for (const auto &file : util::OpenDrive::GetAvailableFiles()) {
+    carla::logging::log("Parsing", file);
+    auto map = boost::make_shared<carla::client::Map>(file, util::OpenDrive::Load(file));
+    InMemoryMap local_map(map);
+    local_map.SetUp();
+    const WaypointGraph &graph = local_map.GetWaypointGraph();
+
+    // Every landmark limiting the speed found from the map must be found by
+    // following the graph too.
+    for (WaypointIndex i = 0u; i < graph.Size(); i += 7u) {
+      const auto graph_landmarks = graph.GetLandmarksInDistance(i, distance);
+      for (const auto &landmark : graph.MakeWaypoint(i)->GetAllLandmarksInDistance(distance, false)) {
+        const std::string type = landmark->GetType();
+        if (type != "1000001" && type != "206" && type != "205" && type != "274") {
+          continue;
+        }
+        const auto location = landmark->GetWaypoint()->GetTransform().location;
+        ASSERT_TRUE(std::any_of(graph_landmarks.begin(), graph_landmarks.end(), [&](const uint32_t index) {
+          return graph.GetLandmark(index).location == location;
+        })) << file << ": landmark " << landmark->GetId() << " not found from waypoint " << i;
+      }
+    }
+  }
+}
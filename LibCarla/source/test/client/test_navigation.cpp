@@ -0,0 +1,414 @@
+// Copyright (c) 2019 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#include "test.h"
+
+#include <carla/geom/Math.h>
+#include <carla/nav/Navigation.h>
+
+#include <recast/DetourNavMesh.h>
+#include <recast/DetourNavMeshBuilder.h>
+#include <recast/DetourNavMeshQuery.h>
+
+#include <cstring>
+#include <vector>
+
+using namespace carla::nav;
+using carla::geom::Location;
+
+// Square navmesh of TILES x TILES tiles, each one with QUADS x QUADS square
+// polygons. Walls of blocked polygons along z split it, they can be crossed
+// only at some gaps, and these gaps are roads.
+static constexpr int TILES = 4;
+static constexpr int QUADS = 4;
+static constexpr float QUAD_SIZE = 4.0f;
+static constexpr float CELL_SIZE = 0.5f;
+static constexpr float TILE_SIZE = QUADS * QUAD_SIZE;
+static constexpr float MESH_SIZE = TILES * TILE_SIZE;
+static constexpr int MAX_PATH_POLYS = 256;
+
+static bool IsBlocked(int x, int z) {
+  return (x % 4 == 2) && (z % 8 != 0);
+}
+
+static bool IsRoad(int x, int z) {
+  return (x % 4 == 2) && (z % 8 == 0);
+}
+
+static bool IsInside(int x, int z) {
+  return x >= 0 && z >= 0 && x < TILES * QUADS && z < TILES * QUADS;
+}
+
+// Data of a tile for Detour, the polygons are quads wound as Recast does,
+// with their edges in the order x-, z+, x+, z-.
+static std::vector<unsigned char> MakeTile(int tile_x, int tile_z) {
+  static const int dx[4] = { -1, 0, 1, 0 };
+  static const int dz[4] = { 0, 1, 0, -1 };
+  const unsigned short null_index = 0xffff;
+  const int cells = static_cast<int>(QUAD_SIZE / CELL_SIZE);
+
+  std::vector<unsigned short> verts;
+  for (int z = 0; z <= QUADS; ++z) {
+    for (int x = 0; x <= QUADS; ++x) {
+      verts.push_back(static_cast<unsigned short>(x * cells));
+      verts.push_back(0u);
+      verts.push_back(static_cast<unsigned short>(z * cells));
+    }
+  }
+
+  std::vector<int> index(QUADS * QUADS, -1);
+  int poly_count = 0;
+  for (int z = 0; z < QUADS; ++z) {
+    for (int x = 0; x < QUADS; ++x) {
+      if (!IsBlocked(tile_x * QUADS + x, tile_z * QUADS + z)) {
+        index[z * QUADS + x] = poly_count++;
+      }
+    }
+  }
+
+  const int nvp = 4;
+  std::vector<unsigned short> polys;
+  std::vector<unsigned short> flags;
+  std::vector<unsigned char> areas;
+  for (int z = 0; z < QUADS; ++z) {
+    for (int x = 0; x < QUADS; ++x) {
+      const int global_x = tile_x * QUADS + x;
+      const int global_z = tile_z * QUADS + z;
+      if (index[z * QUADS + x] == -1) {
+        continue;
+      }
+      const int corner = z * (QUADS + 1) + x;
+      polys.push_back(static_cast<unsigned short>(corner));
+      polys.push_back(static_cast<unsigned short>(corner + QUADS + 1));
+      polys.push_back(static_cast<unsigned short>(corner + QUADS + 2));
+      polys.push_back(static_cast<unsigned short>(corner + 1));
+      for (int edge = 0; edge < 4; ++edge) {
+        const int x2 = x + dx[edge];
+        const int z2 = z + dz[edge];
+        if (!IsInside(global_x + dx[edge], global_z + dz[edge]) ||
+            IsBlocked(global_x + dx[edge], global_z + dz[edge])) {
+          polys.push_back(null_index);
+        } else if (x2 < 0 || z2 < 0 || x2 >= QUADS || z2 >= QUADS) {
+          polys.push_back(static_cast<unsigned short>(0x8000 | edge));
+        } else {
+          polys.push_back(static_cast<unsigned short>(index[z2 * QUADS + x2]));
+        }
+      }
+      const bool road = IsRoad(global_x, global_z);
+      flags.push_back(road ? CARLA_TYPE_ROAD : CARLA_TYPE_SIDEWALK);
+      areas.push_back(road ? CARLA_AREA_ROAD : CARLA_AREA_SIDEWALK);
+    }
+  }
+
+  dtNavMeshCreateParams params;
+  std::memset(&params, 0, sizeof(params));
+  params.verts = verts.data();
+  params.vertCount = static_cast<int>(verts.size() / 3u);
+  params.polys = polys.data();
+  params.polyFlags = flags.data();
+  params.polyAreas = areas.data();
+  params.polyCount = poly_count;
+  params.nvp = nvp;
+  params.tileX = tile_x;
+  params.tileY = tile_z;
+  params.bmin[0] = static_cast<float>(tile_x) * TILE_SIZE;
+  params.bmin[1] = 0.0f;
+  params.bmin[2] = static_cast<float>(tile_z) * TILE_SIZE;
+  params.bmax[0] = params.bmin[0] + TILE_SIZE;
+  params.bmax[1] = 1.0f;
+  params.bmax[2] = params.bmin[2] + TILE_SIZE;
+  params.walkableHeight = 2.0f;
+  params.walkableRadius = 0.3f;
+  params.walkableClimb = 0.9f;
+  params.cs = CELL_SIZE;
+  params.ch = 0.2f;
+  params.buildBvTree = true;
+
+  unsigned char *data = nullptr;
+  int size = 0;
+  if (!dtCreateNavMeshData(&params, &data, &size)) {
+    return {};
+  }
+  std::vector<unsigned char> result(data, data + size);
+  dtFree(data);
+  return result;
+}
+
+// Navmesh used to find the paths without the cache.
+static dtNavMesh *MakeNavMesh() {
+  dtNavMeshParams params;
+  std::memset(&params, 0, sizeof(params));
+  params.tileWidth = TILE_SIZE;
+  params.tileHeight = TILE_SIZE;
+  params.maxTiles = TILES * TILES;
+  params.maxPolys = QUADS * QUADS;
+  dtNavMesh *mesh = dtAllocNavMesh();
+  if (mesh == nullptr || dtStatusFailed(mesh->init(&params))) {
+    dtFreeNavMesh(mesh);
+    return nullptr;
+  }
+  for (int z = 0; z < TILES; ++z) {
+    for (int x = 0; x < TILES; ++x) {
+      const std::vector<unsigned char> tile = MakeTile(x, z);
+      unsigned char *data = static_cast<unsigned char *>(dtAlloc(tile.size(), DT_ALLOC_PERM));
+      std::memcpy(data, tile.data(), tile.size());
+      mesh->addTile(data, static_cast<int>(tile.size()), DT_TILE_FREE_DATA, 0, nullptr);
+    }
+  }
+  return mesh;
+}
+
+// Same navmesh in the binary format loaded by Navigation.
+static std::vector<uint8_t> Serialize(const dtNavMesh &mesh) {
+  const int magic = 'M' << 24 | 'S' << 16 | 'E' << 8 | 'T';
+  const int version = 1;
+  const dtNavMeshParams *params = mesh.getParams();
+  int num_tiles = 0;
+  for (int i = 0; i < mesh.getMaxTiles(); ++i) {
+    const dtMeshTile *tile = mesh.getTile(i);
+    if (tile && tile->header && tile->dataSize) {
+      ++num_tiles;
+    }
+  }
+
+  std::vector<uint8_t> content;
+  auto write = [&](const void *data, size_t size) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    content.insert(content.end(), bytes, bytes + size);
+  };
+  write(&magic, sizeof(magic));
+  write(&version, sizeof(version));
+  write(&num_tiles, sizeof(num_tiles));
+  write(params, sizeof(*params));
+  for (int i = 0; i < mesh.getMaxTiles(); ++i) {
+    const dtMeshTile *tile = mesh.getTile(i);
+    if (!tile || !tile->header || !tile->dataSize) {
+      continue;
+    }
+    const dtTileRef tile_ref = mesh.getTileRef(tile);
+    write(&tile_ref, sizeof(tile_ref));
+    write(&tile->dataSize, sizeof(tile->dataSize));
+    write(tile->data, static_cast<size_t>(tile->dataSize));
+  }
+  return content;
+}
+
+// Path found as Navigation does, with a single search and no cache.
+static bool FindDirectPath(
+    const dtNavMesh &mesh,
+    Location from,
+    Location to,
+    const dtQueryFilter &filter,
+    std::vector<Location> &path) {
+  dtNavMeshQuery query;
+  if (dtStatusFailed(query.init(&mesh, 2048))) {
+    return false;
+  }
+  const float extents[3] = { 2.0f, 4.0f, 2.0f };
+  const float start_pos[3] = { from.x, from.z, from.y };
+  const float end_pos[3] = { to.x, to.z, to.y };
+  dtPolyRef start_ref = 0;
+  dtPolyRef end_ref = 0;
+  query.findNearestPoly(start_pos, extents, &filter, &start_ref, nullptr);
+  query.findNearestPoly(end_pos, extents, &filter, &end_ref, nullptr);
+  if (!start_ref || !end_ref) {
+    return false;
+  }
+
+  dtPolyRef polys[MAX_PATH_POLYS];
+  int num_polys = 0;
+  query.findPath(start_ref, end_ref, start_pos, end_pos, &filter, polys, &num_polys, MAX_PATH_POLYS);
+  if (num_polys == 0) {
+    return false;
+  }
+  float end_pos2[3] = { end_pos[0], end_pos[1], end_pos[2] };
+  if (polys[num_polys - 1] != end_ref) {
+    query.closestPointOnPoly(polys[num_polys - 1], end_pos, end_pos2, nullptr);
+  }
+
+  float straight_path[MAX_PATH_POLYS * 3];
+  int num_straight_path = 0;
+  query.findStraightPath(start_pos, end_pos2, polys, num_polys, straight_path, nullptr, nullptr,
+      &num_straight_path, MAX_PATH_POLYS, DT_STRAIGHTPATH_AREA_CROSSINGS);
+  path.clear();
+  for (int i = 0; i < num_straight_path; ++i) {
+    path.emplace_back(straight_path[i * 3], straight_path[i * 3 + 2], straight_path[i * 3 + 1]);
+  }
+  return true;
+}
+
+static float PathLength(const std::vector<Location> &path) {
+  float length = 0.0f;
+  for (size_t i = 1u; i < path.size(); ++i) {
+    length += carla::geom::Math::Distance(path[i - 1u], path[i]);
+  }
+  return length;
+}
+
+static dtQueryFilter MakeFilter(bool roads) {
+  dtQueryFilter filter;
+  filter.setIncludeFlags(CARLA_TYPE_WALKABLE);
+  filter.setExcludeFlags(roads ? CARLA_TYPE_NONE : CARLA_TYPE_ROAD);
+  filter.setAreaCost(CARLA_AREA_ROAD, 10.0f);
+  filter.setAreaCost(CARLA_AREA_GRASS, 1.0f);
+  return filter;
+}
+
+TEST(navigation, path_cache) {
+  dtNavMesh *mesh = MakeNavMesh();
+  ASSERT_NE(mesh, nullptr);
+  Navigation nav;
+  ASSERT_TRUE(nav.Load(Serialize(*mesh)));
+
+  // Paths across several tiles are split at the tile borders by the cache,
+  // they must reach the same point than a single search, they may be a bit
+  // longer. The second time they come from the cache.
+  dtQueryFilter filter = MakeFilter(true);
+  const std::vector<std::pair<Location, Location>> requests = {
+      {{2.0f, 2.0f, 0.0f}, {62.0f, 62.0f, 0.0f}},
+      {{2.0f, 30.0f, 0.0f}, {62.0f, 2.0f, 0.0f}},
+      {{18.0f, 50.0f, 0.0f}, {46.0f, 14.0f, 0.0f}},
+      {{62.0f, 62.0f, 0.0f}, {2.0f, 2.0f, 0.0f}}};
+  for (const auto &request : requests) {
+    std::vector<Location> direct;
+    std::vector<Location> cached;
+    std::vector<Location> cached_again;
+    std::vector<unsigned char> area;
+    ASSERT_TRUE(FindDirectPath(*mesh, request.first, request.second, filter, direct));
+    ASSERT_TRUE(nav.GetPath(request.first, request.second, &filter, cached, area));
+    ASSERT_TRUE(nav.GetPath(request.first, request.second, &filter, cached_again, area));
+    ASSERT_FALSE(cached.empty());
+    ASSERT_EQ(cached, cached_again);
+    ASSERT_NEAR(carla::geom::Math::Distance(cached.back(), direct.back()), 0.0f, 0.01f);
+    ASSERT_LE(PathLength(cached), PathLength(direct) * 2.0f);
+  }
+
+  // The same points with a filter that can not cross the roads have no
+  // complete path, this must not change the paths with the other filter.
+  dtQueryFilter no_roads = MakeFilter(false);
+  const Location from(2.0f, 30.0f, 0.0f);
+  const Location to(62.0f, 30.0f, 0.0f);
+  std::vector<Location> path;
+  std::vector<Location> direct;
+  std::vector<unsigned char> area;
+  const bool reached = nav.GetPath(from, to, &no_roads, path, area) &&
+      carla::geom::Math::Distance(path.back(), to) < 0.01f;
+  ASSERT_FALSE(reached);
+  ASSERT_TRUE(nav.GetPath(from, to, &filter, path, area));
+  ASSERT_TRUE(FindDirectPath(*mesh, from, to, filter, direct));
+  ASSERT_NEAR(carla::geom::Math::Distance(path.back(), direct.back()), 0.0f, 0.01f);
+  ASSERT_NEAR(carla::geom::Math::Distance(path.back(), to), 0.0f, 0.01f);
+
+  dtFreeNavMesh(mesh);
+}
+
+TEST(navigation, crowd_region_boundary) {
+  dtNavMesh *mesh = MakeNavMesh();
+  ASSERT_NE(mesh, nullptr);
+  Navigation nav;
+  ASSERT_TRUE(nav.Load(Serialize(*mesh)));
+  nav.SetCrowdPartitions(4u);
+  ASSERT_EQ(nav.GetCrowds().size(), 4u);
+
+  // Walk from the first region to the second one, along a row without walls.
+  const carla::ActorId id = 1u;
+  const float boundary = MESH_SIZE / 2.0f;
+  ASSERT_TRUE(nav.AddWalker(id, Location(boundary - 2.0f, 2.0f, 1.0f)));
+  ASSERT_TRUE(nav.SetWalkerDirectTarget(id, Location(boundary + 6.0f, 2.0f, 1.0f)));
+
+  // The walkers of a crowd, and the mirrors of the walkers of the crowds
+  // near, without update flags.
+  auto active_agents = [&](size_t region, bool mirrors) {
+    dtCrowd *crowd = nav.GetCrowds()[region];
+    int count = 0;
+    for (int i = 0; i < crowd->getAgentCount(); ++i) {
+      const dtCrowdAgent *agent = crowd->getAgent(i);
+      count += (agent->active && (agent->params.updateFlags == 0) == mirrors) ? 1 : 0;
+    }
+    return count;
+  };
+  ASSERT_EQ(active_agents(0u, false), 1);
+
+  // Near the border, the walker is seen from the crowd of the second region.
+  nav.UpdateCrowd(0.05);
+  ASSERT_EQ(active_agents(0u, false), 1);
+  ASSERT_EQ(active_agents(1u, true), 1);
+
+  Location position;
+  for (int step = 0; step < 400 && active_agents(1u, false) == 0; ++step) {
+    nav.UpdateCrowd(0.05);
+  }
+  ASSERT_EQ(active_agents(0u, false), 0);
+  ASSERT_EQ(active_agents(1u, false), 1);
+  ASSERT_TRUE(nav.GetWalkerPosition(id, position));
+  ASSERT_GT(position.x, boundary);
+  nav.UpdateCrowd(0.05);
+  ASSERT_EQ(active_agents(0u, true), 1);
+  ASSERT_EQ(active_agents(1u, true), 0);
+
+  // The route of the walker in its new crowd reaches the same point than
+  // without the cache, with the filter of a walker that does not cross roads.
+  const Location to(boundary + 6.0f, MESH_SIZE - 2.0f, 0.0f);
+  std::vector<Location> route;
+  std::vector<Location> direct;
+  std::vector<unsigned char> area;
+  ASSERT_TRUE(nav.GetAgentRoute(id, position, to, route, area));
+  ASSERT_TRUE(FindDirectPath(*mesh, position, to, MakeFilter(false), direct));
+  ASSERT_FALSE(route.empty());
+  ASSERT_NEAR(carla::geom::Math::Distance(route.back(), direct.back()), 0.0f, 0.01f);
+  ASSERT_NEAR(carla::geom::Math::Distance(route.back(), to), 0.0f, 0.01f);
+  ASSERT_LE(PathLength(route), PathLength(direct) * 2.0f);
+
+  std::vector<PathResult> results;
+  nav.GetAgentRoutes({id, id + 1u}, {{position, to}, {position, to}}, results);
+  ASSERT_EQ(results.size(), 2u);
+  ASSERT_TRUE(results[0].found);
+  ASSERT_FALSE(results[1].found);
+  ASSERT_EQ(results[0].path, route);
+
+  ASSERT_TRUE(nav.RemoveAgent(id));
+  ASSERT_EQ(active_agents(0u, true), 0);
+  ASSERT_EQ(active_agents(1u, false), 0);
+  ASSERT_FALSE(nav.GetAgentRoute(id, position, to, route, area));
+
+  dtFreeNavMesh(mesh);
+}
+
+TEST(navigation, crowd_capacity) {
+  dtNavMesh *mesh = MakeNavMesh();
+  ASSERT_NE(mesh, nullptr);
+  Navigation nav;
+  ASSERT_TRUE(nav.Load(Serialize(*mesh)));
+  nav.SetCrowdPartitions(4u);
+
+  // More walkers than the crowds have room for at first, along a row without
+  // walls crossing the border of the regions. They keep their position while
+  // the crowds grow.
+  constexpr carla::ActorId WALKERS = 1200u;
+  std::vector<Location> positions;
+  for (carla::ActorId id = 1u; id <= WALKERS; ++id) {
+    ASSERT_TRUE(nav.AddWalker(id, Location(1.0f + static_cast<float>(id % 60u), 2.0f, 1.0f)));
+    positions.emplace_back();
+    ASSERT_TRUE(nav.GetWalkerPosition(id, positions.back()));
+  }
+  for (carla::ActorId id = 1u; id <= WALKERS; ++id) {
+    Location position;
+    ASSERT_TRUE(nav.GetWalkerPosition(id, position));
+    ASSERT_EQ(position, positions[id - 1u]);
+  }
+
+  nav.UpdateCrowd(0.05);
+  for (carla::ActorId id = 1u; id <= WALKERS; ++id) {
+    ASSERT_TRUE(nav.RemoveAgent(id));
+  }
+  for (dtCrowd *crowd : nav.GetCrowds()) {
+    for (int i = 0; i < crowd->getAgentCount(); ++i) {
+      ASSERT_FALSE(crowd->getAgent(i)->active);
+    }
+  }
+
+  dtFreeNavMesh(mesh);
+}
@@ -10,19 +10,27 @@
 
 #include <carla/StopWatch.h>
 #include <carla/ThreadPool.h>
+#include <carla/client/Map.h>
+#include <carla/client/Waypoint.h>
 #include <carla/geom/Location.h>
 #include <carla/geom/Math.h>
 #include <carla/opendrive/OpenDriveParser.h>
+#include <carla/opendrive/TiledMap.h>
 #include <carla/road/MapBuilder.h>
+#include <carla/road/RoutePlanner.h>
 #include <carla/road/element/RoadInfoElevation.h>
 #include <carla/road/element/RoadInfoGeometry.h>
 #include <carla/road/element/RoadInfoMarkRecord.h>
+#include <carla/road/element/RoadInfoSignal.h>
 #include <carla/road/element/RoadInfoVisitor.h>
 
 #include <pugixml/pugixml.hpp>
 
+#include <algorithm>
 #include <fstream>
+#include <sstream>
 #include <string>
+#include <tuple>
 
 using namespace carla::road;
 using namespace carla::road::element;
@@ -424,3 +432,464 @@ TEST(road, get_waypoint) {
     result.get();
   }
 }
+
+/// Signal search of road::Map before the per-lane signal index, kept as a
+/// reference for the results of GetSignalsInDistance.
+static std::vector<Map::SignalSearchData> GetSignalsInDistanceByTraversal(
+    Map &map, const Waypoint waypoint, const double distance, const bool stop_at_junction) {
+  const auto &lane = map.GetLane(waypoint);
+  const bool forward = (waypoint.lane_id <= 0);
+  const double relative_s = waypoint.s - lane.GetDistance();
+  const double remaining_lane_length = forward ? lane.GetLength() - relative_s : relative_s;
+  const double max_distance = std::min(distance, remaining_lane_length);
+  const double signed_distance = forward ? max_distance : -max_distance;
+
+  std::vector<Map::SignalSearchData> result;
+  auto &road = map.GetMap().GetRoad(waypoint.road_id);
+  for (auto *signal : road.GetInfosInRange<RoadInfoSignal>(
+           waypoint.s, waypoint.s + signed_distance)) {
+    const double distance_to_signal = waypoint.lane_id < 0 ?
+        signal->GetDistance() - waypoint.s :
+        waypoint.s - signal->GetDistance();
+    // Check that the signal affects the waypoint.
+    bool is_valid = false;
+    for (auto &validity : signal->GetValidities()) {
+      if (waypoint.lane_id >= validity._from_lane &&
+          waypoint.lane_id <= validity._to_lane) {
+        is_valid = true;
+        break;
+      }
+    }
+    if (!is_valid) {
+      continue;
+    }
+    if (distance_to_signal == 0) {
+      result.emplace_back(Map::SignalSearchData{signal, waypoint, distance_to_signal});
+    } else {
+      result.emplace_back(Map::SignalSearchData{
+          signal, map.GetNext(waypoint, distance_to_signal).front(), distance_to_signal});
+    }
+  }
+  if (distance <= remaining_lane_length) {
+    return result;
+  }
+  // If we run out of remaining_lane_length we have to go to the successors.
+  for (auto &successor : map.GetSuccessors(waypoint)) {
+    auto &successor_road = map.GetMap().GetRoad(successor.road_id);
+    if (successor_road.IsJunction() && stop_at_junction) {
+      continue;
+    }
+    auto &successor_lane = successor_road.GetLaneByDistance(successor.s, successor.lane_id);
+    if (successor.lane_id < 0) {
+      successor.s = successor_lane.GetDistance();
+    } else {
+      successor.s = successor_lane.GetDistance() + successor_lane.GetLength();
+    }
+    for (auto &signal : GetSignalsInDistanceByTraversal(
+             map, successor, distance - remaining_lane_length, stop_at_junction)) {
+      signal.accumulated_s += remaining_lane_length;
+      result.emplace_back(signal);
+    }
+  }
+  return result;
+}
+
+TEST(road, get_signals_in_distance) {
+  const auto sort = [](std::vector<Map::SignalSearchData> signals) {
+    std::sort(signals.begin(), signals.end(), [](const auto &lhs, const auto &rhs) {
+      return std::make_tuple(lhs.signal->GetSignalId(), lhs.accumulated_s) <
+             std::make_tuple(rhs.signal->GetSignalId(), rhs.accumulated_s);
+    });
+    return signals;
+  };
+  for (const auto& file : util::OpenDrive::GetAvailableFiles()) {
+    carla::logging::log("Parsing", file);
+    auto m = OpenDriveParser::Load(util::OpenDrive::Load(file));
+    ASSERT_TRUE(m.has_value());
+    auto &map = *m;
+    for (auto i = 0u; i < 1'000u; ++i) {
+      const auto location = Random::Location(-500.0f, 500.0f);
+      auto owp = map.GetClosestWaypointOnRoad(location);
+      ASSERT_TRUE(owp.has_value());
+      const double distance = Random::Uniform(1.0, 200.0);
+      for (const bool stop_at_junction : {false, true}) {
+        const auto signals = sort(map.GetSignalsInDistance(*owp, distance, stop_at_junction));
+        const auto expected = sort(
+            GetSignalsInDistanceByTraversal(map, *owp, distance, stop_at_junction));
+        ASSERT_EQ(signals.size(), expected.size());
+        for (auto j = 0u; j < signals.size(); ++j) {
+          ASSERT_EQ(signals[j].signal, expected[j].signal);
+          ASSERT_EQ(signals[j].signal->GetSignalId(), expected[j].signal->GetSignalId());
+          ASSERT_NEAR(signals[j].accumulated_s, expected[j].accumulated_s, 1e-6);
+          ASSERT_EQ(signals[j].waypoint.road_id, expected[j].waypoint.road_id);
+          ASSERT_EQ(signals[j].waypoint.lane_id, expected[j].waypoint.lane_id);
+          ASSERT_NEAR(signals[j].waypoint.s, expected[j].waypoint.s, 1e-3);
+        }
+      }
+    }
+  }
+}
+
+TEST(road, junction_lane_conflicts) {
+  for (const auto& file : util::OpenDrive::GetAvailableFiles()) {
+    carla::logging::log("Parsing", file);
+    auto m = OpenDriveParser::Load(util::OpenDrive::Load(file));
+    ASSERT_TRUE(m.has_value());
+    auto &map = *m;
+    for (auto &pair : map.GetMap().GetJunctions()) {
+      const auto &junction = pair.second;
+      const auto &conflicts = map.GetJunctionLaneConflicts(junction.GetId());
+      for (const auto &conflict : conflicts) {
+        ASSERT_NE(conflict.road_id, conflict.other_road_id);
+        ASSERT_LE(conflict.s_start, conflict.s_end);
+        ASSERT_LE(conflict.other_s_start, conflict.other_s_end);
+        ASSERT_EQ(map.GetJunctionId(conflict.road_id), junction.GetId());
+        ASSERT_EQ(map.GetJunctionId(conflict.other_road_id), junction.GetId());
+        // The zone is inside the lane section of each lane.
+        const auto &lane = map.GetLane(
+            Waypoint{conflict.road_id, conflict.section_id, conflict.lane_id, 0.0});
+        ASSERT_GE(conflict.s_start, lane.GetDistance());
+        ASSERT_LE(conflict.s_end, lane.GetDistance() + lane.GetLength());
+        // Every conflict is stored for both lanes.
+        bool found = false;
+        const Waypoint waypoint{
+            conflict.other_road_id, conflict.other_section_id, conflict.other_lane_id, 0.0};
+        for (const auto &other : map.GetLaneConflicts(waypoint)) {
+          found = found ||
+              (other.other_road_id == conflict.road_id &&
+               other.other_section_id == conflict.section_id &&
+               other.other_lane_id == conflict.lane_id &&
+               other.s_start == conflict.other_s_start &&
+               other.s_end == conflict.other_s_end);
+        }
+        ASSERT_TRUE(found);
+      }
+    }
+  }
+}
+
+static std::string LaneConflictRoad(
+    int id,
+    int junction,
+    int predecessor,
+    double x,
+    double y,
+    double hdg,
+    double length,
+    const std::string &geometry,
+    double second_section_s = 0.0) {
+  std::ostringstream road;
+  road << "<road name=\"\" length=\"" << length << "\" id=\"" << id
+       << "\" junction=\"" << junction << "\">";
+  if (predecessor >= 0) {
+    road << "<link><predecessor elementType=\"road\" elementId=\"" << predecessor
+         << "\" contactPoint=\"end\"/></link>";
+  }
+  road << "<planView><geometry s=\"0\" x=\"" << x << "\" y=\"" << y
+       << "\" hdg=\"" << hdg << "\" length=\"" << length << "\">" << geometry
+       << "</geometry></planView><lanes>";
+  std::vector<double> sections{0.0};
+  if (second_section_s > 0.0) {
+    sections.emplace_back(second_section_s);
+  }
+  for (const double section_s : sections) {
+    road << "<laneSection s=\"" << section_s << "\">"
+         << "<center><lane id=\"0\" type=\"none\" level=\"false\"/></center>"
+         << "<right><lane id=\"-1\" type=\"driving\" level=\"false\">"
+         << "<width sOffset=\"0\" a=\"3.5\" b=\"0\" c=\"0\" d=\"0\"/>"
+         << "</lane></right></laneSection>";
+  }
+  road << "</lanes></road>";
+  return road.str();
+}
+
+TEST(road, junction_lane_conflicts_diverge) {
+  // Road 1 ends in a junction where road 2 goes straight and road 3 turns
+  // right, both leaving from its lane. Road 4 crosses road 2 from road 5 and
+  // has a second lane section after the crossing.
+  const double turn_length = 10.0 * M_PI;
+  std::ostringstream opendrive;
+  opendrive
+      << "<?xml version=\"1.0\" standalone=\"yes\"?><OpenDRIVE>"
+      << "<header revMajor=\"1\" revMinor=\"4\" name=\"\" version=\"1\"/>"
+      << LaneConflictRoad(1, -1, -1, 0.0, 0.0, 0.0, 50.0, "<line/>")
+      << LaneConflictRoad(2, 100, 1, 50.0, 0.0, 0.0, 30.0, "<line/>")
+      << LaneConflictRoad(3, 100, 1, 50.0, 0.0, 0.0, turn_length, "<arc curvature=\"-0.05\"/>")
+      << LaneConflictRoad(5, -1, -1, 65.0, -30.0, M_PI / 2.0, 20.0, "<line/>")
+      << LaneConflictRoad(4, 100, 5, 65.0, -10.0, M_PI / 2.0, 20.0, "<line/>", 15.0)
+      << "<junction id=\"100\" name=\"\">"
+      << "<connection id=\"0\" incomingRoad=\"1\" connectingRoad=\"2\" contactPoint=\"start\">"
+      << "<laneLink from=\"-1\" to=\"-1\"/></connection>"
+      << "<connection id=\"1\" incomingRoad=\"1\" connectingRoad=\"3\" contactPoint=\"start\">"
+      << "<laneLink from=\"-1\" to=\"-1\"/></connection>"
+      << "<connection id=\"2\" incomingRoad=\"5\" connectingRoad=\"4\" contactPoint=\"start\">"
+      << "<laneLink from=\"-1\" to=\"-1\"/></connection>"
+      << "</junction></OpenDRIVE>";
+  auto m = OpenDriveParser::Load(opendrive.str());
+  ASSERT_TRUE(m.has_value());
+  auto &map = *m;
+
+  const auto conflicts_with = [&](RoadId road_id, RoadId other_road_id) {
+    const auto conflicts = map.GetLaneConflicts(Waypoint{road_id, 0u, -1, 0.0});
+    return std::count_if(conflicts.begin(), conflicts.end(),
+        [&](const Junction::LaneConflict &conflict) {
+          return conflict.other_road_id == other_road_id;
+        });
+  };
+  // The lanes leaving from the same point do not cross.
+  ASSERT_EQ(conflicts_with(2u, 3u), 0);
+  ASSERT_EQ(conflicts_with(3u, 2u), 0);
+  // The crossing lanes still conflict around the crossing point.
+  ASSERT_EQ(conflicts_with(2u, 4u), 1);
+  ASSERT_EQ(conflicts_with(4u, 2u), 1);
+  const auto conflicts = map.GetLaneConflicts(Waypoint{2u, 0u, -1, 0.0});
+  const auto crossing = std::find_if(conflicts.begin(), conflicts.end(),
+      [](const Junction::LaneConflict &conflict) { return conflict.other_road_id == 4u; });
+  ASSERT_NE(crossing, conflicts.end());
+  ASSERT_LT(crossing->s_start, 16.75);
+  ASSERT_GT(crossing->s_end, 16.75);
+  ASSERT_LT(crossing->other_s_start, 8.25);
+  ASSERT_GT(crossing->other_s_end, 8.25);
+  // Only the first lane section of road 4 is in the crossing.
+  ASSERT_EQ(crossing->section_id, 0u);
+  ASSERT_EQ(crossing->other_section_id, 0u);
+  ASSERT_EQ(conflicts_with(4u, 2u), 1);
+  ASSERT_TRUE(map.GetLaneConflicts(Waypoint{4u, 1u, -1, 17.0}).empty());
+  for (const auto &conflict : map.GetJunctionLaneConflicts(100)) {
+    ASSERT_EQ(conflict.section_id, 0u);
+    ASSERT_EQ(conflict.other_section_id, 0u);
+  }
+}
+
+TEST(road, tiled_map_get_waypoint) {
+  for (const auto& file : util::OpenDrive::GetAvailableFiles()) {
+    carla::logging::log("Parsing", file);
+    const std::string opendrive = util::OpenDrive::Load(file);
+    auto m = OpenDriveParser::Load(opendrive);
+    ASSERT_TRUE(m.has_value());
+    auto &map = *m;
+    auto tiled_map = TiledMap::Load(opendrive, 100.0, 16u);
+    ASSERT_NE(tiled_map, nullptr);
+    for (auto i = 0u; i < 200u; ++i) {
+      const auto location = Random::Location(-500.0f, 500.0f);
+      auto tile_map = tiled_map->GetMap(location, 50.0);
+      if (tile_map == nullptr) {
+        continue;
+      }
+      ASSERT_LE(tile_map->GetMap().GetRoadCount(), map.GetMap().GetRoadCount());
+      // The map of the tile is built once.
+      ASSERT_EQ(tiled_map->GetMap(location, 50.0), tile_map);
+      auto owp = map.GetClosestWaypointOnRoad(location);
+      ASSERT_TRUE(owp.has_value());
+      // Only compare waypoints close enough to be inside the loaded tiles.
+      if (map.ComputeTransform(*owp).location.Distance(location) > 40.0f) {
+        continue;
+      }
+      auto tile_owp = tile_map->GetClosestWaypointOnRoad(location);
+      ASSERT_TRUE(tile_owp.has_value());
+      ASSERT_EQ(*owp, *tile_owp);
+    }
+    ASSERT_LE(tiled_map->GetLoadedTileCount(), 16u);
+  }
+}
+
+TEST(road, tiled_map_evict_and_clear) {
+  for (const auto& file : util::OpenDrive::GetAvailableFiles()) {
+    carla::logging::log("Parsing", file);
+    auto tiled_map = TiledMap::Load(util::OpenDrive::Load(file), 50.0, 1u);
+    ASSERT_NE(tiled_map, nullptr);
+    for (auto i = 0u; i < 20u; ++i) {
+      auto tile_map = tiled_map->GetMap(Random::Location(-500.0f, 500.0f), 1.0);
+      if (tile_map != nullptr) {
+        ASSERT_EQ(tile_map, tiled_map->GetLoadedMap());
+      }
+      ASSERT_LE(tiled_map->GetLoadedTileCount(), 1u);
+    }
+    tiled_map->Clear();
+    ASSERT_EQ(tiled_map->GetLoadedMap(), nullptr);
+    ASSERT_EQ(tiled_map->GetLoadedTileCount(), 0u);
+  }
+}
+
+TEST(road, tiled_map_build_failure) {
+  // The speed of the object is only parsed when the map is built, hence the
+  // document is split in tiles but building its map throws.
+  const std::string opendrive =
+      "<OpenDRIVE>"
+      "<header revMajor=\"1\" revMinor=\"4\" name=\"\" version=\"1\"/>"
+      "<road name=\"road\" length=\"10\" id=\"1\" junction=\"-1\">"
+      "<link/>"
+      "<planView><geometry s=\"0\" x=\"0\" y=\"0\" hdg=\"0\" length=\"10\"><line/></geometry></planView>"
+      "<lanes><laneSection s=\"0\">"
+      "<center><lane id=\"0\" type=\"none\" level=\"false\"/></center>"
+      "<right><lane id=\"-1\" type=\"driving\" level=\"false\">"
+      "<width sOffset=\"0\" a=\"3.5\" b=\"0\" c=\"0\" d=\"0\"/></lane></right>"
+      "</laneSection></lanes>"
+      "<objects><object id=\"1\" name=\"Speed_invalid\" s=\"5\" t=\"0\"/></objects>"
+      "</road>"
+      "</OpenDRIVE>";
+  auto tiled_map = TiledMap::Load(opendrive, 100.0, 4u);
+  ASSERT_NE(tiled_map, nullptr);
+  const carla::geom::Location location(5.0f, 0.0f, 0.0f);
+  ASSERT_ANY_THROW(tiled_map->GetMap(location, 1.0));
+  // The tile is loaded now; the query waits for its map, which must have
+  // been marked as failed instead of blocking forever.
+  ASSERT_EQ(tiled_map->GetMap(location, 1.0), nullptr);
+  ASSERT_EQ(tiled_map->GetLoadedMap(), nullptr);
+  // Loading the tile again builds a new map, which fails again.
+  tiled_map->Clear();
+  ASSERT_ANY_THROW(tiled_map->GetMap(location, 1.0));
+}
+
+TEST(road, map_region) {
+  for (const auto& file : util::OpenDrive::GetAvailableFiles()) {
+    carla::logging::log("Parsing", file);
+    auto map = carla::SharedPtr<carla::client::Map>(
+        new carla::client::Map("test", util::OpenDrive::Load(file)));
+    for (auto i = 0u; i < 50u; ++i) {
+      const auto location = Random::Location(-500.0f, 500.0f);
+      auto region = map->GetRegion(location, 50.0, 100.0, 4u);
+      if (region == nullptr) {
+        continue;
+      }
+      // The region has the OpenDRIVE of its roads.
+      auto region_xodr = OpenDriveParser::Load(region->GetOpenDrive());
+      ASSERT_TRUE(region_xodr.has_value());
+      ASSERT_EQ(region_xodr->GetMap().GetRoadCount(), region->GetMap().GetMap().GetRoadCount());
+      auto waypoint = map->GetWaypoint(location);
+      ASSERT_NE(waypoint, nullptr);
+      if (waypoint->GetTransform().location.Distance(location) > 40.0f) {
+        continue;
+      }
+      auto region_waypoint = region->GetWaypoint(location);
+      ASSERT_NE(region_waypoint, nullptr);
+      ASSERT_EQ(waypoint->GetId(), region_waypoint->GetId());
+      // Regions share the tiles of their map, unless they are split with
+      // other parameters, then their own OpenDRIVE is split.
+      for (double tile_size : {100.0, 500.0}) {
+        auto sub_region = region->GetRegion(location, 20.0, tile_size, 4u);
+        ASSERT_NE(sub_region, nullptr);
+        auto sub_region_waypoint = sub_region->GetWaypoint(location);
+        ASSERT_NE(sub_region_waypoint, nullptr);
+        ASSERT_EQ(waypoint->GetId(), sub_region_waypoint->GetId());
+      }
+    }
+  }
+}
+
+TEST(road, route_planner_zero_cost_edges) {
+  // The middle road has three driving lanes, only the first one continues
+  // from the previous road and only the third one leads to the next road.
+  // Lane changes are free, so the path through the middle lane costs nothing.
+  const auto make_road = [](int id, double x, std::vector<std::string> lanes, const char *links) {
+    std::ostringstream road;
+    road << "<road name=\"\" length=\"10\" id=\"" << id << "\" junction=\"-1\">"
+         << "<link>" << links << "</link>"
+         << "<planView><geometry s=\"0\" x=\"" << x << "\" y=\"0\" hdg=\"0\" length=\"10\">"
+         << "<line/></geometry></planView>"
+         << "<lanes><laneSection s=\"0\">"
+         << "<center><lane id=\"0\" type=\"none\" level=\"false\"/></center><right>";
+    for (size_t i = 0u; i < lanes.size(); ++i) {
+      road << "<lane id=\"-" << i + 1u << "\" type=\"driving\" level=\"false\">"
+           << "<link>" << lanes[i] << "</link>"
+           << "<width sOffset=\"0\" a=\"3.5\" b=\"0\" c=\"0\" d=\"0\"/></lane>";
+    }
+    road << "</right></laneSection></lanes></road>";
+    return road.str();
+  };
+  std::ostringstream opendrive;
+  opendrive
+      << "<OpenDRIVE><header revMajor=\"1\" revMinor=\"4\" name=\"\" version=\"1\"/>"
+      << make_road(0, 0.0, {"<successor id=\"-1\"/>"},
+             "<successor elementType=\"road\" elementId=\"1\" contactPoint=\"start\"/>")
+      << make_road(1, 10.0, {"<predecessor id=\"-1\"/>", "", "<successor id=\"-1\"/>"},
+             "<predecessor elementType=\"road\" elementId=\"0\" contactPoint=\"end\"/>"
+             "<successor elementType=\"road\" elementId=\"2\" contactPoint=\"start\"/>")
+      << make_road(2, 20.0, {"<predecessor id=\"-3\"/>"},
+             "<predecessor elementType=\"road\" elementId=\"1\" contactPoint=\"end\"/>")
+      << "</OpenDRIVE>";
+  auto m = OpenDriveParser::Load(opendrive.str());
+  ASSERT_TRUE(m.has_value());
+  auto &map = *m;
+  auto origin = map.GetWaypoint(0u, -1, 1.0f);
+  auto destination = map.GetWaypoint(2u, -1, 9.0f);
+  ASSERT_TRUE(origin.has_value());
+  ASSERT_TRUE(destination.has_value());
+  RoutePlanner planner(map, 0.0);
+  planner.BuildContractionHierarchy();
+  const auto a_star = planner.ComputeRoute(
+      *origin, *destination, RoutePlanner::Algorithm::AStar);
+  const auto ch = planner.ComputeRoute(
+      *origin, *destination, RoutePlanner::Algorithm::ContractionHierarchy);
+  ASSERT_FALSE(a_star.lanes.empty());
+  ASSERT_FALSE(ch.lanes.empty());
+  ASSERT_NEAR(a_star.cost, ch.cost, 1e-2);
+  ASSERT_EQ(a_star.lanes.size(), ch.lanes.size());
+}
+
+TEST(road, route_planner_batch) {
+  carla::ThreadPool pool;
+  pool.AsyncRun(4u);
+  for (const auto& file : util::OpenDrive::GetAvailableFiles()) {
+    carla::logging::log("Parsing", file);
+    auto m = OpenDriveParser::Load(util::OpenDrive::Load(file));
+    ASSERT_TRUE(m.has_value());
+    auto &map = *m;
+    RoutePlanner planner(map);
+    std::vector<std::pair<Waypoint, Waypoint>> queries;
+    for (auto i = 0u; i < 100u; ++i) {
+      auto origin = map.GetClosestWaypointOnRoad(Random::Location(-500.0f, 500.0f));
+      auto destination = map.GetClosestWaypointOnRoad(Random::Location(-500.0f, 500.0f));
+      ASSERT_TRUE(origin.has_value());
+      ASSERT_TRUE(destination.has_value());
+      queries.emplace_back(*origin, *destination);
+    }
+    const auto routes = planner.TraceRoutes(queries, 2.0, RoutePlanner::Algorithm::AStar, pool, 4u);
+    ASSERT_EQ(routes.size(), queries.size());
+    for (auto i = 0u; i < queries.size(); ++i) {
+      const auto route = planner.TraceRoute(queries[i].first, queries[i].second, 2.0);
+      ASSERT_EQ(routes[i].size(), route.size());
+      for (auto j = 0u; j < route.size(); ++j) {
+        ASSERT_EQ(routes[i][j], route[j]);
+      }
+    }
+  }
+}
+
+TEST(road, route_planner_algorithms_agree) {
+  for (const auto& file : util::OpenDrive::GetAvailableFiles()) {
+    carla::logging::log("Parsing", file);
+    auto m = OpenDriveParser::Load(util::OpenDrive::Load(file));
+    ASSERT_TRUE(m.has_value());
+    auto &map = *m;
+    RoutePlanner planner(map);
+    planner.BuildContractionHierarchy();
+    ASSERT_TRUE(planner.HasContractionHierarchy());
+    ASSERT_GT(planner.GetNodeCount(), 0u);
+    for (auto i = 0u; i < 200u; ++i) {
+      auto origin = map.GetClosestWaypointOnRoad(Random::Location(-500.0f, 500.0f));
+      auto destination = map.GetClosestWaypointOnRoad(Random::Location(-500.0f, 500.0f));
+      ASSERT_TRUE(origin.has_value());
+      ASSERT_TRUE(destination.has_value());
+      const auto a_star = planner.ComputeRoute(
+          *origin, *destination, RoutePlanner::Algorithm::AStar);
+      const auto dijkstra = planner.ComputeRoute(
+          *origin, *destination, RoutePlanner::Algorithm::BidirectionalDijkstra);
+      const auto ch = planner.ComputeRoute(
+          *origin, *destination, RoutePlanner::Algorithm::ContractionHierarchy);
+      ASSERT_EQ(a_star.lanes.empty(), dijkstra.lanes.empty());
+      ASSERT_EQ(a_star.lanes.empty(), ch.lanes.empty());
+      if (a_star.lanes.empty()) {
+        continue;
+      }
+      ASSERT_NEAR(a_star.cost, dijkstra.cost, 1e-2);
+      ASSERT_NEAR(a_star.cost, ch.cost, 1e-2);
+      ASSERT_EQ(ch.lanes.size(), ch.edges.size());
+      ASSERT_EQ(ch.lanes.front(), *origin);
+      const auto route = planner.TraceRoute(*origin, *destination, 2.0);
+      ASSERT_FALSE(route.empty());
+      ASSERT_EQ(route.front(), *origin);
+      ASSERT_EQ(route.back(), *destination);
+    }
+  }
+}
@@ -0,0 +1,194 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#include "test.h"
+#include "OpenDrive.h"
+
+#include <carla/client/Map.h>
+#include <carla/client/Waypoint.h>
+#include <carla/rpc/Command.h>
+#include <carla/trafficmanager/ReplayHarness.h>
+
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+
+using carla::traffic_manager::ActorType;
+using carla::traffic_manager::ReplayActor;
+using carla::traffic_manager::ReplayActorState;
+using carla::traffic_manager::ReplayFrame;
+using carla::traffic_manager::ReplayHarness;
+using carla::traffic_manager::ReplayRecording;
+
+/// Vehicles driving along their lanes from @a waypoints, one of them
+/// destroyed half way.
+static ReplayRecording make_recording(
+    const carla::client::Map &map,
+    std::vector<carla::SharedPtr<carla::client::Waypoint>> waypoints) {
+  constexpr size_t NUMBER_OF_FRAMES = 100u;
+
+  ReplayRecording recording;
+  recording.map_name = map.GetName();
+  for (size_t i = 0u; i < waypoints.size(); ++i) {
+    ReplayActor actor;
+    actor.id = static_cast<carla::rpc::ActorId>(i + 1u);
+    actor.actor_type = static_cast<uint8_t>(ActorType::Vehicle);
+    actor.registered = i % 4u != 0u;
+    actor.extent = {2.3f, 1.0f, 0.8f};
+    recording.actors.push_back(actor);
+  }
+  for (size_t frame = 0u; frame < NUMBER_OF_FRAMES; ++frame) {
+    ReplayFrame replay_frame;
+    replay_frame.frame = frame;
+    replay_frame.elapsed_seconds = 0.05 * static_cast<double>(frame);
+    replay_frame.delta_seconds = 0.05;
+    for (size_t i = 0u; i < waypoints.size(); ++i) {
+      if (i == 1u && frame > NUMBER_OF_FRAMES / 2u) {
+        continue;
+      }
+      ReplayActorState state;
+      state.id = recording.actors[i].id;
+      state.transform = waypoints[i]->GetTransform();
+      state.velocity = 8.0f * state.transform.GetForwardVector();
+      state.speed_limit = 30.0f;
+      replay_frame.actors.push_back(state);
+      auto next = waypoints[i]->GetNext(0.4);
+      if (!next.empty()) {
+        waypoints[i] = next.front();
+      }
+    }
+    recording.frames.push_back(std::move(replay_frame));
+  }
+  return recording;
+}
+
+/// Vehicles starting 25 meters apart.
+static ReplayRecording make_recording(const carla::client::Map &map) {
+  auto waypoints = map.GenerateWaypoints(25.0);
+  waypoints.resize(std::min<size_t>(waypoints.size(), 30u));
+  return make_recording(map, std::move(waypoints));
+}
+
+static std::vector<carla::rpc::VehicleControl> replay(
+    carla::SharedPtr<carla::client::Map> map,
+    const ReplayRecording &recording,
+    const uint64_t seed) {
+  ReplayHarness harness(map, recording, seed);
+  std::vector<carla::rpc::VehicleControl> controls;
+  while (harness.Step()) {
+    EXPECT_EQ(harness.GetCommands().size(), harness.GetVehicleIds().size());
+    for (const auto &command : harness.GetCommands()) {
+      const auto *apply = boost::variant2::get_if<carla::rpc::Command::ApplyVehicleControl>(&command.command);
+      if (apply != nullptr) {
+        controls.push_back(apply->control);
+      }
+    }
+  }
+  EXPECT_EQ(harness.GetTimings().cycles, recording.frames.size());
+  return controls;
+}
+
+TEST(traffic_manager, replay_harness_is_deterministic) {
+  const auto file = util::OpenDrive::GetAvailableFiles().front();
+  auto map = boost::make_shared<carla::client::Map>(file, util::OpenDrive::Load(file));
+  const ReplayRecording recording = make_recording(*map);
+  ASSERT_FALSE(recording.actors.empty());
+
+  const auto controls = replay(map, recording, 1u);
+  ASSERT_FALSE(controls.empty());
+  ASSERT_EQ(controls, replay(map, recording, 1u));
+}
+
+TEST(traffic_manager, replay_harness_empty_path_and_route) {
+  const auto file = util::OpenDrive::GetAvailableFiles().front();
+  auto map = boost::make_shared<carla::client::Map>(file, util::OpenDrive::Load(file));
+  const ReplayRecording recording = make_recording(*map);
+  ASSERT_GT(recording.actors.size(), 3u);
+
+  // Vehicles given an empty path or route keep driving on random waypoints,
+  // and the empty path or route is dropped.
+  ReplayHarness harness(map, recording, 1u);
+  auto &parameters = harness.GetParameters();
+  parameters.UpdateUploadPath(2u, {});
+  parameters.UpdateImportedRoute(3u, {});
+  for (size_t i = 0u; i < 3u; ++i) {
+    ASSERT_TRUE(harness.Step());
+    EXPECT_EQ(harness.GetCommands().size(), harness.GetVehicleIds().size());
+  }
+  EXPECT_EQ(parameters.GetCustomPath(2u).path, nullptr);
+  EXPECT_EQ(parameters.GetImportedRoute(3u).route, nullptr);
+}
+
+static std::vector<carla::rpc::VehicleControl> get_controls(const ReplayHarness &harness) {
+  std::vector<carla::rpc::VehicleControl> controls;
+  for (const auto &command : harness.GetCommands()) {
+    const auto *apply = boost::variant2::get_if<carla::rpc::Command::ApplyVehicleControl>(&command.command);
+    if (apply != nullptr) {
+      controls.push_back(apply->control);
+    }
+  }
+  return controls;
+}
+
+TEST(traffic_manager, replay_harness_sharded_localization) {
+  // A 4 km long road with two lanes in each direction, long enough to be
+  // split in strips.
+  std::ostringstream lane;
+  lane << "type=\"driving\" level=\"false\">"
+       << "<width sOffset=\"0\" a=\"3.5\" b=\"0\" c=\"0\" d=\"0\"/></lane>";
+  std::ostringstream opendrive;
+  opendrive
+      << "<?xml version=\"1.0\" standalone=\"yes\"?><OpenDRIVE>"
+      << "<header revMajor=\"1\" revMinor=\"4\" name=\"\" version=\"1\"/>"
+      << "<road name=\"\" length=\"4000\" id=\"1\" junction=\"-1\"><link/>"
+      << "<planView><geometry s=\"0\" x=\"0\" y=\"0\" hdg=\"0\" length=\"4000\"><line/></geometry></planView>"
+      << "<lanes><laneSection s=\"0\">"
+      << "<left><lane id=\"2\" " << lane.str() << "<lane id=\"1\" " << lane.str() << "</left>"
+      << "<center><lane id=\"0\" type=\"none\" level=\"false\"/></center>"
+      << "<right><lane id=\"-1\" " << lane.str() << "<lane id=\"-2\" " << lane.str() << "</right>"
+      << "</laneSection></lanes></road></OpenDRIVE>";
+  auto map = boost::make_shared<carla::client::Map>("Highway", opendrive.str());
+  // Vehicles 30 meters apart on the inner lanes find the vehicle ahead close
+  // enough to change lanes, if the outer lane, with a few vehicles, is free
+  // there. Whether it is depends on the waypoints of the vehicles updated
+  // before in the cycle, so the commands change if the vehicles near the
+  // edge of a strip are updated out of order.
+  auto waypoints = map->GenerateWaypoints(30.0);
+  waypoints.erase(std::remove_if(waypoints.begin(), waypoints.end(),
+      [](const carla::SharedPtr<carla::client::Waypoint> &waypoint) {
+        return std::abs(waypoint->GetLaneId()) != 1 &&
+            static_cast<int>(waypoint->GetDistance() / 30.0) % 3 != 0;
+      }), waypoints.end());
+  // Shuffle the ids so the vehicle list does not follow the road.
+  std::vector<carla::SharedPtr<carla::client::Waypoint>> shuffled(waypoints.size());
+  for (size_t i = 0u; i < waypoints.size(); ++i) {
+    shuffled[(i * 7919u) % waypoints.size()] = waypoints[i];
+  }
+  const ReplayRecording recording = make_recording(*map, std::move(shuffled));
+
+  // Localizing the vehicles in strips gives the commands of localizing them
+  // one after the other.
+  ReplayHarness serial(map, recording, 1u);
+  ReplayHarness sharded(map, recording, 1u);
+  sharded.SetLocalizationShards(4u);
+  size_t sharded_cycles = 0u;
+  size_t border_vehicles = 0u;
+  while (serial.Step()) {
+    ASSERT_TRUE(sharded.Step());
+    ASSERT_EQ(serial.GetVehicleIds(), sharded.GetVehicleIds());
+    ASSERT_EQ(get_controls(serial), get_controls(sharded)) << "frame " << serial.GetFrameIndex();
+    if (sharded.GetVehicleShards().GetShards().size() > 1u) {
+      ++sharded_cycles;
+      border_vehicles += sharded.GetVehicleShards().GetBorder().size();
+    }
+  }
+  ASSERT_FALSE(sharded.Step());
+  ASSERT_EQ(sharded_cycles, recording.frames.size());
+  ASSERT_GT(border_vehicles, 0u);
+}
@@ -0,0 +1,78 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#include "test.h"
+
+#include <carla/trafficmanager/Parameters.h>
+#include <carla/trafficmanager/RouteStore.h>
+
+#include <vector>
+
+using namespace carla::traffic_manager;
+
+TEST(traffic_manager, route_store) {
+  RouteStore route_store;
+  const Path line = {{0.0f, 0.0f, 0.0f}, {10.0f, 0.0f, 0.0f}, {20.0f, 5.0f, 0.0f}};
+  Path other_line = line;
+  other_line.back().y = 6.0f;
+
+  // Vehicles following the same path share its entry.
+  auto first = route_store.AddPath(line);
+  auto second = route_store.AddPath(line);
+  ASSERT_EQ(first, second);
+  ASSERT_EQ(first->GetLocations(), line);
+  auto third = route_store.AddPath(other_line);
+  ASSERT_NE(first, third);
+
+  // Entries are dropped once no vehicle follows them.
+  std::weak_ptr<SharedPath> expired = third;
+  third.reset();
+  ASSERT_TRUE(expired.expired());
+  ASSERT_EQ(route_store.AddPath(line), first);
+
+  const Route route = {1u, 3u, 2u};
+  auto first_route = route_store.AddRoute(route);
+  ASSERT_EQ(route_store.AddRoute(route), first_route);
+  ASSERT_EQ(*first_route, route);
+  ASSERT_NE(route_store.AddRoute(Route{1u, 3u}), first_route);
+}
+
+TEST(traffic_manager, route_store_snapshot) {
+  Parameters parameters;
+  const std::vector<carla::ActorId> vehicles = {10u};
+  const Path line = {{0.0f, 0.0f, 0.0f}, {10.0f, 0.0f, 0.0f}};
+  const Route route = {1u, 3u};
+
+  // Every change of the paths and routes must reach the next snapshot, even
+  // when the set of vehicles stays the same.
+  parameters.UpdateUploadPath(10u, line);
+  parameters.UpdateImportedRoute(10u, route);
+  parameters.TakeSnapshot(vehicles);
+  ASSERT_NE(parameters.GetSnapshot().at(0u).imported_path.path, nullptr);
+  ASSERT_NE(parameters.GetSnapshot().at(0u).imported_route.route, nullptr);
+
+  parameters.RemoveUploadPath(10u, true);
+  parameters.RemoveImportedRoute(10u, true);
+  parameters.TakeSnapshot(vehicles);
+  ASSERT_EQ(parameters.GetSnapshot().at(0u).imported_path.path, nullptr);
+  ASSERT_EQ(parameters.GetSnapshot().at(0u).imported_route.route, nullptr);
+
+  parameters.UpdateUploadPath(10u, line);
+  parameters.UpdateImportedRoute(10u, route);
+  parameters.TakeSnapshot(vehicles);
+  ASSERT_NE(parameters.GetSnapshot().at(0u).imported_path.path, nullptr);
+  ASSERT_NE(parameters.GetSnapshot().at(0u).imported_route.route, nullptr);
+  ASSERT_FALSE(parameters.GetSnapshot().at(0u).upload_path);
+
+  // The progress reaches the next snapshot, although the settings did not
+  // change.
+  ImportedPath imported_path = parameters.GetSnapshot().at(0u).imported_path;
+  imported_path.next = 1u;
+  parameters.UpdateCustomPathProgress(10u, imported_path);
+  ASSERT_EQ(parameters.GetSnapshot().at(0u).imported_path.next, 0u);
+  parameters.TakeSnapshot(vehicles);
+  ASSERT_EQ(parameters.GetSnapshot().at(0u).imported_path.next, 1u);
+}
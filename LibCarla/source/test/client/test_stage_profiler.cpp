@@ -0,0 +1,60 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#include "test.h"
+
+#include <carla/trafficmanager/StageProfiler.h>
+
+#include <chrono>
+
+using carla::traffic_manager::ProfiledStage;
+using carla::traffic_manager::StageProfiler;
+using carla::traffic_manager::TrafficManagerTimings;
+
+static constexpr size_t STAGE_COUNT = static_cast<size_t>(ProfiledStage::SIZE);
+
+TEST(traffic_manager, stage_profiler_percentiles) {
+  StageProfiler profiler;
+  // 1 to 1000 ms in steps of 1 ms.
+  for (int i = 1; i <= 1000; ++i) {
+    profiler.Record(ProfiledStage::Collision, std::chrono::milliseconds(i));
+  }
+  profiler.Record(ProfiledStage::Localization, std::chrono::microseconds(7));
+  profiler.RecordVehicles(10u);
+  profiler.RecordVehicles(30u);
+
+  const TrafficManagerTimings timings = profiler.GetTimings();
+  ASSERT_EQ(timings.stages.size(), STAGE_COUNT);
+  ASSERT_EQ(timings.cycles, 2u);
+  ASSERT_EQ(timings.vehicles, 30u);
+  ASSERT_EQ(timings.max_vehicles, 30u);
+  ASSERT_DOUBLE_EQ(timings.mean_vehicles, 20.0);
+
+  const auto &collision = timings.stages[static_cast<size_t>(ProfiledStage::Collision)];
+  ASSERT_EQ(collision.name, "collision");
+  ASSERT_EQ(collision.count, 1000u);
+  ASSERT_NEAR(collision.mean, 500.5, 1e-9);
+  ASSERT_NEAR(collision.p50, 500.0, 500.0 / 32.0);
+  ASSERT_NEAR(collision.p90, 900.0, 900.0 / 32.0);
+  ASSERT_NEAR(collision.p99, 990.0, 990.0 / 32.0);
+  ASSERT_DOUBLE_EQ(collision.max, 1000.0);
+
+  // Small durations are exact.
+  const auto &localization = timings.stages[static_cast<size_t>(ProfiledStage::Localization)];
+  ASSERT_EQ(localization.count, 1u);
+  ASSERT_DOUBLE_EQ(localization.p50, 0.007);
+  ASSERT_DOUBLE_EQ(localization.p99, 0.007);
+
+  ASSERT_EQ(timings.stages[static_cast<size_t>(ProfiledStage::Cycle)].count, 0u);
+
+  profiler.Reset();
+  const TrafficManagerTimings reset_timings = profiler.GetTimings();
+  ASSERT_EQ(reset_timings.cycles, 0u);
+  for (const auto &stage : reset_timings.stages) {
+    ASSERT_EQ(stage.count, 0u);
+    ASSERT_EQ(stage.max, 0.0);
+  }
+}
@@ -0,0 +1,216 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#include "test.h"
+
+#include <carla/client/Map.h>
+#include <carla/client/Waypoint.h>
+#include <carla/client/World.h>
+#include <carla/trafficmanager/InMemoryMap.h>
+#include <carla/trafficmanager/TrafficLightStage.h>
+
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+using carla::traffic_manager::ActorType;
+using carla::traffic_manager::Buffer;
+using carla::traffic_manager::BufferMap;
+using carla::traffic_manager::InMemoryMap;
+using carla::traffic_manager::KinematicState;
+using carla::traffic_manager::Parameters;
+using carla::traffic_manager::RandomGeneratorMap;
+using carla::traffic_manager::SimpleWaypointPtr;
+using carla::traffic_manager::SimulationState;
+using carla::traffic_manager::TLFrame;
+using carla::traffic_manager::TLS;
+using carla::traffic_manager::TrafficLightStage;
+using carla::traffic_manager::TrafficLightState;
+
+static std::string TrafficLightRoad(
+    int id,
+    int junction,
+    const std::string &links,
+    const std::string &lane_links,
+    double x,
+    double length) {
+  std::ostringstream road;
+  road << "<road name=\"\" length=\"" << length << "\" id=\"" << id
+       << "\" junction=\"" << junction << "\"><link>" << links << "</link>"
+       << "<planView><geometry s=\"0\" x=\"" << x << "\" y=\"0\" hdg=\"0\" length=\""
+       << length << "\"><line/></geometry></planView><lanes><laneSection s=\"0\">"
+       << "<center><lane id=\"0\" type=\"none\" level=\"false\"/></center>"
+       << "<right><lane id=\"-1\" type=\"driving\" level=\"false\">"
+       << "<link>" << lane_links << "</link><width sOffset=\"0\" a=\"3.5\" b=\"0\" c=\"0\" d=\"0\"/>"
+       << "</lane></right></laneSection></lanes></road>";
+  return road.str();
+}
+
+TEST(traffic_manager, traffic_light_stage_signalised_approach) {
+  // Road 1 enters junction 100 at x = 50, crosses it along road 2 and leaves
+  // it along road 3.
+  std::ostringstream opendrive;
+  opendrive
+      << "<?xml version=\"1.0\" standalone=\"yes\"?><OpenDRIVE>"
+      << "<header revMajor=\"1\" revMinor=\"4\" name=\"\" version=\"1\"/>"
+      << TrafficLightRoad(1, -1,
+             "<successor elementType=\"junction\" elementId=\"100\"/>", "", 0.0, 50.0)
+      << TrafficLightRoad(2, 100,
+             "<predecessor elementType=\"road\" elementId=\"1\" contactPoint=\"end\"/>"
+             "<successor elementType=\"road\" elementId=\"3\" contactPoint=\"start\"/>",
+             "<predecessor id=\"-1\"/><successor id=\"-1\"/>", 50.0, 30.0)
+      << TrafficLightRoad(3, -1,
+             "<predecessor elementType=\"junction\" elementId=\"100\"/>",
+             "<predecessor id=\"-1\"/>", 80.0, 120.0)
+      << "<junction id=\"100\" name=\"\">"
+      << "<connection id=\"0\" incomingRoad=\"1\" connectingRoad=\"2\" contactPoint=\"start\">"
+      << "<laneLink from=\"-1\" to=\"-1\"/></connection>"
+      << "</junction></OpenDRIVE>";
+  auto map = boost::make_shared<carla::client::Map>("TrafficLight", opendrive.str());
+  auto local_map = std::make_shared<InMemoryMap>(map);
+  local_map->SetUp();
+
+  // A traffic light controls road 1 from 45 meters on.
+  const auto light_waypoint = map->GetWaypointXODR(1u, -1, 45.0f);
+  ASSERT_NE(light_waypoint, nullptr);
+  const carla::geom::Location light_location = light_waypoint->GetTransform().location;
+  const auto light_state = [](size_t frame) {
+    const size_t phase = frame % 100u;
+    return phase < 30u ? TLS::Green : phase < 40u ? TLS::Yellow : TLS::Red;
+  };
+
+  // Vehicles driving along the roads, half a meter per frame unless told to
+  // stop, each one on the first waypoint of its path not behind it. Some of
+  // them reach the light on green, yellow or red, or are at it when it turns
+  // yellow.
+  constexpr size_t NUMBER_OF_VEHICLES = 8u;
+  constexpr size_t NUMBER_OF_FRAMES = 300u;
+  std::vector<SimpleWaypointPtr> path{local_map->GetWaypoint(map->GetWaypointXODR(1u, -1, 0.0f)->GetTransform().location)};
+  std::vector<double> path_distance{0.0};
+  while (path.size() < 100u && !path.back()->GetNextWaypoint().empty()) {
+    const auto next = path.back()->GetNextWaypoint().front();
+    path_distance.push_back(path_distance.back() + next->Distance(path.back()->GetLocation()));
+    path.push_back(next);
+  }
+  ASSERT_GT(path_distance.back(), 100.0);
+
+  std::vector<carla::ActorId> vehicle_id_list;
+  std::vector<double> travelled;
+  for (size_t i = 0u; i < NUMBER_OF_VEHICLES; ++i) {
+    vehicle_id_list.push_back(static_cast<carla::ActorId>(i + 1u));
+    travelled.push_back(7.0 * static_cast<double>(NUMBER_OF_VEHICLES - i));
+  }
+  SimulationState simulation_state;
+  BufferMap buffer_map;
+  Parameters parameters;
+  const carla::client::World world(carla::client::detail::EpisodeProxy{});
+  // One stage does not know the light, so it handles every junction as non
+  // signalized.
+  TLFrame unlit_frame(NUMBER_OF_VEHICLES);
+  TLFrame lit_frame(NUMBER_OF_VEHICLES);
+  RandomGeneratorMap unlit_random_devices(1u);
+  RandomGeneratorMap lit_random_devices(1u);
+  for (const carla::ActorId actor_id : vehicle_id_list) {
+    unlit_random_devices.Add(actor_id);
+    lit_random_devices.Add(actor_id);
+  }
+  TrafficLightStage unlit_stage(
+      vehicle_id_list, simulation_state, buffer_map, parameters, world, unlit_frame, unlit_random_devices);
+  TrafficLightStage lit_stage(
+      vehicle_id_list, simulation_state, buffer_map, parameters, world, lit_frame, lit_random_devices);
+  unlit_stage.SetUp(*local_map, {});
+  lit_stage.SetUp(*local_map, {{100u, {light_location}}});
+  parameters.TakeSnapshot(vehicle_id_list);
+
+  size_t stops = 0u;
+  for (size_t frame = 0u; frame < NUMBER_OF_FRAMES; ++frame) {
+    const carla::client::Timestamp timestamp(frame, 0.05 * static_cast<double>(frame), 0.05, 0.0);
+    unlit_stage.UpdateWorldInfo(timestamp, {});
+    lit_stage.UpdateWorldInfo(timestamp, {light_state(frame)});
+
+    for (size_t i = 0u; i < NUMBER_OF_VEHICLES; ++i) {
+      const carla::ActorId actor_id = vehicle_id_list[i];
+      size_t front = 0u;
+      while (front + 1u < path.size() && path_distance[front] < travelled[i]) {
+        ++front;
+      }
+      Buffer &buffer = buffer_map[actor_id];
+      buffer.clear();
+      for (size_t j = front; j < path.size() && j < front + 10u; ++j) {
+        buffer.push_back(path[j]);
+      }
+      const bool stopped = frame > 0u && lit_frame[i];
+      const KinematicState kinematic_state{
+          path[front]->GetLocation(), {}, {stopped ? 0.0f : 10.0f, 0.0f, 0.0f},
+          15.0f, true, false, {}};
+      // The simulator tells the vehicles in the trigger volume of the light,
+      // from the light to the junction, its state, and green otherwise.
+      const carla::geom::Location location = path[front]->GetLocation();
+      const bool at_traffic_light = !path[front]->CheckJunction() &&
+          location.x > light_location.x - 0.1f && location.x < 50.5f;
+      const TrafficLightState tl_state{at_traffic_light ? light_state(frame) : TLS::Green, at_traffic_light};
+      if (frame == 0u) {
+        simulation_state.AddActor(actor_id, kinematic_state, {ActorType::Vehicle, 2.0f, 1.0f, 1.0f}, tl_state);
+      } else {
+        simulation_state.UpdateKinematicState(actor_id, kinematic_state);
+        simulation_state.UpdateTrafficLightState(actor_id, tl_state);
+      }
+    }
+
+    // Both stages stop at the light as the state reported by the simulator
+    // tells them.
+    for (unsigned long index = 0u; index < NUMBER_OF_VEHICLES; ++index) {
+      unlit_stage.Update(index);
+      lit_stage.Update(index);
+    }
+    ASSERT_EQ(unlit_frame, lit_frame) << "frame " << frame;
+
+    for (size_t i = 0u; i < NUMBER_OF_VEHICLES; ++i) {
+      if (lit_frame[i]) {
+        ++stops;
+      } else {
+        travelled[i] += 0.5;
+      }
+    }
+  }
+  // Vehicles stopped at the light, and others crossed the junction.
+  ASSERT_GT(stops, 0u);
+  ASSERT_GT(*std::max_element(travelled.begin(), travelled.end()), 80.0);
+
+  // A vehicle about to enter the junction, not at the light but not reported
+  // green, is held by the stop sign rules only if the light does not work.
+  size_t front = 0u;
+  while (path_distance[front] < 47.0) {
+    ++front;
+  }
+  for (unsigned long index = 0u; index < NUMBER_OF_VEHICLES; ++index) {
+    const carla::ActorId actor_id = vehicle_id_list[index];
+    Buffer &buffer = buffer_map[actor_id];
+    buffer.clear();
+    for (size_t j = front; j < path.size() && j < front + 10u; ++j) {
+      buffer.push_back(path[j]);
+    }
+    simulation_state.UpdateKinematicState(actor_id, {path[front]->GetLocation(), {}, {}, 15.0f, true, false, {}});
+    // Twice, as a vehicle that was at a green light keeps it once.
+    simulation_state.UpdateTrafficLightState(actor_id, {TLS::Red, false});
+    simulation_state.UpdateTrafficLightState(actor_id, {TLS::Red, false});
+  }
+  ASSERT_FALSE(buffer_map[vehicle_id_list.front()].front()->CheckJunction());
+  const carla::client::Timestamp timestamp(NUMBER_OF_FRAMES, 0.05 * static_cast<double>(NUMBER_OF_FRAMES), 0.05, 0.0);
+  unlit_stage.Reset();
+  lit_stage.Reset();
+  unlit_stage.UpdateWorldInfo(timestamp, {});
+  unlit_stage.Update(0u);
+  ASSERT_TRUE(unlit_frame[0u]);
+  lit_stage.UpdateWorldInfo(timestamp, {TLS::Green});
+  lit_stage.Update(0u);
+  ASSERT_FALSE(lit_frame[0u]);
+  lit_stage.UpdateWorldInfo(timestamp, {TLS::Off});
+  lit_stage.Update(1u);
+  ASSERT_TRUE(lit_frame[1u]);
+}
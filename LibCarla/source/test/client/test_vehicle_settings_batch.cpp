@@ -0,0 +1,66 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#include "test.h"
+
+#include <carla/trafficmanager/Parameters.h>
+#include <carla/trafficmanager/VehicleSettingsBatch.h>
+
+#include <vector>
+
+using carla::traffic_manager::Parameters;
+using carla::traffic_manager::VehicleSetting;
+using carla::traffic_manager::VehicleSettingsBatch;
+
+TEST(traffic_manager, vehicle_settings_batch) {
+  Parameters parameters;
+  const std::vector<carla::ActorId> vehicles = {10u, 20u};
+  parameters.TakeSnapshot(vehicles);
+
+  VehicleSettingsBatch batch;
+  batch.Add(10u, VehicleSetting::PercentageSpeedDifference, 150.0f);
+  batch.Add(10u, VehicleSetting::LaneOffset, 0.5f);
+  batch.Add(20u, VehicleSetting::DesiredSpeed, 12.0f);
+  batch.Add(20u, VehicleSetting::PercentageRunningLight, 120.0f);
+  batch.Add(20u, VehicleSetting::AutoLaneChange, 0.0f);
+  batch.Add(20u, VehicleSetting::ForceLaneChange, 1.0f);
+  // Later entries override earlier ones.
+  batch.Add(10u, VehicleSetting::LaneOffset, -0.25f);
+  ASSERT_TRUE(batch.IsValid());
+  parameters.ApplyVehicleSettings(batch);
+
+  // Nothing changes for the stages until the next cycle, but the getters
+  // return the latest values.
+  ASSERT_EQ(parameters.GetSnapshot().at(0u).lane_offset, 0.0f);
+  ASSERT_EQ(parameters.GetLaneOffset(10u), -0.25f);
+  ASSERT_EQ(parameters.GetPercentageRunningLight(20u), 100.0f);
+  ASSERT_FALSE(parameters.GetAutoLaneChange(20u));
+
+  parameters.TakeSnapshot(vehicles);
+  const auto &first = parameters.GetSnapshot().at(0u);
+  ASSERT_FALSE(first.exact_speed);
+  ASSERT_EQ(first.speed_value, 100.0f);
+  ASSERT_EQ(first.lane_offset, -0.25f);
+  const auto &second = parameters.GetSnapshot().at(1u);
+  ASSERT_TRUE(second.exact_speed);
+  ASSERT_EQ(second.speed_value, 12.0f);
+  ASSERT_EQ(second.perc_run_traffic_light, 100.0f);
+  ASSERT_FALSE(second.auto_lane_change);
+  ASSERT_TRUE(second.force_lane_change.change_lane);
+  ASSERT_TRUE(second.force_lane_change.direction);
+
+  // A malformed batch is rejected as a whole.
+  VehicleSettingsBatch malformed;
+  malformed.Add(10u, VehicleSetting::LaneOffset, 1.0f);
+  malformed.settings.push_back(static_cast<uint8_t>(VehicleSetting::SIZE));
+  malformed.actors.push_back(20u);
+  malformed.values.push_back(1.0f);
+  ASSERT_FALSE(malformed.IsValid());
+  parameters.ApplyVehicleSettings(malformed);
+  parameters.TakeSnapshot(vehicles);
+  ASSERT_EQ(parameters.GetSnapshot().at(0u).lane_offset, -0.25f);
+  ASSERT_FALSE(parameters.GetSnapshot().at(1u).force_lane_change.change_lane);
+}
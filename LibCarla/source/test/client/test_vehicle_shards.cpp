@@ -0,0 +1,81 @@
+// Copyright (c) 2020 Computer Vision Center (CVC) at the Universitat Autonoma
+// de Barcelona (UAB).
+//
+// This work is licensed under the terms of the MIT license.
+// For a copy, see <https://opensource.org/licenses/MIT>.
+
+#include "test.h"
+
+#include <carla/trafficmanager/SimulationState.h>
+#include <carla/trafficmanager/VehicleShards.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace carla::traffic_manager;
+
+TEST(traffic_manager, vehicle_shards) {
+  // A row of vehicles, 5 meters apart, along a 5 km long road.
+  constexpr unsigned long NUMBER_OF_VEHICLES = 1000u;
+  SimulationState simulation_state;
+  std::vector<carla::ActorId> vehicle_id_list;
+  for (unsigned long i = 0u; i < NUMBER_OF_VEHICLES; ++i) {
+    // Shuffle the ids so the vehicle list does not follow the road.
+    const carla::ActorId actor_id = static_cast<carla::ActorId>((i * 7919u) % NUMBER_OF_VEHICLES + 1u);
+    const carla::geom::Location location(5.0f * static_cast<float>(i), 0.0f, 0.0f);
+    KinematicState kinematic_state{location, carla::geom::Rotation(), carla::geom::Vector3D(10.0f, 0.0f, 0.0f),
+                                   30.0f, true, false, carla::geom::Location()};
+    StaticAttributes attributes{ActorType::Vehicle, 2.3f, 1.0f, 0.8f};
+    simulation_state.AddActor(actor_id, kinematic_state, attributes, TrafficLightState{});
+    vehicle_id_list.push_back(actor_id);
+  }
+  const BufferMap buffer_map;
+
+  VehicleShards vehicle_shards;
+  vehicle_shards.Update(vehicle_id_list, simulation_state, buffer_map, 4u);
+  const auto &shards = vehicle_shards.GetShards();
+  ASSERT_EQ(shards.size(), 4u);
+
+  // Every vehicle is either inside a single shard or in the border zone.
+  std::vector<unsigned long> indices = vehicle_shards.GetBorder();
+  ASSERT_TRUE(std::is_sorted(indices.begin(), indices.end()));
+  ASSERT_LT(indices.size(), NUMBER_OF_VEHICLES / 2u);
+  // Border vehicles reach across the edge between two strips.
+  const auto &border_strips = vehicle_shards.GetBorderStrips();
+  ASSERT_EQ(border_strips.size(), indices.size());
+  for (const auto &strips : border_strips) {
+    ASSERT_LT(strips.first, strips.second);
+    ASSERT_LT(strips.second, shards.size());
+  }
+  for (const auto &shard : shards) {
+    ASSERT_FALSE(shard.empty());
+    ASSERT_TRUE(std::is_sorted(shard.begin(), shard.end()));
+    indices.insert(indices.end(), shard.begin(), shard.end());
+  }
+  std::sort(indices.begin(), indices.end());
+  ASSERT_EQ(indices.size(), NUMBER_OF_VEHICLES);
+  for (unsigned long i = 0u; i < NUMBER_OF_VEHICLES; ++i) {
+    ASSERT_EQ(indices[i], i);
+  }
+
+  // Vehicles of different shards are far enough not to share a waypoint.
+  for (unsigned long first = 0u; first < shards.size(); ++first) {
+    for (unsigned long second = first + 1u; second < shards.size(); ++second) {
+      for (const unsigned long a : shards[first]) {
+        for (const unsigned long b : shards[second]) {
+          const float distance = std::abs(simulation_state.GetLocation(vehicle_id_list[a]).x -
+                                          simulation_state.GetLocation(vehicle_id_list[b]).x);
+          ASSERT_GT(distance, 200.0f);
+        }
+      }
+    }
+  }
+
+  // Too few vehicles for more than one shard.
+  vehicle_id_list.resize(10u);
+  vehicle_shards.Update(vehicle_id_list, simulation_state, buffer_map, 4u);
+  ASSERT_EQ(vehicle_shards.GetShards().size(), 1u);
+  ASSERT_EQ(vehicle_shards.GetShards().front().size(), 10u);
+  ASSERT_TRUE(vehicle_shards.GetBorder().empty());
+}
@@ -8,6 +8,7 @@
 
 #include <carla/geom/Vector3D.h>
 #include <carla/geom/Math.h>
+#include <carla/geom/Mesh.h>
 #include <carla/geom/BoundingBox.h>
 #include <carla/geom/Transform.h>
 #include <limits>
@@ -227,3 +228,99 @@ TEST(geom, nearest_point_arc) {
   ASSERT_NEAR(Math::DistanceArcToPoint(Vector3D(1,2,0),
       Vector3D(0,0,0), 1.57f, 0, 1).second, 1.0f, 0.01f);
 }
+
+TEST(geom, mesh_move_merge) {
+  Mesh lhs;
+  lhs.AddTriangleFan({{0,0,0}, {1,0,0}, {1,1,0}});
+  Mesh rhs;
+  rhs.AddMaterial("road");
+  rhs.AddTriangleFan({{2,0,0}, {3,0,0}, {3,1,0}});
+  rhs.EndMaterial();
+  const Mesh expected = lhs + rhs;
+  lhs += std::move(rhs);
+  ASSERT_EQ(lhs.GetVertices(), expected.GetVertices());
+  ASSERT_EQ(lhs.GetIndexes(), expected.GetIndexes());
+  ASSERT_EQ(lhs.GetMaterials().size(), 1u);
+  ASSERT_EQ(lhs.GetMaterials().front().index_start, 3u);
+  ASSERT_EQ(lhs.GetMaterials().front().index_end, 6u);
+
+  Mesh empty;
+  Mesh copy = expected;
+  empty += std::move(copy);
+  ASSERT_EQ(empty.GetVertices(), expected.GetVertices());
+  ASSERT_EQ(empty.GetIndexes(), expected.GetIndexes());
+
+  // Merging into reserved buffers keeps them.
+  Mesh reserved;
+  reserved.Reserve(12u, 0u, 12u, 0u, 2u);
+  const auto *vertices = reserved.GetVertices().data();
+  for (int i = 0; i < 2; ++i) {
+    Mesh part = expected;
+    reserved += std::move(part);
+  }
+  ASSERT_EQ(reserved.GetVertices().data(), vertices);
+  ASSERT_EQ(reserved.GetVerticesNum(), 12u);
+  ASSERT_EQ(reserved.GetIndexes(), (expected + expected).GetIndexes());
+  ASSERT_EQ(reserved.GetMaterials().size(), 2u);
+}
+
+TEST(geom, mesh_weld_vertices) {
+  // Two quads sharing an edge, each one with its own copy of the vertices.
+  Mesh mesh;
+  mesh.AddTriangleStrip({{0,0,0}, {0,1,0}, {1,0,0}, {1,1,0}});
+  mesh.AddTriangleStrip({{1,0,0}, {1,1.0001f,0}, {2,0,0}, {2,1,0}});
+  ASSERT_EQ(mesh.GetVerticesNum(), 8u);
+  const std::vector<size_t> indexes_before = mesh.GetIndexes();
+  ASSERT_EQ(mesh.WeldVertices(1e-3f), 2u);
+  ASSERT_EQ(mesh.GetVerticesNum(), 6u);
+  ASSERT_EQ(mesh.GetIndexesNum(), indexes_before.size());
+  for (auto index : mesh.GetIndexes()) {
+    ASSERT_GE(index, 1u);
+    ASSERT_LE(index, mesh.GetVerticesNum());
+  }
+  ASSERT_TRUE(mesh.IsValid());
+}
+
+TEST(geom, mesh_weld_vertices_keeps_uv_seams) {
+  // Same positions with texture coordinates closer than the position
+  // tolerance but not equal, as found along a texture seam.
+  Mesh mesh;
+  mesh.AddTriangleFan({{0,0,0}, {1,0,0}, {1,1,0}});
+  mesh.AddTriangleFan({{0,0,0}, {1,1,0}, {0,1,0}});
+  for (const auto &uv : std::vector<Vector2D>{
+           {0.0f, 0.0f}, {0.5f, 0.0f}, {0.5f, 0.5f},
+           {0.0f, 0.0f}, {0.5f, 0.5001f}, {0.0f, 0.5f}}) {
+    mesh.AddUV(uv);
+  }
+  ASSERT_EQ(mesh.WeldVertices(1e-3f), 1u);
+  ASSERT_EQ(mesh.GetVerticesNum(), 5u);
+  ASSERT_EQ(mesh.GetUVs().size(), 5u);
+  ASSERT_EQ(mesh.GetIndexesNum(), 6u);
+}
+
+TEST(geom, mesh_weld_vertices_drops_collapsed_triangles) {
+  Mesh mesh;
+  mesh.AddMaterial("road");
+  mesh.AddTriangleFan({{0,0,0}, {1,0,0}, {1,1,0}});
+  // Collapses into a line once its two first vertices are merged.
+  mesh.AddTriangleFan({{2,0,0}, {2,0.0001f,0}, {3,1,0}});
+  mesh.EndMaterial();
+  mesh.AddMaterial("sidewalk");
+  mesh.AddTriangleFan({{4,0,0}, {5,0,0}, {5,1,0}});
+  mesh.EndMaterial();
+  ASSERT_EQ(mesh.WeldVertices(1e-3f), 1u);
+  ASSERT_EQ(mesh.GetIndexesNum(), 6u);
+  for (size_t i = 0u; i < mesh.GetIndexesNum(); i += 3u) {
+    const auto &indexes = mesh.GetIndexes();
+    ASSERT_NE(indexes[i], indexes[i + 1u]);
+    ASSERT_NE(indexes[i + 1u], indexes[i + 2u]);
+    ASSERT_NE(indexes[i], indexes[i + 2u]);
+  }
+  const auto &materials = mesh.GetMaterials();
+  ASSERT_EQ(materials.size(), 2u);
+  ASSERT_EQ(materials[0].index_start, 0u);
+  ASSERT_EQ(materials[0].index_end, 3u);
+  ASSERT_EQ(materials[1].index_start, 3u);
+  ASSERT_EQ(materials[1].index_end, 6u);
+  ASSERT_TRUE(mesh.IsValid());
+}
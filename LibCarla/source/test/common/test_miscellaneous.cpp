@@ -6,8 +6,41 @@
 
 #include "test.h"
 
+#include <carla/ParallelFor.h>
 #include <carla/Version.h>
 
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
 TEST(miscellaneous, version) {
   std::cout << "LibCarla " << carla::version() << std::endl;
 }
+
+TEST(miscellaneous, parallel_for) {
+  carla::ThreadPool pool;
+  pool.AsyncRun(4u);
+  std::vector<std::atomic<int>> calls(1000u);
+  for (auto &count : calls) {
+    count = 0;
+  }
+  carla::ParallelFor(pool, 4u, calls.size(), 7u, [&](size_t i) { ++calls[i]; });
+  for (auto &count : calls) {
+    ASSERT_EQ(count, 1);
+  }
+  std::vector<int> items(100u);
+  for (size_t i = 0u; i < items.size(); ++i) {
+    items[i] = static_cast<int>(i);
+  }
+  auto squares = carla::ParallelTransform(pool, 4u, items, [](int i) { return i * i; });
+  ASSERT_EQ(squares.size(), items.size());
+  for (size_t i = 0u; i < items.size(); ++i) {
+    ASSERT_EQ(squares[i], items[i] * items[i]);
+  }
+  // The pool is reused, and exceptions reach the caller.
+  ASSERT_THROW(carla::ParallelFor(pool, 4u, 100u, 1u, [](size_t i) {
+    if (i == 42u) {
+      throw std::runtime_error("failed");
+    }
+  }), std::runtime_error);
+}
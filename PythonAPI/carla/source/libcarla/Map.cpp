@@ -9,6 +9,7 @@
 #include <carla/client/Junction.h>
 #include <carla/client/Map.h>
 #include <carla/client/Waypoint.h>
+#include <carla/road/RoutePlanner.h>
 #include <carla/road/element/LaneMarking.h>
 #include <carla/client/Landmark.h>
 #include <carla/road/SignalType.h>
@@ -52,6 +53,70 @@ static auto GetTopology(const carla::client::Map &self) {
   return result;
 }
 
+static auto ComputeRoute(
+    const carla::client::Map &self,
+    const carla::geom::Location &origin,
+    const carla::geom::Location &destination,
+    double sampling_resolution,
+    carla::road::RoutePlanner::Algorithm algorithm) {
+  namespace py = boost::python;
+  std::vector<carla::SharedPtr<carla::client::Waypoint>> route;
+  {
+    carla::PythonUtil::ReleaseGIL unlock;
+    route = self.ComputeRoute(origin, destination, sampling_resolution, algorithm);
+  }
+  py::list result;
+  for (auto &waypoint : route) {
+    result.append(waypoint);
+  }
+  return result;
+}
+
+static auto ComputeRoutes(
+    const carla::client::Map &self,
+    const boost::python::object &origins,
+    const boost::python::object &destinations,
+    double sampling_resolution,
+    carla::road::RoutePlanner::Algorithm algorithm) {
+  namespace py = boost::python;
+  std::vector<carla::geom::Location> origin_list{
+      py::stl_input_iterator<carla::geom::Location>(origins),
+      py::stl_input_iterator<carla::geom::Location>()};
+  std::vector<carla::geom::Location> destination_list{
+      py::stl_input_iterator<carla::geom::Location>(destinations),
+      py::stl_input_iterator<carla::geom::Location>()};
+  if (origin_list.size() != destination_list.size()) {
+    throw std::invalid_argument("origins and destinations must have the same length");
+  }
+  std::vector<std::pair<carla::geom::Location, carla::geom::Location>> queries;
+  queries.reserve(origin_list.size());
+  for (size_t i = 0u; i < origin_list.size(); ++i) {
+    queries.emplace_back(origin_list[i], destination_list[i]);
+  }
+  std::vector<std::vector<carla::SharedPtr<carla::client::Waypoint>>> routes;
+  {
+    carla::PythonUtil::ReleaseGIL unlock;
+    routes = self.ComputeRoutes(queries, sampling_resolution, algorithm);
+  }
+  py::list result;
+  for (auto &route : routes) {
+    py::list waypoints;
+    for (auto &waypoint : route) {
+      waypoints.append(waypoint);
+    }
+    result.append(waypoints);
+  }
+  return result;
+}
+
+static void PrepareRoutePlanner(
+    const carla::client::Map &self,
+    double lane_change_cost,
+    bool contraction_hierarchy) {
+  carla::PythonUtil::ReleaseGIL unlock;
+  self.PrepareRoutePlanner(lane_change_cost, contraction_hierarchy);
+}
+
 static auto GetJunctionWaypoints(const carla::client::Junction &self, const carla::road::Lane::LaneType lane_type) {
   namespace py = boost::python;
   auto topology = self.GetWaypoints(lane_type);
@@ -150,6 +215,12 @@ void export_map() {
     .value("Negative", cr::SignalOrientation::Negative)
     .value("Both", cr::SignalOrientation::Both)
   ;
+
+  enum_<cr::RoutePlanner::Algorithm>("RouteAlgorithm")
+    .value("AStar", cr::RoutePlanner::Algorithm::AStar)
+    .value("BidirectionalDijkstra", cr::RoutePlanner::Algorithm::BidirectionalDijkstra)
+    .value("ContractionHierarchy", cr::RoutePlanner::Algorithm::ContractionHierarchy)
+  ;
   // ===========================================================================
   // -- Map --------------------------------------------------------------------
   // ===========================================================================
@@ -171,6 +242,10 @@ void export_map() {
     .def("get_all_landmarks_of_type", CALL_RETURNING_LIST_1(cc::Map, GetAllLandmarksOfType, std::string), (args("type")))
     .def("get_landmark_group", CALL_RETURNING_LIST_1(cc::Map, GetLandmarkGroup, cc::Landmark), args("landmark"))
     .def("cook_in_memory_map", &cc::Map::CookInMemoryMap, (arg("path")=""))
+    .def("prepare_route_planner", &PrepareRoutePlanner, (arg("lane_change_cost")=10.0, arg("contraction_hierarchy")=false))
+    .def("compute_route", &ComputeRoute, (arg("origin"), arg("destination"), arg("sampling_resolution")=2.0, arg("algorithm")=cr::RoutePlanner::Algorithm::AStar))
+    .def("compute_routes", &ComputeRoutes, (arg("origins"), arg("destinations"), arg("sampling_resolution")=2.0, arg("algorithm")=cr::RoutePlanner::Algorithm::AStar))
+    .def("get_region", &cc::Map::GetRegion, (arg("location"), arg("radius"), arg("tile_size")=500.0, arg("max_loaded_tiles")=36u))
     .def(self_ns::str(self_ns::self))
   ;
 
@@ -212,10 +287,24 @@ void export_map() {
     .def(self_ns::str(self_ns::self))
   ;
 
+  class_<cr::Junction::LaneConflict>("JunctionLaneConflict", no_init)
+    .def_readonly("road_id", &cr::Junction::LaneConflict::road_id)
+    .def_readonly("section_id", &cr::Junction::LaneConflict::section_id)
+    .def_readonly("lane_id", &cr::Junction::LaneConflict::lane_id)
+    .def_readonly("s_start", &cr::Junction::LaneConflict::s_start)
+    .def_readonly("s_end", &cr::Junction::LaneConflict::s_end)
+    .def_readonly("other_road_id", &cr::Junction::LaneConflict::other_road_id)
+    .def_readonly("other_section_id", &cr::Junction::LaneConflict::other_section_id)
+    .def_readonly("other_lane_id", &cr::Junction::LaneConflict::other_lane_id)
+    .def_readonly("other_s_start", &cr::Junction::LaneConflict::other_s_start)
+    .def_readonly("other_s_end", &cr::Junction::LaneConflict::other_s_end)
+  ;
+
   class_<cc::Junction, boost::noncopyable, boost::shared_ptr<cc::Junction>>("Junction", no_init)
     .add_property("id", &cc::Junction::GetId)
     .add_property("bounding_box", &cc::Junction::GetBoundingBox)
     .def("get_waypoints", &GetJunctionWaypoints)
+    .def("get_lane_conflicts", CALL_RETURNING_LIST(cc::Junction, GetLaneConflicts))
   ;
 
   class_<cr::SignalType>("LandmarkType", no_init)
@@ -5,7 +5,9 @@
 // For a copy, see <https://opensource.org/licenses/MIT>.
 
 #include <chrono>
+#include <cstring>
 #include <memory>
+#include <stdexcept>
 #include <stdio.h>
 #include "carla/PythonUtil.h"
 #include "boost/python/suite/indexing/vector_indexing_suite.hpp"
@@ -78,12 +80,156 @@ boost::python::list InterGetActionBuffer(carla::traffic_manager::TrafficManager&
   return l;
 }
 
+template <typename T, typename S>
+static void CopyBufferItems(const Py_buffer &view, std::vector<T> &out) {
+  const S *data = static_cast<const S *>(view.buf);
+  out.assign(data, data + view.len / view.itemsize);
+}
+
+/// Copies the elements of a one-dimensional buffer of numbers, such as a NumPy
+/// array, to @a out. Returns false if @a object is not such a buffer.
+template <typename T>
+static bool BufferToVector(PyObject *object, std::vector<T> &out) {
+  if (!PyObject_CheckBuffer(object)) {
+    return false;
+  }
+  Py_buffer view;
+  if (PyObject_GetBuffer(object, &view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) != 0) {
+    PyErr_Clear();
+    return false;
+  }
+  const char *format = view.format != nullptr ? view.format : "B";
+  if (*format == '@' || *format == '=' || *format == '<') {
+    ++format;
+  }
+  bool copied = view.ndim == 1 && std::strlen(format) == 1u;
+  if (copied) {
+    switch (format[0]) {
+      case 'b': CopyBufferItems<T, int8_t>(view, out); break;
+      case 'B': CopyBufferItems<T, uint8_t>(view, out); break;
+      case 'h': CopyBufferItems<T, int16_t>(view, out); break;
+      case 'H': CopyBufferItems<T, uint16_t>(view, out); break;
+      case 'i': CopyBufferItems<T, int32_t>(view, out); break;
+      case 'I': CopyBufferItems<T, uint32_t>(view, out); break;
+      case 'l': case 'q':
+        if (view.itemsize == 8) CopyBufferItems<T, int64_t>(view, out);
+        else CopyBufferItems<T, int32_t>(view, out);
+        break;
+      case 'L': case 'Q':
+        if (view.itemsize == 8) CopyBufferItems<T, uint64_t>(view, out);
+        else CopyBufferItems<T, uint32_t>(view, out);
+        break;
+      case 'f': CopyBufferItems<T, float>(view, out); break;
+      case 'd': CopyBufferItems<T, double>(view, out); break;
+      default: copied = false; break;
+    }
+  }
+  PyBuffer_Release(&view);
+  return copied;
+}
+
+static std::vector<ActorId> ToActorIds(const boost::python::object &actors) {
+  std::vector<ActorId> ids;
+  if (BufferToVector(actors.ptr(), ids)) {
+    return ids;
+  }
+  ids.reserve(static_cast<size_t>(boost::python::len(actors)));
+  for (boost::python::stl_input_iterator<boost::python::object> it(actors), end; it != end; ++it) {
+    boost::python::extract<const carla::client::Actor &> actor(*it);
+    if (actor.check()) {
+      ids.push_back(actor().GetId());
+    } else {
+      ids.push_back(boost::python::extract<ActorId>(boost::python::long_(*it)));
+    }
+  }
+  return ids;
+}
+
+/// @a values is either a sequence or a single value for every actor.
+static std::vector<float> ToValues(const boost::python::object &values, const size_t size) {
+  std::vector<float> result;
+  if (BufferToVector(values.ptr(), result)) {
+    return result;
+  }
+  if (PyNumber_Check(values.ptr())) {
+    return std::vector<float>(size, boost::python::extract<float>(values));
+  }
+  result.assign(
+      boost::python::stl_input_iterator<float>(values),
+      boost::python::stl_input_iterator<float>());
+  return result;
+}
+
+void InterAddVehicleSettings(
+    carla::traffic_manager::VehicleSettingsBatch &self,
+    const boost::python::object &actors,
+    const carla::traffic_manager::VehicleSetting setting,
+    const boost::python::object &values) {
+  const std::vector<ActorId> ids = ToActorIds(actors);
+  const std::vector<float> converted_values = ToValues(values, ids.size());
+  if (converted_values.size() != ids.size()) {
+    throw std::invalid_argument("the number of values does not match the number of actors");
+  }
+  self.Reserve(self.Size() + ids.size());
+  for (size_t i = 0u; i < ids.size(); ++i) {
+    self.Add(ids[i], setting, converted_values[i]);
+  }
+}
+
+boost::python::list InterGetTimingsStages(const carla::traffic_manager::TrafficManagerTimings &self) {
+  boost::python::list l;
+  for (auto &stage : self.stages) {
+    l.append(stage);
+  }
+  return l;
+}
 
 void export_trafficmanager() {
   namespace cc = carla::client;
   namespace ctm = carla::traffic_manager;
   using namespace boost::python;
 
+  enum_<ctm::VehicleSetting>("TrafficManagerSetting")
+    .value("PercentageSpeedDifference", ctm::VehicleSetting::PercentageSpeedDifference)
+    .value("LaneOffset", ctm::VehicleSetting::LaneOffset)
+    .value("DesiredSpeed", ctm::VehicleSetting::DesiredSpeed)
+    .value("DistanceToLeadingVehicle", ctm::VehicleSetting::DistanceToLeadingVehicle)
+    .value("AutoLaneChange", ctm::VehicleSetting::AutoLaneChange)
+    .value("ForceLaneChange", ctm::VehicleSetting::ForceLaneChange)
+    .value("IgnoreLightsPercentage", ctm::VehicleSetting::PercentageRunningLight)
+    .value("IgnoreSignsPercentage", ctm::VehicleSetting::PercentageRunningSign)
+    .value("IgnoreVehiclesPercentage", ctm::VehicleSetting::PercentageIgnoreVehicles)
+    .value("IgnoreWalkersPercentage", ctm::VehicleSetting::PercentageIgnoreWalkers)
+    .value("KeepRightRulePercentage", ctm::VehicleSetting::KeepRightPercentage)
+    .value("RandomLeftLaneChangePercentage", ctm::VehicleSetting::RandomLeftLaneChangePercentage)
+    .value("RandomRightLaneChangePercentage", ctm::VehicleSetting::RandomRightLaneChangePercentage)
+    .value("UpdateVehicleLights", ctm::VehicleSetting::UpdateVehicleLights)
+  ;
+
+  class_<ctm::VehicleSettingsBatch>("TrafficManagerSettingsBatch")
+    .def("add", &InterAddVehicleSettings, (arg("actors"), arg("setting"), arg("values")))
+    .def("clear", &ctm::VehicleSettingsBatch::Clear)
+    .def("__len__", &ctm::VehicleSettingsBatch::Size)
+  ;
+
+  class_<ctm::StageTimings>("TrafficManagerStageTimings", no_init)
+    .def_readonly("name", &ctm::StageTimings::name)
+    .def_readonly("count", &ctm::StageTimings::count)
+    .def_readonly("mean", &ctm::StageTimings::mean)
+    .def_readonly("p50", &ctm::StageTimings::p50)
+    .def_readonly("p90", &ctm::StageTimings::p90)
+    .def_readonly("p99", &ctm::StageTimings::p99)
+    .def_readonly("max", &ctm::StageTimings::max)
+  ;
+
+  class_<ctm::TrafficManagerTimings>("TrafficManagerTimings", no_init)
+    .def_readonly("cycles", &ctm::TrafficManagerTimings::cycles)
+    .def_readonly("vehicles", &ctm::TrafficManagerTimings::vehicles)
+    .def_readonly("mean_vehicles", &ctm::TrafficManagerTimings::mean_vehicles)
+    .def_readonly("max_vehicles", &ctm::TrafficManagerTimings::max_vehicles)
+    .add_property("stages", &InterGetTimingsStages)
+  ;
+
   class_<ctm::TrafficManager>("TrafficManager", no_init)
     .def("get_port", &ctm::TrafficManager::Port)
     .def("vehicle_percentage_speed_difference", &ctm::TrafficManager::SetPercentageSpeedDifference)
@@ -109,11 +255,15 @@ void export_trafficmanager() {
     .def("set_hybrid_physics_radius", &ctm::TrafficManager::SetHybridPhysicsRadius)
     .def("set_random_device_seed", &ctm::TrafficManager::SetRandomDeviceSeed)
     .def("set_osm_mode", &carla::traffic_manager::TrafficManager::SetOSMMode)
+    .def("set_sharded_mode", &ctm::TrafficManager::SetShardedMode, (arg("mode_switch") = true))
     .def("set_path", &InterSetCustomPath, (arg("empty_buffer") = true))
     .def("set_route", &InterSetImportedRoute, (arg("empty_buffer") = true))
     .def("set_respawn_dormant_vehicles", &carla::traffic_manager::TrafficManager::SetRespawnDormantVehicles)
     .def("set_boundaries_respawn_dormant_vehicles", &carla::traffic_manager::TrafficManager::SetBoundariesRespawnDormantVehicles)
     .def("get_next_action", &InterGetNextAction)
     .def("get_all_actions", &InterGetActionBuffer)
+    .def("apply_vehicle_settings", &ctm::TrafficManager::ApplyVehicleSettings, (arg("batch")))
+    .def("get_timings", &ctm::TrafficManager::GetTimings)
+    .def("reset_timings", &ctm::TrafficManager::ResetTimings)
     .def("shut_down", &ctm::TrafficManager::ShutDown);
 }
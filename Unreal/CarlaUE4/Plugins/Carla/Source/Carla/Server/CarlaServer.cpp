@@ -2260,6 +2260,23 @@ void FCarlaServer::FPimpl::BindActions()
     return response.HasError() ? CR{response.GetError()} : CR{id};
   };
 
+  // Applies a command on many actors, calling apply(i) for the first count
+  // actors. Every actor is updated even if some of them fail, the last error
+  // is reported.
+  auto apply_to_actors = [](const std::vector<ActorId> &actors, size_t count, const auto &apply) {
+    CR result{actors.empty() ? 0u : actors.front()};
+    count = std::min(count, actors.size());
+    for (size_t i = 0u; i < count; ++i)
+    {
+      auto response = apply(i);
+      if (response.HasError())
+      {
+        result = CR{response.GetError()};
+      }
+    }
+    return result;
+  };
+
 #define MAKE_RESULT(operation) return parse_result(c.actor, operation);
 
   auto command_visitor = carla::Functional::MakeRecursiveOverload(
@@ -2277,6 +2294,9 @@ void FCarlaServer::FPimpl::BindActions()
           auto set_id = carla::Functional::MakeOverload(
               [](C::SpawnActor &) {},
               [](C::ConsoleCommand &) {},
+              [](C::ApplyTransforms &) {},
+              [](C::SetVehicleLightStates &) {},
+              [](C::ApplyWalkerStates &) {},
               [id](auto &s) { s.actor = id; });
           for (auto command : c.do_after)
           {
@@ -2310,7 +2330,22 @@ void FCarlaServer::FPimpl::BindActions()
       [=](auto, const C::ApplyWalkerState &c) {     MAKE_RESULT(set_walker_state(c.actor, c.transform, c.speed)); },
       [=](auto, const C::ConsoleCommand& c) -> CR {       return console_command(c.cmd); },
       [=](auto, const C::SetTrafficLightState& c) { MAKE_RESULT(set_traffic_light_state(c.actor, c.traffic_light_state)); },
-      [=](auto, const C::ApplyLocation& c)        { MAKE_RESULT(set_actor_location(c.actor, c.location)); }
+      [=](auto, const C::ApplyLocation& c)        { MAKE_RESULT(set_actor_location(c.actor, c.location)); },
+      [=](auto, const C::ApplyTransforms& c) -> CR {
+        return apply_to_actors(c.actors, c.transforms.size(), [&](size_t i) {
+          return set_actor_transform(c.actors[i], c.transforms[i]);
+        });
+      },
+      [=](auto, const C::SetVehicleLightStates& c) -> CR {
+        return apply_to_actors(c.actors, c.light_states.size(), [&](size_t i) {
+          return set_vehicle_light_state(c.actors[i], c.light_states[i]);
+        });
+      },
+      [=](auto, const C::ApplyWalkerStates& c) -> CR {
+        return apply_to_actors(c.actors, std::min(c.transforms.size(), c.speeds.size()), [&](size_t i) {
+          return set_walker_state(c.actors[i], c.transforms[i], c.speeds[i]);
+        });
+      }
   );
 
 #undef MAKE_RESULT